@@ -0,0 +1,325 @@
+/**
+  ******************************************************************************
+  * @file    BenchBusLoop.c
+  * @author  Javier Fernandez Cepeda
+  * @brief   Bus I/O models: a read / write thread pair per bus against a
+  *	     single epoll loop serving every bus and against the bus tasks
+  *	     run as protothreads by a single thread.
+  *	     Each bus is a socketpair whose frames are echoed back through a
+  *	     mail queue, as BUSApp does through the MBA. The CPU time is the
+  *	     whole process (driver included), so compare the lines. The
+  *	     stack line is the RAM each model reserves for its threads and
+  *	     tasks.
+  *	     Usage: BenchBusLoop [rounds] [buses]
+  *
+  *******************************************************************************
+  * Copyright (c) 2015, Javier Fernandez. All rights reserved.
+  *******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include <pthread.h>
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/resource.h>
+#include "BenchUtils.h"
+#include "TOOLS/pqueue.h"
+#include "TOOLS/evloop.h"
+#include "TOOLS/pt.h"
+
+/* Private define ------------------------------------------------------------*/
+#define BENCH_MAX_BUSES		16
+#define BENCH_FRAME_SIZE	16	/* Header + 4 data bytes + checksum */
+#define BENCH_WINDOW		4	/* Frames in flight per bus */
+
+/* Private typedef -----------------------------------------------------------*/
+typedef struct
+{
+  int BusFd;		/* Firmware side */
+  int PeerFd;		/* Driver side */
+  pqueue Queue;
+  pthread_t Reader;
+  pthread_t Writer;
+  struct pt ReadTask;
+  struct pt WriteTask;
+  uint8_t *Mail;	/* Frame taken by the write task */
+}BenchBus;
+
+/* Private variables ---------------------------------------------------------*/
+static BenchBus Buses[BENCH_MAX_BUSES];
+static uint32_t BusCount;
+static evloop Loop;
+static volatile int LoopRunning;
+static uint8_t Frame[BENCH_FRAME_SIZE];
+
+/* Private functions ---------------------------------------------------------*/
+static uint64_t CpuNowNs(void)
+{
+  struct rusage Usage;
+
+  getrusage(RUSAGE_SELF, &Usage);
+  return ((uint64_t)Usage.ru_utime.tv_sec + (uint64_t)Usage.ru_stime.tv_sec) * 1000000000ull +
+         ((uint64_t)Usage.ru_utime.tv_usec + (uint64_t)Usage.ru_stime.tv_usec) * 1000ull;
+}
+
+static void BusEcho(BenchBus *Bus, uint8_t *Data)
+{
+  if (write(Bus->BusFd, Data, BENCH_FRAME_SIZE) < 0)
+    perror("write");
+  free(Data);
+}
+
+static int BusReceive(BenchBus *Bus)
+{
+  uint8_t *Data = (uint8_t *)malloc(BENCH_FRAME_SIZE);
+
+  if (read(Bus->BusFd, Data, BENCH_FRAME_SIZE) != BENCH_FRAME_SIZE)
+  {
+    free(Data);
+    return -1;
+  }
+  pqueue_push(&Bus->Queue, Data);
+  return 0;
+}
+
+/* Thread per bus model */
+static void *ReaderThread(void *arg)
+{
+  BenchBus *Bus = (BenchBus *)arg;
+
+  while (BusReceive(Bus) == 0)
+    ;
+  return NULL;
+}
+
+static void *WriterThread(void *arg)
+{
+  BenchBus *Bus = (BenchBus *)arg;
+  uint8_t *Data;
+
+  while ((Data = (uint8_t *)pqueue_pop(&Bus->Queue)) != NULL)
+    BusEcho(Bus, Data);
+  return NULL;
+}
+
+/* Event loop model */
+static void LoopBusEvent(int fd, uint32_t events, void *arg)
+{
+  (void)fd;
+  (void)events;
+  BusReceive((BenchBus *)arg);
+}
+
+static void LoopQueueEvent(int fd, uint32_t events, void *arg)
+{
+  BenchBus *Bus = (BenchBus *)arg;
+  uint8_t *Data;
+
+  (void)fd;
+  (void)events;
+  while ((Data = (uint8_t *)pqueue_pop_nonb(&Bus->Queue)) != NULL)
+    BusEcho(Bus, Data);
+}
+
+static void *LoopThread(void *arg)
+{
+  (void)arg;
+  while (LoopRunning)
+    evloop_run_once(&Loop, 10);
+  return NULL;
+}
+
+/* Protothread model: the bus tasks of BUSApp with BUS_TASK_MODEL */
+static int BusReadable(BenchBus *Bus)
+{
+  struct pollfd Fd = { Bus->BusFd, POLLIN, 0 };
+
+  return poll(&Fd, 1, 0) > 0;
+}
+
+static PT_THREAD(ReadTask(BenchBus *Bus))
+{
+  PT_BEGIN(&Bus->ReadTask);
+  while (1)
+  {
+    PT_WAIT_UNTIL(&Bus->ReadTask, BusReadable(Bus));
+    BusReceive(Bus);
+    PT_YIELD(&Bus->ReadTask);
+  }
+  PT_END(&Bus->ReadTask);
+}
+
+static PT_THREAD(WriteTask(BenchBus *Bus))
+{
+  PT_BEGIN(&Bus->WriteTask);
+  while (1)
+  {
+    PT_WAIT_UNTIL(&Bus->WriteTask, (Bus->Mail = (uint8_t *)pqueue_pop_nonb(&Bus->Queue)) != NULL);
+    BusEcho(Bus, Bus->Mail);
+    PT_YIELD(&Bus->WriteTask);
+  }
+  PT_END(&Bus->WriteTask);
+}
+
+static void *TaskThread(void *arg)
+{
+  struct pollfd Fds[2 * BENCH_MAX_BUSES];
+  uint32_t i;
+  int Progress;
+
+  (void)arg;
+  for (i = 0; i < BusCount; i++)
+  {
+    PT_INIT(&Buses[i].ReadTask);
+    PT_INIT(&Buses[i].WriteTask);
+    Fds[2 * i].fd = Buses[i].BusFd;
+    Fds[2 * i].events = POLLIN;
+    Fds[2 * i + 1].fd = pqueue_eventfd(&Buses[i].Queue);
+    Fds[2 * i + 1].events = POLLIN;
+  }
+  while (LoopRunning)
+  {
+    Progress = 0;
+    for (i = 0; i < BusCount; i++)
+    {
+      Progress |= (ReadTask(&Buses[i]) != PT_WAITING);
+      Progress |= (WriteTask(&Buses[i]) != PT_WAITING);
+    }
+    if (!Progress)
+      poll(Fds, 2 * BusCount, 10);
+  }
+  return NULL;
+}
+
+/* Stack reserved by Threads threads plus Tasks protothreads */
+static void StackReport(uint32_t Threads, uint32_t Tasks)
+{
+  pthread_attr_t Attr;
+  size_t Stack = 0;
+
+  pthread_attr_init(&Attr);
+  pthread_attr_getstacksize(&Attr, &Stack);
+  pthread_attr_destroy(&Attr);
+  printf("  %u threads, %u tasks: %zu stack bytes\n", Threads, Tasks,
+         Threads * Stack + Tasks * sizeof(struct pt));
+}
+
+static void BusesOpen(void)
+{
+  uint32_t i;
+  int Pair[2];
+
+  for (i = 0; i < BusCount; i++)
+  {
+    socketpair(AF_UNIX, SOCK_SEQPACKET, 0, Pair);
+    Buses[i].BusFd = Pair[0];
+    Buses[i].PeerFd = Pair[1];
+    pqueue_init(&Buses[i].Queue);
+  }
+}
+
+static void BusesClose(void)
+{
+  uint32_t i;
+
+  for (i = 0; i < BusCount; i++)
+  {
+    close(Buses[i].BusFd);
+    close(Buses[i].PeerFd);
+  }
+}
+
+/* Drives Rounds frames through every bus and prints the result */
+static void Drive(const char *Name, uint64_t Rounds)
+{
+  uint8_t Echo[BENCH_FRAME_SIZE];
+  uint64_t Round, Start, CpuStart, Frames;
+  uint32_t i;
+
+  Start = BenchNowNs();
+  CpuStart = CpuNowNs();
+  for (Round = 0; Round < Rounds + BENCH_WINDOW; Round++)
+  {
+    for (i = 0; i < BusCount; i++)
+    {
+      if (Round < Rounds && write(Buses[i].PeerFd, Frame, sizeof(Frame)) < 0)
+        perror("write");
+    }
+    if (Round < BENCH_WINDOW)
+      continue;
+    for (i = 0; i < BusCount; i++)
+    {
+      if (read(Buses[i].PeerFd, Echo, sizeof(Echo)) < 0)
+        perror("read");
+    }
+  }
+  Frames = Rounds * BusCount;
+  BenchReport(Name, Frames, BenchNowNs() - Start);
+  BenchReport("  cpu time", Frames, CpuNowNs() - CpuStart);
+}
+
+int main(int argc, char **argv)
+{
+  uint64_t Rounds;
+  uint32_t i;
+  pthread_t Thread;
+
+  Rounds = BenchIterations(argc, argv, 100000);
+  BusCount = (argc > 2) ? (uint32_t)atoi(argv[2]) : 8;
+  if (BusCount == 0 || BusCount > BENCH_MAX_BUSES)
+    BusCount = 8;
+  memset(Frame, 0x5A, sizeof(Frame));
+  printf("%u buses\n", BusCount);
+
+  /* Read / write thread pair per bus */
+  BusesOpen();
+  for (i = 0; i < BusCount; i++)
+  {
+    pthread_create(&Buses[i].Reader, NULL, ReaderThread, &Buses[i]);
+    pthread_create(&Buses[i].Writer, NULL, WriterThread, &Buses[i]);
+  }
+  Drive("thread pair per bus", Rounds);
+  StackReport(2 * BusCount, 0);
+  for (i = 0; i < BusCount; i++)
+  {
+    shutdown(Buses[i].PeerFd, SHUT_RDWR);
+    pqueue_release(&Buses[i].Queue);
+    pthread_join(Buses[i].Reader, NULL);
+    pthread_join(Buses[i].Writer, NULL);
+  }
+  BusesClose();
+
+  /* Single event loop */
+  if (evloop_init(&Loop) != 0)
+  {
+    printf("epoll not available\n");
+    return 1;
+  }
+  BusesOpen();
+  for (i = 0; i < BusCount; i++)
+  {
+    evloop_add(&Loop, Buses[i].BusFd, EVLOOP_IN, LoopBusEvent, &Buses[i]);
+    evloop_add(&Loop, pqueue_eventfd(&Buses[i].Queue), EVLOOP_IN, LoopQueueEvent, &Buses[i]);
+  }
+  LoopRunning = 1;
+  pthread_create(&Thread, NULL, LoopThread, NULL);
+  Drive("single event loop", Rounds);
+  StackReport(1, 0);
+  LoopRunning = 0;
+  pthread_join(Thread, NULL);
+  BusesClose();
+
+  /* Protothreads on one thread */
+  BusesOpen();
+  LoopRunning = 1;
+  pthread_create(&Thread, NULL, TaskThread, NULL);
+  Drive("protothreads on one thread", Rounds);
+  StackReport(1, 2 * BusCount);
+  LoopRunning = 0;
+  pthread_join(Thread, NULL);
+  BusesClose();
+
+  return 0;
+}
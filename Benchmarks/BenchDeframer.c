@@ -0,0 +1,89 @@
+/**
+  ******************************************************************************
+  * @file    BenchDeframer.c
+  * @author  Javier Fernandez Cepeda
+  * @brief   Frames split out of a byte stream bus: one frame per read, as
+  *	     packet buses deliver them, against reads of 16 KB carrying many
+  *	     frames and frames across reads. The reads are copied from memory
+  *	     as the socket bus does, so the lines are the cost per frame of
+  *	     everything but the system call.
+  *	     Usage: BenchDeframer [frames] [payload size]
+  *
+  *******************************************************************************
+  * Copyright (c) 2015, Javier Fernandez. All rights reserved.
+  *******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include <string.h>
+#include "BenchUtils.h"
+#include "MBALibrary/MBAProtocols/MBATransferProtocol.h"
+#include "TOOLS/deframer.h"
+#include "TOOLS/MemoryManagement.h"
+
+/* Private define ------------------------------------------------------------*/
+#define BENCH_READ	16384	/* Bytes per read */
+#define BENCH_STREAM	(BENCH_READ + 8192)
+
+/* Private variables ---------------------------------------------------------*/
+static uint8_t Stream[BENCH_STREAM];
+static uint64_t Frames;
+
+/* Private functions ---------------------------------------------------------*/
+static void Consume(void *arg, uint8_t *frame, uint32_t size)
+{
+  (void)arg;
+  (void)size;
+  Frames++;
+  MemFree(frame);
+}
+
+static void Run(const char *Name, uint64_t Count, uint32_t FrameSize, uint32_t Read)
+{
+  deframer Deframer;
+  uint64_t Start, Bytes = Count * FrameSize, Pos = 0;
+  uint32_t Size;
+  uint8_t *Chunk;
+
+  deframer_init(&Deframer, HEADER_SIZE, SIZE_FIELD_OFFSET, CRC_SIZE, BENCH_READ);
+  Frames = 0;
+  Start = BenchNowNs();
+  while (Pos < Bytes)
+  {
+    Size = (Bytes - Pos < Read) ? (uint32_t)(Bytes - Pos) : Read;
+    Chunk = (uint8_t *)MemAlloc(Size);
+    /* The stream repeats every frame */
+    memcpy(Chunk, Stream + Pos % FrameSize, Size);
+    deframer_feed(&Deframer, Chunk, Size, Consume, NULL);
+    Pos += Size;
+  }
+  BenchReport(Name, Frames, BenchNowNs() - Start);
+  printf("%-36s %10llu reads\n", "", (unsigned long long)((Bytes + Read - 1) / Read));
+  deframer_reset(&Deframer);
+}
+
+int main(int argc, char **argv)
+{
+  uint64_t Count;
+  uint32_t Payload, FrameSize, i;
+
+  Count = BenchIterations(argc, argv, 1000000);
+  Payload = (argc > 2) ? (uint32_t)strtoul(argv[2], NULL, 0) : 64;
+  if (Payload > 4096)
+    Payload = 4096;
+  FrameSize = HEADER_SIZE + Payload + CRC_SIZE;
+
+  /* Back to back frames of the same size */
+  for (i = 0; i + FrameSize <= BENCH_STREAM; i += FrameSize)
+  {
+    memset(Stream + i, 0x5A, FrameSize);
+    Stream[i + SIZE_FIELD_OFFSET] = (uint8_t)(Payload & 0xFF);
+    Stream[i + SIZE_FIELD_OFFSET + 1] = (uint8_t)(Payload >> 8);
+  }
+  printf("%u bytes per frame\n", FrameSize);
+
+  Run("one frame per read", Count, FrameSize, FrameSize);
+  Run("16 KB reads", Count, FrameSize, BENCH_READ);
+
+  return 0;
+}
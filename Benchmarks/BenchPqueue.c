@@ -0,0 +1,60 @@
+/**
+  ******************************************************************************
+  * @file    BenchPqueue.c
+  * @author  Javier Fernandez Cepeda
+  * @brief   Throughput of the pThread mail queue.
+  *	     Usage: BenchPqueue [iterations]
+  *
+  *******************************************************************************
+  * Copyright (c) 2015, Javier Fernandez. All rights reserved.
+  *******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include <pthread.h>
+#include "BenchUtils.h"
+#include "TOOLS/pqueue.h"
+
+/* Private variables ---------------------------------------------------------*/
+static pqueue Queue;
+static uint64_t Iterations;
+static int Item;
+
+/* Private functions ---------------------------------------------------------*/
+static void *Producer(void *arg)
+{
+  uint64_t i;
+
+  (void)arg;
+  for (i = 0; i < Iterations; i++)
+    pqueue_push_prio(&Queue, &Item, (int)(i % PQUEUE_LANES));
+  return NULL;
+}
+
+int main(int argc, char **argv)
+{
+  uint64_t i, Start;
+  pthread_t Thread;
+
+  Iterations = BenchIterations(argc, argv, 1000000);
+  pqueue_init(&Queue);
+
+  /* Same thread push + pop */
+  Start = BenchNowNs();
+  for (i = 0; i < Iterations; i++)
+  {
+    pqueue_push_prio(&Queue, &Item, (int)(i % PQUEUE_LANES));
+    pqueue_pop_nonb(&Queue);
+  }
+  BenchReport("pqueue push+pop (1 thread)", Iterations, BenchNowNs() - Start);
+
+  /* Producer / consumer */
+  Start = BenchNowNs();
+  pthread_create(&Thread, NULL, Producer, NULL);
+  for (i = 0; i < Iterations; i++)
+    pqueue_pop(&Queue);
+  pthread_join(Thread, NULL);
+  BenchReport("pqueue producer/consumer", Iterations, BenchNowNs() - Start);
+
+  return 0;
+}
@@ -0,0 +1,110 @@
+/**
+  ******************************************************************************
+  * @file    BenchSpscRing.c
+  * @author  Javier Fernandez Cepeda
+  * @brief   Hand off of frames between two bus shards: lock-free ring against
+  *	     the pThread mail queue, and pool against heap frames.
+  *	     Usage: BenchSpscRing [iterations]
+  *
+  *******************************************************************************
+  * Copyright (c) 2015, Javier Fernandez. All rights reserved.
+  *******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include <pthread.h>
+#include <sched.h>
+#include "BenchUtils.h"
+#include "TOOLS/spscring.h"
+#include "TOOLS/objpool.h"
+#include "TOOLS/pqueue.h"
+#include "TOOLS/MemoryManagement.h"
+
+/* Private define ------------------------------------------------------------*/
+#define BENCH_RING_SIZE		256
+#define BENCH_FRAME_SIZE	64	/* About a transfer frame and its bus */
+
+/* Private variables ---------------------------------------------------------*/
+static spscring Ring;
+static pqueue Queue;
+static uint64_t Iterations;
+static int Item;
+static void * volatile Sink;	/* Keeps the heap calls */
+
+/* Private functions ---------------------------------------------------------*/
+static void *RingProducer(void *arg)
+{
+  uint64_t i;
+
+  (void)arg;
+  for (i = 0; i < Iterations; i++)
+  {
+    while (spscring_push(&Ring, &Item) != 0)
+      sched_yield();
+  }
+  return NULL;
+}
+
+static void *QueueProducer(void *arg)
+{
+  uint64_t i;
+
+  (void)arg;
+  for (i = 0; i < Iterations; i++)
+    pqueue_push(&Queue, &Item);
+  return NULL;
+}
+
+int main(int argc, char **argv)
+{
+  uint64_t i, Start;
+  pthread_t Thread;
+  objpool Pool;
+  void *Frame;
+
+  Iterations = BenchIterations(argc, argv, 1000000);
+
+  /* Producer / consumer */
+  spscring_init(&Ring, BENCH_RING_SIZE);
+  Start = BenchNowNs();
+  pthread_create(&Thread, NULL, RingProducer, NULL);
+  for (i = 0; i < Iterations; )
+  {
+    if (spscring_pop(&Ring) != NULL)
+      i++;
+    else
+      sched_yield();
+  }
+  pthread_join(Thread, NULL);
+  BenchReport("spscring producer/consumer", Iterations, BenchNowNs() - Start);
+  spscring_release(&Ring);
+
+  pqueue_init(&Queue);
+  Start = BenchNowNs();
+  pthread_create(&Thread, NULL, QueueProducer, NULL);
+  for (i = 0; i < Iterations; i++)
+    pqueue_pop(&Queue);
+  pthread_join(Thread, NULL);
+  BenchReport("pqueue producer/consumer", Iterations, BenchNowNs() - Start);
+
+  /* Frame per hand off */
+  objpool_init(&Pool, BENCH_FRAME_SIZE, 64);
+  Start = BenchNowNs();
+  for (i = 0; i < Iterations; i++)
+  {
+    Frame = objpool_get(&Pool);
+    objpool_put(&Pool, Frame);
+  }
+  BenchReport("objpool get+put", Iterations, BenchNowNs() - Start);
+  objpool_release(&Pool);
+
+  Start = BenchNowNs();
+  for (i = 0; i < Iterations; i++)
+  {
+    Sink = MemAlloc(BENCH_FRAME_SIZE);
+    MemFree(Sink);
+  }
+  BenchReport("MemAlloc+MemFree", Iterations, BenchNowNs() - Start);
+
+  return 0;
+}
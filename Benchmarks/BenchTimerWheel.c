@@ -0,0 +1,105 @@
+/**
+  ******************************************************************************
+  * @file    BenchTimerWheel.c
+  * @author  Javier Fernandez Cepeda
+  * @brief   Frame timeouts: every received byte re-arms the decoding timeout
+  *	     of its interface. Compares the re-arm cost of the timer wheel
+  *	     used by BUSApp with the binary heap of the timer service, with
+  *	     many interfaces armed at the same time.
+  *	     Usage: BenchTimerWheel [bytes] [interfaces]
+  *
+  *******************************************************************************
+  * Copyright (c) 2015, Javier Fernandez. All rights reserved.
+  *******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "BenchUtils.h"
+#include "TOOLS/timerwheel.h"
+#include "TOOLS/timerheap.h"
+
+/* Private define ------------------------------------------------------------*/
+#define BENCH_DECODING_TIMEOUT	20	/* Ticks */
+#define BENCH_BYTES_PER_TICK	8	/* Bytes received by an interface per tick */
+
+/* Private variables ---------------------------------------------------------*/
+static uint64_t Expiries;
+
+/* Private functions ---------------------------------------------------------*/
+static void BenchExpired(struct timerwheel_entry *Entry, void *Arg)
+{
+  (void)Entry;
+  (void)Arg;
+  Expiries++;
+}
+
+static void BenchWheel(uint64_t Bytes, uint32_t Interfaces)
+{
+  struct timerwheel_entry *Entries;
+  timerwheel Wheel;
+  uint64_t i, Now = 0, Start;
+
+  Entries = (struct timerwheel_entry *)calloc(Interfaces, sizeof(*Entries));
+  timerwheel_init(&Wheel, 0);
+  for (i = 0; i < Interfaces; i++)
+    timerwheel_entry_init(&Entries[i], BenchExpired, NULL);
+
+  Start = BenchNowNs();
+  for (i = 0; i < Bytes; i++)
+  {
+    if (i % ((uint64_t)Interfaces * BENCH_BYTES_PER_TICK) == 0)
+      timerwheel_advance(&Wheel, Now++);
+    timerwheel_add(&Wheel, &Entries[i % Interfaces], Now + BENCH_DECODING_TIMEOUT);
+  }
+  BenchReport("timer wheel re-arm", Bytes, BenchNowNs() - Start);
+  free(Entries);
+}
+
+static void BenchHeap(uint64_t Bytes, uint32_t Interfaces)
+{
+  struct timerheap_node *Nodes;
+  struct timerheap_node *Node;
+  timerheap Heap;
+  uint64_t i, Now = 0, Start;
+
+  Nodes = (struct timerheap_node *)calloc(Interfaces, sizeof(*Nodes));
+  timerheap_init(&Heap);
+  for (i = 0; i < Interfaces; i++)
+    timerheap_node_init(&Nodes[i]);
+
+  Start = BenchNowNs();
+  for (i = 0; i < Bytes; i++)
+  {
+    if (i % ((uint64_t)Interfaces * BENCH_BYTES_PER_TICK) == 0)
+    {
+      while ((Node = timerheap_top(&Heap)) != NULL && Node->deadline <= Now)
+      {
+        timerheap_pop(&Heap);
+        Expiries++;
+      }
+      Now++;
+    }
+    timerheap_push(&Heap, &Nodes[i % Interfaces], Now + BENCH_DECODING_TIMEOUT);
+  }
+  BenchReport("timer heap re-arm", Bytes, BenchNowNs() - Start);
+  timerheap_release(&Heap);
+  free(Nodes);
+}
+
+int main(int argc, char **argv)
+{
+  uint64_t Bytes;
+  uint32_t Interfaces;
+
+  Bytes = BenchIterations(argc, argv, 10000000);
+  Interfaces = (argc > 2) ? (uint32_t)atoi(argv[2]) : 64;
+  if (Interfaces == 0)
+    Interfaces = 64;
+  printf("%u interfaces\n", Interfaces);
+
+  BenchWheel(Bytes, Interfaces);
+  BenchHeap(Bytes, Interfaces);
+
+  /* Busy interfaces never go silent */
+  return (Expiries == 0) ? 0 : 1;
+}
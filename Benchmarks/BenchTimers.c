@@ -0,0 +1,91 @@
+/**
+  ******************************************************************************
+  * @file    BenchTimers.c
+  * @author  Javier Fernandez Cepeda
+  * @brief   Timer service of the pThread backend: many periodic timers with
+  *	     the same period, started back to back. Reports the CPU time
+  *	     per expiry and how many expiries each wake up serves.
+  *	     Usage: BenchTimers [timers] [period ms]
+  *
+  *******************************************************************************
+  * Copyright (c) 2015, Javier Fernandez. All rights reserved.
+  *******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include <unistd.h>
+#include <sys/resource.h>
+#include "BenchUtils.h"
+#include "OSSupport.h"
+
+/* Private define ------------------------------------------------------------*/
+#define BENCH_RUN_MS	2000
+
+/* Private function prototypes -----------------------------------------------*/
+static void BenchCallback(void const *arg);
+static DEFINE_TIMER(BenchTimer, BenchCallback);
+
+/* Private variables ---------------------------------------------------------*/
+static volatile uint64_t Expirations;
+
+/* Private functions ---------------------------------------------------------*/
+static void BenchCallback(void const *arg)
+{
+  (void)arg;
+  Expirations++;
+}
+
+static uint64_t CpuNowNs(void)
+{
+  struct rusage Usage;
+
+  getrusage(RUSAGE_SELF, &Usage);
+  return ((uint64_t)Usage.ru_utime.tv_sec + (uint64_t)Usage.ru_stime.tv_sec) * 1000000000ull +
+         ((uint64_t)Usage.ru_utime.tv_usec + (uint64_t)Usage.ru_stime.tv_usec) * 1000ull;
+}
+
+int main(int argc, char **argv)
+{
+  TIMER_ID *Timers;
+  OSTimerStats Stats;
+  OSRetValue Ret;
+  uint64_t Count, CpuStart;
+  uint32_t Period, i;
+
+  Count = BenchIterations(argc, argv, 10000);
+  Period = (argc > 2) ? (uint32_t)atoi(argv[2]) : 10;
+  if (Period == 0)
+    Period = 10;
+  Timers = (TIMER_ID *)malloc(Count * sizeof(TIMER_ID));
+
+  for (i = 0; i < Count; i++)
+  {
+    Timers[i] = CreateTimer(TIMER_REF(BenchTimer), osTimerPeriodic, NULL);
+    if (Timers[i] == NULL)
+    {
+      printf("timer service not available\n");
+      return 1;
+    }
+  }
+  for (i = 0; i < Count; i++)
+  {
+    TimerStart(Ret, Timers[i], Period);
+    (void)Ret;
+  }
+
+  TimerGetStats(&Stats, 1);
+  Expirations = 0;
+  CpuStart = CpuNowNs();
+  usleep(BENCH_RUN_MS * 1000);
+  TimerGetStats(&Stats, 1);
+
+  printf("%llu timers, %u ms period\n", (unsigned long long)Count, Period);
+  BenchReport("cpu time per expiry", Stats.Expirations, CpuNowNs() - CpuStart);
+  printf("%-36s %10u wakeups %10.1f expiries/wakeup\n", "timer service", Stats.Wakeups,
+         (Stats.Wakeups != 0) ? (double)Stats.Expirations / Stats.Wakeups : 0.0);
+
+  for (i = 0; i < Count; i++)
+    TimerDelete(Timers[i]);
+  free(Timers);
+  return 0;
+}
@@ -0,0 +1,84 @@
+/**
+  ******************************************************************************
+  * @file    BenchTransferProtocol.c
+  * @author  Javier Fernandez Cepeda
+  * @brief   Cost of the transfer protocol path of a bridged frame: cast from
+  *	     the bus buffer, routing and cast to the output buffer. The in
+  *	     place line reads the buffer as a view and writes it back, as the
+  *	     buses do. Both check the CRC of the frame on the way in.
+  *	     Usage: BenchTransferProtocol [iterations] [payload size]
+  *
+  *******************************************************************************
+  * Copyright (c) 2015, Javier Fernandez. All rights reserved.
+  *******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include <string.h>
+#include "BenchUtils.h"
+#include "MBALibrary/MBALib.h"
+#include "TOOLS/MemoryManagement.h"
+#include "TOOLS/crc16.h"
+
+/* Private define ------------------------------------------------------------*/
+#define NODE_ID		2	/*!< Logical ID of the node under test */
+#define MAX_PAYLOAD	4096	/*!< Maximum payload size */
+
+/* Private variables ---------------------------------------------------------*/
+static uint8_t InBuf[HEADER_SIZE + MAX_PAYLOAD + CRC_SIZE];
+static uint8_t OutBuf[HEADER_SIZE + MAX_PAYLOAD + CRC_SIZE];
+
+int main(int argc, char **argv)
+{
+  uint64_t i, Iterations, Start;
+  uint32_t Payload, Size;
+  uint16_t Checksum;
+  uint8_t *BusBuf;
+  TransProtFrame Rx, Tx;
+
+  Iterations = BenchIterations(argc, argv, 1000000);
+  Payload = (argc > 2) ? (uint32_t)strtoul(argv[2], NULL, 0) : 64;
+  if (Payload > MAX_PAYLOAD)
+    Payload = MAX_PAYLOAD;
+
+  MBAInit();
+
+  /* Transfer frame to interface 0 of this node */
+  Size = HEADER_SIZE + Payload + CRC_SIZE;
+  memset(InBuf, 0x5A, sizeof(InBuf));
+  InBuf[0] = SetLogicalId(NODE_ID);
+  InBuf[1] = TRANSFER_COMMAND;
+  InBuf[2] = (uint8_t)(Payload & 0xFF);
+  InBuf[3] = (uint8_t)(Payload >> 8);
+  Checksum = crc16(InBuf, HEADER_SIZE + Payload);
+  InBuf[HEADER_SIZE + Payload] = (uint8_t)(Checksum & 0xFF);
+  InBuf[HEADER_SIZE + Payload + 1] = (uint8_t)(Checksum >> 8);
+
+  TransferProtocolFrameInit(&Rx);
+  TransferProtocolFrameInit(&Tx);
+
+  Start = BenchNowNs();
+  for (i = 0; i < Iterations; i++)
+  {
+    TransferProtocolCast(&Rx, InBuf, Size, 0, MBA_BRIDGE | FROM_BUFFER);
+    TransferProtocolProcess(&Tx, &Rx);
+    TransferProtocolCast(&Tx, OutBuf, Size, 0, MBA_BRIDGE | TO_BUFFER);
+  }
+  BenchReport("transfer protocol bridge path", Iterations, BenchNowNs() - Start);
+
+  /* Same path on views: the bus buffer is read and written once */
+  Start = BenchNowNs();
+  for (i = 0; i < Iterations; i++)
+  {
+    BusBuf = (uint8_t *)MemAlloc(Size);
+    memcpy(BusBuf, InBuf, Size);
+    TransferProtocolCast(&Rx, BusBuf, Size, 0, MBA_BRIDGE | FROM_BUFFER | IN_PLACE);
+    TransferProtocolProcess(&Tx, &Rx);
+    TransferProtocolCast(&Tx, TransferProtocolFrameBuffer(&Tx, MBA_BRIDGE), Size, 0,
+                         MBA_BRIDGE | TO_BUFFER);
+    TransferProtocolFrameFree(&Tx);
+  }
+  BenchReport("transfer protocol bridge path in place", Iterations, BenchNowNs() - Start);
+
+  return 0;
+}
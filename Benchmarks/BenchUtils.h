@@ -0,0 +1,54 @@
+/**
+  ******************************************************************************
+  * @file    BenchUtils.h
+  * @author  Javier Fernandez Cepeda
+  * @brief   Timing helpers for the host benchmarks.
+  *
+  *******************************************************************************
+  * Copyright (c) 2015, Javier Fernandez. All rights reserved.
+  *******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __BENCHUTILS_H
+#define __BENCHUTILS_H
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+
+/* Exported functions ------------------------------------------------------- */
+/**
+  * @brief  Monotonic time in nanoseconds.
+  */
+static inline uint64_t BenchNowNs(void)
+{
+  struct timespec Now;
+
+  clock_gettime(CLOCK_MONOTONIC, &Now);
+  return (uint64_t)Now.tv_sec * 1000000000ull + (uint64_t)Now.tv_nsec;
+}
+
+/**
+  * @brief  Prints a benchmark result line: name, operations, ns/op and ops/s.
+  */
+static inline void BenchReport(const char *Name, uint64_t Ops, uint64_t ElapsedNs)
+{
+  double NsPerOp = (Ops != 0) ? (double)ElapsedNs / (double)Ops : 0.0;
+
+  printf("%-36s %10llu ops %10.1f ns/op %12.0f ops/s\n", Name,
+         (unsigned long long)Ops, NsPerOp,
+         (NsPerOp > 0.0) ? 1e9 / NsPerOp : 0.0);
+}
+
+/**
+  * @brief  Number of iterations: first argument or the default value.
+  */
+static inline uint64_t BenchIterations(int argc, char **argv, uint64_t Default)
+{
+  return (argc > 1) ? strtoull(argv[1], NULL, 0) : Default;
+}
+
+#endif /* __BENCHUTILS_H */
@@ -0,0 +1,109 @@
+/**
+  ******************************************************************************
+  * @file    BenchWorkPool.c
+  * @author  Javier Fernandez Cepeda
+  * @brief   MBA worker pool: frames of several sources processed by 1, 2, 4...
+  *	     workers. Each frame costs a checksum over its payload, close to
+  *	     the per frame work of the transfer protocol. The ns/op of each
+  *	     line should drop with the workers while there are free cores.
+  *	     Usage: BenchWorkPool [frames] [sources]
+  *
+  *******************************************************************************
+  * Copyright (c) 2015, Javier Fernandez. All rights reserved.
+  *******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include <pthread.h>
+#include <string.h>
+#include <unistd.h>
+#include "BenchUtils.h"
+#include "TOOLS/workpool.h"
+
+/* Private define ------------------------------------------------------------*/
+#define BENCH_PAYLOAD	1024	/* Bytes per frame */
+#define BENCH_ROUNDS	8	/* Checksum passes per frame */
+
+/* Private typedef -----------------------------------------------------------*/
+typedef struct
+{
+  workpool *Pool;
+  uint32_t Worker;
+}BenchWorker;
+
+/* Private variables ---------------------------------------------------------*/
+static uint8_t Payload[BENCH_PAYLOAD];
+static volatile uint32_t Sink;
+
+/* Private functions ---------------------------------------------------------*/
+static void BenchFrame(void *item, void *arg)
+{
+  uint32_t Sum = (uint32_t)(uintptr_t)item;
+  uint32_t r, i;
+
+  (void)arg;
+  for (r = 0; r < BENCH_ROUNDS; r++)
+    for (i = 0; i < BENCH_PAYLOAD; i++)
+      Sum = (Sum << 1 | Sum >> 31) ^ Payload[i];
+  Sink += Sum;
+}
+
+static void *BenchWorkerThread(void *arg)
+{
+  BenchWorker *Worker = (BenchWorker *)arg;
+
+  workpool_run(Worker->Pool, Worker->Worker);
+  return NULL;
+}
+
+static void Run(uint32_t Workers, uint64_t Frames, uint32_t Sources)
+{
+  pthread_t Threads[WORKPOOL_MAX_WORKERS];
+  BenchWorker Args[WORKPOOL_MAX_WORKERS];
+  workpool Pool;
+  uint64_t i, Start;
+  char Name[40];
+
+  if (workpool_init(&Pool, Workers, Sources, BenchFrame, NULL) != 0)
+    return;
+
+  Start = BenchNowNs();
+  for (i = 0; i < Workers; i++)
+  {
+    Args[i].Pool = &Pool;
+    Args[i].Worker = (uint32_t)i;
+    pthread_create(&Threads[i], NULL, BenchWorkerThread, &Args[i]);
+  }
+  for (i = 0; i < Frames; i++)
+    workpool_submit(&Pool, (uint32_t)(i % Sources), (void *)(uintptr_t)i, 0);
+  workpool_release(&Pool);
+  for (i = 0; i < Workers; i++)
+    pthread_join(Threads[i], NULL);
+
+  snprintf(Name, sizeof(Name), "%u workers", Workers);
+  BenchReport(Name, Frames, BenchNowNs() - Start);
+  workpool_free(&Pool);
+}
+
+int main(int argc, char **argv)
+{
+  uint64_t Frames;
+  uint32_t Sources, Workers;
+  long Cores = sysconf(_SC_NPROCESSORS_ONLN);
+
+  Frames = BenchIterations(argc, argv, 200000);
+  Sources = (argc > 2) ? (uint32_t)atoi(argv[2]) : 16;
+  if (Sources == 0)
+    Sources = 16;
+  memset(Payload, 0xA5, sizeof(Payload));
+  printf("%u sources, %ld cores\n", Sources, Cores);
+
+  for (Workers = 1; Workers <= WORKPOOL_MAX_WORKERS; Workers *= 2)
+  {
+    Run(Workers, Frames, Sources);
+    if ((long)Workers >= Cores * 2)
+      break;
+  }
+
+  return 0;
+}
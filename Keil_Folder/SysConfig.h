@@ -49,6 +49,7 @@
   #define FREERTOS 		0 /*!< Free source code. It will be always available */
   #define KEIL_RTX		1 /*!< For KEIL contest.  */
   #define WINDOWS		0 /*!< For PC instance.  */
+  #define LINUX			0 /*!< For Linux host daemon. */
 	
   /**** RTOS Services *********************************************************/
 #if WINDOWS == 0
@@ -73,6 +74,14 @@
 #define SOCKET_API		0 /*!<  SOCKETS API activated */
 
 #define ENABLE_FLOW_CONTROL 0 /*!<  Enable additional buffers into each BUS */
+#define BUS_TASK_MODEL		0 /*!<  1 = bus tasks as protothreads on one thread */
+
+/* MBA frame checksum: CRC-16/CCITT of the header and the data */
+#define TP_CHECKSUM		1 /*!<  Checked on decode, written on encode */
+#define CRC16_SLICE8		0 /*!<  One 512 bytes table instead of 4 KB */
+/* CRC unit of the device. Only for units that can compute CRC-16/CCITT: the
+ * STM32F4 one is fixed to CRC-32 */
+/* #define CRC16_HW(Data, Size)	DeviceCrc16(Data, Size) */
 
 /* Device support*/
 #define DEVICE_SUPPORT		1 /*!<  For HW that need initialization or has additional functions */
@@ -114,6 +123,7 @@
    #define FREERTOS 	0 /*!< Free source code. It will be always available */
    #define KEIL_RTX		0 /*!< For KEIL contest.  */
    #define WINDOWS		1 /*!< For PC instance.  */
+   #define LINUX		0 /*!< For Linux host daemon. */
 
    /**** RTOS Services *********************************************************/
  #if WINDOWS == 0
@@ -139,6 +149,10 @@
 
  #define ENABLE_FLOW_CONTROL 0 /*!<  Enable additional buffers into each BUS */
 
+ /* MBA frame checksum: CRC-16/CCITT of the header and the data */
+ #define TP_CHECKSUM		1 /*!<  Checked on decode, written on encode */
+ #define CRC16_SLICE8		1 /*!<  Slice-by-8 CRC, 4 KB of tables */
+
  /* Device support*/
  #define DEVICE_SUPPORT		0 /*!<  For HW that need initialization or has additional functions */
  /* MCU */
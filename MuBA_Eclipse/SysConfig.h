@@ -48,6 +48,7 @@
    #define FREERTOS 	0 /*!< Free source code. It will be always available */
    #define KEIL_RTX		0 /*!< For KEIL contest.  */
    #define WINDOWS		1 /*!< For PC instance.  */
+   #define LINUX		0 /*!< For Linux host daemon. */
 
    /**** RTOS Services *********************************************************/
  #if WINDOWS == 0
@@ -78,6 +79,10 @@
 
  #define ENABLE_FLOW_CONTROL 0 /*!<  Enable additional buffers into each BUS */
 
+ /* MBA frame checksum: CRC-16/CCITT of the header and the data */
+ #define TP_CHECKSUM		1 /*!<  Checked on decode, written on encode */
+ #define CRC16_SLICE8		1 /*!<  Slice-by-8 CRC, 4 KB of tables */
+
  /* Device support*/
  #define DEVICE_SUPPORT		0 /*!<  For HW that need initialization or has additional functions */
  /* MCU */
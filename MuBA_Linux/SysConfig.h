@@ -0,0 +1,174 @@
+/**
+  ******************************************************************************
+  * @file    SysConfig.h
+  * @author  Javier Fernandez Cepeda
+  * @brief   This file configures the system for the Linux host build.
+  *
+  *******************************************************************************
+  * Copyright (c) 2015, Javier Fernandez. All rights reserved.
+  *******************************************************************************
+  *
+  * @page Configuration
+  * @{
+  *	@brief		Linux host configuration. Used by the CMake project at the
+  *			root of the repository.
+  *	@details	The firmware core runs as a host daemon on top of pThreads.
+  *			Bus interfaces are mapped to BSD sockets and, optionally,
+  *			to libusb (-DMUBA_USB_HOST=ON).
+*/
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __SYSCONFIG_H
+#define __SYSCONFIG_H
+
+#ifdef __cplusplus
+ extern "C" {
+#endif 
+
+ /*----------------------------------------------------------------------------*/
+ /*	GENERAL SETTINGS														*/
+ /*----------------------------------------------------------------------------*/
+ #define DEBUG_ACTIVE 		0 /*!< If debug is active, Debug messages are sent through USB  */
+ #define SYSTEM_TEST_MODE 	0 /*!< If set, allows to run test functions   */
+
+ /*----------------------------------------------------------------------------*/
+ /*	RTOS SETTINGS			 */
+ /*----------------------------------------------------------------------------*/
+ #ifndef MUBA_OS_ACTIVE
+ #define MUBA_OS_ACTIVE		1
+ #endif
+ #define OS_ACTIVE 		MUBA_OS_ACTIVE /*!< Enable / disable the OS. In time-critial applications
+ 				   	       *    may not be interesting to use an OS even a RTOS */
+
+  /* Select the RTOS */
+ #if OS_ACTIVE != 0
+
+   /*** Select RTOS ************************************************************/
+   #define COOS 		0 /*!< Legacy. The first implementation was with this RTOS  */
+   #define FREERTOS 	0 /*!< Free source code. It will be always available */
+   #define KEIL_RTX		0 /*!< For KEIL contest.  */
+
+   /**** RTOS Services *********************************************************/
+ #endif
+
+ /* Host platform. With the OS it selects the pThread backend */
+ #define WINDOWS		0 /*!< For PC instance.  */
+ #define LINUX		1 /*!< For Linux host daemon. */
+
+ /*----------------------------------------------------------------------------*/
+ /*	MBADEVICE SETTINGS																*/
+ /*----------------------------------------------------------------------------*/
+ /* libusb support is selected by the build system */
+ #ifndef MUBA_USB_HOST
+ #define MUBA_USB_HOST		0
+ #endif
+
+ /* Determines BUS interfaces */
+ #define USB_API    		0 /*!<  USB API activated */
+ #define USB_HOST_API		MUBA_USB_HOST /*!<  USB Host API activated */
+ #define SPI_API			0 /*!<  SPI API activated */
+ #define CAN_API			0 /*!<  CAN API activated */
+ #define LIN_API			0 /*!<  LIN API activated */
+ #define USART_API			0 /*!<  USART API activated */
+ #define I2C_API			0 /*!<  I2C API activated */
+ #define SOCKET_API			1 /*!<  SOCKETS API activated */
+
+ #define AVAILABLE_INTERFACES	(USB_HOST_API + SOCKET_API)  /*!<  Available interfaces in the device */
+
+ #define ENABLE_FLOW_CONTROL 0 /*!<  Enable additional buffers into each BUS */
+ /* Credits granted to the node at the other end of each MBA bridge, 1 to 63
+  * frames. Both ends need the same value. 0 = no flow control. Register 0xN008 */
+ #define BUS_FLOW_WINDOW	0
+ /* Bytes of the writes that pack the frames of each MBA bridge, 0 = a write
+  * per frame. A frame is held at most BUS_AGGREGATE_HOLD us, rounded down to
+  * the ms of the OS. Registers 0xN009 and 0xN00A */
+ #define BUS_AGGREGATE_SIZE	0
+ #define BUS_AGGREGATE_HOLD	200
+ /* Largest frame written into each MBA bridge, header and checksum included:
+  * larger frames go in fragments. 0 = no fragments. Register 0xN00C. Frames
+  * are gathered from their fragments up to BUS_REASSEMBLY_SIZE bytes of data */
+ #define BUS_FRAGMENT_SIZE	0
+ #define BUS_REASSEMBLY_SIZE	0xFFFF
+
+ /* Bus I/O model */
+ #ifndef MUBA_BUS_EVENT_LOOP
+ #define MUBA_BUS_EVENT_LOOP	1
+ #endif
+ #define BUS_EVENT_LOOP		MUBA_BUS_EVENT_LOOP /*!<  Serve descriptor based buses from one epoll thread */
+ /* Interfaces the node needs to be ready, a bit each. See BUSWaitReady */
+ #define BUS_REQUIRED_INTERFACES	0x01
+ /* Bus shards. 0 = one bus loop, N = N loops pinned to a core each. Bus i
+  * belongs to shard i % N, which also routes the frames read from it */
+ #ifndef MUBA_BUS_SHARDS
+ #define MUBA_BUS_SHARDS	0
+ #endif
+ #define BUS_SHARDS		MUBA_BUS_SHARDS
+ /* Bus task model. 0 = thread per task, 1 = protothreads on one thread */
+ #ifndef MUBA_BUS_TASK_MODEL
+ #define MUBA_BUS_TASK_MODEL	0
+ #endif
+ #define BUS_TASK_MODEL		MUBA_BUS_TASK_MODEL
+
+ /* MBA processing. 0 = single MBA thread, N = pool of N worker threads */
+ #ifndef MUBA_MBA_WORKERS
+ #define MUBA_MBA_WORKERS	0
+ #endif
+ #define MBA_WORKERS		MUBA_MBA_WORKERS
+
+ /* Thread loop statistics: latency histogram per thread loop, stall log on
+  * stderr and dump on SIGUSR1. Registers 0x0B00, 0x0B1n and 0x0B2n */
+ #ifndef MUBA_LOOP_STATS
+ #define MUBA_LOOP_STATS	1
+ #endif
+ #define LOOP_STATS		MUBA_LOOP_STATS
+ #define LOOP_STALL_US		10000 /*!<  Loop iterations longer than this are logged */
+
+ /* MBA frame checksum: CRC-16/CCITT of the header and the data, written on
+  * encode and checked on decode. 0 = frames carry the checksum unchecked */
+ #define TP_CHECKSUM		1
+ #define CRC16_SLICE8		1 /*!<  Slice-by-8 CRC, 4 KB of tables. 0 = one 512 bytes table */
+
+ /* Thread scheduling. 0 = default policy, 1 = SCHED_FIFO, 2 = SCHED_RR. Real time
+  * policies need CAP_SYS_NICE; without it threads keep the default policy */
+ #ifndef MUBA_THREAD_POLICY
+ #define MUBA_THREAD_POLICY	0
+ #endif
+ #define THREAD_SCHED_POLICY		MUBA_THREAD_POLICY
+ #define THREAD_SCHED_PRIORITY_BASE	10 /*!<  Real time level of osPriorityIdle */
+ #define THREAD_SCHED_PRIORITY_STEP	10 /*!<  Levels between two osPriority values */
+ /* Per thread settings: { function name, priority, CPU mask (0 = any CPU) } */
+ #define THREAD_SETTINGS_TABLE \
+	{ "BUSLoopProcess",  osPriorityHigh,        0 }, \
+	{ "BUSTaskProcess",  osPriorityHigh,        0 }, \
+	{ "BUSReadProcess",  osPriorityHigh,        0 }, \
+	{ "BUSWriteProcess", osPriorityAboveNormal, 0 }, \
+	{ "MBAProcess",      osPriorityAboveNormal, 0 }, \
+	{ "MBAWorkerProcess", osPriorityAboveNormal, 0 }, \
+	{ "OSTimerProcess",  osPriorityHigh,        0 }
+
+ /* Device support*/
+ #define DEVICE_SUPPORT		0 /*!<  For HW that need initialization or has additional functions */
+ /* MCU */
+ #define MCU_STM32F4XX		0  /*!<  Indentifies specific HW */
+ /*----------------------------------------------------------------------------*/
+ /*	COMPILER SETTINGS																*/
+ /*----------------------------------------------------------------------------*/
+ #define ARMCC_COMPILER		0 /*!< For Keil contest */
+ #define GNU_COMPILER		1 /*!< Is free. It will be always available */
+ #define CYGWIN_COMPILER	0 /*!< For windows instance */
+
+ /*----------------------------------------------------------------------------*/
+ /*	STORAGE & MEMORY SUPPORT																*/
+ /*----------------------------------------------------------------------------*/
+ #define DINAMIC_MEMORY_CONTROL	0
+ #define DICTIONARY_IN_FILE	0
+
+#if (ARMCC_COMPILER != 0) && (GNU_COMPILER != 0) && (CYGWIN_COMPILER != 0)
+#error "More than one compiler selected."
+#endif
+ 
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __SYSCONFIG_H */
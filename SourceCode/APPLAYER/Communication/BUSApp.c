@@ -34,18 +34,247 @@
 
 /* Includes ------------------------------------------------------------------*/
 #include "BUSApp.h"			/*!< Bus application parameters */
-#include "../../MBALIBRARY/MBALib.h"		/*!< Access to MBA instance */
+#include "MBAApp.h"			/*!< Super loop hand over */
+#include "../../MBALibrary/MBALib.h"		/*!< Access to MBA instance */
 #include "../../PHDLLAYER/BUSAPI/BUSAPI.h" 	/*!< Main API of this file */
 #include "../../TOOLS/MemoryManagement.h" 	/*!< Definition of memory functions */
+#include "../../TOOLS/deframer.h"		/*!< Frames of the byte stream buses */
+#include "../../TOOLS/latstats.h"		/*!< Latency of the frames written */
+#include "../../TOOLS/aggregator.h"		/*!< Writes of the MBA bridges */
+#if BUS_EVENT_LOOP > 0
+#include "../../TOOLS/evloop.h"			/*!< Bus loop */
+#endif
+#if BUS_SHARDS > 0
+#include "../../TOOLS/spscring.h"		/*!< Frames between shards */
+#include "../../TOOLS/objpool.h"		/*!< Frames of a shard */
+#endif
+#if BUS_TASK_MODEL > 0
+#include "../../TOOLS/pt.h"			/*!< Bus tasks */
+#ifdef MailQueueFd
+#include <poll.h>
+#endif
+#endif
 
-/* Private typedef -----------------------------------------------------------*/
 /* Private define ------------------------------------------------------------*/
-	
+#define BUS_LOOP_MAX_FRAMES	16	/*!< Reads served per bus and loop wake up */
+#define BUS_MAX_FRAME_SIZE	(HEADER_SIZE + 0xFFFF + CRC_SIZE) /*!< Largest size field */
+#define BUS_TASK_POLL_MS	1	/*!< Task scheduler sleep while a bus is polled */
+#define BUS_TASK_IDLE_MS	10	/*!< Task scheduler sleep while waiting on descriptors */
+
+#if BUS_SHARDS > 0
+#define BUS_LOOPS		BUS_SHARDS
+#else
+#define BUS_LOOPS		1
+#endif
+#define BUS_SHARD_RING_SIZE	256	/*!< Frames in flight from a shard to another */
+#define BUS_SHARD_POOL_SIZE	64	/*!< Free frames kept by a shard */
+
+/* Frame detection by timeout needs a tick: the super loop or the OS timers */
+#if (OS_ACTIVE == 0) || (TIMER_AVAILABLE != 0)
+#define BUS_FRAME_TIMEOUTS	1
+#include "../../TOOLS/timerwheel.h"		/*!< Frame timeouts */
+#else
+#define BUS_FRAME_TIMEOUTS	0
+#endif
+
+/* Frame detection registers of each interface: 0x1700, 0x2700... */
+#define BUS_FRAME_DETECTION_REG		0x0700	/*!< See FRAME_DETECTION_TIMEOUT */
+#define BUS_GLOBAL_TIMEOUT_REG		0x0710	/*!< Max. frame duration in ms. 0 = none */
+#define BUS_DECODING_TIMEOUT_REG	0x0711	/*!< Silence that ends a frame in ms */
+
+/* Bring-up registers: 0x1005, 0x2005... and the node ones */
+#define BUS_INIT_TIME_REG		0x0005	/*!< ms from launch to active */
+#define BUS_READY_INDEX			0x0F20	/*!< Active interfaces, a bit each */
+#define BUS_REQUIRED_INDEX		0x0F21	/*!< Interfaces the node needs to be ready */
+
+/* Latency registers: 0x1007, 0x2007... */
+#define BUS_LATENCY_REG			0x0007	/*!< Latency of the frames written */
+
+/* Flow control of the MBA bridges needs the bus queues to hold the frames */
+#if OS_ACTIVE != 0
+#define BUS_FLOW_CONTROL	1
+#define BUS_FLOW_POLL_MS	1	/*!< Writer sleep while it waits for credit, if the
+					 *   bus queue cannot hold the frames */
+#else
+#define BUS_FLOW_CONTROL	0
+#endif
+/* Flow control registers: 0x1008, 0x2008... */
+#define BUS_FLOW_WINDOW_REG		0x0008	/*!< Credits granted to the peer. 0 = off */
+
+/* The writers of the MBA bridges pack frames while their queue has more */
+#if OS_ACTIVE != 0
+#define BUS_AGGREGATION		1
+#else
+#define BUS_AGGREGATION		0
+#endif
+/* Aggregation registers: 0x1009, 0x100A, 0x2009... */
+#define BUS_AGGREGATE_SIZE_REG		0x0009	/*!< Bytes of a write. 0 = off */
+#define BUS_AGGREGATE_HOLD_REG		0x000A	/*!< Max time a frame is held, in us */
+
+/* Fragmentation registers: 0x100C, 0x200C... */
+#define BUS_FRAGMENT_SIZE_REG		0x000C	/*!< Largest frame written. 0 = off */
+
+/* Private typedef -----------------------------------------------------------*/
+#if BUS_FRAME_TIMEOUTS > 0
+/**
+ * @brief Frame detection by timeout. The data read from the bus is gathered
+ *	  until the bus is silent for the decoding timeout or the global
+ *	  timeout, counted from the first data, expires.
+ */
+typedef struct
+{
+  uint16_t FrameDetection;	/*!< Frame detection register */
+  uint16_t GlobalTimeout;	/*!< Global timeout register */
+  uint16_t DecodingTimeout;	/*!< Decoding timeout register */
+  uint8_t *Data;		/*!< Frame being gathered */
+  uint32_t Size;		/*!< Bytes gathered */
+  struct timerwheel_entry Global;	/*!< Armed on the first data */
+  struct timerwheel_entry Decoding;	/*!< Re-armed on every read */
+}BusFrameTimeout;
+#endif
+
+#if BUS_EVENT_LOOP > 0
+/**
+ * @brief Bus loop. With shards there is a loop per shard, and each one also
+ *	  routes the transfer frames read from its buses: frames for a bus of
+ *	  another shard go through the ring of that shard, the rest never
+ *	  leave the thread. Control frames go to the MBA as usual.
+ */
+typedef struct
+{
+  evloop Loop;
+#if BUS_SHARDS > 0
+  uint32_t Index;		/*!< Shard number */
+  spscring Inbox[BUS_SHARDS];	/*!< Frames from each other shard */
+  objpool Frames;		/*!< Free @ref BusShardFrame */
+  TPRouteView Route;		/*!< Routing tables of the shard */
+#endif
+}BusShard;
+#endif
+
+#if BUS_SHARDS > 0
+/**
+ * @brief Frame routed by a shard. Frames that end up in a mail queue are
+ *	  copied into a mail, see @ref BUSShardMail.
+ */
+typedef struct
+{
+  TransProtFrame Frame;
+  int32_t BUSId;		/*!< Destination bus */
+}BusShardFrame;
+#endif
+
+#if BUS_TASK_MODEL > 0
+/**
+ * @brief Tasks of a bus. A bring-up thread configures the bus, so slow buses
+ *	  do not hold the scheduler; then the read task receives from it and
+ *	  the write task empties the bus queue.
+ */
+typedef struct
+{
+  struct pt Read;	/*!< Read task position */
+  struct pt Write;	/*!< Write task position */
+  uint8_t Active;	/*!< Launched and not stopped */
+  int8_t Configured;	/*!< Bring-up result: 1 configured, -1 failed, 0 running */
+  uint8_t BringUp;	/*!< The bring-up thread has been created and not joined */
+  uint8_t Ready;	/*!< Configured: the write task runs */
+  int8_t Event;		/*!< Last read task event. See @ref BUSTaskPoll */
+  int Fd;		/*!< Bus descriptor for the idle wait, -1 if none */
+  OSGlobalRet Mail;	/*!< Frame taken from the bus queue */
+}BusTask;
+#endif
+
+#if BUS_FLOW_CONTROL > 0
+/**
+ * @brief Credit based flow control of a MBA bridge. Each end grants the other
+ *	  a window of frames: the peer may send until the frames it has sent
+ *	  reach the limit it got from this node, which moves on as those frames
+ *	  leave the node. Counters are mod 128. Frames without credit wait, in
+ *	  order, in the bus queue until the peer grants more. Where the queue
+ *	  can hold them, control frames still go; the peer accounts them as
+ *	  usual. A node that forwards frames returns their credit once they are
+ *	  written, so a chain of bridges runs at the pace of its slowest link.
+ */
+typedef struct
+{
+  uint16_t Window;		/*!< Window register */
+  int32_t Applied;		/*!< Window in use. -1 = to be applied */
+  volatile uint8_t Active;	/*!< The bridge runs flow control. Read by the
+				 *   shards without the mutex */
+  uint8_t Credits;		/*!< Window in use, at most TP_FLOW_WINDOW_MAX */
+  uint8_t Sent;			/*!< Frames sent to the peer */
+  uint8_t Limit;		/*!< Limit of Sent granted by the peer */
+  uint8_t Released;		/*!< Frames of the peer that have left the node */
+  uint8_t Advertised;		/*!< Released when the last limit was sent */
+  TransProtFrame *Kick;		/*!< Mail that wakes the writer up. Never freed */
+  uint8_t Kicked;		/*!< Kick is in the bus queue */
+  uint8_t Waiting;		/*!< The frames wait for credit in the bus queue */
+}BusFlow;
+#endif
+
+#if BUS_AGGREGATION > 0
+/**
+ * @brief Frames of a MBA bridge waiting to be written together
+ */
+typedef struct
+{
+  uint16_t Size;		/*!< Aggregate size register */
+  uint16_t Hold;		/*!< Aggregate hold register */
+  aggregator Frames;
+}BusAggregate;
+#endif
+
 /* Private macro -------------------------------------------------------------*/
+#define BUS_LOOP_OF(BUSId)	(&BusLoops[(BUSId) % BUS_LOOPS].Loop)
+#define BUS_REGISTER(BUSId, Offset)	((uint16_t)((((BUSId) + 1) << 12) | (Offset)))
+
+#if (BUS_FRAME_TIMEOUTS > 0) && (OS_ACTIVE != 0)
+#define BUS_WHEEL_LOCK()	MutexWait(MidBusWheelMutex)
+#define BUS_WHEEL_UNLOCK()	MutexRelease(MidBusWheelMutex)
+#else
+#define BUS_WHEEL_LOCK()
+#define BUS_WHEEL_UNLOCK()
+#endif
+
+#if BUS_FLOW_CONTROL > 0
+#define BUS_FLOW_LOCK(BUSId)	MutexWait(MidBusFlowMutex[BUSId])
+#define BUS_FLOW_UNLOCK(BUSId)	MutexRelease(MidBusFlowMutex[BUSId])
+/* Frames that can still be sent to the peer */
+#define BUS_FLOW_LEFT(Flow)	((uint8_t)((Flow)->Limit - (Flow)->Sent) & TP_FLOW_LIMIT_MASK)
+#define BUS_FLOW_CAN_SEND(Flow)	((BUS_FLOW_LEFT(Flow) != 0) && (BUS_FLOW_LEFT(Flow) <= TP_FLOW_WINDOW_MAX))
+/* Half the window has been released since the peer got the last limit */
+#define BUS_FLOW_DUE(Flow)	((((uint8_t)((Flow)->Released - (Flow)->Advertised) & TP_FLOW_LIMIT_MASK)) >= \
+				 (((Flow)->Credits + 1) / 2))
+#endif
+
+#if OS_ACTIVE != 0
+#define BUS_BRINGUP_LOCK()	MutexWait(MidMBAMutex)
+#define BUS_BRINGUP_UNLOCK()	MutexRelease(MidMBAMutex)
+#else
+#define BUS_BRINGUP_LOCK()
+#define BUS_BRINGUP_UNLOCK()
+#endif
+
 /* Private variables ---------------------------------------------------------*/
+#if OS_ACTIVE != 0
 
+#if BUS_TASK_MODEL > 0
+/**
+ * @brief Task model. The tasks of all the buses run in a single thread and
+ *	  hold the mutex while they run, so buses are not stopped under them.
+ */
+static BusTask BusTasks[BUS_INSTANCES];
+DEFINE_MUTEX(BusTaskMutex);
+static MUTEX_ID MidBusTaskMutex;   /*!< Mutex ID */
+THREAD_ID ThreadIDBUSTaskProcess;  /*!< Thread ID */
+THREAD_ID ThreadIDBUSBringUpProcess[BUS_INSTANCES]; /*!< Thread IDs */
+#else
 THREAD_ID ThreadIDBUSReadProcess[BUS_INSTANCES];  /*!< Thread IDs */
 THREAD_ID ThreadIDBUSWriteProcess[BUS_INSTANCES];  /*!< Thread IDs */
+static uint8_t BusReadRunning[BUS_INSTANCES];	/*!< The read thread has been created and not joined */
+static uint8_t BusWriteRunning[BUS_INSTANCES];	/*!< The write thread has been created and not joined */
+static TransProtFrame *BusWriteStopMail[BUS_INSTANCES];	/*!< Mail that stops the write thread. See @ref BUSWriteStop */
+#endif
 
 /**
  * @brief A mail queue for each bus thread is created. This mailbox are used to 
@@ -85,6 +314,14 @@ extern MAIL_QUEUE_ID QueueIDMBAQueue;
  */
 DEFINE_MUTEX(MBAMutex);	
 MUTEX_ID MidMBAMutex;              /*!< Mutex ID */
+#else
+
+/**
+ * @brief Super loop. Buses configured by @ref LaunchBUSInstance and polled by
+ *	  @ref BUSProcessStep.
+ */
+static uint8_t BusActive[BUS_INSTANCES];
+#endif
 														  
 
 /**
@@ -94,13 +331,160 @@ MUTEX_ID MidMBAMutex;              /*!< Mutex ID */
 int32_t InstanceID[BUS_INSTANCES] =
 {
  BUS_ID_1,
- BUS_ID_2
+#if BUS_INSTANCES > 1
+ BUS_ID_2,
+#endif
 #if BUS_INSTANCES > 2
- , BUS_ID_3
+ BUS_ID_3,
 #endif
  };
 
+#if BUS_EVENT_LOOP > 0
+/**
+ * @brief Bus loops. Descriptor based buses and their mail queues are served
+ *	  by a loop thread instead of a read / write thread pair per bus. Bus
+ *	  BUSId belongs to loop BUSId % BUS_LOOPS.
+ */
+static BusShard BusLoops[BUS_LOOPS];
+static uint8_t BusLoopAvailable;           /*!< The loop threads are running */
+static int BusLoopFd[BUS_INSTANCES];       /*!< Bus descriptor, -1 if not in the loop */
+static int BusLoopQueueFd[BUS_INSTANCES];  /*!< Bus queue descriptor */
+static uint8_t BusLoopWaiting[BUS_INSTANCES]; /*!< Data pending: the bus queue waits until the bus is writable */
+THREAD_ID ThreadIDBUSLoopProcess[BUS_LOOPS]; /*!< Thread IDs */
+#endif
+#if BUS_SHARDS > 0
+static __thread BusShard *BusCurrentShard; /*!< Shard of the calling thread, NULL out of them */
+static uint8_t BusShardQueued[BUS_INSTANCES]; /*!< Frames routed by the owner shard may be in
+					       *   the bus queue. Only used by the owner */
+#endif
+
+/**
+ * @brief Bring-up. Launched buses configure at the same time, each one in its
+ *	  own thread, and the node is ready once the required ones are active,
+ *	  whatever the state of the rest.
+ */
+static uint32_t BusLaunchTick[BUS_INSTANCES];	/*!< OS tick of the launch */
+static uint32_t BusInitTime[BUS_INSTANCES];	/*!< Init time register */
+static volatile uint16_t BusReadyMask;		/*!< Ready register */
+static volatile uint16_t BusFailedMask;		/*!< Buses whose configuration failed */
+static uint16_t BusRequiredMask;		/*!< Required register */
+
+/**
+ * @brief Frames of the MBA bridges, split out of the data read. A read may
+ *	  carry several frames or part of one.
+ */
+static deframer BusDeframers[BUS_INSTANCES];
+
+/**
+ * @brief Frames of MBA bridges larger than their fragment size are written in
+ *	  fragments, and the fragments read are gathered into whole frames.
+ */
+static uint16_t BusFragmentSize[BUS_INSTANCES];
+static TPReassembly BusReassembly[BUS_INSTANCES];
+
+/**
+ * @brief Latency of the frames written into each bus, from their capture to
+ *	  their write, split at the MBA and at the bus queue.
+ */
+static latstats BusLatency[BUS_INSTANCES];
+
+#if BUS_AGGREGATION > 0
+static BusAggregate BusAggregates[BUS_INSTANCES];
+#endif
+
+#if BUS_FLOW_CONTROL > 0
+static BusFlow BusFlows[BUS_INSTANCES];
+/* The flow state of a bus is only shared by its reader and writer and by the
+ * threads that return its credit */
+#if BUS_INSTANCES > 0
+DEFINE_MUTEX(BusFlowMutex_1);
+#endif
+#if BUS_INSTANCES > 1
+DEFINE_MUTEX(BusFlowMutex_2);
+#endif
+#if BUS_INSTANCES > 2
+DEFINE_MUTEX(BusFlowMutex_3);
+#endif
+static MUTEX_ID MidBusFlowMutex[BUS_INSTANCES];
+#endif
+
+#if BUS_FRAME_TIMEOUTS > 0
+static BusFrameTimeout BusTimeouts[BUS_INSTANCES];
+/**
+ * @brief Timeouts of all the buses. One wheel tick is one millisecond.
+ */
+static timerwheel BusWheel;
+static uint64_t BusWheelTime;	/*!< Milliseconds processed by the wheel */
+static uint32_t BusWheelTick;	/*!< OS tick of the last wheel update */
+#if OS_ACTIVE != 0
+DEFINE_MUTEX(BusWheelMutex);
+static MUTEX_ID MidBusWheelMutex;  /*!< Taken by the readers and the wheel timer */
+static TIMER_ID BusWheelTimer;	   /*!< Ticks the wheel while timeouts are armed */
+static uint8_t BusWheelTicking;
+#endif
+#endif
+
 /* Private function prototypes -----------------------------------------------*/
+static void BUSReadFrame(int32_t BUSId);
+static void BUSDeliverFrame(int32_t BUSId, uint8_t *BusBuffer, uint32_t FrameSize);
+static void BUSWriteFrame(int32_t BUSId, TransProtFrame *RxFrame);
+static void BUSLinkLost(int32_t BUSId);
+static void BUSBringUpInit(void);
+static void BUSBringUpStart(int32_t BUSId);
+static void BUSBringUpEnd(int32_t BUSId, uint8_t Active);
+static void BUSBringUpStop(int32_t BUSId);
+static void BUSDeframersInit(void);
+static void BUSDeframed(void *Arg, uint8_t *Frame, uint32_t Size);
+static uint8_t BUSReassemble(int32_t BUSId, uint8_t **BusBuffer, uint32_t *FrameSize);
+static void BUSStampFrame(int32_t BUSId, TransProtFrame *Frame, uint64_t RxTime);
+static void BUSLatencyInit(void);
+static void BUSLatencyUpdate(int32_t BUSId, const TransProtFrame *Frame);
+static void BUSWriteFragments(int32_t BUSId, uint8_t *Data, uint32_t Size);
+static void BUSWriteData(int32_t BUSId, uint8_t *Data, uint32_t Size);
+#if OS_ACTIVE != 0
+static void BUSWriteMail(int32_t BUSId, TransProtFrame *Frame);
+#endif
+#if BUS_AGGREGATION > 0
+static void BUSAggregateInit(void);
+static void BUSAggregateWrite(void *Arg, const uint8_t *Data, uint32_t Size);
+static void BUSAggregateFlush(int32_t BUSId);
+#if BUS_TASK_MODEL == 0
+static uint8_t BUSAggregatePending(int32_t BUSId);
+static uint32_t BUSAggregateWait(int32_t BUSId);
+#endif
+#endif
+#if BUS_FLOW_CONTROL > 0
+static void BUSFlowInit(void);
+static void BUSFlowReset(int32_t BUSId);
+static void BUSFlowApply(int32_t BUSId);
+#if BUS_SHARDS > 0
+static uint8_t BUSFlowActive(int32_t BUSId);
+#endif
+static uint8_t BUSFlowReceive(int32_t BUSId, TransProtFrame *Frame);
+static uint8_t BUSFlowWait(int32_t BUSId);
+static uint8_t BUSFlowHold(int32_t BUSId);
+static uint8_t BUSFlowKicked(int32_t BUSId, TransProtFrame *Frame);
+static void BUSFlowService(int32_t BUSId);
+static void BUSFlowStamp(int32_t BUSId, TransProtFrame *Frame);
+static void BUSFlowCredit(int32_t BUSId);
+static void BUSFlowKick(int32_t BUSId);
+#endif
+
+#if BUS_FRAME_TIMEOUTS > 0
+static void BUSTimeoutsInit(void);
+static void BUSTimeoutsReset(int32_t BUSId);
+static uint8_t BUSGatherFrame(int32_t BUSId, uint8_t *BusBuffer, uint32_t FrameSize);
+static void BUSFrameTimeout(struct timerwheel_entry *Entry, void *Arg);
+static void BUSWheelAdvance(void);
+#if OS_ACTIVE != 0
+static void BUSWheelCallback(void const *arg);	/*!< Wheel tick */
+static DEFINE_TIMER(BUSWheel, BUSWheelCallback);
+#endif
+#endif
+
+#if (OS_ACTIVE != 0) && (BUS_TASK_MODEL == 0)
+static void BUSWriteStop(int32_t BUSId);
+static void BUSReadLinkLost(int32_t BUSId);
 OS_THREAD_TYPE BUSReadProcess (OS_THREAD_ARG argument);	 /*!< Bus thread function */
 OS_THREAD_TYPE BUSWriteProcess (OS_THREAD_ARG argument); /*!< Bus thread function */
 
@@ -109,9 +493,40 @@ OS_THREAD_TYPE BUSWriteProcess (OS_THREAD_ARG argument); /*!< Bus thread functio
  */
 DEFINE_THREAD(BUSReadProcess, osPriorityNormal, BUS_INSTANCES, BUS_STACKSIZE);
 DEFINE_THREAD(BUSWriteProcess, osPriorityNormal, BUS_INSTANCES, BUS_STACKSIZE);
+#endif
+
+#if BUS_TASK_MODEL > 0
+OS_THREAD_TYPE BUSTaskProcess (OS_THREAD_ARG argument);	 /*!< Bus task scheduler */
+OS_THREAD_TYPE BUSBringUpProcess (OS_THREAD_ARG argument); /*!< Bus configuration */
+DEFINE_THREAD(BUSBringUpProcess, osPriorityNormal, BUS_INSTANCES, BUS_STACKSIZE);
+DEFINE_THREAD(BUSTaskProcess, osPriorityNormal, 1, BUS_STACKSIZE);
+static PT_THREAD(BUSTaskRead(struct pt *pt, int32_t BUSId));
+static PT_THREAD(BUSTaskWrite(struct pt *pt, int32_t BUSId));
+static int8_t BUSTaskPoll(int32_t BUSId);
+static uint8_t BUSTaskMail(int32_t BUSId);
+static void BUSTaskIdle(void);
+#endif
 
+#if BUS_EVENT_LOOP > 0
+OS_THREAD_TYPE BUSLoopProcess (OS_THREAD_ARG argument);	 /*!< Bus loop thread function */
+DEFINE_THREAD(BUSLoopProcess, osPriorityNormal, BUS_LOOPS, BUS_STACKSIZE);
+static int32_t BUSLoopInit(uint32_t Index);
+static int32_t BUSLoopAttach(int32_t BUSId);
+static void BUSLoopDetach(int32_t BUSId);
+static void BUSLoopBusEvent(int fd, uint32_t events, void *arg);
+static void BUSLoopQueueEvent(int fd, uint32_t events, void *arg);
+static void BUSLoopBusy(int32_t BUSId);
+#endif
+#if BUS_SHARDS > 0
+static void BUSShardDeliver(BusShard *Shard, int32_t BUSId, uint8_t *BusBuffer, uint32_t FrameSize,
+                            uint64_t RxTime);
+static void BUSShardWrite(BusShard *Shard, BusShardFrame *Item);
+static void BUSShardMail(BusShard *Shard, BusShardFrame *Item, MAIL_QUEUE_ID *Queue, uint8_t Priority);
+static void BUSShardInboxEvent(int fd, uint32_t events, void *arg);
+#endif
 
 /* Private functions ---------------------------------------------------------*/
+#if OS_ACTIVE != 0
 
 /**
   * @brief  Initializes BUS App process
@@ -122,6 +537,9 @@ int32_t InitBUSProcess(void)
 {
   int32_t ret = INSTANCE_OK;
   int32_t FuncRet;
+#if BUS_EVENT_LOOP > 0
+  uint32_t Loop;
+#endif
 
   /* Create Bus buffers */
 #if BUS_INSTANCES > 0
@@ -141,22 +559,158 @@ int32_t InitBUSProcess(void)
 #endif
 #if BUS_INSTANCES > 2
   CreateMailQueue(FuncRet, QueueIDBusQueue[BUS_ID_3], MAIL_QUEUE_REF(BusQueue_3), NULL);
-  if(!QueueIDBusQueue[BUS_ID_3])
+  if(!FuncRet)
   {
 	ret = BUFFER_ERROR; // Mail Queue object not created
   }
 #endif
 	
   /* Create synchronization tools */
-  CreateMutex(MidMBAMutex, MUTEX_REF(MBAMutex));
-  if (!MidMBAMutex)
+  CreateMutex(FuncRet, MidMBAMutex, MUTEX_REF(MBAMutex));
+  if (!FuncRet)
+  {
+      ret = SYNC_TOOL_ERROR; // Mutex object not created
+  }
+
+#if BUS_EVENT_LOOP > 0
+  /* Descriptor based buses are served by the loop threads. If the loops
+   * cannot be created, all the buses use their own threads. */
+  for(FuncRet = 0; FuncRet < BUS_INSTANCES; FuncRet++)
+  {
+    BusLoopFd[FuncRet] = -1;
+  }
+  BusLoopAvailable = 1;
+  for(Loop = 0; (Loop < BUS_LOOPS) && BusLoopAvailable; Loop++)
+  {
+    BusLoopAvailable = (BUSLoopInit(Loop) == 0);
+  }
+  for(Loop = 0; (Loop < BUS_LOOPS) && BusLoopAvailable; Loop++)
+  {
+    CreateThread (FuncRet, ThreadIDBUSLoopProcess[Loop], THREAD_REF(BUSLoopProcess), &BusLoops[Loop]);
+    BusLoopAvailable = FuncRet;
+#if BUS_SHARDS > 0
+    /* A shard per core: its buses, rings and pool stay in that cache */
+    if(FuncRet)
+    {
+      ThreadSetCpu(FuncRet, ThreadIDBUSLoopProcess[Loop], Loop);
+    }
+#endif
+  }
+#endif
+
+#if BUS_TASK_MODEL > 0
+  /* The tasks of all the buses share one thread */
+  CreateMutex(FuncRet, MidBusTaskMutex, MUTEX_REF(BusTaskMutex));
+  if (!FuncRet)
   {
       ret = SYNC_TOOL_ERROR; // Mutex object not created
   }
+  CreateThread (FuncRet, ThreadIDBUSTaskProcess, THREAD_REF(BUSTaskProcess), NULL);
+  if (!FuncRet)
+  {
+      ret = TASK_ERROR; // Scheduler thread not created
+  }
+#endif
+
+#if BUS_FRAME_TIMEOUTS > 0
+  BUSTimeoutsInit();
+#endif
+  BUSDeframersInit();
+  BUSLatencyInit();
+#if BUS_FLOW_CONTROL > 0
+  BUSFlowInit();
+#endif
+  BUSAggregateInit();
+  BUSBringUpInit();
 
   return ret;
 }
 
+#if BUS_TASK_MODEL > 0
+/**
+  * @brief   Starts the tasks of a bus. The scheduler configures the bus in
+  *	     its next round.
+  * @param[in] 	Bus ID
+  */
+void LaunchBUSInstance(uint8_t BusInstanceID)
+{
+  BusTask *Task = &BusTasks[BusInstanceID];
+  int32_t FuncRet;
+
+  BUSBringUpStart(BusInstanceID);
+  MutexWait(MidBusTaskMutex);
+  PT_INIT(&Task->Read);
+  PT_INIT(&Task->Write);
+  Task->Ready = 0;
+  Task->Configured = 0;
+  Task->Fd = -1;
+  Task->Active = 1;
+  MutexRelease(MidBusTaskMutex);
+
+  CreateThread (FuncRet, ThreadIDBUSBringUpProcess[BusInstanceID], THREAD_REF(BUSBringUpProcess),
+                &(InstanceID[BusInstanceID]));
+  MutexWait(MidBusTaskMutex);
+  Task->BringUp = (FuncRet != 0);
+  if(!FuncRet)
+  {
+    Task->Configured = -1;
+  }
+  MutexRelease(MidBusTaskMutex);
+}
+
+/**
+  * @brief   Stops the tasks of a bus launched by @ref LaunchBUSInstance.
+  * @param[in] 	Bus ID
+  */
+void StopBUSInstance(uint8_t BusInstanceID)
+{
+  BusTask *Task = &BusTasks[BusInstanceID];
+  int32_t FuncRet;
+  uint8_t Active, BringUp;
+  int8_t Configured;
+
+  /* The scheduler leaves the bus alone from now on */
+  MutexWait(MidBusTaskMutex);
+  Active = Task->Active;
+  BringUp = Task->BringUp;
+  Configured = Task->Configured;
+  Task->Active = 0;
+  Task->Ready = 0;
+  Task->BringUp = 0;
+  MutexRelease(MidBusTaskMutex);
+
+  /* The bring-up thread takes the mutex once configured: it is joined
+   * without holding it. Cancelled if it still waits for the bus (accept,
+   * connect), it is torn down below as a bus that failed to configure */
+  if(BringUp)
+  {
+    if(Configured == 0)
+    {
+      StopThread(FuncRet, ThreadIDBUSBringUpProcess[BusInstanceID]);
+    }
+    JoinThread(FuncRet, ThreadIDBUSBringUpProcess[BusInstanceID]);
+    if(FuncRet != 0)
+    {
+      /* Handle Error */
+    }
+  }
+
+  MutexWait(MidBusTaskMutex);
+  if(Active)
+  {
+    BUSBringUpStop(BusInstanceID);
+    BusInstances[BusInstanceID].DeInit();
+#if BUS_FRAME_TIMEOUTS > 0
+    BUSTimeoutsReset(BusInstanceID);
+#endif
+    deframer_reset(&BusDeframers[BusInstanceID]);
+    TransferProtocolReassemblyReset(&BusReassembly[BusInstanceID]);
+    BUSFlowReset(BusInstanceID);
+    aggregator_reset(&BusAggregates[BusInstanceID].Frames);
+  }
+  MutexRelease(MidBusTaskMutex);
+}
+#else
 /**
   * @brief   Creates a new thread form an external module.
   * @param[in] 	Thread ID
@@ -164,26 +718,80 @@ int32_t InitBUSProcess(void)
 void LaunchBUSInstance(uint8_t BusInstanceID)
 {
   uint32_t FuncRet;
+
+  BUSBringUpStart(BusInstanceID);
   CreateThread (FuncRet, ThreadIDBUSReadProcess[BusInstanceID],THREAD_REF(BUSReadProcess), &(InstanceID[BusInstanceID]));
+  BusReadRunning[BusInstanceID] = (FuncRet != 0);
   if(!FuncRet)
   {
 	  /* Handle Erro */
   }
 }
+
+/**
+  * @brief   Stops a bus instance launched by @ref LaunchBUSInstance.
+  * @param[in] 	Thread ID
+  */
+void StopBUSInstance(uint8_t BusInstanceID)
+{
+  int32_t FuncRet;
+
+  BUSBringUpStop(BusInstanceID);
+  if(BusReadRunning[BusInstanceID])
+  {
+    /* It has finished already if the bus is in the loop or its link is lost */
+    StopThread(FuncRet, ThreadIDBUSReadProcess[BusInstanceID]);
+    JoinThread(FuncRet, ThreadIDBUSReadProcess[BusInstanceID]);
+    if(FuncRet != 0)
+    {
+      /* Handle Error */
+    }
+    BusReadRunning[BusInstanceID] = 0;
+  }
+#if BUS_EVENT_LOOP > 0
+  if(BusLoopFd[BusInstanceID] >= 0)
+  {
+    BUSLoopDetach(BusInstanceID);
+  }
+#endif
+  BUSWriteStop(BusInstanceID);
+  BusInstances[BusInstanceID].DeInit();
+#if BUS_FRAME_TIMEOUTS > 0
+  BUSTimeoutsReset(BusInstanceID);
+#endif
+  deframer_reset(&BusDeframers[BusInstanceID]);
+  TransferProtocolReassemblyReset(&BusReassembly[BusInstanceID]);
+  BUSFlowReset(BusInstanceID);
+  aggregator_reset(&BusAggregates[BusInstanceID].Frames);
+}
+#endif /* BUS_TASK_MODEL */
+
+#if MUTEX_STATS_AVAILABLE > 0
+/**
+  * @brief   Usage counters of the mutex shared by the buses to feed the MBA.
+  * @param[out] Stats Counters
+  * @param[in] 	Reset Clears the counters after the copy if not 0
+  */
+void BUSGetMBAMutexStats(OSMutexStats *Stats, uint8_t Reset)
+{
+  MutexGetStats(MidMBAMutex, Stats, Reset);
+}
+#endif
+
+#if BUS_TASK_MODEL == 0
 /**
   * @brief   Bus task instance.
   * @details This task must be called for each available bus interface. It is the
   *	     responsible of the initialization and configuration of the physical bus
   *	     interface. Furthermore, data transfer are transmitted /
   *	     received to / from the MBA instance and the linked Bus.
+  *	     In event loop mode, once the bus is configured, descriptor based
+  *	     buses are handed over to the bus loop and this thread finishes.
   * @param[in] 	argument Bus identification
   */
 OS_THREAD_TYPE BUSReadProcess (OS_THREAD_ARG argument)
 {
-  uint8_t *BusBuffer; 	/* Temporal buffer to save data from/to linked bus */
-  uint32_t FrameSize, FuncRet;	/* Saves size of the received/transmitted frames */
-  TransProtFrame *TxFrame = NULL;  /* Transfer protocol buffers to transfer data */
-  OSRetValue	RetMutex;
+  uint32_t FuncRet;
 
   /* Get BUS Identification */
   int32_t BUSId = *((int32_t *)argument);
@@ -197,65 +805,41 @@ OS_THREAD_TYPE BUSReadProcess (OS_THREAD_ARG argument)
       BusInstances[BUSId].DeInit();
       ForceBusInterfaceStop(BUSId);
       TransferProtocolUpdateInterfaceState(BUSId);
+      BUSBringUpEnd(BUSId, 0);
       ForceStopThread(FuncRet, ThreadIDBUSReadProcess[BUSId]);
   }
   else
   {
+#if BUS_EVENT_LOOP > 0
+    if(BUSLoopAttach(BUSId) == 0)
+    {
+      ForceStopThread(FuncRet, ThreadIDBUSReadProcess[BUSId]);
+    }
+#endif
     /* Once the Interface is enabled, launch the read process */
     CreateThread (FuncRet, ThreadIDBUSWriteProcess[BUSId],THREAD_REF(BUSWriteProcess),&(InstanceID[BUSId]));
+    BusWriteRunning[BUSId] = (FuncRet != 0);
     if(!FuncRet)
     {
   	/* handle Error */
     }
   }
 
+  LoopStatsOpen("BUSReadProcess", BUSId);
   while (1)
   {
     /* Check data from Bus */
     if(BusInstances[BUSId].DataAvailable() > 0)
     {
-      /* Alloc memory for temporal buffer */
-      FrameSize = BusInstances[BUSId].SizeDataAvailable();
-      BusBuffer = (uint8_t*) MemAlloc(FrameSize);
-
-      if(BusBuffer != NULL)
-      {
-        /* Read data in from the bus */
-        BusInstances[BUSId].Read(BusBuffer, FrameSize);
-
-        /* Put data into mailbox */
-        MailAlloc(TxFrame, QueueIDMBAQueue, 0);        // Allocate memory
-        if(TxFrame)
-        {
-          /* Cast data from bus into transfer protocol frame */
-          TransferProtocolCast(TxFrame, BusBuffer, FrameSize, BUSId,
-          TransferProtocolGetInterfaceType(BUSId) | FROM_BUFFER);
-
-          /* Check is the resource is available */
-          RetMutex = MutexWait(MidMBAMutex);
-          switch(RetMutex)
-          {
-            case OS_OK:
-            /* Put data into MBA buffer */
-            MailPut(QueueIDMBAQueue, TxFrame);
-            MutexRelease(MidMBAMutex);
-            break;
-            case OS_TIMEOUT:
-            break;
-            case OS_ERROR:
-            break;
-            default:
-            break;
-          }
-        }
-      }
-
-      if(BusBuffer != NULL)
-      {
-        /* Free allocated data */
-        MemFree(BusBuffer);
-        BusBuffer = NULL;
-      }
+      LoopStatsBegin();
+      BUSReadFrame(BUSId);
+      LoopStatsEnd();
+    }
+    else if(BusInstances[BUSId].Configuration(BUS_LINK_LOST, NULL) == 1)
+    {
+      /* The peer has gone: stop instead of polling a closed link */
+      BUSReadLinkLost(BUSId);
+      ForceStopThread(FuncRet, ThreadIDBUSReadProcess[BUSId]);
     }
   }
 }
@@ -269,12 +853,8 @@ OS_THREAD_TYPE BUSReadProcess (OS_THREAD_ARG argument)
   */
 OS_THREAD_TYPE BUSWriteProcess (OS_THREAD_ARG argument)
 {
-  uint8_t *BusBuffer; 	/* Temporal buffer to save data from/to linked bus */
-  uint32_t FrameSize;	/* Saves size of the received/transmitted frames */
-
-  TransProtFrame *RxFrame = NULL; /* Transfer protocol buffers to transfer data
-				    to/from the MBA instante */
   OSGlobalRet  RetMail;
+  uint32_t FuncRet;
 
   /* Get BUS Identification */
   int32_t BUSId = *((int32_t *)argument);
@@ -284,42 +864,1933 @@ OS_THREAD_TYPE BUSWriteProcess (OS_THREAD_ARG argument)
    */
   SetBusInstanceState(BUSId, BUS_ACTIVE);
   TransferProtocolUpdateInterfaceState(BUSId);
+  BUSBringUpEnd(BUSId, 1);
 
+  LoopStatsOpen("BUSWriteProcess", BUSId);
   while (1)
   {
-
-    /* if there is data in the mailbox, read it */
-    MailGet(RetMail, QueueIDBusQueue[BUSId]);
-    if (RetMail.RetValue == OS_OK)
+#if BUS_FLOW_CONTROL > 0
+    /* No credit and a queue that cannot hold the frames: they are left in
+     * it, unless the writer is being stopped */
+    if(!BUSFlowWait(BUSId) && (BusWriteStopMail[BUSId] == NULL))
+    {
+      BUSFlowService(BUSId);
+      OSDelay(BUS_FLOW_POLL_MS);
+      continue;
+    }
+#endif
+    /* Frames held wait for more only while their hold time lasts */
+    if(BUSAggregatePending(BUSId))
+    {
+      MailGetTimeout(RetMail, QueueIDBusQueue[BUSId], BUSAggregateWait(BUSId));
+      if(RetMail.RetValue != OS_OK)
+      {
+        LoopStatsBegin();
+        BUSAggregateFlush(BUSId);
+        LoopStatsEnd();
+        continue;
+      }
+    }
+    else
+    {
+      /* if there is data in the mailbox, read it */
+      MailGet(RetMail, QueueIDBusQueue[BUSId]);
+    }
+    if (RetMail.RetValue != OS_OK)
+    {
+      continue;
+    }
+    if (RetMail.Data == BusWriteStopMail[BUSId])
     {
-      RxFrame = RetMail.Data;
-      FrameSize = GetFrameSizeP(RxFrame);
+      /* Stopped by BUSWriteStop, which joins this thread */
+      MailFree(QueueIDBusQueue[BUSId], RetMail.Data);
+      break;
+    }
+    LoopStatsBegin();
+    BUSWriteMail(BUSId, RetMail.Data);
+    LoopStatsEnd();
+  }
+  ForceStopThread(FuncRet, ThreadIDBUSWriteProcess[BUSId]);
+  (void)FuncRet;
+  return NULL;
+}
+
+/**
+  * @brief  	Stops the write thread of a bus and waits until it has finished,
+  *		so the bus can be torn down. The thread is woken up by a stop
+  *		mail instead of being cancelled: a thread cancelled while it
+  *		waits on the bus queue would leave the queue locked.
+  * @param[in] 	BUSId Bus identification
+  */
+static void BUSWriteStop(int32_t BUSId)
+{
+  TransProtFrame *StopMail;
+  int32_t FuncRet;
 
-      /* Allocate memory for busbuffer */
-      BusBuffer = (uint8_t*) MemAlloc(FrameSize);
+  if(!BusWriteRunning[BUSId])
+  {
+    return;
+  }
 
-      if(BusBuffer != NULL)
-      {
-        /* Cast from transfer protocol to buffer format */
-        FrameSize = TransferProtocolCast(RxFrame, BusBuffer, FrameSize, BUSId,
-        TransferProtocolGetInterfaceType(BUSId) | TO_BUFFER);
+  /* A stop interrupted by the cancel of the read thread is not sent twice */
+  if(BusWriteStopMail[BUSId] == NULL)
+  {
+    do
+    {
+      MailAlloc(StopMail, QueueIDBusQueue[BUSId], OS_WAIT_FOREVER);
+    }while(StopMail == NULL);
+    TransferProtocolFrameInit(StopMail);
+    BusWriteStopMail[BUSId] = StopMail;
+    MailPutPrio(QueueIDBusQueue[BUSId], StopMail, TP_PRIORITY_CONTROL);
+  }
 
-        /* Add new frame into Bus buffer to send it */
-        BusInstances[BUSId].Write(BusBuffer, FrameSize);
+  JoinThread(FuncRet, ThreadIDBUSWriteProcess[BUSId]);
+  if(FuncRet != 0)
+  {
+    /* Handle Error */
+  }
+  BusWriteStopMail[BUSId] = NULL;
+  BusWriteRunning[BUSId] = 0;
+}
 
-        /* Free allocated data */
-        MailFree(QueueIDBusQueue[BUSId], RxFrame);
+/**
+  * @brief  	Stops a bus whose peer has gone, from its read thread. The
+  *		write thread is stopped first, so nothing writes into the bus
+  *		while it is torn down.
+  * @param[in] 	BUSId Bus identification
+  */
+static void BUSReadLinkLost(int32_t BUSId)
+{
+  BUSWriteStop(BUSId);
+  BUSLinkLost(BUSId);
+}
+#else
+/**
+  * @brief  	Bus task scheduler.
+  * @details	Runs the read and write tasks of every launched bus in turn.
+  *		Tasks return at their wait points instead of blocking, so a
+  *		single thread and stack serve all the buses. When no task has
+  *		made progress in a round, the thread sleeps until a bus or a
+  *		bus queue is readable, or for a tick on targets that cannot
+  *		wait on them.
+  * @param[in] 	argument Not used
+  */
+OS_THREAD_TYPE BUSTaskProcess (OS_THREAD_ARG argument)
+{
+  BusTask *Task;
+  int32_t BUSId;
+  uint8_t Progress;
+  char Ret;
 
-        if(BusBuffer != NULL)
+  (void)argument;
+  LoopStatsOpen("BUSTaskProcess", -1);
+  while (1)
+  {
+    LoopStatsBegin();
+    Progress = 0;
+    for(BUSId = 0; BUSId < BUS_INSTANCES; BUSId++)
+    {
+      Task = &BusTasks[BUSId];
+      MutexWait(MidBusTaskMutex);
+      if(Task->Active)
+      {
+        Ret = BUSTaskRead(&Task->Read, BUSId);
+        if(!PT_SCHEDULE(Ret))
         {
-          /* Free allocated data */
-          MemFree(BusBuffer);
-          BusBuffer = NULL;
+          Task->Active = 0;
+          Task->Ready = 0;
         }
+        Progress |= (Ret != PT_WAITING);
+      }
+      if(Task->Ready)
+      {
+        Progress |= (BUSTaskWrite(&Task->Write, BUSId) != PT_WAITING);
       }
+      MutexRelease(MidBusTaskMutex);
     }
-  }
+    LoopStatsEnd();
+
+    if(!Progress)
+    {
+      BUSTaskIdle();
+    }
+  }
+}
+
+/**
+  * @brief  	Bus configuration thread.
+  * @details	Configures a bus launched in task model and finishes. Buses
+  *		that wait for a peer (socket accept) or enumerate slowly do it
+  *		at the same time, without holding the scheduler.
+  * @param[in] 	argument Bus identification
+  */
+OS_THREAD_TYPE BUSBringUpProcess (OS_THREAD_ARG argument)
+{
+  int32_t BUSId = *((int32_t *)argument);
+  BusTask *Task = &BusTasks[BUSId];
+  int8_t Configured = 1;
+  int Fd = -1;
+  uint32_t FuncRet;
+
+  BusInstances[BUSId].Init();
+  if(BusInstances[BUSId].Configuration(1,0) < 0)
+  {
+    BusInstances[BUSId].DeInit();
+    Configured = -1;
+  }
+  else
+  {
+    /* Shared thread: reads must not block */
+    BusInstances[BUSId].Configuration(BUS_GET_FD, &Fd);
+  }
+
+  MutexWait(MidBusTaskMutex);
+  Task->Fd = Fd;
+  Task->Configured = Configured;
+  MutexRelease(MidBusTaskMutex);
+  ForceStopThread(FuncRet, ThreadIDBUSBringUpProcess[BUSId]);
+  (void)FuncRet;
+  return NULL;
+}
+
+/**
+  * @brief  	Bus read task.
+  * @details	Waits for the bring-up thread to configure the bus. Then
+  *		serves a frame each time the bus has data.
+  * @param[in] 	pt Task position
+  * @param[in] 	BUSId Bus identification
+  * @retval	PT_WAITING, PT_YIELDED or PT_EXITED when the bus is stopped
+  */
+static PT_THREAD(BUSTaskRead(struct pt *pt, int32_t BUSId))
+{
+  BusTask *Task = &BusTasks[BUSId];
+
+  PT_BEGIN(pt);
+
+  PT_WAIT_UNTIL(pt, Task->Configured != 0);
+  if(Task->Configured < 0)
+  {
+    ForceBusInterfaceStop(BUSId);
+    TransferProtocolUpdateInterfaceState(BUSId);
+    BUSBringUpEnd(BUSId, 0);
+    PT_EXIT(pt);
+  }
+
+  Task->Ready = 1;
+  SetBusInstanceState(BUSId, BUS_ACTIVE);
+  TransferProtocolUpdateInterfaceState(BUSId);
+  BUSBringUpEnd(BUSId, 1);
+
+  while (1)
+  {
+    PT_WAIT_UNTIL(pt, (Task->Event = BUSTaskPoll(BUSId)) != 0);
+    if(Task->Event < 0)
+    {
+      /* The peer has gone: stop instead of polling a closed link */
+      BUSLinkLost(BUSId);
+      PT_EXIT(pt);
+    }
+    BUSReadFrame(BUSId);
+    PT_YIELD(pt);
+  }
+
+  PT_END(pt);
+}
+
+/**
+  * @brief  	Bus write task. Writes a frame each time the bus queue has one.
+  * @param[in] 	pt Task position
+  * @param[in] 	BUSId Bus identification
+  * @retval	PT_WAITING or PT_YIELDED
+  */
+static PT_THREAD(BUSTaskWrite(struct pt *pt, int32_t BUSId))
+{
+  BusTask *Task = &BusTasks[BUSId];
+
+  PT_BEGIN(pt);
+
+  while (1)
+  {
+    PT_WAIT_UNTIL(pt, BUSTaskMail(BUSId));
+    BUSWriteMail(BUSId, Task->Mail.Data);
+    PT_YIELD(pt);
+  }
+
+  PT_END(pt);
+}
+
+/**
+  * @brief  	Read task wait point.
+  * @param[in] 	BUSId Bus identification
+  * @retval	1 if the bus has data, -1 if its link is lost, 0 otherwise
+  */
+static int8_t BUSTaskPoll(int32_t BUSId)
+{
+  if(BusInstances[BUSId].DataAvailable() > 0)
+  {
+    return 1;
+  }
+  if(BusInstances[BUSId].Configuration(BUS_LINK_LOST, NULL) == 1)
+  {
+    return -1;
+  }
+  return 0;
+}
+
+/**
+  * @brief  	Write task wait point. Takes a frame from the bus queue.
+  * @param[in] 	BUSId Bus identification
+  * @retval	1 if a frame has been taken, 0 if the queue is empty
+  */
+static uint8_t BUSTaskMail(int32_t BUSId)
+{
+#if BUS_FLOW_CONTROL > 0
+  /* No credit: the frames are left in the queue */
+  if(!BUSFlowWait(BUSId))
+  {
+    BUSFlowService(BUSId);
+    return 0;
+  }
+#endif
+  MailGetTimeout(BusTasks[BUSId].Mail, QueueIDBusQueue[BUSId], 0);
+  if(BusTasks[BUSId].Mail.RetValue != OS_OK)
+  {
+    /* The scheduler may sleep: the frames held go now */
+    BUSAggregateFlush(BUSId);
+    return 0;
+  }
+  return 1;
+}
+
+/**
+  * @brief  	Sleeps the scheduler when no task can run.
+  * @details	Where the mail queues have descriptors, waits until a bus or
+  *		a bus queue is readable. Buses without descriptor are polled
+  *		every BUS_TASK_POLL_MS.
+  */
+static void BUSTaskIdle(void)
+{
+#ifdef MailQueueFd
+  struct pollfd Fds[2 * BUS_INSTANCES];
+  nfds_t Count = 0;
+  int Timeout = BUS_TASK_IDLE_MS;
+  int32_t BUSId;
+
+  MutexWait(MidBusTaskMutex);
+  for(BUSId = 0; BUSId < BUS_INSTANCES; BUSId++)
+  {
+    if(!BusTasks[BUSId].Ready)
+    {
+      continue;
+    }
+    if(BusTasks[BUSId].Fd < 0)
+    {
+      Timeout = BUS_TASK_POLL_MS;
+    }
+    else
+    {
+      Fds[Count].fd = BusTasks[BUSId].Fd;
+      Fds[Count].events = POLLIN;
+      Count++;
+    }
+    Fds[Count].fd = MailQueueFd(QueueIDBusQueue[BUSId]);
+    Fds[Count].events = POLLIN;
+    if(Fds[Count].fd < 0)
+    {
+      Timeout = BUS_TASK_POLL_MS;
+    }
+    else
+    {
+      Count++;
+    }
+  }
+  MutexRelease(MidBusTaskMutex);
+
+  poll(Fds, Count, Timeout);
+#else
+  OSDelay(BUS_TASK_POLL_MS);
+#endif
+}
+#endif /* BUS_TASK_MODEL */
+
+#if BUS_EVENT_LOOP > 0
+/**
+  * @brief  	Bus loop thread.
+  * @details	Waits for the readiness of all the attached buses and of their
+  *		mail queues, and serves them without blocking. Shards also
+  *		wait for the frames routed to them by the other shards.
+  * @param[in] 	argument Loop. See @ref BusLoops
+  */
+OS_THREAD_TYPE BUSLoopProcess (OS_THREAD_ARG argument)
+{
+  BusShard *Shard = (BusShard *)argument;
+
+#if BUS_SHARDS > 0
+  BusCurrentShard = Shard;
+  TransferProtocolGetRouteView(&Shard->Route);
+#endif
+  LoopStatsOpen("BUSLoopProcess", (int)(Shard - BusLoops));
+  evloop_run(&Shard->Loop);
+  return NULL;
+}
+#endif
+
+#else /* OS_ACTIVE */
+
+/**
+  * @brief  Initializes BUS App process
+  * @details Super loop: there is nothing to create, buses are configured when
+  *	     the MBA launches them.
+  * @retval @ref BusInstanceRet
+  */
+int32_t InitBUSProcess(void)
+{
+  uint8_t BUSId;
+
+  for(BUSId = 0; BUSId < BUS_INSTANCES; BUSId++)
+  {
+    BusActive[BUSId] = 0;
+  }
+  BUSTimeoutsInit();
+  BUSDeframersInit();
+  BUSLatencyInit();
+  BUSBringUpInit();
+  return INSTANCE_OK;
+}
+
+/**
+  * @brief   Configures a bus and adds it to the super loop.
+  * @details The configuration runs to completion, so buses that wait for a
+  *	     peer (socket accept) hold the loop until it arrives. Buses able to
+  *	     work without blocking are switched to that mode.
+  * @param[in] 	Bus ID
+  */
+void LaunchBUSInstance(uint8_t BusInstanceID)
+{
+  int BusFd;
+
+  BUSBringUpStart(BusInstanceID);
+  BusInstances[BusInstanceID].Init();
+  if(BusInstances[BusInstanceID].Configuration(1,0) < 0)
+  {
+    BusInstances[BusInstanceID].DeInit();
+    ForceBusInterfaceStop(BusInstanceID);
+    TransferProtocolUpdateInterfaceState(BusInstanceID);
+    BUSBringUpEnd(BusInstanceID, 0);
+    return;
+  }
+
+  /* Polled from the loop: reads must not block */
+  BusInstances[BusInstanceID].Configuration(BUS_GET_FD, &BusFd);
+
+  BusActive[BusInstanceID] = 1;
+  SetBusInstanceState(BusInstanceID, BUS_ACTIVE);
+  TransferProtocolUpdateInterfaceState(BusInstanceID);
+  BUSBringUpEnd(BusInstanceID, 1);
+}
+
+/**
+  * @brief   Removes a bus from the super loop.
+  * @param[in] 	Bus ID
+  */
+void StopBUSInstance(uint8_t BusInstanceID)
+{
+  BUSBringUpStop(BusInstanceID);
+  if(BusActive[BusInstanceID])
+  {
+    BusActive[BusInstanceID] = 0;
+    BusInstances[BusInstanceID].DeInit();
+    BUSTimeoutsReset(BusInstanceID);
+    deframer_reset(&BusDeframers[BusInstanceID]);
+    TransferProtocolReassemblyReset(&BusReassembly[BusInstanceID]);
+  }
+}
+
+/**
+  * @brief   Super loop bus step.
+  * @details Polls every active bus. Each received frame is processed by the MBA
+  *	     and written to its destination bus before this function returns.
+  *	     Frames ended by a timeout are processed when the step finds it
+  *	     expired.
+  */
+void BUSProcessStep(void)
+{
+  uint8_t BUSId;
+  uint32_t Reads;
+
+  BUSWheelAdvance();
+
+  for(BUSId = 0; BUSId < BUS_INSTANCES; BUSId++)
+  {
+    /* Bounded, so a busy bus cannot starve the others */
+    for(Reads = 0; BusActive[BUSId] && (Reads < BUS_LOOP_MAX_FRAMES); Reads++)
+    {
+      if(BusInstances[BUSId].DataAvailable() > 0)
+      {
+        BUSReadFrame(BUSId);
+      }
+      else
+      {
+        if(BusInstances[BUSId].Configuration(BUS_LINK_LOST, NULL) == 1)
+        {
+          BusActive[BUSId] = 0;
+          BUSLinkLost(BUSId);
+        }
+        break;
+      }
+    }
+  }
+}
+
+/**
+  * @brief   Writes a frame into a bus. Super loop replacement of the bus queues.
+  * @param[in] 	BusInstanceID Bus ID
+  * @param[in] 	Frame Frame to be written. Its data is released
+  */
+void BUSDirectWrite(uint8_t BusInstanceID, TransProtFrame *Frame)
+{
+  if((BusInstanceID < BUS_INSTANCES) && BusActive[BusInstanceID])
+  {
+    BUSWriteFrame(BusInstanceID, Frame);
+  }
+  else
+  {
+    TransferProtocolFrameFree(Frame);
+  }
+}
+#endif /* OS_ACTIVE */
+
+/*********************************************************************************************/
+/*****	STATIC FUNCTIONS 	    **********************************************************/
+/*********************************************************************************************/
+
+/**
+  * @brief  	Reads the data signaled by DataAvailable. The frames of a MBA
+  *		bridge are split out of it by their size field, unless the bus
+  *		detects them by timeout. On end buses the data is a frame.
+  * @param[in] 	BUSId Bus identification
+  */
+static void BUSReadFrame(int32_t BUSId)
+{
+  uint8_t *BusBuffer; 	/* Temporal buffer to save data from/to linked bus */
+  uint32_t FrameSize;	/* Saves size of the received/transmitted frames */
+
+  /* Alloc memory for temporal buffer */
+  FrameSize = BusInstances[BUSId].SizeDataAvailable();
+  BusBuffer = (uint8_t*) MemAlloc(FrameSize);
+
+  if(BusBuffer != NULL)
+  {
+    /* Read data in from the bus */
+    BusInstances[BUSId].Read(BusBuffer, FrameSize);
+
+#if BUS_FRAME_TIMEOUTS > 0
+    /* The buffer is kept until the frame ends */
+    if(BUSGatherFrame(BUSId, BusBuffer, FrameSize))
+    {
+      return;
+    }
+#endif
+    if(TransferProtocolGetInterfaceType(BUSId) == MBA_BRIDGE)
+    {
+      /* The frames are delivered as they are completed */
+      deframer_feed(&BusDeframers[BUSId], BusBuffer, FrameSize, BUSDeframed, &(InstanceID[BUSId]));
+      return;
+    }
+    /* The frame takes the buffer over */
+    BUSDeliverFrame(BUSId, BusBuffer, FrameSize);
+  }
+}
+
+/**
+  * @brief  	Deframer callback: delivers a frame of a MBA bridge
+  * @param[in] 	Arg Bus identification
+  * @param[in] 	Frame Frame, allocated with MemAlloc. It is passed on
+  * @param[in] 	Size Frame size
+  */
+static void BUSDeframed(void *Arg, uint8_t *Frame, uint32_t Size)
+{
+  BUSDeliverFrame(*((int32_t *)Arg), Frame, Size);
+}
+
+/**
+  * @brief  	Gathers the fragments read from a MBA bridge. The credit of a
+  *		frame lost goes back, as for a corrupt frame.
+  * @param[in] 	BUSId Bus identification
+  * @param[in,out] BusBuffer Data read. It is taken and replaced by the frame
+  * @param[in,out] FrameSize Size of the data, then of the frame
+  * @return 	1 if there is a whole frame to deliver
+  */
+static uint8_t BUSReassemble(int32_t BUSId, uint8_t **BusBuffer, uint32_t *FrameSize)
+{
+  TPReassembly *Reassembly = &BusReassembly[BUSId];
+  uint32_t Dropped = Reassembly->Dropped;
+  int32_t Whole;
+
+  if(TransferProtocolGetInterfaceType(BUSId) != MBA_BRIDGE)
+  {
+    return 1;
+  }
+  Whole = TransferProtocolReassemble(Reassembly, BusBuffer, FrameSize);
+#if BUS_FLOW_CONTROL > 0
+  for(; Dropped != Reassembly->Dropped; Dropped++)
+  {
+    BUSFlowRelease(BUSId);
+  }
+#else
+  (void)Dropped;
+#endif
+  return (Whole > 0);
+}
+
+/**
+  * @brief  	Puts a frame read from a bus into the MBA queue. In the super loop
+  *		the frame is processed by the MBA right away.
+  * @param[in] 	BUSId Bus identification
+  * @param[in] 	BusBuffer Frame as read from the bus, allocated with MemAlloc.
+  *		The frame is a view of it and releases it
+  * @param[in] 	FrameSize Frame size
+  */
+static void BUSDeliverFrame(int32_t BUSId, uint8_t *BusBuffer, uint32_t FrameSize)
+{
+#if OS_ACTIVE != 0
+  TransProtFrame *TxFrame = NULL;  /* Transfer protocol buffers to transfer data */
+  OSRetValue	RetMutex;
+#endif
+  TransProtFrame RxFrame;
+  uint64_t RxTime = OSGetTimeStamp();
+
+  if(!BUSReassemble(BUSId, &BusBuffer, &FrameSize))
+  {
+    return;
+  }
+
+#if OS_ACTIVE == 0
+  /* Direct hand over: processed and written before returning */
+  if(TransferProtocolCast(&RxFrame, BusBuffer, FrameSize, BUSId,
+     TransferProtocolGetInterfaceType(BUSId) | FROM_BUFFER | IN_PLACE) >= 0)
+  {
+    BUSStampFrame(BUSId, &RxFrame, RxTime);
+    MBAProcessFrame(&RxFrame);
+  }
+#else
+#if BUS_SHARDS > 0
+  /* Read by a shard: the shard routes it */
+  if(BusCurrentShard != NULL)
+  {
+    BUSShardDeliver(BusCurrentShard, BUSId, BusBuffer, FrameSize, RxTime);
+    return;
+  }
+#endif
+  /* Corrupt frames are dropped before the mail is allocated. The buffer has
+   * been released */
+  if(TransferProtocolCast(&RxFrame, BusBuffer, FrameSize, BUSId,
+     TransferProtocolGetInterfaceType(BUSId) | FROM_BUFFER | IN_PLACE) < 0)
+  {
+    BUSFlowRelease(BUSId);
+    return;
+  }
+  BUSStampFrame(BUSId, &RxFrame, RxTime);
+  if(BUSFlowReceive(BUSId, &RxFrame))
+  {
+    return;
+  }
+
+  /* Put data into mailbox */
+  MailAlloc(TxFrame, QueueIDMBAQueue, 0);        // Allocate memory
+  if(TxFrame == NULL)
+  {
+    BUSFlowRelease(RxFrame.CreditInterface);
+    TransferProtocolFrameFree(&RxFrame);
+  }
+  else
+  {
+    *TxFrame = RxFrame;
+    LoopStatsFrame(TxFrame);
+
+    /* Check is the resource is available */
+    RetMutex = MutexWait(MidMBAMutex);
+    switch(RetMutex)
+    {
+      case OS_OK:
+      /* Put data into MBA buffer. Control frames overtake data frames */
+      MailPutPrio(QueueIDMBAQueue, TxFrame, TransferProtocolGetPriority(TxFrame));
+      MutexRelease(MidMBAMutex);
+      TxFrame = NULL;
+      break;
+      case OS_TIMEOUT:
+      break;
+      case OS_ERROR:
+      break;
+      default:
+      break;
+    }
+  }
+
+  if(TxFrame != NULL)
+  {
+    /* The frame has not been delivered */
+    BUSFlowRelease(TxFrame->CreditInterface);
+    TransferProtocolFrameFree(TxFrame);
+    MailFree(QueueIDMBAQueue, TxFrame);
+  }
+#endif
+}
+
+/**
+  * @brief  	Casts a frame of the bus queue and writes it into the bus. The frame
+  *		data is released, the frame itself belongs to the caller.
+  * @param[in] 	BUSId Bus identification
+  * @param[in] 	RxFrame Frame taken from the bus queue
+  */
+static void BUSWriteFrame(int32_t BUSId, TransProtFrame *RxFrame)
+{
+  uint8_t *BusBuffer; 	/* Temporal buffer to save data from/to linked bus */
+  uint32_t FrameSize;	/* Saves size of the received/transmitted frames */
+  uint8_t InPlace;	/* The frame is written from the buffer it was read into */
+
+  LoopStatsFrame(RxFrame);
+  FrameSize = GetFrameSizeP(RxFrame);
+
+  /* Views of a bus buffer are written from it; the rest needs a new one */
+  BusBuffer = TransferProtocolFrameBuffer(RxFrame, TransferProtocolGetInterfaceType(BUSId));
+  InPlace = (BusBuffer != NULL);
+  if(!InPlace)
+  {
+    BusBuffer = (uint8_t*) MemAlloc(FrameSize);
+  }
+
+  if(BusBuffer != NULL)
+  {
+#if BUS_FLOW_CONTROL > 0
+    BUSFlowStamp(BUSId, RxFrame);
+#endif
+    /* Cast from transfer protocol to buffer format */
+    FrameSize = TransferProtocolCast(RxFrame, BusBuffer, FrameSize, BUSId,
+    TransferProtocolGetInterfaceType(BUSId) | TO_BUFFER);
+
+    /* Add new frame into Bus buffer to send it */
+    BUSWriteFragments(BUSId, BusBuffer, FrameSize);
+    BUSLatencyUpdate(BUSId, RxFrame);
+
+    /* Free allocated data */
+    if(!InPlace)
+    {
+      MemFree(BusBuffer);
+    }
+    BusBuffer = NULL;
+  }
+#if BUS_FLOW_CONTROL > 0
+  /* Written or lost, the frame has left the node */
+  BUSFlowRelease(RxFrame->CreditInterface);
+#endif
+  TransferProtocolFrameFree(RxFrame);
+}
+
+/**
+  * @brief  	Stamps a frame read from a bus. Frames of end buses also carry
+  *		their capture time in us in the header.
+  * @param[in] 	BUSId Bus identification
+  * @param[out] Frame Frame just cast
+  * @param[in] 	RxTime Time stamp of its read
+  */
+static void BUSStampFrame(int32_t BUSId, TransProtFrame *Frame, uint64_t RxTime)
+{
+  Frame->RxTime = RxTime;
+  if(TransferProtocolGetInterfaceType(BUSId) == END_BUS)
+  {
+    Frame->Header.TimeStamp = (uint32_t)OS_TIMESTAMP_TO_US(RxTime);
+  }
+}
+
+/**
+  * @brief  	Clears the latency of the buses and attaches their registers
+  */
+static void BUSLatencyInit(void)
+{
+  int32_t BUSId;
+
+  for(BUSId = 0; BUSId < BUS_INSTANCES; BUSId++)
+  {
+    latstats_reset(&BusLatency[BUSId]);
+    AttachVariableToRegister(BUS_REGISTER(BUSId, BUS_LATENCY_REG),
+                             &BusLatency[BUSId], sizeof(latstats));
+  }
+}
+
+/**
+  * @brief  	Adds a frame just written into a bus to its latency. Frames made
+  *		by the node are not counted.
+  * @param[in] 	BUSId Bus identification
+  * @param[in] 	Frame Frame written
+  */
+static void BUSLatencyUpdate(int32_t BUSId, const TransProtFrame *Frame)
+{
+  uint64_t Marks[LATSTATS_MARKS];
+
+  if(Frame->RxTime == 0)
+  {
+    return;
+  }
+  Marks[0] = OS_TIMESTAMP_TO_US(Frame->RxTime);
+  Marks[1] = OS_TIMESTAMP_TO_US(Frame->MBATime);
+  Marks[2] = OS_TIMESTAMP_TO_US(Frame->OutTime);
+  Marks[3] = OS_TIMESTAMP_TO_US(OSGetTimeStamp());
+  latstats_add(&BusLatency[BUSId], Marks);
+}
+
+/**
+  * @brief  	Writes a frame cast into a bus. Frames of a MBA bridge larger
+  *		than its fragment size go in fragments, one after the other, so
+  *		that the peer gathers them in order.
+  * @param[in] 	BUSId Bus identification
+  * @param[in] 	Data Frame in buffer format
+  * @param[in] 	Size Frame size
+  */
+static void BUSWriteFragments(int32_t BUSId, uint8_t *Data, uint32_t Size)
+{
+  uint32_t FragmentSize = BusFragmentSize[BUSId];
+  uint8_t *Fragment;
+  uint32_t Index;
+
+  if((Size <= FragmentSize) || (FragmentSize <= HEADER_SIZE + CRC_SIZE) ||
+     (TransferProtocolGetInterfaceType(BUSId) != MBA_BRIDGE))
+  {
+    BUSWriteData(BUSId, Data, Size);
+    return;
+  }
+
+  /* A frame that cannot be split is lost, as one that cannot be cast */
+  Fragment = (uint8_t *)MemAlloc(FragmentSize);
+  if(Fragment == NULL)
+  {
+    return;
+  }
+  for(Index = 0; (Size = TransferProtocolFragment(Fragment, Data, Index, FragmentSize)) != 0; Index++)
+  {
+    BUSWriteData(BUSId, Fragment, Size);
+  }
+  MemFree(Fragment);
+}
+
+/**
+  * @brief  	Writes a frame cast into a bus. The frames of a MBA bridge may be
+  *		held to go in a single write with the next ones.
+  * @param[in] 	BUSId Bus identification
+  * @param[in] 	Data Frame in buffer format
+  * @param[in] 	Size Frame size
+  */
+static void BUSWriteData(int32_t BUSId, uint8_t *Data, uint32_t Size)
+{
+#if BUS_AGGREGATION > 0
+  BusAggregate *Aggregate = &BusAggregates[BUSId];
+
+  if((Aggregate->Size != 0) || (Aggregate->Frames.len != 0))
+  {
+    aggregator_add(&Aggregate->Frames, Data, Size,
+                   (TransferProtocolGetInterfaceType(BUSId) == MBA_BRIDGE) ? Aggregate->Size : 0,
+                   OS_TIMESTAMP_TO_US(OSGetTimeStamp()), Aggregate->Hold,
+                   BUSAggregateWrite, &(InstanceID[BUSId]));
+    return;
+  }
+#endif
+  BusInstances[BUSId].Write(Data, Size);
+}
+
+#if OS_ACTIVE != 0
+/**
+  * @brief  	Writes a frame taken from the bus queue and releases its mail.
+  *		The flow control kick is served instead.
+  * @param[in] 	BUSId Bus identification
+  * @param[in] 	Frame Mail of the bus queue
+  */
+static void BUSWriteMail(int32_t BUSId, TransProtFrame *Frame)
+{
+#if BUS_FLOW_CONTROL > 0
+  if(BUSFlowKicked(BUSId, Frame))
+  {
+    return;
+  }
+#endif
+  BUSWriteFrame(BUSId, Frame);
+  MailFree(QueueIDBusQueue[BUSId], Frame);
+}
+#endif
+
+#if BUS_AGGREGATION > 0
+/**
+  * @brief  	Attaches the aggregation registers. Frames go alone unless
+  *		BUS_AGGREGATE_SIZE says otherwise.
+  */
+static void BUSAggregateInit(void)
+{
+  int32_t BUSId;
+
+  for(BUSId = 0; BUSId < BUS_INSTANCES; BUSId++)
+  {
+    BusAggregates[BUSId].Size = BUS_AGGREGATE_SIZE;
+    BusAggregates[BUSId].Hold = BUS_AGGREGATE_HOLD;
+    aggregator_init(&BusAggregates[BUSId].Frames);
+    AttachVariableToRegister(BUS_REGISTER(BUSId, BUS_AGGREGATE_SIZE_REG),
+                             &BusAggregates[BUSId].Size, sizeof(uint16_t));
+    AttachVariableToRegister(BUS_REGISTER(BUSId, BUS_AGGREGATE_HOLD_REG),
+                             &BusAggregates[BUSId].Hold, sizeof(uint16_t));
+  }
+}
+
+/**
+  * @brief  	Aggregator callback: writes frames packed into a bus
+  * @param[in] 	Arg Bus identification
+  * @param[in] 	Data Frames
+  * @param[in] 	Size Size of the frames
+  */
+static void BUSAggregateWrite(void *Arg, const uint8_t *Data, uint32_t Size)
+{
+  BusInstances[*((int32_t *)Arg)].Write((uint8_t *)Data, Size);
+}
+
+/**
+  * @brief  	Writes the frames held for a bus. Called by its writer when it
+  *		runs out of frames.
+  * @param[in] 	BUSId Bus identification
+  */
+static void BUSAggregateFlush(int32_t BUSId)
+{
+  aggregator_flush(&BusAggregates[BUSId].Frames, BUSAggregateWrite, &(InstanceID[BUSId]));
+}
+
+#if BUS_TASK_MODEL == 0
+/**
+  * @brief  	Tells whether a bus has frames held
+  * @param[in] 	BUSId Bus identification
+  * @return 	1 if its writer has to flush them
+  */
+static uint8_t BUSAggregatePending(int32_t BUSId)
+{
+  return (BusAggregates[BUSId].Frames.len != 0);
+}
+
+/**
+  * @brief  	Time the writer of a bus may wait for more frames. Rounded down
+  *		to the ms of the queue timeouts, so the hold is never exceeded.
+  * @param[in] 	BUSId Bus identification
+  * @return 	ms, 0 if the frames held are due
+  */
+static uint32_t BUSAggregateWait(int32_t BUSId)
+{
+  return aggregator_wait_us(&BusAggregates[BUSId].Frames, OS_TIMESTAMP_TO_US(OSGetTimeStamp()),
+                            BusAggregates[BUSId].Hold) / 1000;
+}
+#endif
+#endif
+
+#if BUS_FLOW_CONTROL > 0
+/**
+  * @brief  	Attaches the flow window registers. Flow control starts off
+  *		unless BUS_FLOW_WINDOW says otherwise.
+  */
+static void BUSFlowInit(void)
+{
+  int32_t BUSId;
+  int32_t FuncRet;
+
+#if BUS_INSTANCES > 0
+  CreateMutex(FuncRet, MidBusFlowMutex[BUS_ID_1], MUTEX_REF(BusFlowMutex_1));
+#endif
+#if BUS_INSTANCES > 1
+  CreateMutex(FuncRet, MidBusFlowMutex[BUS_ID_2], MUTEX_REF(BusFlowMutex_2));
+#endif
+#if BUS_INSTANCES > 2
+  CreateMutex(FuncRet, MidBusFlowMutex[BUS_ID_3], MUTEX_REF(BusFlowMutex_3));
+#endif
+  (void)FuncRet;
+  for(BUSId = 0; BUSId < BUS_INSTANCES; BUSId++)
+  {
+    BusFlows[BUSId].Window = BUS_FLOW_WINDOW;
+    BusFlows[BUSId].Applied = -1;
+    AttachVariableToRegister(BUS_REGISTER(BUSId, BUS_FLOW_WINDOW_REG),
+                             &BusFlows[BUSId].Window, sizeof(uint16_t));
+  }
+}
+
+/**
+  * @brief  	Stops the flow control of a bus whose link is lost. The frames
+  *		waiting for credit are taken again. The window is applied
+  *		again with the next frame, when the link is back.
+  * @param[in] 	BUSId Bus identification
+  */
+static void BUSFlowReset(int32_t BUSId)
+{
+  BusFlow *Flow = &BusFlows[BUSId];
+
+  BUS_FLOW_LOCK(BUSId);
+  Flow->Active = 0;
+  Flow->Applied = -1;
+  BUSFlowHold(BUSId);
+  BUS_FLOW_UNLOCK(BUSId);
+}
+
+/**
+  * @brief  	Applies a new window. Both ends start over: each one may send
+  *		a window of frames. Called with the flow mutex taken.
+  * @param[in] 	BUSId Bus identification
+  */
+static void BUSFlowApply(int32_t BUSId)
+{
+  BusFlow *Flow = &BusFlows[BUSId];
+  uint8_t Changed = 0;
+
+  if(Flow->Applied != (int32_t)Flow->Window)
+  {
+    Changed = 1;
+    Flow->Applied = Flow->Window;
+    Flow->Credits = (Flow->Window > TP_FLOW_WINDOW_MAX) ? TP_FLOW_WINDOW_MAX : (uint8_t)Flow->Window;
+    Flow->Sent = 0;
+    Flow->Limit = Flow->Credits;
+    Flow->Released = 0;
+    Flow->Advertised = 0;
+    if((Flow->Credits != 0) && (Flow->Kick == NULL))
+    {
+      MailAlloc(Flow->Kick, QueueIDBusQueue[BUSId], 0);
+      if(Flow->Kick == NULL)
+      {
+        /* Retried with the next frame */
+        Flow->Applied = -1;
+      }
+      else
+      {
+        TransferProtocolFrameInit(Flow->Kick);
+      }
+    }
+  }
+  Flow->Active = (Flow->Credits != 0) && (Flow->Kick != NULL) &&
+                 (TransferProtocolGetInterfaceType(BUSId) == MBA_BRIDGE);
+
+  /* A new window: the frames waiting may go */
+  if(Changed && Flow->Waiting)
+  {
+    BUSFlowKick(BUSId);
+  }
+}
+
+#if BUS_SHARDS > 0
+/**
+  * @brief  	Tells whether a bus runs flow control. Read without the mutex:
+  *		a new window is applied with the next frame written, which
+  *		takes its credit then.
+  * @param[in] 	BUSId Bus identification
+  * @return 	1 if the frames of the bus need credit
+  */
+static uint8_t BUSFlowActive(int32_t BUSId)
+{
+  return BusFlows[BUSId].Active;
+}
+#endif
+
+/**
+  * @brief  	Takes the credits of a frame read from a MBA bridge and marks
+  *		the frame so that its credit goes back once it leaves the node.
+  * @param[in] 	BUSId Bus identification
+  * @param[in,out] Frame Frame just cast
+  * @return 	1 if the frame only carried credits. Its data has been released
+  */
+static uint8_t BUSFlowReceive(int32_t BUSId, TransProtFrame *Frame)
+{
+  BusFlow *Flow = &BusFlows[BUSId];
+  uint8_t Credit;
+
+  if(TransferProtocolGetInterfaceType(BUSId) != MBA_BRIDGE)
+  {
+    return 0;
+  }
+  Credit = (Frame->Header.Command == FLOW_CONTROL_COMMAND);
+
+  BUS_FLOW_LOCK(BUSId);
+  BUSFlowApply(BUSId);
+  if(Flow->Active)
+  {
+    if(Frame->Header.FlowControl & TP_FLOW_CREDITS)
+    {
+      Flow->Limit = Frame->Header.FlowControl & TP_FLOW_LIMIT_MASK;
+      if(Flow->Waiting && BUS_FLOW_CAN_SEND(Flow))
+      {
+        BUSFlowKick(BUSId);
+      }
+    }
+    if(!Credit)
+    {
+      Frame->CreditInterface = (int8_t)BUSId;
+    }
+  }
+  BUS_FLOW_UNLOCK(BUSId);
+
+  if(Credit)
+  {
+    TransferProtocolFrameFree(Frame);
+  }
+  return Credit;
+}
+
+/**
+  * @brief  	Returns the credit of a frame of a MBA bridge that has left the
+  *		node: written, consumed or dropped.
+  * @param[in] 	BUSId Bridge the frame came from. Ignored if negative
+  */
+void BUSFlowRelease(int32_t BUSId)
+{
+  if((BUSId < 0) || (BUSId >= BUS_INSTANCES))
+  {
+    return;
+  }
+  BUS_FLOW_LOCK(BUSId);
+  BUSFlowCredit(BUSId);
+  BUS_FLOW_UNLOCK(BUSId);
+}
+
+/**
+  * @brief  	Counts a credit released and has the writer send the new limit
+  *		once half the window is due. Called with the flow mutex taken.
+  * @param[in] 	BUSId Bus identification. Ignored if negative
+  */
+static void BUSFlowCredit(int32_t BUSId)
+{
+  BusFlow *Flow;
+
+  if((BUSId < 0) || (BUSId >= BUS_INSTANCES) || !BusFlows[BUSId].Active)
+  {
+    return;
+  }
+  Flow = &BusFlows[BUSId];
+  Flow->Released++;
+  if(BUS_FLOW_DUE(Flow))
+  {
+    BUSFlowKick(BUSId);
+  }
+}
+
+/**
+  * @brief  	Wakes the writer of a bus up to take the frames waiting for
+  *		credit or to send the credits. Called with the flow mutex taken.
+  * @param[in] 	BUSId Bus identification
+  */
+static void BUSFlowKick(int32_t BUSId)
+{
+  BusFlow *Flow = &BusFlows[BUSId];
+
+  if(!Flow->Kicked && (Flow->Kick != NULL))
+  {
+    Flow->Kicked = 1;
+    MailPutPrio(QueueIDBusQueue[BUSId], Flow->Kick, TP_PRIORITY_CONTROL);
+  }
+}
+
+/**
+  * @brief  	Called by the writer of a bus before it takes a frame from the
+  *		bus queue. While the peer has no credit, the frames are left in
+  *		the queue, in order, and the writer is woken up by the kick when
+  *		it grants more.
+  * @param[in] 	BUSId Bus identification
+  * @return 	1 if a frame can be taken. Where the queue holds the frames
+  *		itself, always: it only gives the control mails out
+  */
+static uint8_t BUSFlowWait(int32_t BUSId)
+{
+  uint8_t Waiting;
+
+  BUS_FLOW_LOCK(BUSId);
+  BUSFlowApply(BUSId);
+  Waiting = BUSFlowHold(BUSId);
+  BUS_FLOW_UNLOCK(BUSId);
+#ifdef MailQueueHold
+  Waiting = 0;
+#endif
+  return !Waiting;
+}
+
+/**
+  * @brief  	Holds the frames of the bus queue while the peer has no credit
+  *		for them, and takes them again once it has. Called with the
+  *		flow mutex taken.
+  * @param[in] 	BUSId Bus identification
+  * @return 	1 if the frames wait for credit
+  */
+static uint8_t BUSFlowHold(int32_t BUSId)
+{
+  BusFlow *Flow = &BusFlows[BUSId];
+  uint8_t Waiting;
+
+  Waiting = Flow->Active && !BUS_FLOW_CAN_SEND(Flow);
+  if(Waiting != Flow->Waiting)
+  {
+    Flow->Waiting = Waiting;
+#ifdef MailQueueHold
+    MailQueueHold(QueueIDBusQueue[BUSId], Waiting);
+#endif
+  }
+  return Waiting;
+}
+
+/**
+  * @brief  	Serves the kick of a bus, if the mail is.
+  * @param[in] 	BUSId Bus identification
+  * @param[in] 	Frame Mail of the bus queue
+  * @return 	1 if the mail was the kick
+  */
+static uint8_t BUSFlowKicked(int32_t BUSId, TransProtFrame *Frame)
+{
+  BusFlow *Flow = &BusFlows[BUSId];
+
+  if(Frame != Flow->Kick)
+  {
+    return 0;
+  }
+  BUS_FLOW_LOCK(BUSId);
+  Flow->Kicked = 0;
+  BUS_FLOW_UNLOCK(BUSId);
+  BUSFlowService(BUSId);
+  return 1;
+}
+
+/**
+  * @brief  	Takes the frames of the bus queue again if the peer has granted
+  *		credit for them and sends the credits due that no frame has
+  *		carried. Runs in the writer of the bus.
+  * @param[in] 	BUSId Bus identification
+  */
+static void BUSFlowService(int32_t BUSId)
+{
+  BusFlow *Flow = &BusFlows[BUSId];
+  TransProtFrame Credits;
+  uint8_t Due;
+
+  BUS_FLOW_LOCK(BUSId);
+  BUSFlowApply(BUSId);
+  BUSFlowHold(BUSId);
+  Due = Flow->Active && (Flow->Released != Flow->Advertised) && BUS_FLOW_DUE(Flow);
+  BUS_FLOW_UNLOCK(BUSId);
+  if(Due)
+  {
+    TransferProtocolFlowFrame(&Credits, (uint8_t)BUSId);
+    BUSWriteFrame(BUSId, &Credits);
+  }
+}
+
+/**
+  * @brief  	Stamps a frame about to be written into a MBA bridge with the
+  *		limit granted to the peer, and takes its credit.
+  * @param[in] 	BUSId Bus identification
+  * @param[in,out] Frame Frame to be written
+  */
+static void BUSFlowStamp(int32_t BUSId, TransProtFrame *Frame)
+{
+  BusFlow *Flow = &BusFlows[BUSId];
+
+  if(TransferProtocolGetInterfaceType(BUSId) != MBA_BRIDGE)
+  {
+    return;
+  }
+  BUS_FLOW_LOCK(BUSId);
+  BUSFlowApply(BUSId);
+  Frame->Header.FlowControl = 0;
+  if(Flow->Active)
+  {
+    Flow->Advertised = Flow->Released;
+    Frame->Header.FlowControl = TP_FLOW_CREDITS |
+                                ((uint8_t)(Flow->Released + Flow->Credits) & TP_FLOW_LIMIT_MASK);
+    if(Frame->Header.Command != FLOW_CONTROL_COMMAND)
+    {
+      Flow->Sent++;
+    }
+  }
+  BUS_FLOW_UNLOCK(BUSId);
+}
+#endif
+
+/**
+  * @brief  	Stops a bus whose peer has gone
+  * @param[in] 	BUSId Bus identification
+  */
+static void BUSLinkLost(int32_t BUSId)
+{
+  BUSBringUpStop(BUSId);
+  BusInstances[BUSId].DeInit();
+#if BUS_FRAME_TIMEOUTS > 0
+  BUSTimeoutsReset(BUSId);
+#endif
+  deframer_reset(&BusDeframers[BUSId]);
+  TransferProtocolReassemblyReset(&BusReassembly[BUSId]);
+#if BUS_FLOW_CONTROL > 0
+  BUSFlowReset(BUSId);
+#endif
+#if BUS_AGGREGATION > 0
+  aggregator_reset(&BusAggregates[BUSId].Frames);
+#endif
+  ForceBusInterfaceStop(BUSId);
+  TransferProtocolUpdateInterfaceState(BUSId);
+}
+
+/**
+  * @brief  	Attaches the bring-up registers. Every interface is required
+  *		unless BUS_REQUIRED_INTERFACES says otherwise.
+  */
+static void BUSBringUpInit(void)
+{
+  int32_t BUSId;
+
+  BusReadyMask = 0;
+  BusFailedMask = 0;
+  BusRequiredMask = BUS_REQUIRED_INTERFACES;
+  AttachVariableToRegister(BUS_READY_INDEX, (void *)&BusReadyMask, sizeof(uint16_t));
+  AttachVariableToRegister(BUS_REQUIRED_INDEX, &BusRequiredMask, sizeof(uint16_t));
+
+  for(BUSId = 0; BUSId < BUS_INSTANCES; BUSId++)
+  {
+    BusInitTime[BUSId] = 0;
+    AttachVariableToRegister(BUS_REGISTER(BUSId, BUS_INIT_TIME_REG),
+                             &BusInitTime[BUSId], sizeof(uint32_t));
+  }
+}
+
+/**
+  * @brief  	Sets the deframers of the buses up: frames of MBA bridges, and
+  *		their fragments
+  */
+static void BUSDeframersInit(void)
+{
+  int32_t BUSId;
+
+  for(BUSId = 0; BUSId < BUS_INSTANCES; BUSId++)
+  {
+    deframer_init(&BusDeframers[BUSId], HEADER_SIZE, SIZE_FIELD_OFFSET, CRC_SIZE, BUS_MAX_FRAME_SIZE);
+    TransferProtocolReassemblyInit(&BusReassembly[BUSId], BUS_REASSEMBLY_SIZE);
+    BusFragmentSize[BUSId] = BUS_FRAGMENT_SIZE;
+    AttachVariableToRegister(BUS_REGISTER(BUSId, BUS_FRAGMENT_SIZE_REG),
+                             &BusFragmentSize[BUSId], sizeof(uint16_t));
+  }
+}
+
+/**
+  * @brief  	Starts the init time of a bus being launched
+  * @param[in] 	BUSId Bus identification
+  */
+static void BUSBringUpStart(int32_t BUSId)
+{
+  BUS_BRINGUP_LOCK();
+  BusLaunchTick[BUSId] = OSGetTick();
+  BusInitTime[BUSId] = 0;
+  BusReadyMask &= (uint16_t)~(1u << BUSId);
+  BusFailedMask &= (uint16_t)~(1u << BUSId);
+  BUS_BRINGUP_UNLOCK();
+}
+
+/**
+  * @brief  	Ends the bring-up of a bus
+  * @param[in] 	BUSId Bus identification
+  * @param[in] 	Active 1 if the bus is active, 0 if its configuration failed
+  */
+static void BUSBringUpEnd(int32_t BUSId, uint8_t Active)
+{
+  BUS_BRINGUP_LOCK();
+  BusInitTime[BUSId] = OS_TICKS_TO_MS(OSGetTick() - BusLaunchTick[BUSId]);
+  if(Active)
+  {
+    BusReadyMask |= (uint16_t)(1u << BUSId);
+  }
+  else
+  {
+    BusFailedMask |= (uint16_t)(1u << BUSId);
+  }
+  BUS_BRINGUP_UNLOCK();
+}
+
+/**
+  * @brief  	A stopped bus is no longer ready
+  * @param[in] 	BUSId Bus identification
+  */
+static void BUSBringUpStop(int32_t BUSId)
+{
+  BUS_BRINGUP_LOCK();
+  BusReadyMask &= (uint16_t)~(1u << BUSId);
+  BUS_BRINGUP_UNLOCK();
+}
+
+/**
+  * @brief  	Checks if the required interfaces are active
+  * @retval	1 if they are, -1 if one of them has failed, 0 if one of them is
+  *		still being configured or is not launched
+  */
+int32_t BUSReady(void)
+{
+  uint16_t Required = BusRequiredMask;
+
+  if((BusFailedMask & Required) != 0)
+  {
+    return -1;
+  }
+  return ((BusReadyMask & Required) == Required) ? 1 : 0;
+}
+
+#if OS_ACTIVE != 0
+/**
+  * @brief  	Waits for the required interfaces. It returns as soon as they are
+  *		active, whatever the state of the others.
+  * @param[in] 	Timeout Maximum wait in ms
+  * @retval	See @ref BUSReady
+  */
+int32_t BUSWaitReady(uint32_t Timeout)
+{
+  uint32_t Start = OSGetTick();
+  int32_t Ready;
+
+  while((Ready = BUSReady()) == 0)
+  {
+    if(OS_TICKS_TO_MS(OSGetTick() - Start) >= Timeout)
+    {
+      break;
+    }
+    OSDelay(1);
+  }
+  return Ready;
+}
+#endif
+
+#if BUS_FRAME_TIMEOUTS > 0
+/**
+  * @brief  	Creates the timeout wheel and attaches the frame detection
+  *		registers of each bus.
+  */
+static void BUSTimeoutsInit(void)
+{
+  int32_t BUSId;
+#if OS_ACTIVE != 0
+  int32_t FuncRet;
+
+  CreateMutex(FuncRet, MidBusWheelMutex, MUTEX_REF(BusWheelMutex));
+  BusWheelTimer = FuncRet ? CreateTimer(TIMER_REF(BUSWheel), osTimerPeriodic, NULL) : NULL;
+  BusWheelTicking = 0;
+#endif
+
+  BusWheelTime = 0;
+  BusWheelTick = OSGetTick();
+  timerwheel_init(&BusWheel, 0);
+
+  for(BUSId = 0; BUSId < BUS_INSTANCES; BUSId++)
+  {
+    BusTimeouts[BUSId].FrameDetection = FRAME_DETECTION_SIZE;
+    BusTimeouts[BUSId].GlobalTimeout = 0;
+    BusTimeouts[BUSId].DecodingTimeout = 0;
+    BusTimeouts[BUSId].Data = NULL;
+    BusTimeouts[BUSId].Size = 0;
+    timerwheel_entry_init(&BusTimeouts[BUSId].Global, BUSFrameTimeout, &(InstanceID[BUSId]));
+    timerwheel_entry_init(&BusTimeouts[BUSId].Decoding, BUSFrameTimeout, &(InstanceID[BUSId]));
+
+    AttachVariableToRegister(BUS_REGISTER(BUSId, BUS_FRAME_DETECTION_REG),
+                             &BusTimeouts[BUSId].FrameDetection, sizeof(uint16_t));
+    AttachVariableToRegister(BUS_REGISTER(BUSId, BUS_GLOBAL_TIMEOUT_REG),
+                             &BusTimeouts[BUSId].GlobalTimeout, sizeof(uint16_t));
+    AttachVariableToRegister(BUS_REGISTER(BUSId, BUS_DECODING_TIMEOUT_REG),
+                             &BusTimeouts[BUSId].DecodingTimeout, sizeof(uint16_t));
+  }
+}
+
+/**
+  * @brief  	Drops the frame being gathered and its timeouts
+  * @param[in] 	BUSId Bus identification
+  */
+static void BUSTimeoutsReset(int32_t BUSId)
+{
+  BusFrameTimeout *Timeout = &BusTimeouts[BUSId];
+
+  BUS_WHEEL_LOCK();
+  timerwheel_del(&BusWheel, &Timeout->Global);
+  timerwheel_del(&BusWheel, &Timeout->Decoding);
+  if(Timeout->Data != NULL)
+  {
+    MemFree(Timeout->Data);
+    Timeout->Data = NULL;
+  }
+  Timeout->Size = 0;
+  BUS_WHEEL_UNLOCK();
+}
+
+/**
+  * @brief  	Adds data read from a bus that detects frames by timeout to the
+  *		frame being gathered and re-arms its timeouts.
+  * @param[in] 	BUSId Bus identification
+  * @param[in] 	BusBuffer Data read. It is released if taken
+  * @param[in] 	FrameSize Data size
+  * @retval	1 if the data has been taken, 0 if the bus does not detect frames
+  *		by timeout
+  */
+static uint8_t BUSGatherFrame(int32_t BUSId, uint8_t *BusBuffer, uint32_t FrameSize)
+{
+  BusFrameTimeout *Timeout = &BusTimeouts[BUSId];
+  uint8_t *Data;
+#if OS_ACTIVE != 0
+  OSRetValue Ret;
+
+  if(BusWheelTimer == NULL)
+  {
+    return 0;
+  }
+#endif
+
+  if((Timeout->FrameDetection != FRAME_DETECTION_TIMEOUT) || (Timeout->DecodingTimeout == 0))
+  {
+    return 0;
+  }
+
+  BUS_WHEEL_LOCK();
+  BUSWheelAdvance();
+
+  if(Timeout->Data == NULL)
+  {
+    /* First data of a frame */
+    Timeout->Data = BusBuffer;
+    Timeout->Size = FrameSize;
+    if(Timeout->GlobalTimeout != 0)
+    {
+      timerwheel_add(&BusWheel, &Timeout->Global, BusWheelTime + Timeout->GlobalTimeout);
+    }
+  }
+  else
+  {
+    Data = (uint8_t *)MemRealloc(Timeout->Data, Timeout->Size + FrameSize);
+    if(Data != NULL)
+    {
+      memcpy(Data + Timeout->Size, BusBuffer, FrameSize);
+      Timeout->Data = Data;
+      Timeout->Size += FrameSize;
+    }
+    MemFree(BusBuffer);
+  }
+
+  /* Moving an armed entry between two wheel slots costs the same as arming it */
+  timerwheel_add(&BusWheel, &Timeout->Decoding, BusWheelTime + Timeout->DecodingTimeout);
+
+#if OS_ACTIVE != 0
+  if(!BusWheelTicking)
+  {
+    TimerStart(Ret, BusWheelTimer, 1);
+    BusWheelTicking = (Ret == OS_OK);
+  }
+#endif
+  BUS_WHEEL_UNLOCK();
+
+  return 1;
+}
+
+/**
+  * @brief  	Wheel callback: one of the timeouts of a bus has expired and the
+  *		data gathered is delivered as a frame.
+  */
+static void BUSFrameTimeout(struct timerwheel_entry *Entry, void *Arg)
+{
+  int32_t BUSId = *((int32_t *)Arg);
+  BusFrameTimeout *Timeout = &BusTimeouts[BUSId];
+  uint8_t *Data = Timeout->Data;
+
+  (void)Entry;
+  timerwheel_del(&BusWheel, &Timeout->Global);
+  timerwheel_del(&BusWheel, &Timeout->Decoding);
+  Timeout->Data = NULL;
+
+  if(Data != NULL)
+  {
+    BUSDeliverFrame(BUSId, Data, Timeout->Size);
+  }
+  Timeout->Size = 0;
+}
+
+/**
+  * @brief  	Brings the wheel to the current time, running the expired
+  *		timeouts. Called with the wheel locked.
+  * @note	Ticks are added in whole milliseconds.
+  */
+static void BUSWheelAdvance(void)
+{
+  uint32_t Tick = OSGetTick();
+  uint32_t Elapsed = OS_TICKS_TO_MS(Tick - BusWheelTick);
+
+  if(Elapsed > 0)
+  {
+    BusWheelTick = Tick;
+    BusWheelTime += Elapsed;
+    timerwheel_advance(&BusWheel, BusWheelTime);
+  }
+}
+
+#if OS_ACTIVE != 0
+/**
+  * @brief  	OS timer callback. It runs every tick while timeouts are armed.
+  */
+static void BUSWheelCallback(void const *arg)
+{
+  OSRetValue Ret;
+
+  (void)arg;
+  BUS_WHEEL_LOCK();
+  BUSWheelAdvance();
+  if(BusWheel.pending == 0)
+  {
+    TimerStop(Ret, BusWheelTimer);
+    BusWheelTicking = 0;
+    (void)Ret;
+  }
+  BUS_WHEEL_UNLOCK();
+}
+#endif
+#endif
+
+#if BUS_EVENT_LOOP > 0
+/**
+  * @brief  	Creates a bus loop and, with shards, its rings and frame pool
+  * @param[in] 	Index Loop number
+  * @retval	0 if the loop is ready, -1 otherwise
+  */
+static int32_t BUSLoopInit(uint32_t Index)
+{
+  BusShard *Shard = &BusLoops[Index];
+#if BUS_SHARDS > 0
+  uint32_t Source;
+#endif
+
+  if(evloop_init(&Shard->Loop) != 0)
+  {
+    return -1;
+  }
+#if BUS_SHARDS > 0
+  Shard->Index = Index;
+  Shard->Route.Version = 0;
+  objpool_init(&Shard->Frames, sizeof(BusShardFrame), BUS_SHARD_POOL_SIZE);
+  for(Source = 0; Source < BUS_SHARDS; Source++)
+  {
+    if(Source == Index)
+    {
+      continue;
+    }
+    if((spscring_init(&Shard->Inbox[Source], BUS_SHARD_RING_SIZE) != 0) ||
+       (evloop_add(&Shard->Loop, spscring_eventfd(&Shard->Inbox[Source]), EVLOOP_IN,
+                   BUSShardInboxEvent, &Shard->Inbox[Source]) != 0))
+    {
+      return -1;
+    }
+  }
+#endif
+  return 0;
 }
+
+/**
+  * @brief  	Hands a configured bus over to the bus loop
+  * @param[in] 	BUSId Bus identification
+  * @retval	0 if the bus is served by the loop, -1 if it needs its own threads
+  */
+static int32_t BUSLoopAttach(int32_t BUSId)
+{
+  int BusFd, QueueFd;
+
+  if(!BusLoopAvailable)
+  {
+    return -1;
+  }
+
+  QueueFd = MailQueueFd(QueueIDBusQueue[BUSId]);
+  if((QueueFd < 0) || (BusInstances[BUSId].Configuration(BUS_GET_FD, &BusFd) < 0))
+  {
+    return -1;
+  }
+
+  BusLoopFd[BUSId] = BusFd;
+  BusLoopQueueFd[BUSId] = QueueFd;
+
+  /* Same as BUSWriteProcess: the interface is ready for continuous communication */
+  SetBusInstanceState(BUSId, BUS_ACTIVE);
+  TransferProtocolUpdateInterfaceState(BUSId);
+  BUSBringUpEnd(BUSId, 1);
+
+  evloop_add(BUS_LOOP_OF(BUSId), BusFd, EVLOOP_IN | EVLOOP_RDHUP, BUSLoopBusEvent, &(InstanceID[BUSId]));
+  evloop_add(BUS_LOOP_OF(BUSId), QueueFd, EVLOOP_IN, BUSLoopQueueEvent, &(InstanceID[BUSId]));
+
+  return 0;
+}
+
+/**
+  * @brief  	Removes a bus from the bus loop
+  * @param[in] 	BUSId Bus identification
+  */
+static void BUSLoopDetach(int32_t BUSId)
+{
+  evloop_del(BUS_LOOP_OF(BUSId), BusLoopQueueFd[BUSId]);
+  evloop_del(BUS_LOOP_OF(BUSId), BusLoopFd[BUSId]);
+  BusLoopFd[BUSId] = -1;
+  BusLoopWaiting[BUSId] = 0;
+}
+
+/**
+  * @brief  	Bus descriptor callback: reads frames, resumes the output of a busy
+  *		bus and stops the bus if the peer has gone.
+  */
+static void BUSLoopBusEvent(int fd, uint32_t events, void *arg)
+{
+  int32_t BUSId = *((int32_t *)arg);
+  uint32_t Reads;
+
+  LoopStatsBegin();
+  if(events & EVLOOP_IN)
+  {
+    /* Bounded, the loop is level triggered and other buses are waiting */
+    for(Reads = 0; Reads < BUS_LOOP_MAX_FRAMES; Reads++)
+    {
+      if(BusInstances[BUSId].DataAvailable() == 0)
+      {
+        break;
+      }
+      BUSReadFrame(BUSId);
+    }
+  }
+
+  if(events & EVLOOP_OUT)
+  {
+    /* Once the pending data is sent, the queue is served again */
+    if(BusInstances[BUSId].Configuration(BUS_TX_FLUSH, NULL) == 0)
+    {
+      BusLoopWaiting[BUSId] = 0;
+      evloop_mod(BUS_LOOP_OF(BUSId), fd, EVLOOP_IN | EVLOOP_RDHUP);
+      evloop_mod(BUS_LOOP_OF(BUSId), BusLoopQueueFd[BUSId], EVLOOP_IN);
+    }
+  }
+
+  if(events & (EVLOOP_ERR | EVLOOP_HUP | EVLOOP_RDHUP))
+  {
+    BUSLoopDetach(BUSId);
+    BUSLinkLost(BUSId);
+  }
+  LoopStatsEnd();
+}
+
+/**
+  * @brief  	Bus queue callback: writes the queued frames while the bus accepts them.
+  */
+static void BUSLoopQueueEvent(int fd, uint32_t events, void *arg)
+{
+  int32_t BUSId = *((int32_t *)arg);
+  uint32_t Writes;
+  OSGlobalRet RetMail;
+
+  (void)fd;
+  (void)events;
+  LoopStatsBegin();
+  for(Writes = 0; Writes < BUS_LOOP_MAX_FRAMES; Writes++)
+  {
+    /* The bus cannot take more data: wait until it is writable */
+    if(BusInstances[BUSId].Configuration(BUS_TX_FLUSH, NULL) > 0)
+    {
+      BUSLoopBusy(BUSId);
+      break;
+    }
+
+#if BUS_FLOW_CONTROL > 0
+    if(!BUSFlowWait(BUSId))
+    {
+      break;
+    }
+#endif
+    MailGetTimeout(RetMail, QueueIDBusQueue[BUSId], 0);
+    if(RetMail.RetValue != OS_OK)
+    {
+#if BUS_SHARDS > 0
+      /* Drained: the shard writes its frames right away again. Frames
+       * waiting for credit are still there */
+      if(!BusFlows[BUSId].Waiting)
+      {
+        BusShardQueued[BUSId] = 0;
+      }
+#endif
+      break;
+    }
+    BUSWriteMail(BUSId, RetMail.Data);
+  }
+  BUSAggregateFlush(BUSId);
+  LoopStatsEnd();
+}
+
+/**
+  * @brief  	Stops serving the queue of a bus until the bus is writable again.
+  * @param[in] 	BUSId Bus identification
+  */
+static void BUSLoopBusy(int32_t BUSId)
+{
+  BusLoopWaiting[BUSId] = 1;
+  evloop_mod(BUS_LOOP_OF(BUSId), BusLoopQueueFd[BUSId], 0);
+  evloop_mod(BUS_LOOP_OF(BUSId), BusLoopFd[BUSId], EVLOOP_IN | EVLOOP_OUT | EVLOOP_RDHUP);
+}
+#endif
+
+#if BUS_SHARDS > 0
+/**
+  * @brief  	Routes a frame read by a shard.
+  * @details	Transfer frames are routed with the tables of the shard and
+  *		written by the shard that owns the destination bus: right away
+  *		if it is this one, through its ring otherwise. The ring spills
+  *		instead of refusing frames, so the frames of a source keep their
+  *		order.
+  * @param[in] 	Shard Shard of the calling thread
+  * @param[in] 	BUSId Bus identification
+  * @param[in] 	BusBuffer Frame as read from the bus. It is passed to the frame
+  * @param[in] 	FrameSize Frame size
+  * @param[in] 	RxTime Time stamp of its read
+  */
+static void BUSShardDeliver(BusShard *Shard, int32_t BUSId, uint8_t *BusBuffer, uint32_t FrameSize,
+                            uint64_t RxTime)
+{
+  BusShardFrame *Item;
+  BusShard *Owner;
+  uint8_t Priority;
+
+  Item = (BusShardFrame *)objpool_get(&Shard->Frames);
+  if(Item == NULL)
+  {
+    MemFree(BusBuffer);
+    BUSFlowRelease(BUSId);
+    return;
+  }
+  if(TransferProtocolCast(&Item->Frame, BusBuffer, FrameSize, BUSId,
+     TransferProtocolGetInterfaceType(BUSId) | FROM_BUFFER | IN_PLACE) < 0)
+  {
+    objpool_put(&Shard->Frames, Item);
+    BUSFlowRelease(BUSId);
+    return;
+  }
+  BUSStampFrame(BUSId, &Item->Frame, RxTime);
+  if(BUSFlowReceive(BUSId, &Item->Frame))
+  {
+    objpool_put(&Shard->Frames, Item);
+    return;
+  }
+  LoopStatsFrame(&Item->Frame);
+
+  Priority = TransferProtocolGetPriority(&Item->Frame);
+  Item->BUSId = -1;
+  if(Priority != TP_PRIORITY_CONTROL)
+  {
+    TransferProtocolGetRouteView(&Shard->Route);
+    Item->BUSId = TransferProtocolRoute(&Shard->Route, &Item->Frame);
+  }
+
+  /* The dictionary, the state machine and the groups belong to the MBA */
+  if((Priority == TP_PRIORITY_CONTROL) || (Item->BUSId == TP_MULTICAST))
+  {
+    if(MutexWait(MidMBAMutex) == OS_OK)
+    {
+      BUSShardMail(Shard, Item, &QueueIDMBAQueue, Priority);
+      MutexRelease(MidMBAMutex);
+      return;
+    }
+    Item->BUSId = -1;
+  }
+
+  if(Item->BUSId < 0)
+  {
+    /* Not for any bus: dropped */
+    BUSFlowRelease(Item->Frame.CreditInterface);
+    TransferProtocolFrameFree(&Item->Frame);
+    objpool_put(&Shard->Frames, Item);
+    return;
+  }
+
+  Owner = &BusLoops[Item->BUSId % BUS_SHARDS];
+  if(Owner == Shard)
+  {
+    BUSShardWrite(Shard, Item);
+  }
+  else if(spscring_push_spill(&Owner->Inbox[Shard->Index], Item) != 0)
+  {
+    BUSFlowRelease(Item->Frame.CreditInterface);
+    TransferProtocolFrameFree(&Item->Frame);
+    objpool_put(&Shard->Frames, Item);
+  }
+}
+
+/**
+  * @brief  	Writes a routed frame into a bus of the calling shard.
+  * @param[in] 	Shard Shard of the calling thread
+  * @param[in] 	Item Frame. It is released
+  */
+static void BUSShardWrite(BusShard *Shard, BusShardFrame *Item)
+{
+  int32_t BUSId = Item->BUSId;
+
+  /* Not in the loop, served by its own threads if launched, or waiting for
+   * credit: the frame goes through the bus queue. So it does while the queue
+   * may hold frames of the shard or the bus has data pending, not to overtake
+   * them */
+  if((BusLoopFd[BUSId] < 0) || BusLoopWaiting[BUSId] || BusShardQueued[BUSId] ||
+     BUSFlowActive(BUSId))
+  {
+    BusShardQueued[BUSId] = 1;
+    BUSShardMail(Shard, Item, &QueueIDBusQueue[BUSId], TransferProtocolGetPriority(&Item->Frame));
+    return;
+  }
+
+  BUSWriteFrame(BUSId, &Item->Frame);
+  BUSAggregateFlush(BUSId);
+  objpool_put(&Shard->Frames, Item);
+
+  /* Data left pending: the bus queue waits until it is written */
+  if(BusInstances[BUSId].Configuration(BUS_TX_FLUSH, NULL) > 0)
+  {
+    BUSLoopBusy(BUSId);
+  }
+}
+
+/**
+  * @brief  	Moves a routed frame into a mail of a queue, whose consumer
+  *		releases it with MailFree. The frame itself goes back to the
+  *		pool of the shard.
+  * @param[in] 	Shard Shard of the calling thread
+  * @param[in] 	Item Frame. It is released
+  * @param[in] 	Queue Mail queue
+  * @param[in] 	Priority Lane of the frame
+  */
+static void BUSShardMail(BusShard *Shard, BusShardFrame *Item, MAIL_QUEUE_ID *Queue, uint8_t Priority)
+{
+  TransProtFrame *Mail;
+
+  MailAlloc(Mail, *Queue, 0);
+  if(Mail == NULL)
+  {
+    BUSFlowRelease(Item->Frame.CreditInterface);
+    TransferProtocolFrameFree(&Item->Frame);
+  }
+  else
+  {
+    *Mail = Item->Frame;
+    MailPutPrio(*Queue, Mail, Priority);
+  }
+  objpool_put(&Shard->Frames, Item);
+}
+
+/**
+  * @brief  	Shard ring callback: writes the frames routed by another shard.
+  */
+static void BUSShardInboxEvent(int fd, uint32_t events, void *arg)
+{
+  spscring *Ring = (spscring *)arg;
+  BusShardFrame *Item;
+
+  (void)fd;
+  (void)events;
+  /* Emptied: the producer signals again once the ring has been found empty */
+  LoopStatsBegin();
+  spscring_clear(Ring);
+  while((Item = (BusShardFrame *)spscring_pop(Ring)) != NULL)
+  {
+    BUSShardWrite(BusCurrentShard, Item);
+  }
+  LoopStatsEnd();
+}
+#endif
+
 /**
   *@}
   */
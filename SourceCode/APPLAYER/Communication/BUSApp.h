@@ -39,8 +39,10 @@
 #endif
 
 /* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
 #include "SysConfig.h"
 #include "../OSSupport.h"		/*!< Operating sytem functions */
+#include "../../MBALibrary/MBAProtocols/MBATransferProtocol.h"
 /* Exported define -----------------------------------------------------------*/
 #define BUS_QUEUE_SIZE	8 /*!<default queue sizes for bus threads */
 /* Thread paramters definition */
@@ -55,6 +57,50 @@
 #define BUS_ID_7	6	/* Check BUSInstance Array */
 #define BUS_ID_8	7	/* Check BUSInstance Array */
 
+/* Bus task model. See SysConfig.h. The protothreads share an OS thread */
+#if !defined(BUS_TASK_MODEL) || (OS_ACTIVE == 0)
+#undef BUS_TASK_MODEL
+#define BUS_TASK_MODEL	0
+#endif
+
+/* Bus I/O model. See SysConfig.h. The bus loop needs the OS and the threads */
+#if !defined(BUS_EVENT_LOOP) || (OS_ACTIVE == 0) || (BUS_TASK_MODEL != 0)
+#undef BUS_EVENT_LOOP
+#define BUS_EVENT_LOOP	0
+#endif
+
+/* Interfaces the node needs to be ready. See SysConfig.h */
+#ifndef BUS_REQUIRED_INTERFACES
+#define BUS_REQUIRED_INTERFACES	((1u << AVAILABLE_INTERFACES) - 1)
+#endif
+
+/* Flow control window of the MBA bridges. See SysConfig.h */
+#ifndef BUS_FLOW_WINDOW
+#define BUS_FLOW_WINDOW	0
+#endif
+
+/* Write aggregation of the MBA bridges. See SysConfig.h */
+#ifndef BUS_AGGREGATE_SIZE
+#define BUS_AGGREGATE_SIZE	0
+#endif
+#ifndef BUS_AGGREGATE_HOLD
+#define BUS_AGGREGATE_HOLD	200
+#endif
+
+/* Fragmentation of the MBA bridges. See SysConfig.h */
+#ifndef BUS_FRAGMENT_SIZE
+#define BUS_FRAGMENT_SIZE	0
+#endif
+#ifndef BUS_REASSEMBLY_SIZE
+#define BUS_REASSEMBLY_SIZE	4096
+#endif
+
+/* Bus shards. See SysConfig.h. A shard is a bus loop thread */
+#if !defined(BUS_SHARDS) || (BUS_EVENT_LOOP == 0)
+#undef BUS_SHARDS
+#define BUS_SHARDS	0
+#endif
+
 	 
 /* Exported types ------------------------------------------------------------*/
 /* Exported constants --------------------------------------------------------*/
@@ -63,6 +109,20 @@
 /* Exported functions ------------------------------------------------------- */
 int InitBUSProcess(void);
 void LaunchBUSInstance(uint8_t BusInstanceID);
+void StopBUSInstance(uint8_t BusInstanceID);
+int32_t BUSReady(void);
+#if OS_ACTIVE != 0
+int32_t BUSWaitReady(uint32_t Timeout);
+void BUSFlowRelease(int32_t BUSId);
+#endif
+#if MUTEX_STATS_AVAILABLE > 0
+void BUSGetMBAMutexStats(OSMutexStats *Stats, uint8_t Reset);
+#endif
+#if OS_ACTIVE == 0
+/* Super loop */
+void BUSProcessStep(void);
+void BUSDirectWrite(uint8_t BusInstanceID, TransProtFrame *Frame);
+#endif
 
 /**
   *@}
@@ -31,32 +31,70 @@
 #include "SysConfig.h"		/*!< System paramters */
 #include "../OSSupport.h"		/*!< Operating sytem functions */
 #include "MBAApp.h"			/*!< MBA application parameters */
-#include "BusApp.h"
+#include "BUSApp.h"
 #include "../../MBALibrary/MBALib.h"	/*!< Access to MBA instance */
+#if MBA_WORKERS > 0
+#include "../../TOOLS/workpool.h"		/*!< MBA worker pool */
+#endif
 
 #include "stdio.h"
+#if LOOP_STATS > 0
+#include <signal.h>
+#endif
 
 /* Private typedef -----------------------------------------------------------*/
 /* Private define ------------------------------------------------------------*/
 #define MBAPROCESS_SIZE_STACK		0	/*!< Thread stack size */
+#define MBA_ACTORS			256	/*!< One actor per source ID */
 /* Private macro -------------------------------------------------------------*/
 /* Private variables ---------------------------------------------------------*/
+#if OS_ACTIVE != 0
 THREAD_ID ThreadIDMBAProcess; 																/*!< Thread ID */
 MAIL_QUEUE_ID QueueIDMBAQueue;                                /*!< Mail queue id */
 DEFINE_MAIL_QUEUE (MBAQueue, MBA_QUEUE_SIZE, TransProtFrame); /*!<  Mail queue object */
 
 /* Call to BusApp variables to give thread management to the MBA thread*/
-extern BusInstance BusInstances[];
 extern MAIL_QUEUE_ID QueueIDBusQueue[];
 extern THREAD_ID ThreadIDBUSReadProcess[BUS_INSTANCES];  /*!< Thread IDs */
 
+#if MBA_WORKERS > 0
+/**
+ * @brief Frames are processed by the pool, one actor per source ID, so the
+ *	  frames of a source keep their order. Config and operation frames
+ *	  update the dictionary and the state machine: they run alone.
+ */
+static workpool MBAPool;
+static TransProtFrame WorkerSMFrame;	   /*!< State machine output of the workers */
+static uint32_t WorkerIndex[MBA_WORKERS];
+THREAD_ID ThreadIDMBAWorkerProcess[MBA_WORKERS]; /*!< Thread IDs */
+#endif
+#else
+static TransProtFrame SMFrame;	/*!< State machine output */
+static uint32_t LastUpdate;	/*!< Last state machine run */
+#endif
+extern BusInstance BusInstances[];
+
 /* Private function prototypes -----------------------------------------------*/
 
+#if OS_ACTIVE != 0
 OS_THREAD_TYPE MBAProcess (OS_THREAD_ARG argument);          /*!<  Thread function  */
 DEFINE_THREAD (MBAProcess, osPriorityNormal, MBALIB_INSTANCES, MBAPROCESS_SIZE_STACK);
+#if MBA_WORKERS > 0
+OS_THREAD_TYPE MBAWorkerProcess (OS_THREAD_ARG argument);    /*!<  Worker thread function  */
+DEFINE_THREAD (MBAWorkerProcess, osPriorityNormal, MBA_WORKERS, MBAPROCESS_SIZE_STACK);
+static void MBAWorkerFrame(void *Item, void *Arg);
+#endif
+#if LOOP_STATS > 0
+static void MBALoopStatsInit(void);
+#endif
+#endif
 void MBABusInterfaceUpdate(void);
+static void MBAOutputFrame(int32_t InterfaceID, TransProtFrame *Frame, uint8_t Priority);
+static void MBAOutputGroup(TransProtFrame *Frame, uint8_t Priority);
+static void MBAStateMachineUpdate(TransProtFrame *SMFrame);
 
 /* Private functions ---------------------------------------------------------*/
+#if OS_ACTIVE != 0
 
 /**
   * @brief  Initializes MBA App thread
@@ -66,15 +104,38 @@ int32_t InitMBAProcess(void)
 {
   int32_t ret = 0;
   int32_t FuncRet;
+#if MBA_WORKERS > 0
+  uint32_t Worker;
+#endif
   
   /* Initializes the MBA module */
   MBAInit();
+#if LOOP_STATS > 0
+  MBALoopStatsInit();
+#endif
 	
   CreateMailQueue(FuncRet, QueueIDMBAQueue,MAIL_QUEUE_REF(MBAQueue), NULL);	// create mail queue
   if(!FuncRet)
   {
     ret = BUFFER_ERROR; // Mail Queue object not created, handle failure
   }
+#if MBA_WORKERS > 0
+  TransferProtocolFrameInit(&WorkerSMFrame);
+  if(workpool_init(&MBAPool, MBA_WORKERS, MBA_ACTORS, MBAWorkerFrame, NULL) != 0)
+  {
+    return TASK_ERROR;
+  }
+  for(Worker = 0; Worker < MBA_WORKERS; Worker++)
+  {
+    WorkerIndex[Worker] = Worker;
+    CreateThread (FuncRet, ThreadIDMBAWorkerProcess[Worker], THREAD_REF(MBAWorkerProcess),
+                  &WorkerIndex[Worker]);
+    if(!FuncRet)
+    {
+      ret = TASK_ERROR;
+    }
+  }
+#endif
   CreateThread (FuncRet, ThreadIDMBAProcess,THREAD_REF(MBAProcess), NULL);
   if(!FuncRet)
   {
@@ -93,88 +154,243 @@ int32_t InitMBAProcess(void)
 OS_THREAD_TYPE MBAProcess (OS_THREAD_ARG argument) {
 	
   OSGlobalRet    RetMBAMail;
-  int32_t	 TPInterfaceID = 0, OPInterfaceID = 0;
+  int32_t	 TPInterfaceID = 0;
+  uint32_t	 LastUpdate, Elapsed, WaitTime;
+  uint8_t	 ControlFrame;
   TransProtFrame *RxFrame = NULL;
-  TransProtFrame *TxFrame = NULL;
   TransProtFrame SMFrame, ProcessedFrame;
 
   TransferProtocolFrameInit(&ProcessedFrame);
   TransferProtocolFrameInit(&SMFrame);
+  LastUpdate = OSGetTick();
+  LoopStatsOpen("MBAProcess", -1);
 	
   while (1) 
   {
 
     /******************** Process Input data ***************************/
 
-    /* if there is data in the mailbox, read it */
-    MailGet(RetMBAMail, QueueIDMBAQueue);
+    /* Wait for a frame, but no longer than the next state machine deadline */
+    Elapsed = OS_TICKS_TO_MS(OSGetTick() - LastUpdate);
+    WaitTime = (Elapsed < MBA_STATE_MACHINE_PERIOD) ? (MBA_STATE_MACHINE_PERIOD - Elapsed) : 0;
+    MailGetTimeout(RetMBAMail, QueueIDMBAQueue, WaitTime);
+    LoopStatsBegin();
+#if LOOP_STATS > 0
+    /* The dump requested by the signal is written here, out of the handler */
+    loopstats_poll_dump(stderr);
+#endif
 
+    ControlFrame = 0;
     if (RetMBAMail.RetValue == OS_OK)
     {
       RxFrame = RetMBAMail.Data;
+      RxFrame->MBATime = OSGetTimeStamp();
+      LoopStatsFrame(RxFrame);
+      /* Operation and config frames may trigger a state transition */
+      ControlFrame = (TransferProtocolGetPriority(RxFrame) == TP_PRIORITY_CONTROL);
+#if MBA_WORKERS > 0
+      /* Control frames run alone and update the state machine themselves */
+      if(workpool_submit(&MBAPool, RxFrame->Header.SourceID, RxFrame,
+                         ControlFrame ? WORKPOOL_EXCLUSIVE : 0) != 0)
+      {
+        BUSFlowRelease(RxFrame->CreditInterface);
+        TransferProtocolFrameFree(RxFrame);
+        MailFree(QueueIDMBAQueue, RxFrame);
+      }
+      ControlFrame = 0;
+#else
       /* Process Received Data */
       TPInterfaceID = TransferProtocolProcess(&ProcessedFrame, RxFrame);
       if(TPInterfaceID < 0)
       {
 	/* Handle error */
       }
+      if(GetFrameDataSize(ProcessedFrame) == 0)
+      {
+        /* Consumed by the node */
+        BUSFlowRelease(RxFrame->CreditInterface);
+      }
       if(RxFrame)
       {
         MailFree(QueueIDMBAQueue, RxFrame); // free memory allocated for mail
       }
+#endif
     }
     
 /******************** End Process Input data ***************************/
 
-/******************** Process State machine  ***************************/
-  
-    /* Execute state machine operations */
-   OPInterfaceID = OperationProtocolUpdate(&SMFrame);
-
-   /* Once the Operation State machine is processed, check all the bus instance
-    * states and update them.
-    */
-   MBABusInterfaceUpdate();
-   TransferProtocolUpdateInterfaceState(OPInterfaceID);
-  
-   /* If a frame is generated due a state trasition, put it into the Queue */
-    if(GetFrameDataSize(SMFrame) > 0)
-    {
-      if((OPInterfaceID >= 0) && (OPInterfaceID < AVAILABLE_INTERFACES))
-      {
-        MailAlloc(TxFrame, QueueIDBusQueue[OPInterfaceID], 0); // Allocate memory
-        if(TxFrame)
-        {
-          TransferProtocolCopy(TxFrame, &SMFrame);
-          MailPut(QueueIDBusQueue[OPInterfaceID],TxFrame);     // Send Mail
-
-          /* Initializa ProcessedFrame to avoid multiple access*/
-          TransferProtocolFrameInit(&SMFrame);
-        }
-      }
-    }
-/***************** End Process State machine  ************************/
-    
 /******************** Process Output data ***************************/
 
     if(GetFrameDataSize(ProcessedFrame) > 0)
     {
-      if((TPInterfaceID >= 0) && (TPInterfaceID < AVAILABLE_INTERFACES))
-      {
-        MailAlloc(TxFrame, QueueIDBusQueue[TPInterfaceID], 0); // Allocate memory
-        if(TxFrame)
-        {
-          TransferProtocolCopy(TxFrame, &ProcessedFrame);
-          MailPut(QueueIDBusQueue[TPInterfaceID],TxFrame);  	// Send Mail
-
-          /* Initializa ProcessedFrame to avoid multiple access*/
-          TransferProtocolFrameInit(&ProcessedFrame);
-        }
-      }
+      MBAOutputFrame(TPInterfaceID, &ProcessedFrame, TransferProtocolGetPriority(&ProcessedFrame));
     }
 /******************* End Process Output data *************************/
+
+/******************** Process State machine  ***************************/
+
+    /* The state machine runs when its period expires or right after a
+     * control frame, so data traffic does not make it spin.
+     */
+    Elapsed = OS_TICKS_TO_MS(OSGetTick() - LastUpdate);
+    if((Elapsed < MBA_STATE_MACHINE_PERIOD) && !ControlFrame)
+    {
+      LoopStatsEnd();
+      continue;
+    }
+    LastUpdate = OSGetTick();
+#if MBA_WORKERS > 0
+    workpool_exclusive_begin(&MBAPool);
+    MBAStateMachineUpdate(&SMFrame);
+    workpool_exclusive_end(&MBAPool);
+#else
+    MBAStateMachineUpdate(&SMFrame);
+#endif
+/***************** End Process State machine  ************************/
+    LoopStatsEnd();
+  }
+}
+
+#if MBA_WORKERS > 0
+/**
+  * @brief  		MBA worker thread
+  * @param[in]  argument Worker index
+  */
+OS_THREAD_TYPE MBAWorkerProcess (OS_THREAD_ARG argument)
+{
+  LoopStatsOpen("MBAWorkerProcess", (int)*((uint32_t *)argument));
+  workpool_run(&MBAPool, *((uint32_t *)argument));
+  return NULL;
+}
+
+/**
+  * @brief  	Processes a frame in a worker and delivers the result. Called with
+  *		the frames of the same source serialized and control frames alone.
+  * @param[in]  Item Received frame. It is released
+  * @param[in]  Arg Not used
+  */
+static void MBAWorkerFrame(void *Item, void *Arg)
+{
+  TransProtFrame *RxFrame = (TransProtFrame *)Item;
+  TransProtFrame ProcessedFrame;
+  int32_t TPInterfaceID;
+  uint8_t ControlFrame;
+
+  (void)Arg;
+  LoopStatsBegin();
+  LoopStatsFrame(RxFrame);
+  TransferProtocolFrameInit(&ProcessedFrame);
+
+  ControlFrame = (TransferProtocolGetPriority(RxFrame) == TP_PRIORITY_CONTROL);
+  TPInterfaceID = TransferProtocolProcess(&ProcessedFrame, RxFrame);
+  if(GetFrameDataSize(ProcessedFrame) == 0)
+  {
+    /* Consumed by the node */
+    BUSFlowRelease(RxFrame->CreditInterface);
+  }
+  MailFree(QueueIDMBAQueue, RxFrame);
+
+  if(GetFrameDataSize(ProcessedFrame) > 0)
+  {
+    MBAOutputFrame(TPInterfaceID, &ProcessedFrame, TransferProtocolGetPriority(&ProcessedFrame));
+  }
+
+  /* Runs exclusively: the state machine can be updated */
+  if(ControlFrame)
+  {
+    MBAStateMachineUpdate(&WorkerSMFrame);
+  }
+  LoopStatsEnd();
+}
+#endif
+
+#if LOOP_STATS > 0
+/**
+  * @brief  Publishes the loop statistics of the threads in the dictionary and
+  *	    lets SIGUSR1 request a dump of them on stderr.
+  */
+static void MBALoopStatsInit(void)
+{
+  loopstats *Stats;
+  uint16_t Slot;
+
+  loopstats_threshold_us = LOOP_STALL_US;
+  AttachVariableToRegister(LOOP_STALL_INDEX, &loopstats_threshold_us, sizeof(uint32_t));
+  for(Slot = 0; Slot < LOOP_STATS_REGISTERS; Slot++)
+  {
+    Stats = loopstats_slot(Slot);
+    AttachVariableToRegister(LOOP_NAME_INDEX + Slot, Stats->name, LOOPSTATS_NAME);
+    AttachVariableToRegister(LOOP_STATS_INDEX + Slot, &Stats->iterations, LOOPSTATS_REGISTER_SIZE);
+  }
+  if(loopstats_dump_on_signal(SIGUSR1) != 0)
+  {
+    /* Handle error: statistics are still readable from the dictionary */
+  }
+}
+#endif
+
+#else /* OS_ACTIVE */
+
+/**
+  * @brief  Initializes the MBA for the super loop
+  * @retval @ref InstanceRet
+  */
+int32_t InitMBAProcess(void)
+{
+  /* Initializes the MBA module */
+  MBAInit();
+
+  TransferProtocolFrameInit(&SMFrame);
+  LastUpdate = OSGetTick();
+
+  /* Once the state machine is updated, launch related buses */
+  MBABusInterfaceUpdate();
+  return INSTANCE_OK;
+}
+
+/**
+  * @brief  	Processes a frame received by a bus and writes the result into the
+  *		destination bus. Super loop replacement of the MBA queue.
+  * @param[in]  RxFrame Received frame. Its data is released
+  */
+void MBAProcessFrame(TransProtFrame *RxFrame)
+{
+  int32_t TPInterfaceID;
+  uint8_t ControlFrame;
+  TransProtFrame ProcessedFrame;
+
+  TransferProtocolFrameInit(&ProcessedFrame);
+  RxFrame->MBATime = OSGetTimeStamp();
+
+  /* Operation and config frames may trigger a state transition */
+  ControlFrame = (TransferProtocolGetPriority(RxFrame) == TP_PRIORITY_CONTROL);
+  TPInterfaceID = TransferProtocolProcess(&ProcessedFrame, RxFrame);
+
+  if(GetFrameDataSize(ProcessedFrame) > 0)
+  {
+    MBAOutputFrame(TPInterfaceID, &ProcessedFrame, TransferProtocolGetPriority(&ProcessedFrame));
+  }
+
+  if(ControlFrame)
+  {
+    LastUpdate = OSGetTick();
+    MBAStateMachineUpdate(&SMFrame);
+  }
+}
+
+/**
+  * @brief  	Super loop MBA step. Runs the state machine every
+  *		MBA_STATE_MACHINE_PERIOD milliseconds.
+  */
+void MBAProcessStep(void)
+{
+  if(OS_TICKS_TO_MS(OSGetTick() - LastUpdate) >= MBA_STATE_MACHINE_PERIOD)
+  {
+    LastUpdate = OSGetTick();
+    MBAStateMachineUpdate(&SMFrame);
   }
 }
+#endif /* OS_ACTIVE */
 
 /*********************************************************************************************/
 /*****	STATIC FUNCTIONS 	    **********************************************************/
@@ -198,12 +414,7 @@ void MBABusInterfaceUpdate(void)
             case BUS_INACTIVE_2_ACTIVE:
         break;
       case BUS_ACTIVE_2_STOP:
-        StopThread(FuncRet, ThreadIDBUSReadProcess[InterfaceCounter]);
-        if(FuncRet != 0)
-        {
-          /* Handle Error */
-        }
-        BusInstances[InterfaceCounter].DeInit();
+        StopBUSInstance(InterfaceCounter);
       break;
      case BUS_NO_TRANSITION:
       break;
@@ -211,4 +422,119 @@ void MBABusInterfaceUpdate(void)
   }
 }
 
+/**
+  * @brief  	Delivers a frame generated by the MBA to its bus. It is queued, or
+  *		written right away in the super loop. The frame is initialized once
+  *		delivered.
+  * @param[in]  InterfaceID Destination interface
+  * @param[in]  Frame Frame to be delivered
+  * @param[in]  Priority Queue priority. See @ref TransferProtocolGetPriority
+  */
+static void MBAOutputFrame(int32_t InterfaceID, TransProtFrame *Frame, uint8_t Priority)
+{
+#if OS_ACTIVE != 0
+  TransProtFrame *TxFrame = NULL;
+#endif
 
+  if(InterfaceID == TP_MULTICAST)
+  {
+    MBAOutputGroup(Frame, Priority);
+    return;
+  }
+  if((InterfaceID < 0) || (InterfaceID >= AVAILABLE_INTERFACES))
+  {
+#if OS_ACTIVE != 0
+    BUSFlowRelease(Frame->CreditInterface);
+#endif
+    return;
+  }
+
+#if OS_ACTIVE != 0
+  MailAlloc(TxFrame, QueueIDBusQueue[InterfaceID], 0); // Allocate memory
+  if(TxFrame)
+  {
+    TransferProtocolCopy(TxFrame, Frame);
+    TxFrame->OutTime = OSGetTimeStamp();
+    MailPutPrio(QueueIDBusQueue[InterfaceID], TxFrame, Priority);  	// Send Mail
+
+    /* Initializa the frame to avoid multiple access*/
+    TransferProtocolFrameInit(Frame);
+  }
+  else
+  {
+    /* Dropped: its credit goes back */
+    BUSFlowRelease(Frame->CreditInterface);
+    TransferProtocolFrameFree(Frame);
+    TransferProtocolFrameInit(Frame);
+  }
+#else
+  (void)Priority;
+  Frame->OutTime = OSGetTimeStamp();
+  BUSDirectWrite((uint8_t)InterfaceID, Frame);
+  TransferProtocolFrameInit(Frame);
+#endif
+}
+
+/**
+  * @brief  	Delivers a frame for a group to each member. The members get
+  *		frames that share its data; the last one gets the frame itself,
+  *		and its credit. The frame is initialized once delivered.
+  * @param[in]  Frame Frame to be delivered
+  * @param[in]  Priority Queue priority. See @ref TransferProtocolGetPriority
+  */
+static void MBAOutputGroup(TransProtFrame *Frame, uint8_t Priority)
+{
+  TransProtFrame Member;
+  uint8_t Members;
+  int32_t InterfaceID;
+
+  Members = TransferProtocolGetGroup(GetDestLogicalIdP(Frame));
+  for(InterfaceID = 0; InterfaceID < AVAILABLE_INTERFACES; InterfaceID++)
+  {
+    if(!(Members & (1u << InterfaceID)))
+    {
+      continue;
+    }
+    Members &= (uint8_t)~(1u << InterfaceID);
+    if(Members == 0)
+    {
+      MBAOutputFrame(InterfaceID, Frame, Priority);
+      return;
+    }
+    if(TransferProtocolShare(&Member, Frame) == 0)
+    {
+      MBAOutputFrame(InterfaceID, &Member, Priority);
+    }
+  }
+
+  /* The group has no members left */
+#if OS_ACTIVE != 0
+  BUSFlowRelease(Frame->CreditInterface);
+#endif
+  TransferProtocolFrameFree(Frame);
+  TransferProtocolFrameInit(Frame);
+}
+
+/**
+  * @brief  	Runs the operation state machine and updates the bus instances
+  * @param[in,out]  SMFrame Frame generated by a state transition
+  */
+static void MBAStateMachineUpdate(TransProtFrame *SMFrame)
+{
+  int32_t OPInterfaceID;
+
+  /* Execute state machine operations */
+  OPInterfaceID = OperationProtocolUpdate(SMFrame);
+
+  /* Once the Operation State machine is processed, check all the bus instance
+   * states and update them.
+   */
+  MBABusInterfaceUpdate();
+  TransferProtocolUpdateInterfaceState(OPInterfaceID);
+
+  /* If a frame is generated due a state trasition, send it */
+  if(GetFrameDataSize((*SMFrame)) > 0)
+  {
+    MBAOutputFrame(OPInterfaceID, SMFrame, TP_PRIORITY_CONTROL);
+  }
+}
@@ -24,13 +24,33 @@
 #endif
 
 /* Includes ------------------------------------------------------------------*/
+#include "SysConfig.h"
+#include "../../MBALibrary/MBAProtocols/MBATransferProtocol.h"
 /* Exported define -----------------------------------------------------------*/
+/* MBA worker pool. See SysConfig.h. It needs the pThread backend */
+#if !defined(MBA_WORKERS) || (OS_ACTIVE == 0) || ((WINDOWS == 0) && (LINUX == 0))
+#undef MBA_WORKERS
+#define MBA_WORKERS	0
+#endif
+/* Thread loop statistics registers. See LOOP_STATS in SysConfig.h */
+#ifndef LOOP_STALL_US
+#define LOOP_STALL_US		10000	/*!< Iterations logged as stalls, us */
+#endif
+#define LOOP_STALL_INDEX	0x0B00	/*!< Stall threshold, us */
+#define LOOP_NAME_INDEX		0x0B10	/*!< Thread name of slot n at 0x0B10 + n */
+#define LOOP_STATS_INDEX	0x0B20	/*!< Counters of slot n at 0x0B20 + n */
+#define LOOP_STATS_REGISTERS	8	/*!< Slots published in the dictionary */
 /* Exported types ------------------------------------------------------------*/
 /* Exported constants --------------------------------------------------------*/
 /* Exported macro ------------------------------------------------------------*/
 /* Exported variables --------------------------------------------------------*/
 /* Exported functions ------------------------------------------------------- */
 int InitMBAProcess(void);
+#if OS_ACTIVE == 0
+/* Super loop */
+void MBAProcessFrame(TransProtFrame *RxFrame);
+void MBAProcessStep(void);
+#endif
 
 /**
   *@}
@@ -76,7 +76,7 @@ void InitDeviceProcess (void)
  
   // Create periodic timer
   HeartBeat_arg = NULL;
-  HeartBeat_id = CreateTimer(osTimer(HeartBeat), osTimerPeriodic, &HeartBeat_arg);
+  HeartBeat_id = CreateTimer(TIMER_REF(HeartBeat), osTimerPeriodic, &HeartBeat_arg);
   if (HeartBeat_id != NULL)   // Periodic timer created 
 	{     
 		// start timer with periodic 500 ms interval
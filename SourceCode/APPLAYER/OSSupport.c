@@ -10,31 +10,223 @@
   */
 
 /* Includes ------------------------------------------------------------------*/
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE	/* CPU affinity of the threads */
+#endif
 #include "SysConfig.h"	/*!< System paramters */
 #include "OSSupport.h"	/*!< Operating sytem functions */
 
+#if (WINDOWS != 0) || (LINUX != 0)
+#include <time.h>
+#include <errno.h>
+#include <string.h>
+#include <sched.h>
+#if TIMER_AVAILABLE != 0
+#include <unistd.h>
+#include <sys/timerfd.h>
+#include "../TOOLS/timerheap.h"
+#endif
+#endif
+
+#if OS_ACTIVE != 0
 /* Private typedef -----------------------------------------------------------*/
+#if ((WINDOWS != 0) || (LINUX != 0)) && (TIMER_AVAILABLE != 0)
+/**
+  * @brief Timer instance.
+  */
+struct OSTimer
+{
+  struct timerheap_node Node;	/*!< Next expiry, in microseconds */
+  os_ptimer Callback;		/*!< Function called on expiry */
+  void *Arg;			/*!< Callback argument */
+  os_timer_type Type;		/*!< One shot or periodic */
+  uint64_t PeriodUs;		/*!< Period of a periodic timer */
+};
+#endif
 /* Private define ------------------------------------------------------------*/				
+#if (WINDOWS != 0) || (LINUX != 0)
+/* Thread scheduling defaults. See SysConfig.h */
+#ifndef THREAD_SCHED_POLICY
+#define THREAD_SCHED_POLICY		0
+#endif
+#ifndef THREAD_SCHED_PRIORITY_BASE
+#define THREAD_SCHED_PRIORITY_BASE	10
+#endif
+#ifndef THREAD_SCHED_PRIORITY_STEP
+#define THREAD_SCHED_PRIORITY_STEP	10
+#endif
+#endif
 /* Private macro -------------------------------------------------------------*/
 /* Private variables ---------------------------------------------------------*/
+#if (WINDOWS != 0) || (LINUX != 0)
+#ifdef THREAD_SETTINGS_TABLE
+/**
+  * @brief Per thread priority and CPU affinity.
+  */
+static const OSThreadSettings ThreadSettings[] = { THREAD_SETTINGS_TABLE };
+#endif
+/**
+  * @brief Set once the real time policy has been refused, so the next threads
+  *	   are created with the default policy straight away.
+  */
+static volatile int ThreadSchedRefused;
+#if TIMER_AVAILABLE != 0
+static pthread_once_t TimerOnce = PTHREAD_ONCE_INIT;
+static pthread_mutex_t TimerLock = PTHREAD_MUTEX_INITIALIZER;	/*!< Protects the timer service */
+static pthread_cond_t TimerDone = PTHREAD_COND_INITIALIZER;	/*!< Signaled after each callback */
+static timerheap TimerHeap;		/*!< Running timers by expiry */
+static int TimerFd = -1;		/*!< Armed with the earliest expiry */
+static uint64_t TimerArmed;		/*!< Expiry the timerfd is armed with. 0 = disarmed */
+static OSTimer *TimerRunning;		/*!< Timer whose callback is running */
+static OSTimerStats TimerStats;
+static THREAD_ID ThreadIDTimer;
+#endif
+#endif
 /* Private function prototypes -----------------------------------------------*/
+#if (WINDOWS != 0) || (LINUX != 0)
+static uint64_t OSGetMicroseconds(void);
+static void OSThreadGetSettings(const OSThreadDef *Def, osPriority *Priority, uint32_t *CpuMask);
+static int OSThreadSetAttributes(pthread_attr_t *Attr, osPriority Priority, uint32_t CpuMask);
+#if TIMER_AVAILABLE != 0
+OS_THREAD_TYPE OSTimerProcess (OS_THREAD_ARG argument);	/*!< Timer service thread */
+DEFINE_THREAD(OSTimerProcess, osPriorityHigh, 1, 0);
+static void OSTimerInit(void);
+static void OSTimerArm(void);
+#endif
+#endif
 /* Private functions ---------------------------------------------------------*/
 
+#if (WINDOWS != 0) || (LINUX != 0)
+/**
+  * @brief   Creates a thread.
+  * @details The priority of the definition is mapped to THREAD_SCHED_POLICY
+  *	     levels and the thread is bound to its CPU mask. Both can be
+  *	     overridden by name in THREAD_SETTINGS_TABLE. If the process is not
+  *	     allowed to use them, the thread is created with the default
+  *	     attributes instead.
+  * @param[out] ThreadID Thread identification
+  * @param[in] 	Def Thread definition. See @ref DEFINE_THREAD
+  * @param[in] 	Arg Thread argument
+  * @retval	OS_OK if the thread is created, OS_ERROR Otherwise
+  */
+OSRetValue CreateThreadFunc(THREAD_ID *ThreadID, const OSThreadDef *Def, void *Arg)
+{
+  pthread_attr_t Attr;
+  osPriority Priority;
+  uint32_t CpuMask;
+  int RetThread = -1;
+
+  OSThreadGetSettings(Def, &Priority, &CpuMask);
+
+  pthread_attr_init(&Attr);
+  if(OSThreadSetAttributes(&Attr, Priority, CpuMask) > 0)
+  {
+    RetThread = pthread_create(ThreadID, &Attr, Def->Func, Arg);
+    if(RetThread == EPERM)
+    {
+      ThreadSchedRefused = 1;
+    }
+  }
+  pthread_attr_destroy(&Attr);
+
+  /* No attributes or not permitted: default attributes */
+  if(RetThread != 0)
+  {
+    RetThread = pthread_create(ThreadID, NULL, Def->Func, Arg);
+  }
+
+  return (RetThread == 0) ? OS_OK : OS_ERROR;
+}
+
+/**
+  * @brief   Pins a thread to a CPU. Overrides the THREAD_SETTINGS_TABLE mask.
+  * @param[in] 	ThreadID Thread identification
+  * @param[in] 	Cpu CPU number, modulo the online CPUs
+  * @retval	OS_OK if the thread is pinned, OS_ERROR Otherwise
+  */
+OSRetValue ThreadSetCpuFunc(THREAD_ID ThreadID, uint32_t Cpu)
+{
+#ifdef __linux__
+  cpu_set_t Cpus;
+  long Online = sysconf(_SC_NPROCESSORS_ONLN);
+
+  if(Online <= 0)
+  {
+    return OS_ERROR;
+  }
+  CPU_ZERO(&Cpus);
+  CPU_SET(Cpu % (uint32_t)Online, &Cpus);
+  return (pthread_setaffinity_np(ThreadID, sizeof(Cpus), &Cpus) == 0) ? OS_OK : OS_ERROR;
+#else
+  (void)ThreadID;
+  (void)Cpu;
+  return OS_ERROR;
+#endif
+}
+
+/**
+  * @brief   Creates a mutex.
+  * @details Priority inheritance is enabled when the platform supports it, so
+  *	     a low priority bus thread holding the mutex cannot delay a higher
+  *	     priority one indefinitely.
+  * @param[out] MutexID Mutex identification
+  * @retval	OS_OK if the mutex is created, OS_ERROR Otherwise
+  */
+OSRetValue CreateMutexFunc(MUTEX_ID *MutexID)
+{
+  pthread_mutexattr_t Attr;
+  int RetMutex;
+
+  memset(&MutexID->Stats, 0, sizeof(MutexID->Stats));
+
+  pthread_mutexattr_init(&Attr);
+#if defined(_POSIX_THREAD_PRIO_INHERIT) && (_POSIX_THREAD_PRIO_INHERIT > 0)
+  pthread_mutexattr_setprotocol(&Attr, PTHREAD_PRIO_INHERIT);
+#endif
+  RetMutex = pthread_mutex_init(&MutexID->Mutex, &Attr);
+  pthread_mutexattr_destroy(&Attr);
+
+  return (RetMutex == 0) ? OS_OK : OS_ERROR;
+}
+
+/**
+  * @brief   Copies the usage counters of a mutex.
+  * @param[in] 	MutexID Mutex identification
+  * @param[out] Stats Counters
+  * @param[in] 	Reset Clears the counters after the copy if not 0
+  */
+void MutexGetStatsFunc(MUTEX_ID *MutexID, OSMutexStats *Stats, uint8_t Reset)
+{
+  pthread_mutex_lock(&MutexID->Mutex);
+  *Stats = MutexID->Stats;
+  /* Timeouts are updated without the mutex */
+  Stats->Timeouts = __sync_fetch_and_add(&MutexID->Stats.Timeouts, 0);
+  if(Reset)
+  {
+    memset(&MutexID->Stats, 0, sizeof(MutexID->Stats));
+  }
+  pthread_mutex_unlock(&MutexID->Mutex);
+}
+#endif
+
 /**
   * @brief   Global mutex wait function.
   * @details This function process the return value of each OS specific mutex
   *          module.
   * @param[in] 	MutexID Mutex identification
-  * @retval	OS_OK if the thread get access, OS_ERROR Otherwise
+  * @param[in] 	millisec Maximum waiting time in milliseconds, @ref OS_WAIT_FOREVER
+  *		or 0 to return immediately
+  * @retval	OS_OK if the thread get access, OS_TIMEOUT if the time expired,
+  *		OS_ERROR Otherwise
   */
-OSRetValue MutexWaitFunc(MUTEX_ID *MutexID)
+OSRetValue MutexWaitFunc(MUTEX_ID *MutexID, uint32_t millisec)
 {
   OSRetValue ret;
   MUTEX_RET RetMutex;
 
   #if KEIL_RTX != 0
 
-  RetMutex = osMutexWait(*MutexID, osWaitForever);
+  RetMutex = osMutexWait(*MutexID, millisec);
   switch(RetMutex)
   {
 	  case osOK:
@@ -56,15 +248,53 @@ OSRetValue MutexWaitFunc(MUTEX_ID *MutexID)
 		  ret = OS_ERROR;
 		  break;
   }
-  #elif WINDOWS > 0
-  RetMutex = pthread_mutex_trylock(MutexID);
-  if(RetMutex == 0)
+  #elif (WINDOWS != 0) || (LINUX != 0)
+  struct timespec Deadline;
+  uint64_t Start;
+
+  /* The uncontended path does not read the clock */
+  RetMutex = pthread_mutex_trylock(&MutexID->Mutex);
+  if((RetMutex == EBUSY) && (millisec != 0))
   {
-	ret = OS_OK;
+    Start = OSGetMicroseconds();
+    if(millisec == OS_WAIT_FOREVER)
+    {
+      RetMutex = pthread_mutex_lock(&MutexID->Mutex);
+    }
+    else
+    {
+      /* pthread_mutex_timedlock is measured on the realtime clock */
+      clock_gettime(CLOCK_REALTIME, &Deadline);
+      Deadline.tv_sec  += millisec / 1000;
+      Deadline.tv_nsec += (long)(millisec % 1000) * 1000000L;
+      if(Deadline.tv_nsec >= 1000000000L)
+      {
+        Deadline.tv_sec++;
+        Deadline.tv_nsec -= 1000000000L;
+      }
+      RetMutex = pthread_mutex_timedlock(&MutexID->Mutex, &Deadline);
+    }
+    if(RetMutex == 0)
+    {
+      MutexID->Stats.Contended++;
+      MutexID->Stats.WaitTimeUs += OSGetMicroseconds() - Start;
+    }
   }
-  else
+
+  switch(RetMutex)
   {
-	ret = OS_ERROR;
+	  case 0:
+		  MutexID->Stats.Acquisitions++;
+		  ret = OS_OK;
+		  break;
+	  case EBUSY:
+	  case ETIMEDOUT:
+		  __sync_fetch_and_add(&MutexID->Stats.Timeouts, 1);
+		  ret = OS_TIMEOUT;
+		  break;
+	  default:
+		  ret = OS_ERROR;
+		  break;
   }
   #endif
 
@@ -98,7 +328,7 @@ OSGlobalRet MailGetFunc(MAIL_QUEUE_ID *MailID)
 	  ret.Data = NULL;
 	  ret.RetValue = OS_ERROR;
   }
-  #elif WINDOWS != 0
+  #elif (WINDOWS != 0) || (LINUX != 0)
   ret.Data = pqueue_pop(MailID);
   ret.RetValue = OS_OK;
   #endif
@@ -106,33 +336,568 @@ OSGlobalRet MailGetFunc(MAIL_QUEUE_ID *MailID)
   return ret;
 }
 
+/**
+  * @brief   Global mail get function with timeout.
+  * @details Same as @ref MailGetFunc but the thread is blocked at most
+  *	     millisec milliseconds waiting for a message.
+  * @param[in] 	MailID Mail Queue identification
+  * @param[in] 	millisec Maximum waiting time in milliseconds. 0 returns immediately
+  * @retval	OS_OK and the message if any, OS_TIMEOUT if the time expired,
+  *		OS_ERROR otherwise
+  */
+OSGlobalRet MailGetTimeoutFunc(MAIL_QUEUE_ID *MailID, uint32_t millisec)
+{
+  OSGlobalRet ret;
+
+  #if KEIL_RTX != 0
+  MAIL_QUEUE_RET BusQueueEvent;
+  BusQueueEvent = osMailGet(*MailID, millisec);
+  switch(BusQueueEvent.status)
+  {
+	  case osEventMail:
+		  ret.Data = BusQueueEvent.value.p;
+		  ret.RetValue = OS_OK;
+		  break;
+	  case osOK:		/* No message with a 0 timeout */
+	  case osEventTimeout:
+		  ret.Data = NULL;
+		  ret.RetValue = OS_TIMEOUT;
+		  break;
+	  default:
+		  ret.Data = NULL;
+		  ret.RetValue = OS_ERROR;
+		  break;
+  }
+  #elif (WINDOWS != 0) || (LINUX != 0)
+  if (millisec == 0)
+  {
+	  ret.Data = pqueue_pop_nonb(MailID);
+  }
+  else
+  {
+	  ret.Data = pqueue_pop_timed(MailID, millisec);
+  }
+  ret.RetValue = (ret.Data != NULL) ? OS_OK : OS_TIMEOUT;
+  #endif
+
+  return ret;
+}
+
+#if (WINDOWS != 0) || (LINUX != 0)
+/**
+  * @brief   Reads the system tick.
+  * @details Milliseconds from the monotonic clock. Only differences between
+  *	     two readings are meaningful.
+  * @retval	Current tick in milliseconds
+  */
+uint32_t OSGetTickFunc(void)
+{
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint32_t)((uint64_t)now.tv_sec * 1000u + (uint64_t)now.tv_nsec / 1000000u);
+}
+
+/**
+  * @brief   Sleeps the calling thread.
+  * @param[in] millisec Milliseconds
+  */
+void OSDelayFunc(uint32_t millisec)
+{
+  struct timespec delay;
+
+  delay.tv_sec = millisec / 1000u;
+  delay.tv_nsec = (long)(millisec % 1000u) * 1000000L;
+  while (nanosleep(&delay, &delay) != 0 && errno == EINTR)
+    ;
+}
+
+/**
+  * @brief   Time stamp of the events to be measured.
+  * @retval	Nanoseconds from the monotonic clock
+  */
+uint64_t OSGetTimeStampFunc(void)
+{
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000000u + (uint64_t)now.tv_nsec;
+}
+
+/**
+  * @brief   Microseconds from the monotonic clock.
+  */
+static uint64_t OSGetMicroseconds(void)
+{
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000u + (uint64_t)now.tv_nsec / 1000u;
+}
+
+/**
+  * @brief   Priority and CPU mask of a thread: the THREAD_SETTINGS_TABLE entry
+  *	     with its name or the definition values.
+  */
+static void OSThreadGetSettings(const OSThreadDef *Def, osPriority *Priority, uint32_t *CpuMask)
+{
+  *Priority = Def->Priority;
+  *CpuMask = 0;
+#ifdef THREAD_SETTINGS_TABLE
+  uint32_t i;
+
+  for(i = 0; i < sizeof(ThreadSettings) / sizeof(ThreadSettings[0]); i++)
+  {
+    if(strcmp(ThreadSettings[i].Name, Def->Name) == 0)
+    {
+      *Priority = ThreadSettings[i].Priority;
+      *CpuMask = ThreadSettings[i].CpuMask;
+      break;
+    }
+  }
+#endif
+}
+
+/**
+  * @brief   Fills the scheduling and affinity attributes of a new thread.
+  * @retval	Number of attributes set
+  */
+static int OSThreadSetAttributes(pthread_attr_t *Attr, osPriority Priority, uint32_t CpuMask)
+{
+  int Set = 0;
+
+#if THREAD_SCHED_POLICY > 0
+  struct sched_param Param;
+  int Policy = (THREAD_SCHED_POLICY == 2) ? SCHED_RR : SCHED_FIFO;
+  int Level;
+
+  if(!ThreadSchedRefused)
+  {
+    /* Idle .. Realtime are spread from the base level upwards */
+    Level = THREAD_SCHED_PRIORITY_BASE +
+            ((int)Priority - (int)osPriorityIdle) * THREAD_SCHED_PRIORITY_STEP;
+    if(Level < sched_get_priority_min(Policy))
+    {
+      Level = sched_get_priority_min(Policy);
+    }
+    if(Level > sched_get_priority_max(Policy))
+    {
+      Level = sched_get_priority_max(Policy);
+    }
+    Param.sched_priority = Level;
+
+    pthread_attr_setinheritsched(Attr, PTHREAD_EXPLICIT_SCHED);
+    pthread_attr_setschedpolicy(Attr, Policy);
+    pthread_attr_setschedparam(Attr, &Param);
+    Set++;
+  }
+#else
+  (void)Priority;
+#endif
+
+#ifdef __linux__
+  cpu_set_t Cpus;
+  uint32_t Cpu;
+
+  if(CpuMask != 0)
+  {
+    CPU_ZERO(&Cpus);
+    for(Cpu = 0; Cpu < 32; Cpu++)
+    {
+      if(CpuMask & (1u << Cpu))
+      {
+        CPU_SET(Cpu, &Cpus);
+      }
+    }
+    pthread_attr_setaffinity_np(Attr, sizeof(Cpus), &Cpus);
+    Set++;
+  }
+#else
+  (void)CpuMask;
+#endif
+
+  return Set;
+}
+#endif
+
+#if ((WINDOWS != 0) || (LINUX != 0)) && (TIMER_AVAILABLE != 0)
+/**
+  * @brief   Creates a stopped timer.
+  * @details The first timer starts the timer service thread.
+  * @param[in] 	Def Timer definition. See @ref DEFINE_TIMER
+  * @param[in] 	Type osTimerOnce or osTimerPeriodic
+  * @param[in] 	Arg Callback argument
+  * @retval	Timer identification, NULL on error
+  */
+TIMER_ID CreateTimerFunc(const OSTimerDef *Def, os_timer_type Type, void *Arg)
+{
+  OSTimer *Timer;
+
+  pthread_once(&TimerOnce, OSTimerInit);
+  if((TimerFd < 0) || (Def == NULL) || (Def->Callback == NULL))
+  {
+    return NULL;
+  }
+
+  Timer = (OSTimer *)MemAlloc(sizeof(OSTimer));
+  if(Timer != NULL)
+  {
+    timerheap_node_init(&Timer->Node);
+    Timer->Callback = Def->Callback;
+    Timer->Arg = Arg;
+    Timer->Type = Type;
+    Timer->PeriodUs = 0;
+  }
+  return Timer;
+}
+
+/**
+  * @brief   Starts or restarts a timer.
+  * @param[in] 	TimerID Timer identification
+  * @param[in] 	Period In OS ticks
+  * @retval	OS_OK if the timer is running, OS_ERROR Otherwise
+  */
+OSRetValue TimerStartFunc(TIMER_ID TimerID, unsigned int Period)
+{
+  OSRetValue ret = OS_ERROR;
+
+  if((TimerID == NULL) || (Period == 0))
+  {
+    return OS_ERROR;
+  }
+
+  pthread_mutex_lock(&TimerLock);
+  TimerID->PeriodUs = (uint64_t)Period * 1000u;
+  if(timerheap_push(&TimerHeap, &TimerID->Node, OSGetMicroseconds() + TimerID->PeriodUs) == 0)
+  {
+    OSTimerArm();
+    ret = OS_OK;
+  }
+  pthread_mutex_unlock(&TimerLock);
+
+  return ret;
+}
+
+/**
+  * @brief   Stops a timer. A callback already running is not waited for.
+  * @param[in] 	TimerID Timer identification
+  * @retval	OS_OK if the timer was running, OS_ERROR Otherwise
+  */
+OSRetValue TimerStopFunc(TIMER_ID TimerID)
+{
+  OSRetValue ret = OS_ERROR;
+
+  if(TimerID == NULL)
+  {
+    return OS_ERROR;
+  }
+
+  pthread_mutex_lock(&TimerLock);
+  if(timerheap_queued(&TimerID->Node))
+  {
+    timerheap_remove(&TimerHeap, &TimerID->Node);
+    OSTimerArm();
+    ret = OS_OK;
+  }
+  pthread_mutex_unlock(&TimerLock);
+
+  return ret;
+}
+
+/**
+  * @brief   Stops and frees a timer.
+  * @details Out of the timer callbacks it waits until a running callback of
+  *	     the timer finishes, so its argument can be freed afterwards.
+  * @param[in] 	TimerID Timer identification
+  */
+void TimerDeleteFunc(TIMER_ID TimerID)
+{
+  if(TimerID == NULL)
+  {
+    return;
+  }
+
+  pthread_mutex_lock(&TimerLock);
+  timerheap_remove(&TimerHeap, &TimerID->Node);
+  OSTimerArm();
+  while((TimerRunning == TimerID) && !pthread_equal(pthread_self(), ThreadIDTimer))
+  {
+    pthread_cond_wait(&TimerDone, &TimerLock);
+  }
+  pthread_mutex_unlock(&TimerLock);
+
+  MemFree(TimerID);
+}
+
+/**
+  * @brief   Copies the timer service counters.
+  * @param[out] Stats Counters
+  * @param[in] 	Reset If set, the counters are cleared
+  */
+void TimerGetStatsFunc(OSTimerStats *Stats, uint8_t Reset)
+{
+  pthread_mutex_lock(&TimerLock);
+  *Stats = TimerStats;
+  if(Reset)
+  {
+    memset(&TimerStats, 0, sizeof(TimerStats));
+  }
+  pthread_mutex_unlock(&TimerLock);
+}
+
+/**
+  * @brief   Timer service thread.
+  * @details It sleeps on the timerfd, armed with the earliest expiry, and
+  *	     runs the callbacks of every timer expired when it wakes up.
+  *	     Periodic timers keep their cadence; periods missed while the
+  *	     thread was late are skipped, not run in a burst.
+  */
+OS_THREAD_TYPE OSTimerProcess (OS_THREAD_ARG argument)
+{
+  struct timerheap_node *Top;
+  OSTimer *Timer;
+  uint64_t Expirations, Now, Next;
+
+  (void)argument;
+  while(1)
+  {
+    if((read(TimerFd, &Expirations, sizeof(Expirations)) < 0) && (errno != EAGAIN) && (errno != EINTR))
+    {
+      break;
+    }
+
+    pthread_mutex_lock(&TimerLock);
+    TimerStats.Wakeups++;
+    TimerArmed = 0;
+    Now = OSGetMicroseconds();
+    while(((Top = timerheap_top(&TimerHeap)) != NULL) && (Top->deadline <= Now))
+    {
+      Timer = (OSTimer *)Top;
+      if(Timer->Type == osTimerPeriodic)
+      {
+        Next = Top->deadline + Timer->PeriodUs;
+        if(Next <= Now)
+        {
+          Next += ((Now - Next) / Timer->PeriodUs + 1) * Timer->PeriodUs;
+        }
+        timerheap_push(&TimerHeap, Top, Next);
+      }
+      else
+      {
+        timerheap_remove(&TimerHeap, Top);
+      }
+
+      /* The callback may start, stop or delete timers */
+      TimerRunning = Timer;
+      TimerStats.Expirations++;
+      pthread_mutex_unlock(&TimerLock);
+      Timer->Callback(Timer->Arg);
+      pthread_mutex_lock(&TimerLock);
+      TimerRunning = NULL;
+      pthread_cond_broadcast(&TimerDone);
+    }
+    OSTimerArm();
+    pthread_mutex_unlock(&TimerLock);
+  }
+
+  return NULL;
+}
+
+/**
+  * @brief   Creates the timerfd and the timer service thread.
+  */
+static void OSTimerInit(void)
+{
+  int32_t FuncRet;
+
+  timerheap_init(&TimerHeap);
+  TimerFd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+  if(TimerFd < 0)
+  {
+    return;
+  }
+
+  CreateThread(FuncRet, ThreadIDTimer, THREAD_REF(OSTimerProcess), NULL);
+  if(!FuncRet)
+  {
+    close(TimerFd);
+    TimerFd = -1;
+  }
+}
+
+/**
+  * @brief   Arms the timerfd with the earliest expiry. Called with the
+  *	     service locked whenever the heap changes.
+  */
+static void OSTimerArm(void)
+{
+  struct timerheap_node *Top = timerheap_top(&TimerHeap);
+  struct itimerspec Spec;
+  uint64_t Deadline = (Top != NULL) ? Top->deadline : 0;
 
-#if HEARTBEAT_TIMER > 0
+  /* The thread is already waiting for this expiry */
+  if(Deadline == TimerArmed)
+  {
+    return;
+  }
+
+  /* A zero value disarms the timerfd, so keep expiries away from it */
+  if((Top != NULL) && (Deadline == 0))
+  {
+    Deadline = 1;
+  }
+  memset(&Spec, 0, sizeof(Spec));
+  Spec.it_value.tv_sec = (time_t)(Deadline / 1000000u);
+  Spec.it_value.tv_nsec = (long)(Deadline % 1000000u) * 1000L;
+  if(timerfd_settime(TimerFd, TFD_TIMER_ABSTIME, &Spec, NULL) == 0)
+  {
+    TimerArmed = Deadline;
+  }
+}
+#endif
+
+#if KEIL_RTX != 0
 /**
   * @brief  	 Global Timer start function.
   * @details	This function starts a software timer.
   * @param[in] 	TimerID Timer identification
   * @param[in] 	Period In OS ticks
-  * @retval	OS_OK if the thread get access, OS_ERROR Otherwise
+  * @retval	OS_OK if the timer is started, OS_ERROR Otherwise
   */
 OSRetValue TimerStartFunc(TIMER_ID TimerID, unsigned int Period)
 {
-	OSRetValue ret;
 	TIMER_RET  status;  
 	
-	#if KEIL_RTX != 0
-	/* start timer with periodic 500 ms interval */
 	status = osTimerStart (TimerID, Period);            
-	if (status != osOK)  
-	{
-		ret = OS_OK;
-	}
-	else
+	return (status == osOK) ? OS_OK : OS_ERROR;
+}
+
+/**
+  * @brief  	 Adds to a reference count shared by threads.
+  * @details	Exclusive load and store of the Cortex-M, retried until no
+  *		other access came in between.
+  * @param[in,out] Count Reference count
+  * @param[in] 	Delta Value added
+  * @retval	New count
+  */
+uint32_t RefCountAddFunc(volatile uint32_t *Count, int32_t Delta)
+{
+	uint32_t Value;
+
+	__dmb(0xF);
+	do
 	{
-		ret = OS_ERROR;
-	}
-	#endif
-	
-	return ret;
+		Value = __ldrex(Count) + (uint32_t)Delta;
+	} while(__strex(Value, Count) != 0);
+	__dmb(0xF);
+	return Value;
+}
+#endif
+
+#else /* OS_ACTIVE */
+#if MCU_STM32F4XX != 0
+#include "stm32f4xx.h"
+#elif defined(__unix__)
+#include <time.h>
+#endif
+
+/* Private variables ---------------------------------------------------------*/
+#if MCU_STM32F4XX != 0
+static volatile uint32_t OSTickCount;	/*!< Milliseconds since OSInitFunc */
+#endif
+
+/* Private functions ---------------------------------------------------------*/
+
+/**
+  * @brief   Initializes the super loop services.
+  * @details On MCUs the SysTick interrupt is configured to count milliseconds.
+  */
+void OSInitFunc(void)
+{
+#if MCU_STM32F4XX != 0
+  OSTickCount = 0;
+  SysTick_Config(SystemCoreClock / 1000u);
+#endif
+}
+
+/**
+  * @brief   Counts one tick. Called from the SysTick interrupt.
+  */
+void OSTickHandler(void)
+{
+#if MCU_STM32F4XX != 0
+  OSTickCount++;
+#endif
+}
+
+/**
+  * @brief   Reads the system tick.
+  * @retval	Current tick in milliseconds
+  */
+uint32_t OSGetTickFunc(void)
+{
+#if MCU_STM32F4XX != 0
+  return OSTickCount;
+#elif defined(__unix__)
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint32_t)((uint64_t)now.tv_sec * 1000u + (uint64_t)now.tv_nsec / 1000000u);
+#else
+  return 0;
+#endif
+}
+
+#if (MCU_STM32F4XX == 0) && defined(__unix__)
+/**
+  * @brief   Time stamp of the events to be measured.
+  * @retval	Nanoseconds from the monotonic clock
+  */
+uint64_t OSGetTimeStampFunc(void)
+{
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000000u + (uint64_t)now.tv_nsec;
+}
+#endif
+#endif /* OS_ACTIVE */
+
+#if MCU_STM32F4XX != 0
+#include "stm32f4xx.h"
+
+/* Private variables ---------------------------------------------------------*/
+static uint32_t OSCyclesHigh;	/*!< Wraps of the cycle counter */
+static uint32_t OSCyclesLast;	/*!< Last cycle count read */
+
+/**
+  * @brief   Time stamp of the events to be measured.
+  * @details The DWT cycle counter, started on the first call and extended to
+  *	     64 bits. A wrap is only seen if the counter is read at least once
+  *	     per wrap, 25 s at 168 MHz; longer intervals may come out short.
+  * @retval	Cycles
+  */
+uint64_t OSGetTimeStampFunc(void)
+{
+  uint32_t Primask = __get_PRIMASK();
+  uint32_t Now, High;
+
+  __disable_irq();
+  if((DWT->CTRL & DWT_CTRL_CYCCNTENA_Msk) == 0)
+  {
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CYCCNT = 0;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+  }
+  Now = DWT->CYCCNT;
+  if(Now < OSCyclesLast)
+  {
+    OSCyclesHigh++;
+  }
+  OSCyclesLast = Now;
+  High = OSCyclesHigh;
+  __set_PRIMASK(Primask);
+
+  return ((uint64_t)High << 32) | Now;
 }
 #endif
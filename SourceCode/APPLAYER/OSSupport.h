@@ -19,10 +19,10 @@
 #endif
 
 /* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
 #include "SysConfig.h"
 #include "OSSupport.h"
 	
-#if OS_ACTIVE != 0
 	 /* Common Exported types ------------------------------------------------------*/
 	 /**
 		* @brief Global OS enum return values
@@ -42,6 +42,11 @@
 		 int RetValue; 	/*!< OS functions return value. See @ref OsRetValue*/
 		 void*	 Data;	/*!< Pointer to data returned by a OS function*/
 	 }OSGlobalRet;
+
+	 /**
+		* @brief Infinite timeout of the OS wait functions.
+		*/
+	 #define OS_WAIT_FOREVER	0xFFFFFFFFu
 	
 	 typedef enum
 	 {
@@ -50,6 +55,8 @@
 		TASK_ERROR 			= -1, /*!<Task / Thread cannot be initializated */
 		INSTANCE_OK 		= 0		/*!<Instance correctly initializated*/
 	}InstanceRet;
+
+#if OS_ACTIVE != 0
 	/**
 		* @addtogroup KEIL_RTX
 		*	@{
@@ -66,7 +73,7 @@
 		#define THREAD_REF(name)			osThread(name)
 		#define MUTEX_REF(name)				osMutex(name)
 		#define MAIL_QUEUE_REF(name)	osMailQ(name)
-		#define TIMER_REF(name)
+		#define TIMER_REF(name)				osTimer(name)
 				
 		/* Exported types ------------------------------------------------------------*/
 		#define MUTEX_RET					osStatus		
@@ -96,27 +103,55 @@
 
 		/* Exported functions ------------------------------------------------------- */
 		/* Init functions */
-		#define CreateThread(ret,threadid,thread, arg)	threadid = osThreadCreate (thread, arg)
+		#define CreateThread(ret,threadid,thread, arg)	threadid = osThreadCreate (thread, arg); ret = (threadid != NULL)
     #define StopThread(ret, threadid);			        ret = osThreadTerminate(threadid);
     #define ForceStopThread(ret,threadid);		      ret = osThreadTerminate(threadid);
+    /* Waits until a thread has finished */
+    #define JoinThread(ret, threadid)		      while(osThreadGetPriority(threadid) != osPriorityError) { osDelay(1); } ret = 0
 		
 		/* Mutex functions */
-		#define CreateMutex(retID, mutex)				        retID = osMutexCreate(mutex)
-		#define MutexWait(MutexID) 						          MutexWaitFunc(&MutexID)
-		OSRetValue MutexWaitFunc(MUTEX_ID *MutexID);
+		#define MUTEX_STATS_AVAILABLE	0
+		#define CreateMutex(ret, retID, mutex)			      retID = osMutexCreate(mutex); ret = (retID != NULL)
+		#define MutexWait(MutexID) 						          MutexWaitFunc(&MutexID, OS_WAIT_FOREVER)
+		#define MutexWaitTimeout(MutexID, millisec)		  MutexWaitFunc(&MutexID, millisec)
+		OSRetValue MutexWaitFunc(MUTEX_ID *MutexID, uint32_t millisec);
 		#define MutexRelease(MutexID)					          osMutexRelease(MutexID)
 		
 		/* Mail function */
-		#define CreateMailQueue(ret, retID, queue, param)	  retID = osMailCreate(queue, param);
+		#define CreateMailQueue(ret, retID, queue, param)	  retID = osMailCreate(queue, param); ret = (retID != NULL)
 		#define MailAlloc(RetData,MailID, time)				      RetData = osMailAlloc(MailID, time)
 		#define MailFree(MailID, data)						          osMailFree(MailID, data)
 		#define MailPut(MailID, data)						            osMailPut(MailID, data)
+		/* RTX mail queues are FIFO: the priority is ignored */
+		#define MailPutPrio(MailID, data, prio)				      osMailPut(MailID, data)
 		#define MailGet(RetMail,MailID)			                RetMail = MailGetFunc(&MailID)		
 		OSGlobalRet MailGetFunc(MAIL_QUEUE_ID *MailID);
+		#define MailGetTimeout(RetMail,MailID,millisec)	    RetMail = MailGetTimeoutFunc(&MailID, millisec)
+		OSGlobalRet MailGetTimeoutFunc(MAIL_QUEUE_ID *MailID, uint32_t millisec);
+		
+		/* Time functions. Ticks are free running and wrap around */
+		#define OSGetTick()                                 osKernelSysTick()
+		#define OS_TICKS_TO_MS(ticks)                       ((ticks) / osKernelSysTickMicroSec(1000))
+		#define OSDelay(millisec)                           osDelay(millisec)
+		/* Time stamps: cycles of the DWT counter, extended to 64 bits */
+		#define OSGetTimeStamp()                            OSGetTimeStampFunc()
+		#define OS_TIMESTAMP_TO_US(stamp)                   ((stamp) / (SystemCoreClock / 1000000u))
+		extern uint32_t SystemCoreClock;
+		uint64_t OSGetTimeStampFunc(void);
+		
+		/* Reference counts of data shared by threads. They return the new count */
+		#define RefCountInc(Count)                          RefCountAddFunc(&(Count), 1)
+		#define RefCountDec(Count)                          RefCountAddFunc(&(Count), -1)
+		uint32_t RefCountAddFunc(volatile uint32_t *Count, int32_t Delta);
+		/* Orders the memory accesses before and after it */
+		#define OSMemoryBarrier()                           __dmb(0xF)
 		
 		/* Timer function */
+		#define TIMER_AVAILABLE	1
 		#define CreateTimer(timer, mode, arg) 			osTimerCreate (timer, mode, arg)
     #define TimerStart(Ret, TimerID, Period)    Ret = TimerStartFunc(TimerID, Period)
+		#define TimerStop(Ret, TimerID)			Ret = (osTimerStop(TimerID) == osOK) ? OS_OK : OS_ERROR
+		#define TimerDelete(TimerID)			osTimerDelete(TimerID)
 		OSRetValue TimerStartFunc(TIMER_ID TimerID, unsigned int Period);
 	/**
 		*	@}
@@ -167,15 +202,28 @@
 	#define MailAlloc(MailID, time)								
 	#define MailFree(MailID, data)								
 	#define MailPut(MailID, data)								
+	#define MailPutPrio(MailID, data, prio)
 	#define MailGet(MailID)
+	#define MailGetTimeout(MailID, millisec)
+
+	/* Time functions */
+	#define OSGetTick()
+	#define OS_TICKS_TO_MS(ticks)
+	#define OSGetTimeStamp()
+	#define OS_TIMESTAMP_TO_US(stamp)
+
+	/* Reference counts */
+	#define RefCountInc(Count)
+	#define RefCountDec(Count)
+	#define OSMemoryBarrier()
 	/**
 	  *@}
 	  */
-	#elif WINDOWS != 0
+	#elif (WINDOWS != 0) || (LINUX != 0)
 	/**
 	* @addtogroup WINDOWS
 	*	@{
-	*		@brief Windos OS function mapping. Based on pThread.
+	*		@brief Windos and Linux OS function mapping. Based on pThread.
 	*/
 	/* Includes ------------------------------------------------------------------*/
 	#include <pthread.h>             	/*!< pThread header file */
@@ -184,56 +232,208 @@
 	#include "../MBALibrary/MBAProtocols/MBATransferProtocol.h"
 
 	/* Exported define -----------------------------------------------------------*/
+	/* The timer service waits on a timerfd */
+	#ifdef __linux__
+	#define TIMER_AVAILABLE 	1
+	#else
 	#define TIMER_AVAILABLE 	0
+	#endif
 
 
-	#define THREAD_REF(name)	name
+	#define THREAD_REF(name)	(&os_thread_def_##name)
 	#define MUTEX_REF(name)
 	#define MAIL_QUEUE_REF(name)
+	#define TIMER_REF(name)		(&os_timer_def_##name)
 
 	/* Exported types ------------------------------------------------------------*/
 	#define MUTEX_RET		int
 	#define MAIL_QUEUE_RET	int
 
+	/**
+	  * @brief Mutex usage counters. They are updated with the mutex taken.
+	  */
+	typedef struct
+	{
+	  uint32_t Acquisitions;	/*!< Successful waits */
+	  uint32_t Contended;		/*!< Waits that found the mutex taken */
+	  uint32_t Timeouts;		/*!< Waits that expired */
+	  uint64_t WaitTimeUs;		/*!< Time spent in contended waits */
+	}OSMutexStats;
+
+	/**
+	  * @brief pThread mutex with priority inheritance and usage counters.
+	  */
+	typedef struct
+	{
+	  pthread_mutex_t Mutex;
+	  OSMutexStats Stats;
+	}OSMutex;
+
 	#define THREAD_ID	 	pthread_t
-	#define MUTEX_ID	 	pthread_mutex_t
+	#define MUTEX_ID	 	OSMutex
 	#define MAIL_QUEUE_ID		pqueue
+	#define TIMER_ID		OSTimerId
+	#define TIMER_RET		OSRetValue
 
 	#define OS_THREAD_TYPE	void*
 	#define OS_THREAD_ARG		void*
 
+	/**
+	  * @brief Thread priorities. Same values than CMSIS-RTOS.
+	  */
+	typedef enum
+	{
+	  osPriorityIdle          = -3,
+	  osPriorityLow           = -2,
+	  osPriorityBelowNormal   = -1,
+	  osPriorityNormal        =  0,
+	  osPriorityAboveNormal   = +1,
+	  osPriorityHigh          = +2,
+	  osPriorityRealtime      = +3
+	}osPriority;
+
+	/**
+	  * @brief Thread definition. See @ref DEFINE_THREAD.
+	  */
+	typedef struct
+	{
+	  const char *Name;			/*!< Function name, used to find the thread settings */
+	  OS_THREAD_TYPE (*Func)(OS_THREAD_ARG);	/*!< Thread function */
+	  osPriority Priority;			/*!< Priority. See THREAD_SCHED_POLICY */
+	  uint32_t Instances;			/*!< Not used */
+	  uint32_t StackSize;			/*!< Not used, the platform default is kept */
+	}OSThreadDef;
+
+	/**
+	  * @brief Thread settings overriding the definition. See THREAD_SETTINGS_TABLE.
+	  */
+	typedef struct
+	{
+	  const char *Name;			/*!< Function name */
+	  osPriority Priority;			/*!< Priority */
+	  uint32_t CpuMask;			/*!< Allowed CPUs, bit 0 = CPU 0. 0 = any */
+	}OSThreadSettings;
+
+	/**
+	  * @brief Timer modes. Same values than CMSIS-RTOS.
+	  */
+	typedef enum
+	{
+	  osTimerOnce             = 0,	/*!< One shot timer */
+	  osTimerPeriodic         = 1	/*!< Repeating timer */
+	}os_timer_type;
+
+	/**
+	  * @brief Timer callback. It runs in the timer service thread.
+	  */
+	typedef void (*os_ptimer)(void const *argument);
+
+	/**
+	  * @brief Timer definition. See @ref DEFINE_TIMER.
+	  */
+	typedef struct
+	{
+	  os_ptimer Callback;			/*!< Function called on expiry */
+	}OSTimerDef;
+
+	/**
+	  * @brief Timer service counters.
+	  */
+	typedef struct
+	{
+	  uint32_t Expirations;		/*!< Callbacks run */
+	  uint32_t Wakeups;		/*!< Times the service thread woke up */
+	}OSTimerStats;
+
+	typedef struct OSTimer OSTimer;	/*!< Timer instance, private to OSSupport.c */
+	typedef OSTimer *OSTimerId;
+
 
 	/* Exported constants --------------------------------------------------------*/
 	/* Exported macro ------------------------------------------------------------*/
 	#define OS_INIT()
 	#define OS_START()		pthread_exit(NULL);
 
-	#define DEFINE_THREAD(func, prior, inst, size)
+	#define DEFINE_THREAD(func, prior, inst, size)	const OSThreadDef os_thread_def_##func = { #func, func, prior, inst, size }
 	#define DEFINE_MUTEX(name)
 	#define DEFINE_MAIL_QUEUE(name,size,data)
+	#define DEFINE_TIMER(name, callback)		const OSTimerDef os_timer_def_##name = { callback }
 
 	/* Exported variables --------------------------------------------------------*/
 
 	/* Exported functions ------------------------------------------------------- */
 	/* Thread functions */
-	#define CreateThread(ret,threadid,thread,arg)   	ret=pthread_create(&threadid, NULL, thread, arg)
+	#define CreateThread(ret,threadid,thread,arg)   	ret = (CreateThreadFunc(&threadid, thread, arg) == OS_OK)
 	#define StopThread(ret, threadid);			ret=pthread_cancel(threadid)
 	#define ForceStopThread(ret,threadid);		pthread_exit(NULL);
+	/* Waits until a thread has finished and releases it */
+	#define JoinThread(ret, threadid)		ret = pthread_join(threadid, NULL)
+	OSRetValue CreateThreadFunc(THREAD_ID *ThreadID, const OSThreadDef *Def, void *Arg);
+	/* Pins a running thread to one CPU, taken modulo the online CPUs */
+	#define ThreadSetCpu(ret, threadid, cpu)	ret = (ThreadSetCpuFunc(threadid, cpu) == OS_OK)
+	OSRetValue ThreadSetCpuFunc(THREAD_ID ThreadID, uint32_t Cpu);
 
 	/* Mutex functions */
-	#define CreateMutex(retID,mutex)		  	pthread_mutex_init(&retID, NULL)
-	#define MutexWait(MutexID) 				MutexWaitFunc(&MutexID)
-	OSRetValue MutexWaitFunc(MUTEX_ID *MutexID);
-	#define MutexRelease(MutexID) 			pthread_mutex_unlock(&MutexID)
+	#define MUTEX_STATS_AVAILABLE	1
+	#define CreateMutex(ret,retID,mutex)		  	ret = (CreateMutexFunc(&retID) == OS_OK)
+	#define MutexWait(MutexID) 				MutexWaitFunc(&MutexID, OS_WAIT_FOREVER)
+	#define MutexWaitTimeout(MutexID, millisec)	MutexWaitFunc(&MutexID, millisec)
+	#define MutexRelease(MutexID) 			pthread_mutex_unlock(&(MutexID).Mutex)
+	/* Copies the usage counters. Reset clears them */
+	#define MutexGetStats(MutexID, pStats, Reset)	MutexGetStatsFunc(&MutexID, pStats, Reset)
+	OSRetValue CreateMutexFunc(MUTEX_ID *MutexID);
+	OSRetValue MutexWaitFunc(MUTEX_ID *MutexID, uint32_t millisec);
+	void MutexGetStatsFunc(MUTEX_ID *MutexID, OSMutexStats *Stats, uint8_t Reset);
 
 	/* Mail function */
 	#define CreateMailQueue(ret ,retID, queue, param)	pqueue_init(&retID); ret = 1;
 	#define MailAlloc(RetData,MailID,time)		RetData = (TransProtFrame *)MemAlloc(sizeof(TransProtFrame))
 	#define MailFree(MailID, data)				MemFree(data)
 	#define MailPut(MailID, data)				pqueue_push(&MailID, data);
+	#define MailPutPrio(MailID, data, prio)		pqueue_push_prio(&MailID, data, prio);
 	#define MailGet(RetMail,MailID)				RetMail = MailGetFunc(&MailID)
+	#define MailGetTimeout(RetMail,MailID,millisec)	RetMail = MailGetTimeoutFunc(&MailID, millisec)
+	/* Descriptor readable while the queue holds messages. -1 if not supported */
+	#define MailQueueFd(MailID)					pqueue_eventfd(&MailID)
+	/* Holds all but the control mails: they stay in the queue, which is read
+	 * and waited on as if it had none of them. Hold 0 releases them */
+	#define MailQueueHold(MailID, Hold)			pqueue_hold(&MailID, (Hold) ? PQUEUE_LANE_CONTROL + 1 : PQUEUE_LANES)
 
 	OSGlobalRet MailGetFunc(MAIL_QUEUE_ID *MailID);
+	OSGlobalRet MailGetTimeoutFunc(MAIL_QUEUE_ID *MailID, uint32_t millisec);
+
+	/* Time functions. Ticks are milliseconds and wrap around */
+	#define OSGetTick()					OSGetTickFunc()
+	#define OS_TICKS_TO_MS(ticks)		(ticks)
+	#define OSDelay(millisec)			OSDelayFunc(millisec)
+	uint32_t OSGetTickFunc(void);
+	void OSDelayFunc(uint32_t millisec);
+	/* Time stamps: nanoseconds of the monotonic clock */
+	#define OSGetTimeStamp()			OSGetTimeStampFunc()
+	#define OS_TIMESTAMP_TO_US(stamp)		((stamp) / 1000u)
+	uint64_t OSGetTimeStampFunc(void);
+
+	/* Reference counts of data shared by threads. They return the new count */
+	#define RefCountInc(Count)			__atomic_add_fetch(&(Count), 1, __ATOMIC_RELAXED)
+	#define RefCountDec(Count)			__atomic_sub_fetch(&(Count), 1, __ATOMIC_ACQ_REL)
+	/* Orders the memory accesses before and after it */
+	#define OSMemoryBarrier()			__atomic_thread_fence(__ATOMIC_SEQ_CST)
+
+	#if TIMER_AVAILABLE != 0
+	/* Timer functions. Periods are in ticks. All the timers share one service
+	 * thread, woken up once per batch of expiries */
+	#define CreateTimer(timer, mode, arg)			CreateTimerFunc(timer, mode, arg)
+	#define TimerStart(Ret, TimerID, Period)		Ret = TimerStartFunc(TimerID, Period)
+	#define TimerStop(Ret, TimerID)				Ret = TimerStopFunc(TimerID)
+	#define TimerDelete(TimerID)				TimerDeleteFunc(TimerID)
+	/* Copies the service counters. Reset clears them */
+	#define TimerGetStats(pStats, Reset)			TimerGetStatsFunc(pStats, Reset)
+	TIMER_ID CreateTimerFunc(const OSTimerDef *Def, os_timer_type Type, void *Arg);
+	OSRetValue TimerStartFunc(TIMER_ID TimerID, unsigned int Period);
+	OSRetValue TimerStopFunc(TIMER_ID TimerID);
+	void TimerDeleteFunc(TIMER_ID TimerID);
+	void TimerGetStatsFunc(OSTimerStats *Stats, uint8_t Reset);
+	#endif
 
   /**
     *@}
@@ -243,6 +443,74 @@
 	#error "An OS must be selected if the OS_ACTIVE parameter is enabled"
 	#endif
 
+#else
+	/**
+	* @addtogroup NO_OS
+	*	@{
+	*		@brief Super loop. There are no threads, mutexes nor mail queues: main
+	*		       calls the bus and MBA steps in turn and the frames are handed
+	*		       over by direct function calls.
+	*/
+	/* Exported macro ------------------------------------------------------------*/
+	#define OS_INIT()		OSInitFunc()
+	#define OS_START()
+
+	/* Exported functions ------------------------------------------------------- */
+	void OSInitFunc(void);
+
+	/* Time functions. Ticks are milliseconds and wrap around. On MCUs the tick
+	 * is counted by @ref OSTickHandler, called from the SysTick interrupt */
+	#define OSGetTick()		OSGetTickFunc()
+	#define OS_TICKS_TO_MS(ticks)	(ticks)
+	uint32_t OSGetTickFunc(void);
+	void OSTickHandler(void);
+
+	/* Time stamps: cycles of the DWT counter on MCUs, extended to 64 bits, or
+	 * nanoseconds of the monotonic clock */
+	#define OSGetTimeStamp()	OSGetTimeStampFunc()
+	#if MCU_STM32F4XX != 0
+	#define OS_TIMESTAMP_TO_US(stamp)	((stamp) / (SystemCoreClock / 1000000u))
+	extern uint32_t SystemCoreClock;
+	#else
+	#define OS_TIMESTAMP_TO_US(stamp)	((stamp) / 1000u)
+	#endif
+	uint64_t OSGetTimeStampFunc(void);
+
+	/* Reference counts. There is a single thread of execution */
+	#define RefCountInc(Count)	(++(Count))
+	#define RefCountDec(Count)	(--(Count))
+	#define OSMemoryBarrier()
+  /**
+    *@}
+    */
+#endif
+
+/* Thread loop statistics. See LOOP_STATS in SysConfig.h */
+#if !defined(LOOP_STATS) || (OS_ACTIVE == 0) || ((WINDOWS == 0) && (LINUX == 0))
+#undef LOOP_STATS
+#define LOOP_STATS	0
+#endif
+
+#if LOOP_STATS > 0
+	#include "../TOOLS/loopstats.h"
+	/* Takes the statistics of the calling thread, named Name or "Name Index" */
+	#define LoopStatsOpen(Name, Index)		loopstats_current = loopstats_open(Name, Index)
+	/* Work of an iteration of the calling thread: after its wait, up to its end */
+	#define LoopStatsBegin()			do { if(loopstats_current) loopstats_begin(loopstats_current); } while(0)
+	#define LoopStatsEnd()				do { if(loopstats_current) loopstats_end(loopstats_current); } while(0)
+	/* Frame processed by the iteration, logged if it stalls */
+	#define LoopStatsFrame(pFrame)			do { if(loopstats_current) loopstats_frame(loopstats_current, LOOP_FRAME_TAG(pFrame)); } while(0)
+	/* Frame logged on a stall: destination, command, source, size */
+	#define LOOP_FRAME_TAG(pFrame)			(((pFrame) == NULL) ? 0u : \
+							 (((uint32_t)(pFrame)->Header.DestinationID << 24) | \
+							  ((uint32_t)(pFrame)->Header.Command << 16) | \
+							  ((uint32_t)(pFrame)->Header.SourceID << 8) | \
+							  ((uint32_t)(pFrame)->Header.Size & 0xFF)))
+#else
+	#define LoopStatsOpen(Name, Index)
+	#define LoopStatsBegin()
+	#define LoopStatsEnd()
+	#define LoopStatsFrame(pFrame)
 #endif
 
 /**
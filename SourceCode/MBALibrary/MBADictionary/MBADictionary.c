@@ -63,9 +63,31 @@ static ObjectStruct Dictionary[] =
     /* State machine registers */
     {0x0A00, "Actual State",    	  sizeof("Actual State") - 1,       0,                       	    READ_ONLY_ACCESS | UNSIGNED_DATA, NULL,		        NULL},
     {0x0A0A, "Requested State", 	  sizeof("Requested State") - 1,    0,                          	READ_ONLY_ACCESS | UNSIGNED_DATA, NULL,		        NULL},
+#if defined(LOOP_STATS) && (LOOP_STATS > 0)
+    /* Thread loop statistics */
+    {0x0B00, "Stall Threshold",     sizeof("Stall Threshold") - 1,    0,                          	FULL_ACCESS      | UNSIGNED_DATA, NULL,		        NULL},
+    {0x0B10, "Loop Name",           sizeof("Loop Name") - 1,          0,                          	READ_ONLY_ACCESS | CHAR_DATA,     NULL,		        NULL},
+    {0x0B11, "Loop Name",           sizeof("Loop Name") - 1,          0,                          	READ_ONLY_ACCESS | CHAR_DATA,     NULL,		        NULL},
+    {0x0B12, "Loop Name",           sizeof("Loop Name") - 1,          0,                          	READ_ONLY_ACCESS | CHAR_DATA,     NULL,		        NULL},
+    {0x0B13, "Loop Name",           sizeof("Loop Name") - 1,          0,                          	READ_ONLY_ACCESS | CHAR_DATA,     NULL,		        NULL},
+    {0x0B14, "Loop Name",           sizeof("Loop Name") - 1,          0,                          	READ_ONLY_ACCESS | CHAR_DATA,     NULL,		        NULL},
+    {0x0B15, "Loop Name",           sizeof("Loop Name") - 1,          0,                          	READ_ONLY_ACCESS | CHAR_DATA,     NULL,		        NULL},
+    {0x0B16, "Loop Name",           sizeof("Loop Name") - 1,          0,                          	READ_ONLY_ACCESS | CHAR_DATA,     NULL,		        NULL},
+    {0x0B17, "Loop Name",           sizeof("Loop Name") - 1,          0,                          	READ_ONLY_ACCESS | CHAR_DATA,     NULL,		        NULL},
+    {0x0B20, "Loop Stats",          sizeof("Loop Stats") - 1,         0,                          	READ_ONLY_ACCESS | UNSIGNED_DATA, NULL,		        NULL},
+    {0x0B21, "Loop Stats",          sizeof("Loop Stats") - 1,         0,                          	READ_ONLY_ACCESS | UNSIGNED_DATA, NULL,		        NULL},
+    {0x0B22, "Loop Stats",          sizeof("Loop Stats") - 1,         0,                          	READ_ONLY_ACCESS | UNSIGNED_DATA, NULL,		        NULL},
+    {0x0B23, "Loop Stats",          sizeof("Loop Stats") - 1,         0,                          	READ_ONLY_ACCESS | UNSIGNED_DATA, NULL,		        NULL},
+    {0x0B24, "Loop Stats",          sizeof("Loop Stats") - 1,         0,                          	READ_ONLY_ACCESS | UNSIGNED_DATA, NULL,		        NULL},
+    {0x0B25, "Loop Stats",          sizeof("Loop Stats") - 1,         0,                          	READ_ONLY_ACCESS | UNSIGNED_DATA, NULL,		        NULL},
+    {0x0B26, "Loop Stats",          sizeof("Loop Stats") - 1,         0,                          	READ_ONLY_ACCESS | UNSIGNED_DATA, NULL,		        NULL},
+    {0x0B27, "Loop Stats",          sizeof("Loop Stats") - 1,         0,                          	READ_ONLY_ACCESS | UNSIGNED_DATA, NULL,		        NULL},
+#endif
     /* Device Identification in network */
     {0x0F00, "Device ID", 		      sizeof("Device ID") - 1,	   	    0,				                    FULL_ACCESS | UNSIGNED_DATA, 		  NULL,		        NULL},
     {0x0F10, "Device Interfaces", 	sizeof("Device Interfaces") - 1,  0,                       	    READ_ONLY_ACCESS | UNSIGNED_DATA, NULL,		        NULL},
+    {0x0F20, "Ready Interfaces", 	sizeof("Ready Interfaces") - 1,   0,                       	    READ_ONLY_ACCESS | UNSIGNED_DATA, NULL,		        NULL},
+    {0x0F21, "Required Interfaces", sizeof("Required Interfaces") - 1, 0,                      	    FULL_ACCESS      | UNSIGNED_DATA, NULL,		        NULL},
 #if AVAILABLE_INTERFACES > 0
     /* Interface 0 description: USB */
     {0x1000, "Interface 0", 	    	sizeof("Interface 0") - 1, 		    0,				                    READ_ONLY_ACCESS | UNSIGNED_DATA,	NULL,		        NULL},
@@ -73,6 +95,14 @@ static ObjectStruct Dictionary[] =
     {0x1002, "Interface Link",    	sizeof("Interface Link") - 1,     0, 				                    FULL_ACCESS      | UNSIGNED_DATA, NULL,					  NULL},
     {0x1003, "Interface Type",    	sizeof("Interface Type") - 1,     0, 				                    FULL_ACCESS      | UNSIGNED_DATA, NULL,					  NULL},
     {0x1004, "Interface State",   	sizeof("Interface State") - 1,    0, 				                    READ_ONLY_ACCESS | UNSIGNED_DATA, NULL,					  NULL},
+    {0x1005, "Init Time",         	sizeof("Init Time") - 1,          0, 				                    READ_ONLY_ACCESS | UNSIGNED_DATA, NULL,					  NULL},
+    {0x1006, "Routes",            	sizeof("Routes") - 1,              0, 				                    FULL_ACCESS      | UNSIGNED_DATA, NULL,					  NULL},
+    {0x1007, "Latency",           	sizeof("Latency") - 1,             0, 				                    READ_ONLY_ACCESS | UNSIGNED_DATA, NULL,					  NULL},
+    {0x1008, "Flow Window",       	sizeof("Flow Window") - 1,       0, 				                    FULL_ACCESS      | UNSIGNED_DATA, NULL,					  NULL},
+    {0x1009, "Aggregate Size",    	sizeof("Aggregate Size") - 1,    0, 				                    FULL_ACCESS      | UNSIGNED_DATA, NULL,					  NULL},
+    {0x100A, "Aggregate Hold",    	sizeof("Aggregate Hold") - 1,    0, 				                    FULL_ACCESS      | UNSIGNED_DATA, NULL,					  NULL},
+    {0x100B, "Groups",            	sizeof("Groups") - 1,            0, 				                    FULL_ACCESS      | UNSIGNED_DATA, NULL,					  NULL},
+    {0x100C, "Fragment Size",     	sizeof("Fragment Size") - 1,     0, 				                    FULL_ACCESS      | UNSIGNED_DATA, NULL,					  NULL},
     {0x1200, "PHDL Fields",       	sizeof("PHDL Fields") - 1,        0,                       	    READ_ONLY_ACCESS | UNSIGNED_DATA, NULL,					  NULL},
     {0x1201, "Field 0",           	sizeof("Field 0") - 1,            0,                       	    READ_ONLY_ACCESS | UNSIGNED_DATA, NULL,					  NULL},
     {0x1300, "PHDL Parameters",    	sizeof("PHDL Parameters") - 1,    0,                       	    READ_ONLY_ACCESS | UNSIGNED_DATA, NULL,					  NULL},
@@ -108,6 +138,14 @@ static ObjectStruct Dictionary[] =
     {0x2002, "Interface Link",    sizeof("Interface Link") - 1,       0, 											      FULL_ACCESS      | UNSIGNED_DATA, NULL,					  NULL},
     {0x2003, "Interface Type",    sizeof("Interface Type") - 1,       0, 											      FULL_ACCESS      | UNSIGNED_DATA, NULL,					  NULL},
     {0x2004, "Interface State",   sizeof("Interface State") - 1,      0, 			                      READ_ONLY_ACCESS | UNSIGNED_DATA, NULL,					  NULL},
+    {0x2005, "Init Time",         sizeof("Init Time") - 1,            0, 			                      READ_ONLY_ACCESS | UNSIGNED_DATA, NULL,					  NULL},
+    {0x2006, "Routes",            sizeof("Routes") - 1,                0, 			                      FULL_ACCESS      | UNSIGNED_DATA, NULL,					  NULL},
+    {0x2007, "Latency",           sizeof("Latency") - 1,               0, 			                      READ_ONLY_ACCESS | UNSIGNED_DATA, NULL,					  NULL},
+    {0x2008, "Flow Window",       sizeof("Flow Window") - 1,         0, 			                      FULL_ACCESS      | UNSIGNED_DATA, NULL,					  NULL},
+    {0x2009, "Aggregate Size",    sizeof("Aggregate Size") - 1,      0, 			                      FULL_ACCESS      | UNSIGNED_DATA, NULL,					  NULL},
+    {0x200A, "Aggregate Hold",    sizeof("Aggregate Hold") - 1,      0, 			                      FULL_ACCESS      | UNSIGNED_DATA, NULL,					  NULL},
+    {0x200B, "Groups",            sizeof("Groups") - 1,              0, 			                      FULL_ACCESS      | UNSIGNED_DATA, NULL,					  NULL},
+    {0x200C, "Fragment Size",     sizeof("Fragment Size") - 1,       0, 			                      FULL_ACCESS      | UNSIGNED_DATA, NULL,					  NULL},
     {0x2200, "PHDL Fields",       sizeof("PHDL Fields") - 1,          0,                            READ_ONLY_ACCESS | UNSIGNED_DATA, NULL,					  NULL},
     {0x2201, "Field 0",           sizeof("Field 0") - 1,              0,                            READ_ONLY_ACCESS | UNSIGNED_DATA, NULL,					  NULL},
     {0x2300, "PHDL parameters",   sizeof("PHDL parameters") - 1,      0,                            READ_ONLY_ACCESS | UNSIGNED_DATA, NULL,					  NULL},
@@ -143,6 +181,14 @@ static ObjectStruct Dictionary[] =
     {0x3002, "Interface Link",    sizeof("Interface Link") - 1,       0,			                      FULL_ACCESS      | UNSIGNED_DATA, NULL,					  NULL},
     {0x3003, "Interface Type",    sizeof("Interface Type") - 1,       0,			                      FULL_ACCESS      | UNSIGNED_DATA, NULL,					  NULL},
     {0x3004, "Interface State",   sizeof("Interface State") - 1,      0, 			                      FULL_ACCESS      | UNSIGNED_DATA, NULL,					  NULL},
+    {0x3005, "Init Time",         sizeof("Init Time") - 1,            0, 			                      READ_ONLY_ACCESS | UNSIGNED_DATA, NULL,					  NULL},
+    {0x3006, "Routes",            sizeof("Routes") - 1,                0, 			                      FULL_ACCESS      | UNSIGNED_DATA, NULL,					  NULL},
+    {0x3007, "Latency",           sizeof("Latency") - 1,               0, 			                      READ_ONLY_ACCESS | UNSIGNED_DATA, NULL,					  NULL},
+    {0x3008, "Flow Window",       sizeof("Flow Window") - 1,         0, 			                      FULL_ACCESS      | UNSIGNED_DATA, NULL,					  NULL},
+    {0x3009, "Aggregate Size",    sizeof("Aggregate Size") - 1,      0, 			                      FULL_ACCESS      | UNSIGNED_DATA, NULL,					  NULL},
+    {0x300A, "Aggregate Hold",    sizeof("Aggregate Hold") - 1,      0, 			                      FULL_ACCESS      | UNSIGNED_DATA, NULL,					  NULL},
+    {0x300B, "Groups",            sizeof("Groups") - 1,              0, 			                      FULL_ACCESS      | UNSIGNED_DATA, NULL,					  NULL},
+    {0x300C, "Fragment Size",     sizeof("Fragment Size") - 1,       0, 			                      FULL_ACCESS      | UNSIGNED_DATA, NULL,					  NULL},
     {0x3200, "PHDL Fields",       sizeof("PHDL Fields") - 1,          0,                            READ_ONLY_ACCESS | UNSIGNED_DATA, NULL,					  NULL},
     {0x3201, "Field 0",           sizeof("Field 0") - 1,              0,                            READ_ONLY_ACCESS | UNSIGNED_DATA, NULL,					  NULL},
     {0x3300, "PHDL paramters",    sizeof("PHDL parameters") - 1,      0,                            READ_ONLY_ACCESS | UNSIGNED_DATA, NULL,					  NULL},
@@ -257,6 +303,7 @@ ObjectRet ProcessObject(uint16_t RegisterID, uint8_t *TypeAccess, uint32_t *Size
       /* Once the object is written, free the allocated memory */
       MemFree(pDataTemp);
       pDataTemp = NULL;
+      *Data = NULL;
     }
     *Size = 0;
 
@@ -395,21 +442,19 @@ int32_t AttachCallBackToRegister(uint16_t RegisterID, voidFuncPtr Callback)
 ObjectRet CheckObjectIndex(uint16_t Index, uint16_t *DictionaryIndex)
 {
     uint16_t IndexCount;
-    uint16_t *RetIndex;
     ObjectRet ret = OBJECT_NOT_FOUND;
     IndexCount = 0;
 
-    if(DictionaryIndex != NULL)
-    {
-	RetIndex = DictionaryIndex;
-    }
-
     /* Look for the object index */
     while(IndexCount < DICTIONARY_SIZE)
     {
       if(Dictionary[IndexCount].index == Index)
       {
-	  *RetIndex = IndexCount;
+	  /* The internal index is optional */
+	  if(DictionaryIndex != NULL)
+	  {
+	    *DictionaryIndex = IndexCount;
+	  }
 	  ret = OBJECT_FOUND;
 	  break;
       }
@@ -54,6 +54,10 @@
 	 the Bus instances. */
 #define MBA_QUEUE_SIZE       				16  
 
+/* Maximum time in ms between two executions of the state machine and the bus
+	 instance update when no frame is received. */
+#define MBA_STATE_MACHINE_PERIOD			10
+
 /* Exported types ------------------------------------------------------------*/
 /* Exported constants --------------------------------------------------------*/
 /* Exported macro ------------------------------------------------------------*/
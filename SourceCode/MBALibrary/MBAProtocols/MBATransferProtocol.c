@@ -33,6 +33,8 @@
 #include "MBAConfigProtocol.h"
 #include "MBAOperationProtocol.h"
 #include "../../TOOLS/MemoryManagement.h"
+#include "../../TOOLS/crc16.h"
+#include "../../APPLAYER/OSSupport.h"
 /* Private typedef -----------------------------------------------------------*/
 
 /**
@@ -52,7 +54,7 @@ typedef struct
 
 typedef struct
 {
-  uint8_t LinkedLogicalID[10];
+  uint8_t LinkedLogicalID[TP_ROUTE_LINKS];
 }TRouteTable;
 
 typedef enum
@@ -71,6 +73,18 @@ typedef enum
     LINKEDDEV_TO_LOGICAL    /*!< Search link table mode */
 }TPLinkModes;
 
+/**
+  * @brief ID formats of an interface, in the order of @ref TPLinkModes
+  */
+typedef enum
+{
+    LINK_INTERFACE = 0,	/*!< Interface ID: position in the link table */
+    LINK_SCAN,		/*!< Scan ID */
+    LINK_LOGICAL,	/*!< Logical ID */
+    LINK_LINKEDDEV,	/*!< Linked device ID */
+    LINK_FORMATS
+}TPLinkFormats;
+
 /* Private define ------------------------------------------------------------*/
 /* Transfer cast masks */
 #define DIR_MASK	0x01	/*!< Cast direction */
@@ -88,6 +102,13 @@ typedef enum
 #define INTERFACE_DESCRIPTION_LINKEDDEV_OFFSET  2	      /*!< Interface linked device indexoffset */
 #define INTERFACE_DESCRIPTION_TYPE_OFFSET       3	      /*!< Interface type index offset */
 #define INTERFACE_DESCRIPTION_STATE_OFFSET      4	      /*!< Interface state index offset */
+#define INTERFACE_DESCRIPTION_ROUTES_OFFSET     6	      /*!< Interface routes index offset */
+#define INTERFACE_DESCRIPTION_GROUPS_OFFSET     0x0B	      /*!< Interface groups index offset */
+
+/* Link index defines */
+#define LINK_INDEX_SIZE         256     /*!< Slots per format: low byte of the ID */
+#define LINK_NONE               -1      /*!< No interface has the ID */
+#define LINK_SHARED             -2      /*!< IDs with the same low byte, scanned */
 
 /* Frame defines */
 #define DESTINATION_ID_INDEX    0 /*!< Destination id buffer index */
@@ -121,48 +142,67 @@ typedef enum
 static TPIDLink TPIDTable[AVAILABLE_INTERFACES] =
 {
 #if USB_API > 0
-{0, 0, 80, 2,  "USB",  3, MBA_BRIDGE}
+{0, 0, 80, 2,  "USB",  3, MBA_BRIDGE},
 #endif
 #if USB_HOST_API > 0
-{0, 0, 16, 10,  "USB Host",  8, MBA_BRIDGE}
+{0, 0, 16, 10,  "USB Host",  8, MBA_BRIDGE},
 #endif
 #if SOCKET_API > 0
-,{1, 0, 17,  1,  "Socket", 	6, MBA_BRIDGE}
+{1, 0, 17,  1,  "Socket", 	6, MBA_BRIDGE},
 #endif
 #if SPI_API > 0
-,{1, 0, 81, 20, "SPI",  3, MBA_BRIDGE}
+{1, 0, 81, 20, "SPI",  3, MBA_BRIDGE},
 #endif
 #if USART_API > 0
-,{2, 0, 82, 1,  "USART",5, END_BUS}
+{2, 0, 82, 1,  "USART",5, END_BUS},
 #endif
 };
 
-static TRouteTable RouteTableLink[AVAILABLE_INTERFACES] =
+static const TRouteTable RouteTableLink[AVAILABLE_INTERFACES] =
 {
-  #if USB_API > 0
-{{1,2,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF}}
+#if USB_API > 0
+{{1,2,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF}},
 #endif
 #if USB_HOST_API > 0
-{{10,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF}}
+{{10,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF}},
 #endif
 #if SOCKET_API > 0
-,{{1,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF}}
+{{1,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF}},
 #endif
 #if SPI_API > 0
-,{{5,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF}}
+{{5,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF}},
 #endif
 #if USART_API > 0
-,{{0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF}}
+{{0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF}},
 #endif
 };
 
 static uint8_t AvailableInterfaces;
 static uint8_t LogicalID;
+static uint32_t RouteMask[AVAILABLE_INTERFACES];	/*!< Bit n: logical ID n is reached
+							 *   through the interface */
+static int8_t RouteInterface[TP_ROUTE_IDS];	/*!< Interface of each logical ID, built
+						 *   from RouteMask */
+static uint32_t GroupMask[AVAILABLE_INTERFACES];	/*!< Bit n: the interface is a member
+							 *   of the group with logical ID n */
+static uint8_t GroupInterfaces[TP_ROUTE_IDS];	/*!< Members of each group, a bit per
+						 *   interface, built from GroupMask */
+static volatile uint32_t RouteVersion = 2;	/*!< Changes with the routing tables.
+						 *   Odd while they are rebuilt */
+static int8_t LinkIndex[LINK_FORMATS - 1][LINK_INDEX_SIZE];	/*!< Position in TPIDTable
+								 *   of each scan, logical
+								 *   and linked device ID */
 
 /* Private function prototypes -----------------------------------------------*/
 int16_t TransferProtocolGetRouteInterface(uint16_t DestLogicalID);
 int16_t TransferProtocolGetIDLink(uint16_t ID, TPLinkModes Mode);
+static uint16_t TransferProtocolGetLinkID(uint8_t Row, uint8_t Format);
+static int16_t TransferProtocolGetLinkRow(uint16_t ID, uint8_t Format);
+static void TransferProtocolIndexLinks(void);
 void	TransferProtocolUpdateLinks(void);
+uint8_t	TransferProtocolHeaderUpdate(uint8_t *pBuf, TransProtFrame *TPFrame);
+static void TransferProtocolSetChecksum(uint8_t *pBuf);
+static void TransferProtocolReassemblyDrop(TPReassembly *Reassembly);
 /* Private functions ---------------------------------------------------------*/
 
 /**
@@ -170,14 +210,28 @@ void	TransferProtocolUpdateLinks(void);
   */
 void TransferProtocolInit(void)
 {
-    uint8_t InterfaceIndex;
+    uint8_t InterfaceIndex, LinkIndex, LinkedID;
 
     /* Initialize device addresses and attach related variables to object dictionary */
     LogicalID = TPIDTable[0].LogicalID >> 3;
     AvailableInterfaces = AVAILABLE_INTERFACES;
     for (InterfaceIndex = 0; InterfaceIndex < AvailableInterfaces; InterfaceIndex++)
     {
+      /* The interface ID is the position in the table, whatever the selected APIs */
+      TPIDTable[InterfaceIndex].InterfaceID = InterfaceIndex;
       TPIDTable[InterfaceIndex].InterfaceState = GetBusInstanceState(InterfaceIndex);
+
+      /* Default routes, changed afterwards through the routes registers */
+      RouteMask[InterfaceIndex] = 0;
+      GroupMask[InterfaceIndex] = 0;
+      for (LinkIndex = 0; LinkIndex < TP_ROUTE_LINKS; LinkIndex++)
+      {
+        LinkedID = RouteTableLink[InterfaceIndex].LinkedLogicalID[LinkIndex];
+        if (LinkedID < TP_ROUTE_IDS)
+        {
+          RouteMask[InterfaceIndex] |= (uint32_t)1 << LinkedID;
+        }
+      }
     }
 
     AttachVariableToRegister(LOGICAL_ID_INDEX, &LogicalID, sizeof(LogicalID));
@@ -196,6 +250,8 @@ void TransferProtocolInit(void)
 	    AttachVariableToRegister(INTERFACE_DESCRIPTION_BASE_ADDRESS*(InterfaceIndex + 1) + INTERFACE_DESCRIPTION_LINKEDDEV_OFFSET,
 				     &(TPIDTable[InterfaceIndex].LinkedDevice),
 				     sizeof(TPIDTable[InterfaceIndex].LinkedDevice));
+	    AttachCallBackToRegister(INTERFACE_DESCRIPTION_BASE_ADDRESS*(InterfaceIndex + 1) + INTERFACE_DESCRIPTION_LINKEDDEV_OFFSET,
+				     TransferProtocolUpdateLinks);
 	    AttachVariableToRegister(INTERFACE_DESCRIPTION_BASE_ADDRESS*(InterfaceIndex + 1) +
 				     INTERFACE_DESCRIPTION_STATE_OFFSET,
 				     &(TPIDTable[InterfaceIndex].InterfaceState),
@@ -203,6 +259,16 @@ void TransferProtocolInit(void)
 	    AttachVariableToRegister(INTERFACE_DESCRIPTION_BASE_ADDRESS*(InterfaceIndex + 1) + INTERFACE_DESCRIPTION_TYPE_OFFSET,
 				     &(TPIDTable[InterfaceIndex].InterfaceType),
 				     sizeof(TPIDTable[InterfaceIndex].InterfaceType));
+	    AttachVariableToRegister(INTERFACE_DESCRIPTION_BASE_ADDRESS*(InterfaceIndex + 1) + INTERFACE_DESCRIPTION_ROUTES_OFFSET,
+				     &RouteMask[InterfaceIndex],
+				     sizeof(RouteMask[InterfaceIndex]));
+	    AttachCallBackToRegister(INTERFACE_DESCRIPTION_BASE_ADDRESS*(InterfaceIndex + 1) + INTERFACE_DESCRIPTION_ROUTES_OFFSET,
+				     TransferProtocolUpdateLinks);
+	    AttachVariableToRegister(INTERFACE_DESCRIPTION_BASE_ADDRESS*(InterfaceIndex + 1) + INTERFACE_DESCRIPTION_GROUPS_OFFSET,
+				     &GroupMask[InterfaceIndex],
+				     sizeof(GroupMask[InterfaceIndex]));
+	    AttachCallBackToRegister(INTERFACE_DESCRIPTION_BASE_ADDRESS*(InterfaceIndex + 1) + INTERFACE_DESCRIPTION_GROUPS_OFFSET,
+				     TransferProtocolUpdateLinks);
     }
 
     /* Update all the table links */
@@ -222,16 +288,49 @@ void TransferProtocolFrameInit(TransProtFrame *Frame)
     Frame->Header.FlowControl   = 0;
     Frame->Header.TimeStamp     = 0;
     Frame->Checksum             = 0;
+    Frame->Data                 = NULL;
+    Frame->Buffer               = NULL;
+    Frame->BufferSize           = 0;
+    Frame->RxTime               = 0;
+    Frame->MBATime              = 0;
+    Frame->OutTime              = 0;
+    Frame->CreditInterface      = -1;
+    Frame->Shared               = NULL;
+}
+
+/**
+  * @brief  	Builds a flow control frame: a header without data that only
+  *		carries the credits of a MBA bridge to the node at its end
+  * @param[out] Frame Transfer protocol frame
+  * @param[in]  InterfaceID MBA bridge
+  */
+void TransferProtocolFlowFrame(TransProtFrame *Frame, uint8_t InterfaceID)
+{
+    TransferProtocolFrameInit(Frame);
+    Frame->Header.Command = FLOW_CONTROL_COMMAND;
+    Frame->Header.DestinationID = SetLogicalId(TransferProtocolGetIDLink (InterfaceID, INTERFACE_TO_LINKEDDEV));
+    Frame->Header.SourceID = SetLogicalId(LogicalID) | SetInterfaceId(InterfaceID);
 }
 
 
 /**
   * @brief  Casts standard buffers into Transfer protocol frames and vice versa
+  * @details With IN_PLACE, a frame cast from a buffer is a view of it: its data
+  *	    points into the buffer, which is passed to the frame. A view cast
+  *	    into its own buffer (see @ref TransferProtocolFrameBuffer) only
+  *	    writes the header fields that have changed; the buffer is
+  *	    released later with the frame. Other casts to a buffer release the
+  *	    frame data.
+  *	    With TP_CHECKSUM, MBA bridge frames are checked against their
+  *	    CRC-16 when cast from a buffer, and it is computed when they are
+  *	    cast into one.
   * @param[in,out]  TPFrame Transfer protocol frame to be processed
   * @param[in,out]  pBuf    Standard buffer to be processed
   * @param[in]	    Size    Number of bytes to be casted
-  * @param[int]     Mode    Cast parameters: Direction and cast mode
-  * @retval 	    0 if OK.
+  * @param[int]     Mode    Cast parameters: Direction, cast mode and IN_PLACE
+  * @retval 	    Frame size, CAST_ERROR if the buffer does not hold a frame or
+  *		    its checksum is wrong. An IN_PLACE buffer that does not
+  *		    hold a frame is released
   */
 int32_t TransferProtocolCast(TransProtFrame *TPFrame, uint8_t *pBuf, uint32_t Size, 
                              uint8_t InterfaceID, uint8_t Mode)
@@ -239,30 +338,60 @@ int32_t TransferProtocolCast(TransProtFrame *TPFrame, uint8_t *pBuf, uint32_t Si
   int32_t NewFrameSize = Size;
   TransProtFrame *pTPTemp = TPFrame;
   uint8_t	 *pBufTemp = pBuf, *pAuxBufTemp;
+  uint8_t	 Changed;
 
   /* Check the cast direction */
   if((Mode & DIR_MASK) == FROM_BUFFER)
   {
+      pTPTemp->Buffer = NULL;
+      pTPTemp->BufferSize = 0;
+      pTPTemp->RxTime = 0;
+      pTPTemp->MBATime = 0;
+      pTPTemp->OutTime = 0;
+      pTPTemp->CreditInterface = -1;
+      pTPTemp->Shared = NULL;
       switch(Mode & CAST_MASK)
       {
         /* Check if the interface is a MBA_BRIDGE or an END_BUS */
         case MBA_BRIDGE:
-        /* Copy header into Transfer protocol frame */
-          pTPTemp->Header.DestinationID = *(pBufTemp++);
-          pTPTemp->Header.Command = *(pBufTemp++);
-          pTPTemp->Header.Size = ((uint16_t)pBufTemp[SIZE_LOW_BYTE_REL_INDEX] & WORD_LOW_MASK) +
-               (((uint16_t)pBufTemp[SIZE_HIGH_BYTE_REL_INDEX] << BYTE_SHIFT) & WORD_HIGH_MASK);
-          pBufTemp += SIZE_FIELD_SIZE;
-          pTPTemp->Header.SourceID = *(pBufTemp++);
-          pTPTemp->Header.FlowControl = *(pBufTemp++);
-
-          pAuxBufTemp = (uint8_t *)&(pTPTemp->Header.TimeStamp);
-          memcpy(pAuxBufTemp, pBufTemp, TIME_STAMP_FIELD_SIZE);
-          pBufTemp += TIME_STAMP_FIELD_SIZE;
-
-          if(GetFrameSizeP(pTPTemp) != Size)
+          /* The buffer must hold the header, the data and the checksum */
+          if((Size < HEADER_SIZE + CRC_SIZE) ||
+             (GetBufFrameDataSize(pBufTemp) > Size - (HEADER_SIZE + CRC_SIZE)))
           {
-            /* handle error */
+            pTPTemp->Header.Size = 0;
+            pTPTemp->Data = NULL;
+            NewFrameSize = CAST_ERROR;
+            break;
+          }
+
+#if TP_CHECKSUM > 0
+          /* Corrupt frames are dropped before anything is allocated for them */
+          if(crc16(pBufTemp, HEADER_SIZE + GetBufFrameDataSize(pBufTemp)) !=
+             GetBufChecksum(pBufTemp, GetBufFrameDataSize(pBufTemp)))
+          {
+            pTPTemp->Header.Size = 0;
+            pTPTemp->Data = NULL;
+            NewFrameSize = CAST_ERROR;
+            break;
+          }
+#endif
+
+          /* Copy header into Transfer protocol frame */
+          pTPTemp->Header.DestinationID = GetBufDestNodeId(pBufTemp);
+          pTPTemp->Header.Command = GetBufFrameCommand(pBufTemp);
+          pTPTemp->Header.Size = GetBufFrameDataSize(pBufTemp);
+          pTPTemp->Header.SourceID = GetBufSrcNodeId(pBufTemp);
+          pTPTemp->Header.FlowControl = GetBufFlowControl(pBufTemp);
+          pTPTemp->Header.TimeStamp = GetBufTimeStamp(pBufTemp);
+          pTPTemp->Checksum = GetBufChecksum(pBufTemp, pTPTemp->Header.Size);
+
+          if(Mode & IN_PLACE)
+          {
+            /* The data stays in the buffer */
+            pTPTemp->Buffer = pBuf;
+            pTPTemp->BufferSize = Size;
+            pTPTemp->Data = pBufTemp + HEADER_SIZE;
+            break;
           }
 
           /* Alloc memory for transfer protocol data */
@@ -272,17 +401,12 @@ int32_t TransferProtocolCast(TransProtFrame *TPFrame, uint8_t *pBuf, uint32_t Si
           {
             /* Copy data into transfer protocol buffer */
             pAuxBufTemp = pTPTemp->Data;
-            memcpy(pAuxBufTemp, pBufTemp, pTPTemp->Header.Size);
-            pBufTemp += pTPTemp->Header.Size;
+            memcpy(pAuxBufTemp, pBufTemp + HEADER_SIZE, pTPTemp->Header.Size);
           }
           else
           {
             NewFrameSize = CAST_ERROR;
           }
-
-          /* Copy checksum */
-          pTPTemp->Checksum = (uint16_t)(pBufTemp[CHECKSUM_LOW_REL_INDEX] & WORD_LOW_MASK)  |
-                  (uint16_t)((pBufTemp[CHECKSUM_HIGH_REL_INDEX] << BYTE_SHIFT) & WORD_HIGH_MASK);
           break;
 
         case END_BUS:
@@ -295,16 +419,28 @@ int32_t TransferProtocolCast(TransProtFrame *TPFrame, uint8_t *pBuf, uint32_t Si
       
           /* Update the source ID with the device Logical ID */
           pTPTemp->Header.SourceID = SetLogicalId(LogicalID) |  SetInterfaceId(InterfaceID);
+          pTPTemp->Checksum = 0;
+
+          if(Mode & IN_PLACE)
+          {
+            /* The whole buffer is data */
+            pTPTemp->Buffer = pBuf;
+            pTPTemp->BufferSize = Size;
+            pTPTemp->Data = pBuf;
+            break;
+          }
 
           /* Copy data */
           pTPTemp->Data = (uint8_t *)MemAlloc(Size);
           pAuxBufTemp = pTPTemp->Data;
           memcpy(pAuxBufTemp, pBufTemp, Size);
-
-          pTPTemp->Checksum = 0;
-
           break;
       }
+
+      if((NewFrameSize == CAST_ERROR) && (Mode & IN_PLACE))
+      {
+        MemFree(pBuf);
+      }
   }
   else
   {
@@ -312,6 +448,33 @@ int32_t TransferProtocolCast(TransProtFrame *TPFrame, uint8_t *pBuf, uint32_t Si
       {
         /* Check if the interface is a MBA_BRIDGE or an END_BUS */
         case MBA_BRIDGE:
+          if((pBufTemp != NULL) && (pBufTemp == pTPTemp->Buffer))
+          {
+            /* In place: the buffer keeps the fields that have not changed */
+            Changed = TransferProtocolHeaderUpdate(pBufTemp, pTPTemp);
+            if(pTPTemp->Data != pBufTemp + HEADER_SIZE)
+            {
+              memmove(pBufTemp + HEADER_SIZE, pTPTemp->Data, pTPTemp->Header.Size);
+              pTPTemp->Data = pBufTemp + HEADER_SIZE;
+              Changed = 1;
+            }
+#if TP_CHECKSUM > 0
+            /* An untouched frame keeps the checksum checked on decode */
+            if(Changed)
+            {
+              pTPTemp->Checksum = crc16(pBufTemp, HEADER_SIZE + pTPTemp->Header.Size);
+            }
+#endif
+            pAuxBufTemp = pBufTemp + HEADER_SIZE + pTPTemp->Header.Size;
+            if(GetBufChecksum(pBufTemp, pTPTemp->Header.Size) != pTPTemp->Checksum)
+            {
+              pAuxBufTemp[CHECKSUM_LOW_REL_INDEX]  = (uint8_t)(pTPTemp->Checksum & WORD_LOW_MASK);
+              pAuxBufTemp[CHECKSUM_HIGH_REL_INDEX] = (uint8_t)((pTPTemp->Checksum >> BYTE_SHIFT) & WORD_LOW_MASK);
+            }
+            NewFrameSize = GetFrameSizeP(pTPTemp);
+            break;
+          }
+
           /* Frame defines */
           /* Copy header into Transfer protocol frame */
           pBufTemp[DESTINATION_ID_INDEX]   = pTPTemp->Header.DestinationID;
@@ -327,12 +490,19 @@ int32_t TransferProtocolCast(TransProtFrame *TPFrame, uint8_t *pBuf, uint32_t Si
 
           pBufTemp += HEADER_SIZE;
 
-          if(pTPTemp->Data != NULL)
+          if((pTPTemp->Data != NULL) || (pTPTemp->Header.Size == 0))
           {
-              /* Copy data into transfer protocol buffer */
+              /* Copy data into transfer protocol buffer. Flow control
+               * frames have none */
               pAuxBufTemp = pTPTemp->Data;
-              memcpy(pBufTemp, pAuxBufTemp, pTPTemp->Header.Size);
+              if(pTPTemp->Header.Size > 0)
+              {
+                memcpy(pBufTemp, pAuxBufTemp, pTPTemp->Header.Size);
+              }
               pBufTemp += pTPTemp->Header.Size;
+#if TP_CHECKSUM > 0
+              pTPTemp->Checksum = crc16(pBuf, HEADER_SIZE + pTPTemp->Header.Size);
+#endif
           }
           else
           {
@@ -343,24 +513,21 @@ int32_t TransferProtocolCast(TransProtFrame *TPFrame, uint8_t *pBuf, uint32_t Si
           pBufTemp[CHECKSUM_LOW_REL_INDEX]  = (uint8_t)pTPTemp->Checksum & WORD_LOW_MASK;
           pBufTemp[CHECKSUM_HIGH_REL_INDEX]  = (uint8_t)(pTPTemp->Checksum >> BYTE_SHIFT) & WORD_LOW_MASK;
 
-          if(pTPTemp->Data != NULL)
-          {
-            /* Free allocated data for input transfer protocol frame */
-            MemFree(pTPTemp->Data);
-            pTPTemp->Data = NULL;
-          }
+          /* Free allocated data for input transfer protocol frame */
+          TransferProtocolFrameFree(pTPTemp);
           break;
 			
         case END_BUS:
-          pAuxBufTemp = pTPTemp->Data;
-          memcpy(pBufTemp, pAuxBufTemp, pTPTemp->Header.Size);
-          if(pTPTemp->Data != NULL)
+          NewFrameSize = pTPTemp->Header.Size;
+          if((pBufTemp != NULL) && (pBufTemp == pTPTemp->Data))
           {
-            /* Free allocated data for input transfer protocol frame */
-            MemFree(pTPTemp->Data);
-            pTPTemp->Data = NULL;
+            /* In place: the data is already there */
+            break;
           }
-          NewFrameSize = pTPTemp->Header.Size;
+          pAuxBufTemp = pTPTemp->Data;
+          memcpy(pBufTemp, pAuxBufTemp, pTPTemp->Header.Size);
+          /* Free allocated data for input transfer protocol frame */
+          TransferProtocolFrameFree(pTPTemp);
           break;
         }
   }
@@ -368,7 +535,83 @@ int32_t TransferProtocolCast(TransProtFrame *TPFrame, uint8_t *pBuf, uint32_t Si
 }
 
 /**
-  * @brief  Copy an input transfer protocol into an output transfer protocol
+  * @brief  Buffer where a frame can be cast in place
+  * @details Frames cast from a buffer with IN_PLACE are views of it, and they
+  *	     are written back into it as long as the data has not been moved
+  *	     out or grown.
+  * @param[in]  TPFrame Transfer protocol frame
+  * @param[in]  Mode    Cast mode of the destination: MBA_BRIDGE or END_BUS
+  * @retval 	Buffer to pass to @ref TransferProtocolCast, NULL if the frame
+  *		has to be cast into a new buffer
+  */
+uint8_t *TransferProtocolFrameBuffer(TransProtFrame *TPFrame, uint8_t Mode)
+{
+  uint8_t *pBuf = NULL;
+
+  if((TPFrame->Buffer == NULL) || (TPFrame->Data == NULL))
+  {
+    return NULL;
+  }
+
+  switch(Mode & CAST_MASK)
+  {
+    case MBA_BRIDGE:
+      /* The header of shared data belongs to every member */
+      if((TPFrame->Shared == NULL) &&
+         (TPFrame->Data == TPFrame->Buffer + HEADER_SIZE) &&
+         ((uint32_t)GetFrameSizeP(TPFrame) <= TPFrame->BufferSize))
+      {
+        pBuf = TPFrame->Buffer;
+      }
+      break;
+    case END_BUS:
+      if((uint32_t)(TPFrame->Data - TPFrame->Buffer) + TPFrame->Header.Size <= TPFrame->BufferSize)
+      {
+        pBuf = TPFrame->Data;
+      }
+      break;
+  }
+  return pBuf;
+}
+
+/**
+  * @brief  Releases the data of a frame, or the buffer it is a view of.
+  *	    Shared data is only released with its last frame.
+  * @param[in,out]  TPFrame Transfer protocol frame
+  */
+void TransferProtocolFrameFree(TransProtFrame *TPFrame)
+{
+  if(TPFrame->Shared != NULL)
+  {
+    if(RefCountDec(TPFrame->Shared->Refs) != 0)
+    {
+      /* Other frames hold it */
+      TPFrame->Buffer = NULL;
+      TPFrame->Data = NULL;
+    }
+    else
+    {
+      MemFree(TPFrame->Shared);
+    }
+    TPFrame->Shared = NULL;
+  }
+  if(TPFrame->Buffer != NULL)
+  {
+    MemFree(TPFrame->Buffer);
+  }
+  else if(TPFrame->Data != NULL)
+  {
+    MemFree(TPFrame->Data);
+  }
+  TPFrame->Buffer = NULL;
+  TPFrame->BufferSize = 0;
+  TPFrame->Data = NULL;
+}
+
+/**
+  * @brief  Moves an input transfer protocol frame into an output frame
+  * @details The data is not copied: the output frame takes it over, buffer
+  *	     included, and the input frame is left without data.
   * @param[out]  TPFrameDest	Transfer protocol frame to be created
   * @param[in]   TPFrameSrc	Transfer protocol frame to be copied
   * @retval 0 if Ok
@@ -387,19 +630,47 @@ int32_t TransferProtocolCopy(TransProtFrame *TPFrameDest, TransProtFrame *TPFram
     pTPOut->Header.FlowControl 	 = pTPIn->Header.FlowControl;
     pTPOut->Checksum 		 = pTPIn->Checksum;
 
-    pTPOut->Data = (uint8_t*)MemAlloc(pTPIn->Header.Size *sizeof(uint8_t));
-    if(pTPOut->Data != NULL)
-    {
-      memcpy(pTPOut->Data, pTPIn->Data, pTPIn->Header.Size);
-    }
-    if(pTPIn->Data != NULL)
+    pTPOut->Data       = pTPIn->Data;
+    pTPOut->Buffer     = pTPIn->Buffer;
+    pTPOut->BufferSize = pTPIn->BufferSize;
+    pTPOut->RxTime     = pTPIn->RxTime;
+    pTPOut->MBATime    = pTPIn->MBATime;
+    pTPOut->OutTime    = pTPIn->OutTime;
+    pTPOut->CreditInterface = pTPIn->CreditInterface;
+    pTPOut->Shared     = pTPIn->Shared;
+    pTPIn->Data       = NULL;
+    pTPIn->Buffer     = NULL;
+    pTPIn->BufferSize = 0;
+    pTPIn->Shared     = NULL;
+
+    return ret;
+}
+
+/**
+  * @brief  Makes a second frame with the data of a frame
+  * @details The data is not copied: both frames share it, buffer included,
+  *	     and it is released with the last of them. The output frame has
+  *	     no credit; it stays with the input frame.
+  * @param[out]  TPFrameDest	Transfer protocol frame to be created
+  * @param[in,out] TPFrameSrc	Transfer protocol frame whose data is shared
+  * @retval 0 if Ok, -1 if there is no memory to share the data
+  */
+int32_t TransferProtocolShare(TransProtFrame *TPFrameDest, TransProtFrame *TPFrameSrc)
+{
+    if(TPFrameSrc->Shared == NULL)
     {
-      /* Free allocated memory for input transfer protocol frame */
-      MemFree(pTPIn->Data);
-      pTPIn->Data = NULL;
+      TPFrameSrc->Shared = (TPShared *)MemAlloc(sizeof(TPShared));
+      if(TPFrameSrc->Shared == NULL)
+      {
+        return -1;
+      }
+      TPFrameSrc->Shared->Refs = 1;
     }
+    RefCountInc(TPFrameSrc->Shared->Refs);
 
-    return ret;
+    *TPFrameDest = *TPFrameSrc;
+    TPFrameDest->CreditInterface = -1;
+    return 0;
 }
 
 /**
@@ -436,6 +707,9 @@ int32_t TransferProtocolProcess(TransProtFrame *TPFrameDest, TransProtFrame *TPF
           break;
         case CONFIG_COMMAND:
           /* Process the Config protocol frame */
+          TPOut->Buffer = NULL;
+          TPOut->BufferSize = 0;
+          TPOut->Shared = NULL;
           DestFrameSize = ConfigProtocolProcess(&(TPOut->Data),TPIn->Data, TPIn->Header.Size);
 
           /* Process output to generate Transfer protocol header */
@@ -449,12 +723,19 @@ int32_t TransferProtocolProcess(TransProtFrame *TPFrameDest, TransProtFrame *TPF
           TPOut->Header.TimeStamp= TPIn->Header.TimeStamp;
           TPOut->Header.Size = DestFrameSize;
           TPOut->Checksum = 0;
+          /* The reply goes on with the times and the credit of the request */
+          TPOut->RxTime = TPIn->RxTime;
+          TPOut->MBATime = TPIn->MBATime;
+          TPOut->CreditInterface = TPIn->CreditInterface;
 
           /* Update return value for upper functions */
           InterfaceLink = (int32_t)GetDestInterfaceIdP(TPIn);
           break;
 
         case OPERATION_COMMAND:
+          TPOut->Buffer = NULL;
+          TPOut->BufferSize = 0;
+          TPOut->Shared = NULL;
           DestFrameSize = OperationProtocolProcess(&(TPOut->Data),TPIn->Data, TPIn->Header.Size);
 
           /* Process output to generate Transfer protocol header */
@@ -467,6 +748,10 @@ int32_t TransferProtocolProcess(TransProtFrame *TPFrameDest, TransProtFrame *TPF
           TPOut->Header.TimeStamp= TPIn->Header.TimeStamp;
           TPOut->Header.Size = DestFrameSize;
           TPOut->Checksum = 0;
+          /* The reply goes on with the times and the credit of the request */
+          TPOut->RxTime = TPIn->RxTime;
+          TPOut->MBATime = TPIn->MBATime;
+          TPOut->CreditInterface = TPIn->CreditInterface;
 
           /* Update return value for upper functions */
           InterfaceLink = (int32_t)GetDestInterfaceIdP(TPIn);
@@ -478,8 +763,13 @@ int32_t TransferProtocolProcess(TransProtFrame *TPFrameDest, TransProtFrame *TPF
     }
     else
     {
-      /* Check if the destination Node ID is linked to some interface */
+      /* Check if the destination Node ID is linked to some interface. A
+       * group goes to all its members */
       InterfaceLink = (int32_t)TransferProtocolGetRouteInterface(DestNode);
+      if(TransferProtocolGetGroup(DestNode) != 0)
+      {
+          InterfaceLink = TP_MULTICAST;
+      }
       if(InterfaceLink != -1)
       {
           TransferProtocolCopy(TPOut, TPIn);
@@ -489,13 +779,340 @@ int32_t TransferProtocolProcess(TransProtFrame *TPFrameDest, TransProtFrame *TPF
           /* Generate an error */
       }
     }
-    if(TPIn->Data != NULL)
+    /* Free allocated memory for input transfer protocol data */
+    TransferProtocolFrameFree(TPIn);
+    return InterfaceLink;
+}
+
+/**
+  * @brief  	Classifies a transfer protocol frame by its command
+  * @details	Control plane frames (config and operation) must not wait behind
+  *		data frames, so queues serve them first. Transfer frames for an
+  *		interface of this node go before the ones routed to other nodes.
+  * @param[in]  TPFrame	Transfer protocol frame to be classified
+  * @retval	TP_PRIORITY_CONTROL, TP_PRIORITY_REALTIME or TP_PRIORITY_BULK
+  */
+uint8_t TransferProtocolGetPriority(TransProtFrame *TPFrame)
+{
+    uint8_t Priority = TP_PRIORITY_BULK;
+
+    switch(GetFrameCommandP(TPFrame))
     {
-      /* Free allocated memory for input transfer protocol data */
-      MemFree(TPIn->Data);
-      TPIn->Data = NULL;
+      case CONFIG_COMMAND:
+      case OPERATION_COMMAND:
+        Priority = TP_PRIORITY_CONTROL;
+        break;
+      case TRANSFER_COMMAND:
+        if(GetDestLogicalIdP(TPFrame) == LogicalID)
+        {
+          Priority = TP_PRIORITY_REALTIME;
+        }
+        break;
+      default:
+        break;
     }
-    return InterfaceLink;
+    return Priority;
+}
+
+/**
+  * @brief  	Builds a fragment of a frame too large for a MBA bridge
+  * @details	The data is split in shares that fill fragments of FragmentSize
+  *		bytes. Each fragment is a frame with the header of the frame,
+  *		its share of the data and the fragment bits in the command
+  *		field; the last one has no TP_FRAGMENT_MORE. A frame that fits
+  *		is its only fragment.
+  * @param[out] pFragment Buffer of FragmentSize bytes
+  * @param[in]  pBuf	Frame in buffer format
+  * @param[in]  Index	Fragment, from 0
+  * @param[in]  FragmentSize Largest fragment, more than HEADER_SIZE + CRC_SIZE
+  * @retval	Fragment size, 0 if the frame has no such fragment
+  */
+uint32_t TransferProtocolFragment(uint8_t *pFragment, const uint8_t *pBuf, uint32_t Index,
+                                  uint32_t FragmentSize)
+{
+    uint32_t DataSize = GetBufFrameDataSize(pBuf);
+    uint32_t Share = FragmentSize - (HEADER_SIZE + CRC_SIZE);
+    uint32_t Offset = Index * Share;
+
+    if(DataSize <= Share)
+    {
+      if(Index != 0)
+      {
+        return 0;
+      }
+      memcpy(pFragment, pBuf, HEADER_SIZE + DataSize + CRC_SIZE);
+      return HEADER_SIZE + DataSize + CRC_SIZE;
+    }
+    if(Offset >= DataSize)
+    {
+      return 0;
+    }
+    if(Share > DataSize - Offset)
+    {
+      Share = DataSize - Offset;
+    }
+
+    memcpy(pFragment, pBuf, HEADER_SIZE);
+    pFragment[COMMAND_INDEX] = (pBuf[COMMAND_INDEX] & TP_COMMAND_MASK) |
+                               (uint8_t)(((Index % 7) + 1) << TP_FRAGMENT_INDEX_SHIFT);
+    if(Offset + Share < DataSize)
+    {
+      pFragment[COMMAND_INDEX] |= TP_FRAGMENT_MORE;
+    }
+    pFragment[SIZE_LOW_BYTE_INDEX]  = (uint8_t)(Share & WORD_LOW_MASK);
+    pFragment[SIZE_HIGH_BYTE_INDEX] = (uint8_t)((Share >> BYTE_SHIFT) & WORD_LOW_MASK);
+    memcpy(pFragment + HEADER_SIZE, pBuf + HEADER_SIZE + Offset, Share);
+    TransferProtocolSetChecksum(pFragment);
+    return HEADER_SIZE + Share + CRC_SIZE;
+}
+
+/**
+  * @brief  	Prepares the reassembly of the frames of a MBA bridge
+  * @param[out] Reassembly Fragments gathered from the bridge
+  * @param[in]  MaxSize	Largest data of a frame gathered
+  */
+void TransferProtocolReassemblyInit(TPReassembly *Reassembly, uint32_t MaxSize)
+{
+    Reassembly->Buffer = NULL;
+    Reassembly->Size = 0;
+    Reassembly->Capacity = 0;
+    Reassembly->MaxSize = MaxSize;
+    Reassembly->Next = 0;
+    Reassembly->Dropped = 0;
+}
+
+/**
+  * @brief  	Releases the fragments gathered. The frame is not counted as
+  *		lost: the link has gone.
+  * @param[in,out] Reassembly Fragments gathered from the bridge
+  */
+void TransferProtocolReassemblyReset(TPReassembly *Reassembly)
+{
+    if(Reassembly->Buffer != NULL)
+    {
+      MemFree(Reassembly->Buffer);
+    }
+    Reassembly->Buffer = NULL;
+    Reassembly->Size = 0;
+    Reassembly->Capacity = 0;
+    Reassembly->Next = 0;
+}
+
+/**
+  * @brief  	Gathers the fragments of a frame read from a MBA bridge
+  * @details	Fragments come in order, as they are written, and whole frames
+  *		pass through. The frame grows with each fragment up to MaxSize
+  *		bytes of data, so a bridge only holds the frame it is reading.
+  *		A frame with a corrupt or missing fragment, or too large, is
+  *		dropped and counted in Dropped; the rest of its fragments are
+  *		dropped as they come.
+  * @param[in,out] Reassembly Fragments gathered from the bridge
+  * @param[in,out] pBuf	Frame read, allocated with MemAlloc. It is taken and
+  *		replaced by the whole frame
+  * @param[in,out] Size	Size of the frame read, then of the whole frame
+  * @retval	1 if pBuf holds a whole frame, 0 if it has been taken
+  */
+int32_t TransferProtocolReassemble(TPReassembly *Reassembly, uint8_t **pBuf, uint32_t *Size)
+{
+    uint8_t *pFragment = *pBuf, *pNewBuf;
+    uint8_t Command, Index;
+    uint32_t DataSize, Capacity;
+
+    if(*Size < HEADER_SIZE + CRC_SIZE)
+    {
+      /* Not even a header: the cast drops it */
+      return 1;
+    }
+    Command = GetBufFrameCommand(pFragment);
+    Index = (Command & TP_FRAGMENT_INDEX_MASK) >> TP_FRAGMENT_INDEX_SHIFT;
+    if((Index == 0) && !(Command & TP_FRAGMENT_MORE))
+    {
+      /* A whole frame. One gathered without its last fragment is lost */
+      TransferProtocolReassemblyDrop(Reassembly);
+      return 1;
+    }
+
+    DataSize = GetBufFrameDataSize(pFragment);
+    if((Index == 0) || (DataSize > *Size - (HEADER_SIZE + CRC_SIZE))
+#if TP_CHECKSUM > 0
+       || (crc16(pFragment, HEADER_SIZE + DataSize) != GetBufChecksum(pFragment, DataSize))
+#endif
+      )
+    {
+      /* Corrupt: its frame is lost */
+      if(Reassembly->Buffer == NULL)
+      {
+        Reassembly->Dropped++;
+      }
+      TransferProtocolReassemblyDrop(Reassembly);
+      MemFree(pFragment);
+      return 0;
+    }
+
+    if((Reassembly->Buffer == NULL) || (Index != Reassembly->Next))
+    {
+      TransferProtocolReassemblyDrop(Reassembly);
+      if(Index != 1)
+      {
+        /* The start of its frame has been lost */
+        MemFree(pFragment);
+        return 0;
+      }
+    }
+
+    if(Reassembly->Size + DataSize > Reassembly->MaxSize)
+    {
+      if(Reassembly->Buffer == NULL)
+      {
+        Reassembly->Dropped++;
+      }
+      TransferProtocolReassemblyDrop(Reassembly);
+      MemFree(pFragment);
+      return 0;
+    }
+
+    if(Reassembly->Buffer == NULL)
+    {
+      /* The first fragment starts the frame */
+      Reassembly->Buffer = pFragment;
+      Reassembly->Size = DataSize;
+      Reassembly->Capacity = *Size - (HEADER_SIZE + CRC_SIZE);
+    }
+    else
+    {
+      if(Reassembly->Size + DataSize > Reassembly->Capacity)
+      {
+        /* Doubled, so a frame is not copied once per fragment */
+        Capacity = Reassembly->Capacity * 2;
+        if(Capacity > Reassembly->MaxSize)
+        {
+          Capacity = Reassembly->MaxSize;
+        }
+        if(Capacity < Reassembly->Size + DataSize)
+        {
+          Capacity = Reassembly->Size + DataSize;
+        }
+        pNewBuf = (uint8_t *)MemRealloc(Reassembly->Buffer, HEADER_SIZE + Capacity + CRC_SIZE);
+        if(pNewBuf == NULL)
+        {
+          TransferProtocolReassemblyDrop(Reassembly);
+          MemFree(pFragment);
+          return 0;
+        }
+        Reassembly->Buffer = pNewBuf;
+        Reassembly->Capacity = Capacity;
+      }
+      memcpy(Reassembly->Buffer + HEADER_SIZE + Reassembly->Size, pFragment + HEADER_SIZE, DataSize);
+      Reassembly->Size += DataSize;
+      /* The last fragment has the latest credits */
+      Reassembly->Buffer[FLOW_CONTROL_INDEX] = pFragment[FLOW_CONTROL_INDEX];
+      MemFree(pFragment);
+    }
+    Reassembly->Next = (uint8_t)((Index % 7) + 1);
+
+    if(Command & TP_FRAGMENT_MORE)
+    {
+      return 0;
+    }
+
+    /* Last fragment: the frame is whole */
+    pNewBuf = Reassembly->Buffer;
+    pNewBuf[COMMAND_INDEX] = Command & TP_COMMAND_MASK;
+    pNewBuf[SIZE_LOW_BYTE_INDEX]  = (uint8_t)(Reassembly->Size & WORD_LOW_MASK);
+    pNewBuf[SIZE_HIGH_BYTE_INDEX] = (uint8_t)((Reassembly->Size >> BYTE_SHIFT) & WORD_LOW_MASK);
+    TransferProtocolSetChecksum(pNewBuf);
+    *pBuf = pNewBuf;
+    *Size = HEADER_SIZE + Reassembly->Size + CRC_SIZE;
+    Reassembly->Buffer = NULL;
+    TransferProtocolReassemblyReset(Reassembly);
+    return 1;
+}
+
+/**
+  * @brief  	Updates a copy of the routing tables
+  * @details	Threads that route frames outside the MBA keep their own copy,
+  *		so the hot path reads no shared data. The copy is only made
+  *		when the tables have changed since the last one. A copy made
+  *		while @ref TransferProtocolUpdateLinks rebuilds them, with an
+  *		odd version, or that overlapped a rebuild is made again.
+  * @param[in,out] View Copy to update. Version 0 for the first call
+  * @retval	1 if the copy has been updated, 0 if it was up to date
+  */
+uint8_t TransferProtocolGetRouteView(TPRouteView *View)
+{
+    uint32_t Version;
+
+    for(;;)
+    {
+      Version = RouteVersion;
+      OSMemoryBarrier();
+      if(Version == View->Version)
+      {
+        return 0;
+      }
+      if((Version & 1) == 0)
+      {
+        View->LogicalID = LogicalID;
+        memcpy(View->Interface, RouteInterface, sizeof(View->Interface));
+        memcpy(View->Group, GroupInterfaces, sizeof(View->Group));
+        OSMemoryBarrier();
+        if(Version == RouteVersion)
+        {
+          break;
+        }
+      }
+    }
+
+    View->Version = Version;
+    return 1;
+}
+
+/**
+  * @brief  	Destination interface of a frame the MBA would just forward
+  * @details	Same routing as @ref TransferProtocolProcess for transfer frames
+  *		addressed to an interface of this node and for frames addressed
+  *		to other nodes. The frame is not modified.
+  * @param[in]  View Routing tables. See @ref TransferProtocolGetRouteView
+  * @param[in]  TPFrame Frame to be routed
+  * @retval	Destination interface, -1 if the frame is not forwarded,
+  *		TP_MULTICAST if it goes to a group
+  */
+int32_t TransferProtocolRoute(const TPRouteView *View, TransProtFrame *TPFrame)
+{
+    uint8_t DestNode = GetDestLogicalIdP(TPFrame);
+
+    if(DestNode == View->LogicalID)
+    {
+      if((GetFrameCommandP(TPFrame) != TRANSFER_COMMAND) ||
+         (GetDestInterfaceIdP(TPFrame) >= AVAILABLE_INTERFACES))
+      {
+        return -1;
+      }
+      return (int32_t)GetDestInterfaceIdP(TPFrame);
+    }
+    if(View->Group[DestNode] != 0)
+    {
+      return TP_MULTICAST;
+    }
+
+    return (int32_t)View->Interface[DestNode];
+}
+
+/**
+  * @brief  	Members of a group
+  * @details	A logical ID is a group when some interface has its bit in the
+  *		groups register. Frames for a group are sent to every member
+  *		instead of the interface that reaches the logical ID.
+  * @param[in]  DestLogicalID Logical ID
+  * @retval	Bit n: interface n is a member. 0 if the logical ID is no group
+  */
+uint8_t TransferProtocolGetGroup(uint8_t DestLogicalID)
+{
+    if(DestLogicalID >= TP_ROUTE_IDS)
+    {
+      return 0;
+    }
+    return GroupInterfaces[DestLogicalID];
 }
 
 /**
@@ -553,6 +1170,11 @@ void TransferProtocolSetInterfaceType(uint8_t InterfaceID, uint8_t type)
   */
 void TransferProtocolUpdateInterfaceState(uint8_t InterfaceID)
 {
+  /* The state machine reports -1 when no interface is involved */
+  if(InterfaceID >= AvailableInterfaces)
+  {
+      return;
+  }
   if(TPIDTable[InterfaceID].InterfaceType == MBA_BRIDGE)
   {
       TPIDTable[InterfaceID].InterfaceState = GetBusInstanceState(InterfaceID);
@@ -577,232 +1199,252 @@ void TransferProtocolForceInterfaceState(uint8_t InterfaceID,   uint8_t State)
 
 /************** Static Functions **********************************/
 /**
-  * @brief  Routine to get links between IDs
-  * @param[in]  ID	Source ID in any format (Interface, Scan, Logical & Linked)
-	* @param[in]  Mode Link relationship
-  * @retval ID in the desired format
+  * @brief  Interface that reaches a logical ID
+  * @param[in]  DestLogicalID	Logical ID of the destination node
+  * @retval Interface ID, -1 if the node is reached through no interface
   */
 int16_t TransferProtocolGetRouteInterface(uint16_t DestLogicalID)
 {
-    uint8_t TableIndex = 0, InterfaceCount;
-    int16_t retID = -1;
-    for(InterfaceCount = 0; InterfaceCount < AVAILABLE_INTERFACES; InterfaceCount++)
+    if(DestLogicalID >= TP_ROUTE_IDS)
     {
-      while((RouteTableLink[InterfaceCount].LinkedLogicalID[TableIndex] != 0xFF) &&
-            (RouteTableLink[InterfaceCount].LinkedLogicalID[TableIndex] != DestLogicalID))
-      {
-        TableIndex++;
-      }
-      if (RouteTableLink[InterfaceCount].LinkedLogicalID[TableIndex] == DestLogicalID)
-      {
-        break;
-      }
-      TableIndex = 0;
-    }
-    if(InterfaceCount < AVAILABLE_INTERFACES)
-    {
-      retID = InterfaceCount;
+      return TP_NO_ROUTE;
     }
-    return retID;
+    return RouteInterface[DestLogicalID];
 }
 
 /**
   * @brief  Routine to get links between IDs
+  * @details The interface ID is the position in the link table; the other
+  *	     formats are looked up in the link indexes.
   * @param[in]  ID	Source ID in any format (Interface, Scan, Logical & Linked)
 	* @param[in]  Mode Link relationship
-  * @retval ID in the desired format
+  * @retval ID in the desired format, -1 if no interface has the source ID
   */
 int16_t TransferProtocolGetIDLink(uint16_t ID, TPLinkModes Mode)
 {
-    uint8_t TableIndex = 0;
-    int16_t retID = -1;
-    switch(Mode)
+    /* Modes go by source format, each one to the other three in order */
+    uint8_t Source = (uint8_t)Mode / (LINK_FORMATS - 1);
+    uint8_t Target = (uint8_t)Mode % (LINK_FORMATS - 1);
+    int16_t Row;
+
+    if(Mode > LINKEDDEV_TO_LOGICAL)
     {
-      case INTERFACE_TO_SCAN:
-        while(TableIndex < AvailableInterfaces)
-        {
-          if(TPIDTable[TableIndex].InterfaceID == ID)
-          {
-              retID =  TPIDTable[TableIndex].ScanID;
-              break;
-          }
-          else
-          {
-              TableIndex++;
-          }
-        }
-        break;
-      case INTERFACE_TO_LOGICAL:
-        while(TableIndex < AvailableInterfaces)
-        {
-          if(TPIDTable[TableIndex].InterfaceID == ID)
-          {
-              retID =  TPIDTable[TableIndex].LogicalID;
-              break;
-          }
-          else
-          {
-              TableIndex++;
-          }
-        }
-        break;
-      case INTERFACE_TO_LINKEDDEV:
-        while(TableIndex < AvailableInterfaces)
-        {
-          if(TPIDTable[TableIndex].InterfaceID == ID)
-          {
-              retID =  TPIDTable[TableIndex].LinkedDevice;
-              break;
-          }
-          else
-          {
-              TableIndex++;
-          }
-        }
-        break;
-      case SCAN_TO_INTERFACE:
-        while(TableIndex < AvailableInterfaces)
-        {
-          if(TPIDTable[TableIndex].ScanID == ID)
-          {
-              retID =  TPIDTable[TableIndex].InterfaceID;
-              break;
-          }
-          else
-          {
-              TableIndex++;
-          }
-        }
-        break;
-      case SCAN_TO_LOGICAL:
-        while(TableIndex < AvailableInterfaces)
-        {
-          if(TPIDTable[TableIndex].ScanID == ID)
-          {
-              retID =  TPIDTable[TableIndex].LogicalID;
-              break;
-          }
-          else
-          {
-              TableIndex++;
-          }
-        }
-        break;
-      case SCAN_TO_LINKEDDEV:
-        while(TableIndex < AvailableInterfaces)
-        {
-          if(TPIDTable[TableIndex].ScanID == ID)
-          {
-              retID =  TPIDTable[TableIndex].LinkedDevice;
-              break;
-          }
-          else
-          {
-              TableIndex++;
-          }
-        }
-        break;
-      case LOGICAL_TO_INTERFACE:
-        while(TableIndex < AvailableInterfaces)
-        {
-          if(TPIDTable[TableIndex].LogicalID == ID)
-          {
-            retID =  TPIDTable[TableIndex].InterfaceID;
-            break;
-          }
-          else
-          {
-              TableIndex++;
-          }
-        }
-        break;
-      case LOGICAL_TO_SCAN:
-        while(TableIndex < AvailableInterfaces)
-        {
-          if(TPIDTable[TableIndex].LogicalID == ID)
-          {
-              retID =  TPIDTable[TableIndex].ScanID;
-              break;
-          }
-          else
-          {
-              TableIndex++;
-          }
-        }
-        break;
-      case LOGICAL_TO_LINKEDDEV:
-        while(TableIndex < AvailableInterfaces)
+      return -1;
+    }
+    if(Target >= Source)
+    {
+      Target++;
+    }
+
+    Row = TransferProtocolGetLinkRow(ID, Source);
+    if(Row == LINK_NONE)
+    {
+      return -1;
+    }
+    return (int16_t)TransferProtocolGetLinkID((uint8_t)Row, Target);
+}
+
+/**
+  * @brief  ID of an interface in the given format
+  * @param[in]  Row	Position of the interface in the link table
+  * @param[in]  Format	ID format. See @ref TPLinkFormats
+  * @retval ID
+  */
+static uint16_t TransferProtocolGetLinkID(uint8_t Row, uint8_t Format)
+{
+    switch(Format)
+    {
+      case LINK_INTERFACE:
+        return TPIDTable[Row].InterfaceID;
+      case LINK_SCAN:
+        return TPIDTable[Row].ScanID;
+      case LINK_LOGICAL:
+        return TPIDTable[Row].LogicalID;
+      default:
+        return TPIDTable[Row].LinkedDevice;
+    }
+}
+
+/**
+  * @brief  Position in the link table of the interface with an ID
+  * @details The first interface with the ID is taken.
+  * @param[in]  ID	ID to look for
+  * @param[in]  Format	ID format. See @ref TPLinkFormats
+  * @retval Position, LINK_NONE if no interface has the ID
+  */
+static int16_t TransferProtocolGetLinkRow(uint16_t ID, uint8_t Format)
+{
+    int16_t Row;
+
+    if(Format == LINK_INTERFACE)
+    {
+      return (ID < AvailableInterfaces) ? (int16_t)ID : LINK_NONE;
+    }
+
+    Row = LinkIndex[Format - 1][ID & (LINK_INDEX_SIZE - 1)];
+    if(Row == LINK_SHARED)
+    {
+      /* IDs with the same low byte: only met with scan IDs */
+      for(Row = 0; Row < AvailableInterfaces; Row++)
+      {
+        if(TransferProtocolGetLinkID((uint8_t)Row, Format) == ID)
         {
-          if(TPIDTable[TableIndex].LogicalID == ID)
-          {
-            retID =  TPIDTable[TableIndex].LinkedDevice;
-            break;
-          }
-          else
-          {
-              TableIndex++;
-          }
+          return Row;
         }
-        break;
-      case LINKEDDEV_TO_INTERFACE:
-	      while(TableIndex < AvailableInterfaces)
-	      {
-          if(TPIDTable[TableIndex].LinkedDevice == ID)
-          {
-              retID =  TPIDTable[TableIndex].InterfaceID;
-              break;
-          }
-          else
-          {
-              TableIndex++;
-          }
-	      }
-	      break;
-      case LINKEDDEV_TO_SCAN:
-        while(TableIndex < AvailableInterfaces)
+      }
+      return LINK_NONE;
+    }
+    if((Row != LINK_NONE) && (TransferProtocolGetLinkID((uint8_t)Row, Format) != ID))
+    {
+      Row = LINK_NONE;
+    }
+    return Row;
+}
+
+/**
+  * @brief  Builds the link indexes from the link table
+  */
+static void TransferProtocolIndexLinks(void)
+{
+    uint8_t Format, Row;
+    uint16_t ID;
+    int8_t *Slot;
+
+    memset(LinkIndex, LINK_NONE, sizeof(LinkIndex));
+    for(Format = LINK_SCAN; Format < LINK_FORMATS; Format++)
+    {
+      for(Row = 0; Row < AvailableInterfaces; Row++)
+      {
+        ID = TransferProtocolGetLinkID(Row, Format);
+        Slot = &LinkIndex[Format - 1][ID & (LINK_INDEX_SIZE - 1)];
+        if(*Slot == LINK_NONE)
         {
-          if(TPIDTable[TableIndex].LinkedDevice == ID)
-          {
-              retID =  TPIDTable[TableIndex].ScanID;
-              break;
-          }
-          else
-          {
-              TableIndex++;
-          }
+          *Slot = (int8_t)Row;
         }
-        break;
-      case LINKEDDEV_TO_LOGICAL:
-        while(TableIndex < AvailableInterfaces)
+        else if((*Slot != LINK_SHARED) &&
+                (TransferProtocolGetLinkID((uint8_t)*Slot, Format) != ID))
         {
-          if(TPIDTable[TableIndex].LinkedDevice == ID)
-          {
-            retID =  TPIDTable[TableIndex].LogicalID;
-            break;
-          }
-          else
-          {
-            TableIndex++;
-          }
+          *Slot = LINK_SHARED;
         }
-        break;
-      default:
-        break;
+      }
     }
-    return retID;
 }
 
 /**
-  * @brief  Update link table
+  * @brief  Update link table and the interface of each logical ID
+  * @details Called whenever the Device ID, an interface link, a routes or
+  *	     a groups register is written. If several interfaces reach a
+  *	     node, the first one is taken.
   */
 void TransferProtocolUpdateLinks(void)
 {
   uint8_t index;
+  int8_t InterfaceIndex;
 
   for ( index = 0; index < AVAILABLE_INTERFACES; index++)
   {
       TPIDTable[index].LogicalID = LogicalID + index;
   }
+  TransferProtocolIndexLinks();
+  /* Odd while the tables are rebuilt. See @ref TransferProtocolGetRouteView */
+  RouteVersion++;
+  OSMemoryBarrier();
+  for ( index = 0; index < TP_ROUTE_IDS; index++)
+  {
+      RouteInterface[index] = TP_NO_ROUTE;
+      GroupInterfaces[index] = 0;
+      for ( InterfaceIndex = AVAILABLE_INTERFACES - 1; InterfaceIndex >= 0; InterfaceIndex--)
+      {
+          if (RouteMask[InterfaceIndex] & ((uint32_t)1 << index))
+          {
+              RouteInterface[index] = InterfaceIndex;
+          }
+          if (GroupMask[InterfaceIndex] & ((uint32_t)1 << index))
+          {
+              GroupInterfaces[index] |= (uint8_t)(1u << InterfaceIndex);
+          }
+      }
+  }
+  OSMemoryBarrier();
+  RouteVersion++;
+}
+
+/**
+  * @brief  Writes the header of a frame into the bus buffer it is a view of.
+  *	    Only the fields that differ are stored.
+  * @param[in,out]  pBuf    Bus buffer of the frame
+  * @param[in]	    TPFrame Transfer protocol frame
+  * @retval 	    1 if a field has been stored, 0 if the header was up to date
+  */
+uint8_t TransferProtocolHeaderUpdate(uint8_t *pBuf, TransProtFrame *TPFrame)
+{
+  uint8_t Changed = 0;
+
+  if(GetBufDestNodeId(pBuf) != TPFrame->Header.DestinationID)
+  {
+    pBuf[DESTINATION_ID_INDEX] = TPFrame->Header.DestinationID;
+    Changed = 1;
+  }
+  if(GetBufFrameCommand(pBuf) != TPFrame->Header.Command)
+  {
+    pBuf[COMMAND_INDEX] = TPFrame->Header.Command;
+    Changed = 1;
+  }
+  if(GetBufFrameDataSize(pBuf) != TPFrame->Header.Size)
+  {
+    pBuf[SIZE_LOW_BYTE_INDEX]  = (uint8_t)(TPFrame->Header.Size & WORD_LOW_MASK);
+    pBuf[SIZE_HIGH_BYTE_INDEX] = (uint8_t)((TPFrame->Header.Size >> BYTE_SHIFT) & WORD_LOW_MASK);
+    Changed = 1;
+  }
+  if(GetBufSrcNodeId(pBuf) != TPFrame->Header.SourceID)
+  {
+    pBuf[SOURCE_ID_INDEX] = TPFrame->Header.SourceID;
+    Changed = 1;
+  }
+  if(GetBufFlowControl(pBuf) != TPFrame->Header.FlowControl)
+  {
+    pBuf[FLOW_CONTROL_INDEX] = TPFrame->Header.FlowControl;
+    Changed = 1;
+  }
+  if(GetBufTimeStamp(pBuf) != TPFrame->Header.TimeStamp)
+  {
+    pBuf[TIMESTAMP_0_BYTE_INDEX] = (uint8_t)(TPFrame->Header.TimeStamp & DWORD_0_BYTE_MASK);
+    pBuf[TIMESTAMP_1_BYTE_INDEX] = (uint8_t)((TPFrame->Header.TimeStamp >> BYTE_SHIFT) & DWORD_0_BYTE_MASK);
+    pBuf[TIMESTAMP_2_BYTE_INDEX] = (uint8_t)((TPFrame->Header.TimeStamp >> WORD_SHIFT) & DWORD_0_BYTE_MASK);
+    pBuf[TIMESTAMP_3_BYTE_INDEX] = (uint8_t)((TPFrame->Header.TimeStamp >> DWORD_24_SHIFT) & DWORD_0_BYTE_MASK);
+    Changed = 1;
+  }
+  return Changed;
+}
+
+/**
+  * @brief  Writes the checksum of a frame in buffer format: its CRC-16 with
+  *	    TP_CHECKSUM, 0 otherwise.
+  * @param[in,out] pBuf Frame
+  */
+static void TransferProtocolSetChecksum(uint8_t *pBuf)
+{
+  uint16_t DataSize = GetBufFrameDataSize(pBuf);
+  uint16_t Checksum = 0;
+
+#if TP_CHECKSUM > 0
+  Checksum = crc16(pBuf, HEADER_SIZE + DataSize);
+#endif
+  pBuf[HEADER_SIZE + DataSize + CHECKSUM_LOW_REL_INDEX]  = (uint8_t)(Checksum & WORD_LOW_MASK);
+  pBuf[HEADER_SIZE + DataSize + CHECKSUM_HIGH_REL_INDEX] = (uint8_t)((Checksum >> BYTE_SHIFT) & WORD_LOW_MASK);
+}
+
+/**
+  * @brief  Drops the frame being gathered, if any, and counts it as lost
+  * @param[in,out] Reassembly Fragments gathered from the bridge
+  */
+static void TransferProtocolReassemblyDrop(TPReassembly *Reassembly)
+{
+  if(Reassembly->Buffer != NULL)
+  {
+    Reassembly->Dropped++;
+  }
+  TransferProtocolReassemblyReset(Reassembly);
 }
 
 /**
@@ -34,12 +34,20 @@
 /* Exported define -----------------------------------------------------------*/
 #define HEADER_SIZE			10  /*!< Header Transfer protocol size */
 #define CRC_SIZE			2   /*!< CRC Transfer protocol size */
+#define SIZE_FIELD_OFFSET		2   /*!< Data size in the header, 16 bit
+					     *   little endian */
 	 
 /* Commands inside a transfer protocol frame */
 #define TRANSFER_COMMAND		0x00  /*!< Bridge command */
 #define OPERATION_COMMAND		0x01  /*!< State machine command */
 #define CONFIG_COMMAND			0x02  /*!< Dictionary management command */
+#define FLOW_CONTROL_COMMAND		0x03  /*!< Credits of a MBA bridge, no data */
 	 
+/* Transfer protocol frame priorities. Lower values are served first */
+#define TP_PRIORITY_CONTROL		0x00  /*!< Config and operation frames */
+#define TP_PRIORITY_REALTIME		0x01  /*!< Transfer frames to a local interface */
+#define TP_PRIORITY_BULK		0x02  /*!< Transfer frames routed to other nodes */
+
 /* Transfer protocol cast modes *************/
 /* Cast direction */
 #define TO_BUFFER			0x00 /*!< Cast direction */
@@ -47,6 +55,32 @@
 /* Cast mode		*/
 #define END_BUS				0x00 /*!< The cast add transfer protocol parameters */
 #define	MBA_BRIDGE			0x02 /*!< There is no cast	*/
+/* Cast buffer		*/
+#define IN_PLACE			0x04 /*!< From buffer: the frame is a view of the
+					  *   buffer, which is passed to the frame */
+
+#define TP_ROUTE_LINKS			10   /*!< Default logical IDs routed per interface */
+#define TP_ROUTE_IDS			32   /*!< Logical IDs: 5 bits of the frame IDs */
+#define TP_NO_ROUTE			-1   /*!< Logical ID reached through no interface */
+#define TP_MULTICAST			-2   /*!< Logical ID of a group: the frame goes to
+					  *   every member. See @ref TransferProtocolGetGroup */
+
+/* Flow control field of the frames of a MBA bridge: flag and credit limit */
+#define TP_FLOW_CREDITS			0x80 /*!< The field carries a credit limit */
+#define TP_FLOW_LIMIT_MASK		0x7F /*!< Frames the peer may have sent, mod 128 */
+#define TP_FLOW_WINDOW_MAX		63   /*!< Largest window: half the limit range */
+
+/* Command field of the fragments of a frame split on a MBA bridge. Whole
+ * frames have no fragment bits */
+#define TP_COMMAND_MASK			0x0F /*!< Command of the frame */
+#define TP_FRAGMENT_INDEX_MASK		0x70 /*!< Fragment number: 1 to 7, and 1 again */
+#define TP_FRAGMENT_INDEX_SHIFT		4
+#define TP_FRAGMENT_MORE		0x80 /*!< More fragments of the frame follow */
+
+/* Frame checksum. See TP_CHECKSUM in SysConfig.h */
+#ifndef TP_CHECKSUM
+#define TP_CHECKSUM			0
+#endif
 	 
 /* Exported types ------------------------------------------------------------*/
 
@@ -67,10 +101,38 @@ typedef struct
     uint16_t Size;          /*!< TSize of the data field */
     uint8_t  SourceID;	    /*!< Contains the address of the source node. Same format
 			     *   than @ref DestinationID. */
-    uint8_t  FlowControl;   /*!< Not implemented */
-    uint32_t TimeStamp;	    /*!< Not implemented */
+    uint8_t  FlowControl;   /*!< Credits of MBA bridges with flow control:
+			     *   TP_FLOW_CREDITS and the number of frames, mod
+			     *   128, that the peer may have sent once it gets
+			     *   this one. 0 if the bridge has no flow control */
+    uint32_t TimeStamp;	    /*!< Capture time in us of frames read from an end
+			     *   bus, by the node that read them. Frames of MBA
+			     *   bridges keep the one they carry */
 }TransProtHeader;
 
+/**
+  * @brief Data shared by the frames sent to the members of a group
+  */
+typedef struct
+{
+  uint32_t Refs;	    /*!< Frames that still hold the data */
+}TPShared;
+
+/**
+  * @brief Fragments of a frame being gathered from a MBA bridge. See
+  *	   @ref TransferProtocolReassemble
+  */
+typedef struct
+{
+  uint8_t  *Buffer;	    /*!< Frame gathered so far, in buffer format. NULL
+			     *   if none */
+  uint32_t Size;	    /*!< Data gathered */
+  uint32_t Capacity;	    /*!< Data Buffer has room for */
+  uint32_t MaxSize;	    /*!< Largest data of a frame gathered */
+  uint8_t  Next;	    /*!< Number of the next fragment */
+  uint32_t Dropped;	    /*!< Frames lost: corrupt, incomplete or too large */
+}TPReassembly;
+
 /**
   * @brief Transfer protocol frame
   */
@@ -78,9 +140,39 @@ typedef struct
 {
   TransProtHeader Header;   /*!< Header. Refer to @ref TransProtHeader	*/
   uint8_t	  *Data;    /*!< Data.	*/
-  uint16_t	  Checksum; /*!< Checksum. Format to be defined	*/
+  uint16_t	  Checksum; /*!< CRC-16/CCITT of the header and the data, as
+			     *   sent on MBA bridges. See @ref TP_CHECKSUM */
+  uint8_t	  *Buffer;  /*!< Bus buffer the frame is a view of. Data points
+			     *   into it and it is released with the frame. NULL
+			     *   if Data has been allocated on its own */
+  uint32_t	  BufferSize; /*!< Size of Buffer */
+  /* Time stamps of the way through the node, from OSGetTimeStamp. 0 if the
+   * frame has not got there */
+  uint64_t	  RxTime;   /*!< Read from a bus. 0 if made by the node */
+  uint64_t	  MBATime;  /*!< Taken by the MBA */
+  uint64_t	  OutTime;  /*!< Put into the queue of its bus by the MBA */
+  int8_t	  CreditInterface; /*!< MBA bridge that gets a credit back when
+			     *   the frame leaves the node. -1 if none */
+  TPShared	  *Shared;  /*!< Count of the frames that share Data and Buffer,
+			     *   which are released by the last one. NULL if the
+			     *   frame has them on its own. Shared data is not
+			     *   written in place */
 }TransProtFrame;
 
+/**
+  * @brief Copy of the routing tables for threads that route transfer frames
+  *	   on their own. See @ref TransferProtocolGetRouteView.
+  */
+typedef struct
+{
+  uint32_t Version;	/*!< Tables version of the copy. 0 = never copied */
+  uint8_t  LogicalID;	/*!< Logical ID of this node */
+  int8_t   Interface[TP_ROUTE_IDS]; /*!< Interface that reaches each logical ID,
+			 *   TP_NO_ROUTE if none */
+  uint8_t  Group[TP_ROUTE_IDS]; /*!< Bit n: interface n is a member of the
+			 *   group with the logical ID. 0 if it is no group */
+}TPRouteView;
+
 
 /* Exported constants --------------------------------------------------------*/
 /* Exported macro ------------------------------------------------------------*/
@@ -174,17 +266,67 @@ typedef struct
   */
 #define GetFrameDataSizeP(Frame)(Frame->Header.Size)
 
+/* Bus buffer macros ************************/
+/* Header of a MBA bridge buffer, read in place */
+/**
+  * @brief Reads the destination ID of a bus buffer.
+  */
+#define GetBufDestNodeId(pBuf)			((pBuf)[0])
+/**
+  * @brief Reads the command field of a bus buffer.
+  */
+#define GetBufFrameCommand(pBuf)		((pBuf)[1])
+/**
+  * @brief Reads the data size of a bus buffer.
+  */
+#define GetBufFrameDataSize(pBuf)		((uint16_t)((pBuf)[2] | ((uint16_t)(pBuf)[3] << 8)))
+/**
+  * @brief Reads the source ID of a bus buffer.
+  */
+#define GetBufSrcNodeId(pBuf)			((pBuf)[4])
+/**
+  * @brief Reads the flow control field of a bus buffer.
+  */
+#define GetBufFlowControl(pBuf)			((pBuf)[5])
+/**
+  * @brief Reads the time stamp of a bus buffer.
+  */
+#define GetBufTimeStamp(pBuf)			((uint32_t)(pBuf)[6] | ((uint32_t)(pBuf)[7] << 8) | \
+						 ((uint32_t)(pBuf)[8] << 16) | ((uint32_t)(pBuf)[9] << 24))
+/**
+  * @brief Reads the checksum of a bus buffer with DataSize bytes of data.
+  */
+#define GetBufChecksum(pBuf, DataSize)		((uint16_t)((pBuf)[HEADER_SIZE + (DataSize)] | \
+						 ((uint16_t)(pBuf)[HEADER_SIZE + (DataSize) + 1] << 8)))
+
 /* Exported variables --------------------------------------------------------*/
 /* Exported functions ------------------------------------------------------- */
 /* Initialization */
 void TransferProtocolInit(void);
 void TransferProtocolFrameInit(TransProtFrame *Frame);
+void TransferProtocolFlowFrame(TransProtFrame *Frame, uint8_t InterfaceID);
 
 /* Frame management */
 int32_t TransferProtocolCast(TransProtFrame *TPFrame, uint8_t *pBuf, uint32_t Size, 
                              uint8_t InterfaceID, uint8_t Mode);
+uint8_t *TransferProtocolFrameBuffer(TransProtFrame *TPFrame, uint8_t Mode);
+void TransferProtocolFrameFree(TransProtFrame *TPFrame);
 int32_t TransferProtocolCopy(TransProtFrame *TPFrameDest, TransProtFrame *TPFrameSrc);
+int32_t TransferProtocolShare(TransProtFrame *TPFrameDest, TransProtFrame *TPFrameSrc);
 int32_t TransferProtocolProcess(TransProtFrame *TPFrameDest, TransProtFrame *TPFrameSrc);
+uint8_t TransferProtocolGetPriority(TransProtFrame *TPFrame);
+
+/* Fragments of MBA bridges */
+uint32_t TransferProtocolFragment(uint8_t *pFragment, const uint8_t *pBuf, uint32_t Index,
+                                  uint32_t FragmentSize);
+void TransferProtocolReassemblyInit(TPReassembly *Reassembly, uint32_t MaxSize);
+void TransferProtocolReassemblyReset(TPReassembly *Reassembly);
+int32_t TransferProtocolReassemble(TPReassembly *Reassembly, uint8_t **pBuf, uint32_t *Size);
+
+/* Routing outside the MBA */
+uint8_t TransferProtocolGetRouteView(TPRouteView *View);
+int32_t TransferProtocolRoute(const TPRouteView *View, TransProtFrame *TPFrame);
+uint8_t TransferProtocolGetGroup(uint8_t DestLogicalID);
 
 /* Interfaces management */
 uint8_t TransferProtocolGetAvailableInterfaces(void);
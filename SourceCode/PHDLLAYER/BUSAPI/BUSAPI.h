@@ -39,6 +39,13 @@
 #define BUS_FIELD_SIZE_DETECTION    0x0400 /*!< Location of the field with frame
                                             *   size information */
 #define BUS_END_FIELD_DETECTION     0x0500 /*!< Value of the end detection field */
+#define BUS_GET_FD                  0x0600 /*!< Returns in arg (int *) the descriptor
+                                            *   to wait for readiness. The bus
+                                            *   becomes non-blocking. Host only */
+#define BUS_TX_FLUSH                0x0700 /*!< Writes pending data of a non-blocking
+                                            *   bus. Returns the bytes still pending */
+#define BUS_LINK_LOST               0x0800 /*!< Returns 1 once the peer has closed
+                                            *   the link */
 
 /* Frame detection option */
 #define FRAME_DETECTION_SIZE        0  /*!< A field indicates the size of the frame */
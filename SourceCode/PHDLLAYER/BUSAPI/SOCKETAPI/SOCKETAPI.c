@@ -16,24 +16,34 @@
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <errno.h>
+#include <fcntl.h>
 
-#include "SocketAPI.h"
+#include "SOCKETAPI.h"
 #include "../BUSAPI.h"
+#include "../../../TOOLS/MemoryManagement.h"
 
 /* Private typedef -----------------------------------------------------------*/
 /* Private define ------------------------------------------------------------*/
 #define MAX_CONNECTIONS_SUPPORTED 	1
 #define DEFAULT_PORT			10005
-#define MAX_PACKET_SIZE			512
+#define MAX_PACKET_SIZE			16384	/* Bytes per read: several frames or part of one */
 /* Private macro -------------------------------------------------------------*/
 /* Global variables ---------------------------------------------------------*/
 /* Private variables ---------------------------------------------------------*/
 static int ClientSocketDescriptor;
 static uint8_t RxBuffer[MAX_PACKET_SIZE];
 static uint32_t ReadSize;
+static uint8_t LinkLost;	/* The client has closed the connection */
+
+/* Non-blocking mode: data not accepted by the socket yet */
+static uint8_t NonBlocking;
+static uint8_t *TxPending;
+static uint32_t TxPendingSize;
 
 /* Private function prototypes -----------------------------------------------*/
 int SocketAcceptConnection(void);
+static int32_t SocketGetFd(int *fd);
+static int32_t SocketFlush(void);
 
 /**
   * @brief  Initializes socket interface.
@@ -42,7 +52,7 @@ int SocketAcceptConnection(void);
   */
 int32_t SocketInit(void)
 {
-  int sockfd;
+  int sockfd, reuse = 1;
   struct sockaddr_in serv_addr;
 
   sockfd = socket(AF_INET, SOCK_STREAM, 0);
@@ -51,7 +61,10 @@ int32_t SocketInit(void)
       printf("Error");
   }
 
-  bzero((char *) &serv_addr , sizeof(serv_addr));
+  /* Allows to restart the host daemon while old connections are in TIME_WAIT */
+  setsockopt(sockfd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+  memset((char *) &serv_addr, 0, sizeof(serv_addr));
   serv_addr.sin_family = AF_INET;
   serv_addr.sin_addr.s_addr = INADDR_ANY;
   serv_addr.sin_port = htons(DEFAULT_PORT);
@@ -76,13 +89,34 @@ int32_t SocketInit(void)
   */
 int32_t SocketDeInit(void)
 {
-  close(ClientSocketDescriptor);
+  if(ClientSocketDescriptor >= 0)
+  {
+    close(ClientSocketDescriptor);
+    ClientSocketDescriptor = -1;
+  }
+
+  NonBlocking = 0;
+  if(TxPending != NULL)
+  {
+    MemFree(TxPending);
+    TxPending = NULL;
+  }
+  TxPendingSize = 0;
   return 0;
 }
 
 uint32_t SocketDataAvailable(void)
 {
-  ReadSize = read(ClientSocketDescriptor, RxBuffer, MAX_PACKET_SIZE);
+  ssize_t RetRead;
+
+  RetRead = read(ClientSocketDescriptor, RxBuffer, MAX_PACKET_SIZE);
+  /* Errors and closed connections are reported as no data */
+  ReadSize = (RetRead > 0) ? (uint32_t)RetRead : 0;
+  if((RetRead == 0) ||
+     ((RetRead < 0) && (errno != EAGAIN) && (errno != EWOULDBLOCK) && (errno != EINTR)))
+  {
+    LinkLost = 1;
+  }
   return ReadSize;
 }
 
@@ -116,10 +150,45 @@ uint32_t SocketWrite(uint8_t *data, uint32_t size)
 {
   uint8_t *pTemp = data;
   uint32_t WrittenSize;
+  ssize_t RetWrite;
+  uint8_t *NewPending;
 
-  WrittenSize = write(ClientSocketDescriptor,pTemp, size);
+  if(NonBlocking == 0)
+  {
+    WrittenSize = write(ClientSocketDescriptor,pTemp, size);
 
-  return WrittenSize;
+    return WrittenSize;
+  }
+
+  /* Keep the order: nothing is sent while older data is pending */
+  RetWrite = 0;
+  if(TxPendingSize == 0)
+  {
+    RetWrite = write(ClientSocketDescriptor, pTemp, size);
+    if(RetWrite < 0)
+    {
+      if((errno != EAGAIN) && (errno != EWOULDBLOCK))
+      {
+        return 0;
+      }
+      RetWrite = 0;
+    }
+  }
+
+  /* Save the rest until the socket is writable again */
+  if((uint32_t)RetWrite < size)
+  {
+    NewPending = (uint8_t *)MemRealloc(TxPending, TxPendingSize + size - RetWrite);
+    if(NewPending == NULL)
+    {
+      return (uint32_t)RetWrite;
+    }
+    TxPending = NewPending;
+    memcpy(TxPending + TxPendingSize, pTemp + RetWrite, size - RetWrite);
+    TxPendingSize += size - RetWrite;
+  }
+
+  return size;
 }
 
 /**
@@ -146,6 +215,15 @@ int32_t SocketConfiguration(uint16_t param, void *arg)
    case ACCEPT_CONNECTION:
      SocketAcceptConnection();
      break;
+   case BUS_GET_FD:
+     RetValue = SocketGetFd((int *)arg);
+     break;
+   case BUS_TX_FLUSH:
+     RetValue = SocketFlush();
+     break;
+   case BUS_LINK_LOST:
+     RetValue = LinkLost;
+     break;
    default:
      RetValue = -1;
      break;
@@ -169,6 +247,54 @@ int SocketAcceptConnection(void)
   ClientSocketDescriptor = accept(ClientSocketDescriptor,
 	  (struct sockaddr *) &cli_addr,
 	  &clilen);
+  LinkLost = 0;
 
   return ClientSocketDescriptor;
 }
+
+/**
+  * @brief  Gives the client descriptor and switches it to non-blocking mode.
+  * @param  fd Descriptor of the connected client
+  * @retval 0 on success, -1 if there is no client
+  */
+static int32_t SocketGetFd(int *fd)
+{
+  int Flags;
+
+  if((fd == NULL) || (ClientSocketDescriptor < 0))
+  {
+    return -1;
+  }
+
+  Flags = fcntl(ClientSocketDescriptor, F_GETFL, 0);
+  fcntl(ClientSocketDescriptor, F_SETFL, Flags | O_NONBLOCK);
+  NonBlocking = 1;
+
+  *fd = ClientSocketDescriptor;
+  return 0;
+}
+
+/**
+  * @brief  Sends data kept by a non-blocking write.
+  * @retval Bytes still pending, -1 on error
+  */
+static int32_t SocketFlush(void)
+{
+  ssize_t RetWrite;
+
+  if(TxPendingSize == 0)
+  {
+    return 0;
+  }
+
+  RetWrite = write(ClientSocketDescriptor, TxPending, TxPendingSize);
+  if(RetWrite < 0)
+  {
+    return ((errno == EAGAIN) || (errno == EWOULDBLOCK)) ? (int32_t)TxPendingSize : -1;
+  }
+
+  TxPendingSize -= RetWrite;
+  memmove(TxPending, TxPending + RetWrite, TxPendingSize);
+
+  return (int32_t)TxPendingSize;
+}
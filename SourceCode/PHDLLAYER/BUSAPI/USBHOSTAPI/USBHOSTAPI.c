@@ -23,9 +23,11 @@
 #include "../USBHOSTAPI/USBHOSTAPI.h"
 #include "SysConfig.h"
 #include "../BUSAPI.h"
+#if USB_HOST_API > 0
 
-#if WINDOWS > 0
+#if (WINDOWS > 0) || (LINUX > 0)
 #include <stdio.h>
+#include <string.h>
 #include <libusb-1.0/libusb.h>
 #endif
 
@@ -243,6 +245,7 @@ int32_t USBHostConfiguration(uint16_t param, void *arg)
 
    return ret;
  }
+#endif
 /**
  *@}
  */
@@ -11,13 +11,16 @@
 
 /* Includes ------------------------------------------------------------------*/
 #include "SysConfig.h"
-#if WINDOWS == 0
+#if (WINDOWS == 0) && (LINUX == 0)
 
 #include "Interrupt_Functions.h"
 #include "../../MBALibrary/MBATypes.h"
 #include "../BOARDAPI/boardAPI.h"
 
 #include "../BUSAPI/USBAPI/USBAPI.h"
+#if OS_ACTIVE == 0
+#include "../../APPLAYER/OSSupport.h"	/* Super loop tick */
+#endif
 
 /* Private typedef -----------------------------------------------------------*/
 /* Private define ------------------------------------------------------------*/
@@ -508,7 +511,9 @@ void WEAK PendSV_Handler(void)
   */
 void WEAK SysTick_Handler(void)
 {
-
+#if OS_ACTIVE == 0
+  OSTickHandler();
+#endif
 }
 /**
   * @brief  This function handles PPP interrupt request.
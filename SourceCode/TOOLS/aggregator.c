@@ -0,0 +1,94 @@
+
+/* Includes ------------------------------------------------------------------*/
+
+#include "aggregator.h"
+#include "MemoryManagement.h"
+#include <stddef.h>
+#include <string.h>
+
+/* Private typedef -----------------------------------------------------------*/
+/* Private define ------------------------------------------------------------*/
+/* Private macro -------------------------------------------------------------*/
+/* Private variables ---------------------------------------------------------*/
+/* Private function prototypes -----------------------------------------------*/
+static void aggregator_write(aggregator * a, const uint8_t * data, uint32_t size,
+			     uint32_t frames, aggregator_fn fn, void * arg);
+/* Private functions ---------------------------------------------------------*/
+
+void aggregator_init(aggregator * a)
+{
+  memset(a, 0, sizeof(*a));
+}
+
+void aggregator_reset(aggregator * a)
+{
+  if (a->buf != NULL)
+	  MemFree(a->buf);
+  a->buf = NULL;
+  a->cap = 0;
+  a->len = 0;
+  a->frames = 0;
+}
+
+void aggregator_add(aggregator * a, const uint8_t * frame, uint32_t size, uint32_t size_max,
+		    uint64_t now_us, uint32_t hold_us, aggregator_fn fn, void * arg)
+{
+  // The frames held go first
+  if (a->len > 0 && (a->len + size > size_max || a->cap != size_max))
+	  aggregator_flush(a, fn, arg);
+
+  // Write size changed: the buffer follows it
+  if (a->cap != size_max)
+  {
+	  aggregator_reset(a);
+	  if (size_max > 0)
+		  a->buf = (uint8_t *)MemAlloc(size_max);
+	  a->cap = (a->buf != NULL) ? size_max : 0;
+  }
+
+  // Off, a frame that fills a write or no buffer: written as it is
+  if (size >= a->cap)
+  {
+	  aggregator_write(a, frame, size, 1, fn, arg);
+	  return;
+  }
+
+  if (a->len == 0)
+	  a->first_us = now_us;
+  memcpy(a->buf + a->len, frame, size);
+  a->len += size;
+  a->frames++;
+
+  if (a->len == a->cap || aggregator_wait_us(a, now_us, hold_us) == 0)
+	  aggregator_flush(a, fn, arg);
+}
+
+void aggregator_flush(aggregator * a, aggregator_fn fn, void * arg)
+{
+  if (a->len == 0)
+	  return;
+  aggregator_write(a, a->buf, a->len, a->frames, fn, arg);
+  a->len = 0;
+  a->frames = 0;
+}
+
+uint32_t aggregator_wait_us(const aggregator * a, uint64_t now_us, uint32_t hold_us)
+{
+  uint64_t elapsed;
+
+  if (a->len == 0)
+	  return 0;
+  elapsed = (now_us > a->first_us) ? now_us - a->first_us : 0;
+  return (elapsed >= hold_us) ? 0 : (uint32_t)(hold_us - elapsed);
+}
+
+/************* Static function description *********************/
+
+// Writes data holding frames frames
+static void aggregator_write(aggregator * a, const uint8_t * data, uint32_t size,
+			     uint32_t frames, aggregator_fn fn, void * arg)
+{
+  a->writes++;
+  a->packed += frames;
+  fn(arg, data, size);
+}
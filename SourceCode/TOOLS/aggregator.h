@@ -0,0 +1,45 @@
+#ifndef AGGREGATOR_H_
+#define AGGREGATOR_H_
+
+#include <stdint.h>
+
+// Packs the frames written into a link into fewer, larger writes. Frames are
+// copied one after the other into a buffer of the size of a transport write
+// (an USB packet, a TCP segment) and written together when the next one does
+// not fit, when the oldest one has waited the hold time or when the writer
+// runs out of frames and flushes. The receiving side splits them again by
+// their size field.
+//
+// An aggregator belongs to the thread that writes into the link.
+
+typedef void (*aggregator_fn)(void * arg, const uint8_t * data, uint32_t size);
+
+typedef struct
+{
+  uint8_t * buf;
+  uint32_t len;
+  uint32_t cap;			// Size of buf, 0 if none
+  uint64_t first_us;		// Time of the oldest frame in buf
+  uint32_t frames;		// Frames in buf
+  uint32_t writes;		// Writes made
+  uint32_t packed;		// Frames written
+}aggregator;
+
+void aggregator_init(aggregator * a);
+
+// Drops the frames held and releases the buffer
+void aggregator_reset(aggregator * a);
+
+// Adds a frame at time now_us. size_max is the size of a write, 0 to write
+// every frame as it comes. Frames that do not fit in a write go alone.
+// fn is called with the data to write
+void aggregator_add(aggregator * a, const uint8_t * frame, uint32_t size, uint32_t size_max,
+		    uint64_t now_us, uint32_t hold_us, aggregator_fn fn, void * arg);
+
+// Writes the frames held, if any
+void aggregator_flush(aggregator * a, aggregator_fn fn, void * arg);
+
+// Time the frames held may still wait for others, 0 if none or if due
+uint32_t aggregator_wait_us(const aggregator * a, uint64_t now_us, uint32_t hold_us);
+
+#endif /* AGGREGATOR_H_ */
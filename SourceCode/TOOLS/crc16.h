@@ -0,0 +1,28 @@
+#ifndef CRC16_H_
+#define CRC16_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+// CRC-16/CCITT-FALSE: polynomial 0x1021, initial value 0xFFFF, bits not
+// reflected and no final xor. The CRC of "123456789" is 0x29B1.
+//
+// The variants give the same result and can be chained: the CRC of a buffer
+// is the CRC of its second part started with the CRC of the first one.
+//   crc16_bitwise: a shift per bit, no tables. Reference
+//   crc16_table:   a 256 entry table, one lookup per byte
+//   crc16_slice8:  eight tables, eight bytes per step. Only with CRC16_SLICE8
+// crc16 picks the one selected in SysConfig.h: CRC16_HW, a CRC unit of the
+// device, if it is defined, else slice-by-8 or the table.
+
+#define CRC16_INIT	0xFFFF
+#define CRC16_CHECK	0x29B1	// CRC of "123456789"
+
+uint16_t crc16_bitwise(uint16_t crc, const uint8_t * data, size_t size);
+uint16_t crc16_table(uint16_t crc, const uint8_t * data, size_t size);
+uint16_t crc16_slice8(uint16_t crc, const uint8_t * data, size_t size);
+
+// CRC of a whole buffer
+uint16_t crc16(const uint8_t * data, size_t size);
+
+#endif /* CRC16_H_ */
@@ -0,0 +1,160 @@
+
+/* Includes ------------------------------------------------------------------*/
+
+#include "deframer.h"
+#include "MemoryManagement.h"
+#include <stddef.h>
+#include <string.h>
+
+/* Private typedef -----------------------------------------------------------*/
+/* Private define ------------------------------------------------------------*/
+/* Private macro -------------------------------------------------------------*/
+#define DEFRAMER_MIN(a, b)	(((a) < (b)) ? (a) : (b))
+
+/* Private variables ---------------------------------------------------------*/
+/* Private function prototypes -----------------------------------------------*/
+static uint32_t deframer_size(deframer * d, const uint8_t * header);
+static int deframer_drop(deframer * d, uint8_t * chunk);
+/* Private functions ---------------------------------------------------------*/
+
+void deframer_init(deframer * d, uint32_t header, uint32_t size_offset,
+		   uint32_t trailer, uint32_t max)
+{
+  d->buf = NULL;
+  d->len = 0;
+  d->need = 0;
+  d->header = header;
+  d->size_offset = size_offset;
+  d->trailer = trailer;
+  d->max = max;
+  d->dropped = 0;
+}
+
+void deframer_reset(deframer * d)
+{
+  if (d->buf != NULL)
+	  MemFree(d->buf);
+  d->buf = NULL;
+  d->len = 0;
+  d->need = 0;
+}
+
+int deframer_feed(deframer * d, uint8_t * chunk, uint32_t size, deframer_fn fn, void * arg)
+{
+  uint32_t pos = 0, take, frame_size = 0;
+  uint8_t * frame;
+  int frames = 0;
+
+  // End of the partial frame
+  if (d->buf != NULL)
+  {
+	  if (d->need == 0)
+	  {
+		  take = DEFRAMER_MIN(d->header - d->len, size);
+		  memcpy(d->buf + d->len, chunk, take);
+		  d->len += take;
+		  pos += take;
+		  if (d->len < d->header)
+		  {
+			  MemFree(chunk);
+			  return 0;
+		  }
+
+		  d->need = deframer_size(d, d->buf);
+		  if (d->need > d->max)
+			  return deframer_drop(d, chunk);
+		  frame = (uint8_t *)MemRealloc(d->buf, d->need);
+		  if (frame == NULL)
+			  return deframer_drop(d, chunk);
+		  d->buf = frame;
+	  }
+
+	  take = DEFRAMER_MIN(d->need - d->len, size - pos);
+	  memcpy(d->buf + d->len, chunk + pos, take);
+	  d->len += take;
+	  pos += take;
+	  if (d->len < d->need)
+	  {
+		  MemFree(chunk);
+		  return 0;
+	  }
+
+	  frame = d->buf;
+	  d->buf = NULL;
+	  d->len = 0;
+	  d->need = 0;
+	  fn(arg, frame, deframer_size(d, frame));
+	  frames++;
+  }
+
+  // Whole frames of the chunk
+  while (size - pos >= d->header)
+  {
+	  frame_size = deframer_size(d, chunk + pos);
+	  if (frame_size > d->max)
+		  return deframer_drop(d, chunk);
+	  if (frame_size > size - pos)
+		  break;
+
+	  if ((pos == 0) && (frame_size == size))
+	  {
+		  // The common case: a chunk is a frame
+		  fn(arg, chunk, size);
+		  return frames + 1;
+	  }
+
+	  // A frame that cannot be copied is lost, the stream goes on after it
+	  frame = (uint8_t *)MemAlloc(frame_size);
+	  if (frame != NULL)
+	  {
+		  memcpy(frame, chunk + pos, frame_size);
+		  fn(arg, frame, frame_size);
+		  frames++;
+	  }
+	  pos += frame_size;
+	  frame_size = 0;
+  }
+
+  if (pos == size)
+  {
+	  MemFree(chunk);
+	  return frames;
+  }
+
+  // Start of the next frame. frame_size is 0 if its header is incomplete
+  d->need = frame_size;
+  d->len = size - pos;
+  if (pos == 0)
+  {
+	  // The chunk itself becomes the partial frame
+	  frame = (uint8_t *)MemRealloc(chunk, (frame_size != 0) ? frame_size : d->header);
+	  if (frame == NULL)
+		  return deframer_drop(d, chunk);
+	  d->buf = frame;
+	  return frames;
+  }
+
+  d->buf = (uint8_t *)MemAlloc((frame_size != 0) ? frame_size : d->header);
+  if (d->buf == NULL)
+	  return deframer_drop(d, chunk);
+  memcpy(d->buf, chunk + pos, d->len);
+  MemFree(chunk);
+  return frames;
+}
+
+/************* Static function description *********************/
+
+// Size of the frame whose header starts at header
+static uint32_t deframer_size(deframer * d, const uint8_t * header)
+{
+  return d->header + (uint32_t)(header[d->size_offset] | (header[d->size_offset + 1] << 8)) + d->trailer;
+}
+
+// Drops the partial frame and the chunk
+static int deframer_drop(deframer * d, uint8_t * chunk)
+{
+  deframer_reset(d);
+  MemFree(chunk);
+  d->dropped++;
+  return -1;
+}
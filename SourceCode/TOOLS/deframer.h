@@ -0,0 +1,42 @@
+#ifndef DEFRAMER_H_
+#define DEFRAMER_H_
+
+#include <stdint.h>
+
+// Splits a byte stream into frames that carry their size in the header: a
+// 16 bit little endian field giving the bytes between the header and the
+// trailer. The chunks read from the stream are fed as they come; a frame
+// split across chunks is kept until it is complete, and a chunk with several
+// frames gives all of them.
+//
+// Chunks and frames are heap blocks (MemAlloc). A chunk holding exactly one
+// frame is handed over as it is; the rest are copied into frames of their
+// own. The stream has no marks to resynchronize on: a frame over the maximum
+// size drops what is buffered, and the stream goes on from the next chunk.
+
+typedef void (*deframer_fn)(void * arg, uint8_t * frame, uint32_t size);
+
+typedef struct
+{
+  uint8_t * buf;	// Partial frame, NULL if none
+  uint32_t len;		// Bytes in buf
+  uint32_t need;	// Size of the partial frame, 0 while its header is incomplete
+  uint32_t header;	// Header size
+  uint32_t size_offset;	// Offset of the size field in the header
+  uint32_t trailer;	// Bytes after the data
+  uint32_t max;		// Largest frame accepted
+  uint32_t dropped;	// Chunks dropped by an oversized frame
+}deframer;
+
+void deframer_init(deframer * d, uint32_t header, uint32_t size_offset,
+		   uint32_t trailer, uint32_t max);
+
+// Drops the partial frame
+void deframer_reset(deframer * d);
+
+// Takes a chunk of the stream and calls fn with each frame completed by it.
+// The frames belong to fn. Returns the frames given, -1 if the stream has
+// been dropped
+int deframer_feed(deframer * d, uint8_t * chunk, uint32_t size, deframer_fn fn, void * arg);
+
+#endif /* DEFRAMER_H_ */
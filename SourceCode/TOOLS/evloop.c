@@ -0,0 +1,180 @@
+
+/* Includes ------------------------------------------------------------------*/
+
+#include "evloop.h"
+
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <unistd.h>
+#include <errno.h>
+
+/* Private typedef -----------------------------------------------------------*/
+/* Private define ------------------------------------------------------------*/
+/* Private macro -------------------------------------------------------------*/
+/* Private variables ---------------------------------------------------------*/
+/* Private function prototypes -----------------------------------------------*/
+static int evloop_find(evloop * loop, int fd);
+static int evloop_in_loop(evloop * loop);
+/* Private functions ---------------------------------------------------------*/
+
+int evloop_init(evloop * loop)
+{
+  int slot;
+
+  loop->running = 0;
+  loop->thread_valid = 0;
+  for (slot = 0; slot < EVLOOP_MAX_HANDLERS; slot++)
+  {
+	  loop->handlers[slot].fd = -1;
+	  loop->handlers[slot].cb = 0;
+	  loop->handlers[slot].arg = 0;
+  }
+  pthread_mutex_init(&loop->lock, NULL);
+
+  loop->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  return (loop->epoll_fd < 0) ? -1 : 0;
+}
+
+int evloop_add(evloop * loop, int fd, uint32_t events, evloop_cb cb, void * arg)
+{
+  struct epoll_event ev;
+  int slot, ret = -1;
+  int locked = !evloop_in_loop(loop);
+
+  if (fd < 0 || cb == 0)
+	  return -1;
+
+  if (locked) pthread_mutex_lock(&loop->lock);
+
+  slot = evloop_find(loop, -1);
+  if (slot >= 0)
+  {
+	  loop->handlers[slot].fd = fd;
+	  loop->handlers[slot].cb = cb;
+	  loop->handlers[slot].arg = arg;
+
+	  // The slot travels with the event, so no lookup is needed on dispatch
+	  ev.events = events;
+	  ev.data.u64 = 0;
+	  ev.data.u32 = (uint32_t)slot;
+	  ret = epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, fd, &ev);
+	  if (ret != 0)
+		  loop->handlers[slot].fd = -1;
+  }
+
+  if (locked) pthread_mutex_unlock(&loop->lock);
+
+  return ret;
+}
+
+int evloop_mod(evloop * loop, int fd, uint32_t events)
+{
+  struct epoll_event ev;
+  int slot, ret = -1;
+  int locked = !evloop_in_loop(loop);
+
+  if (locked) pthread_mutex_lock(&loop->lock);
+
+  slot = evloop_find(loop, fd);
+  if (slot >= 0)
+  {
+	  ev.events = events;
+	  ev.data.u64 = 0;
+	  ev.data.u32 = (uint32_t)slot;
+	  ret = epoll_ctl(loop->epoll_fd, EPOLL_CTL_MOD, fd, &ev);
+  }
+
+  if (locked) pthread_mutex_unlock(&loop->lock);
+
+  return ret;
+}
+
+int evloop_del(evloop * loop, int fd)
+{
+  int slot, ret = -1;
+  int locked = !evloop_in_loop(loop);
+
+  if (locked) pthread_mutex_lock(&loop->lock);
+
+  slot = evloop_find(loop, fd);
+  if (slot >= 0)
+  {
+	  ret = epoll_ctl(loop->epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+	  // Events of this wake up that are still pending see a free slot
+	  loop->handlers[slot].fd = -1;
+	  loop->handlers[slot].cb = 0;
+  }
+
+  if (locked) pthread_mutex_unlock(&loop->lock);
+
+  return ret;
+}
+
+int evloop_run_once(evloop * loop, int timeout_ms)
+{
+  struct epoll_event events[EVLOOP_MAX_EVENTS];
+  struct evloop_handler * h;
+  int n, i;
+
+  if (!loop->thread_valid)
+  {
+	  loop->thread = pthread_self();
+	  loop->thread_valid = 1;
+  }
+
+  n = epoll_wait(loop->epoll_fd, events, EVLOOP_MAX_EVENTS, timeout_ms);
+  if (n < 0)
+	  return (errno == EINTR) ? 0 : -1;
+
+  pthread_mutex_lock(&loop->lock);
+  for (i = 0; i < n; i++)
+  {
+	  h = &loop->handlers[events[i].data.u32];
+	  if (h->fd >= 0 && h->cb != 0)
+		  h->cb(h->fd, events[i].events, h->arg);
+  }
+  pthread_mutex_unlock(&loop->lock);
+
+  return n;
+}
+
+void evloop_run(evloop * loop)
+{
+  loop->thread = pthread_self();
+  loop->thread_valid = 1;
+  loop->running = 1;
+
+  while (loop->running)
+  {
+	  if (evloop_run_once(loop, 100) < 0)
+		  break;
+  }
+}
+
+void evloop_stop(evloop * loop)
+{
+  loop->running = 0;
+}
+
+/************* Static function description *********************/
+
+// Returns the slot of fd (-1 looks for a free slot) or -1 if not found
+static int evloop_find(evloop * loop, int fd)
+{
+  int slot;
+
+  for (slot = 0; slot < EVLOOP_MAX_HANDLERS; slot++)
+  {
+	  if (loop->handlers[slot].fd == fd)
+		  return slot;
+  }
+  return -1;
+}
+
+// Callbacks already hold the lock
+static int evloop_in_loop(evloop * loop)
+{
+  return loop->thread_valid && pthread_equal(loop->thread, pthread_self());
+}
+
+#endif /* __linux__ */
@@ -0,0 +1,65 @@
+#ifndef EVLOOP_H_
+#define EVLOOP_H_
+
+#include <stdint.h>
+#include <pthread.h>
+
+// Event loop on top of epoll (Linux only). A single thread waits on all the
+// registered descriptors and runs the callback of the ready ones. Callbacks
+// run in the loop thread and must not block.
+
+// Maximum number of descriptors registered at the same time
+#define EVLOOP_MAX_HANDLERS	64
+// Maximum number of events served per wake up
+#define EVLOOP_MAX_EVENTS	32
+
+// Event flags (same values than epoll)
+#define EVLOOP_IN		0x001
+#define EVLOOP_OUT		0x004
+#define EVLOOP_ERR		0x008
+#define EVLOOP_HUP		0x010
+#define EVLOOP_RDHUP		0x2000
+
+typedef void (*evloop_cb)(int fd, uint32_t events, void * arg);
+
+struct evloop_handler
+{
+  int fd;		// -1 = free slot
+  evloop_cb cb;
+  void * arg;
+};
+
+typedef struct
+{
+  int epoll_fd;
+  int running;
+  pthread_t thread;	// Thread running the loop
+  int thread_valid;
+  pthread_mutex_t lock;	// Held while a callback runs and while the table changes
+  struct evloop_handler handlers[EVLOOP_MAX_HANDLERS];
+}evloop;
+
+// Returns 0 on success, -1 if epoll is not available
+int evloop_init(evloop * loop);
+
+// Registers fd. Returns 0 on success, -1 on error (table full, bad fd)
+int evloop_add(evloop * loop, int fd, uint32_t events, evloop_cb cb, void * arg);
+
+// Changes the events watched for fd. events = 0 disarms the descriptor
+int evloop_mod(evloop * loop, int fd, uint32_t events);
+
+// Unregisters fd. Called from other thread, it waits until a running
+// callback of the loop finishes, so the descriptor can be closed afterwards
+int evloop_del(evloop * loop, int fd);
+
+// Waits at most timeout_ms (-1 = forever) and runs the ready callbacks.
+// Returns the number of events served or -1 on error
+int evloop_run_once(evloop * loop, int timeout_ms);
+
+// Runs the loop in the calling thread until evloop_stop is called
+void evloop_run(evloop * loop);
+
+// Asks the loop to return. The loop notices it on the next wake up
+void evloop_stop(evloop * loop);
+
+#endif /* EVLOOP_H_ */
@@ -0,0 +1,61 @@
+
+/* Includes ------------------------------------------------------------------*/
+
+#include "latstats.h"
+#include <string.h>
+
+/* Private typedef -----------------------------------------------------------*/
+/* Private define ------------------------------------------------------------*/
+/* Private macro -------------------------------------------------------------*/
+/* Private variables ---------------------------------------------------------*/
+/* Private function prototypes -----------------------------------------------*/
+static uint32_t latstats_us(uint64_t from, uint64_t to);
+/* Private functions ---------------------------------------------------------*/
+
+void latstats_reset(latstats * stats)
+{
+  memset(stats, 0, sizeof(*stats));
+}
+
+void latstats_add(latstats * stats, const uint64_t marks[LATSTATS_MARKS])
+{
+  uint32_t us, bucket = 0, i;
+
+  if (marks[0] == 0)
+	  return;
+
+  us = latstats_us(marks[0], marks[LATSTATS_STAGES]);
+  while (bucket < LATSTATS_BUCKETS - 1 && (us >> (bucket + 1)) != 0)
+	  bucket++;
+  stats->frames++;
+  stats->buckets[bucket]++;
+  stats->sum_us += us;
+  if (us > stats->max_us)
+	  stats->max_us = us;
+
+  for (i = 1; i < LATSTATS_STAGES; i++)
+  {
+	  if (marks[i] == 0)
+		  return;
+  }
+  stats->staged++;
+  for (i = 0; i < LATSTATS_STAGES; i++)
+  {
+	  us = latstats_us(marks[i], marks[i + 1]);
+	  stats->stage_sum_us[i] += us;
+	  if (us > stats->stage_max_us[i])
+		  stats->stage_max_us[i] = us;
+  }
+}
+
+/************* Static function description *********************/
+
+// Time between two marks, 0 if they are out of order
+static uint32_t latstats_us(uint64_t from, uint64_t to)
+{
+  if (to <= from)
+	  return 0;
+  if (to - from > 0xFFFFFFFFu)
+	  return 0xFFFFFFFFu;
+  return (uint32_t)(to - from);
+}
@@ -0,0 +1,37 @@
+#ifndef LATSTATS_H_
+#define LATSTATS_H_
+
+#include <stdint.h>
+
+// Latency of the frames that leave through a path, from their capture to
+// their exit, split in stages by the marks a frame gets on its way: stage i
+// goes from mark i to mark i + 1. Frames that skip a mark count in the total
+// only. Durations in us are kept in a histogram of power of two buckets, and
+// the sums and maxima of each stage tell where the time goes.
+//
+// The statistics are a register image of a single writer: the thread that
+// sends the frames. Readers may see a frame half added.
+
+#define LATSTATS_STAGES		3	// Capture, MBA, exit queue
+#define LATSTATS_MARKS		(LATSTATS_STAGES + 1)
+#define LATSTATS_BUCKETS	16	// Bucket i: [2^i, 2^(i+1)) us. The last one has the rest
+
+typedef struct
+{
+  uint64_t sum_us;		// Capture to exit
+  uint64_t stage_sum_us[LATSTATS_STAGES];
+  uint32_t frames;
+  uint32_t staged;		// Frames with every mark, counted in the stages
+  uint32_t max_us;
+  uint32_t stage_max_us[LATSTATS_STAGES];
+  uint32_t buckets[LATSTATS_BUCKETS];
+}latstats;
+
+void latstats_reset(latstats * stats);
+
+// Adds a frame. marks are times in us: marks[0] its capture,
+// marks[LATSTATS_STAGES] its exit and 0 the marks it skipped. Frames without
+// capture time are not counted
+void latstats_add(latstats * stats, const uint64_t marks[LATSTATS_MARKS]);
+
+#endif /* LATSTATS_H_ */
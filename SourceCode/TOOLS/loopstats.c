@@ -0,0 +1,180 @@
+
+/* Includes ------------------------------------------------------------------*/
+
+#include "loopstats.h"
+#include <pthread.h>
+#include <signal.h>
+#include <string.h>
+#include <time.h>
+
+/* Private typedef -----------------------------------------------------------*/
+/* Private define ------------------------------------------------------------*/
+/* Private macro -------------------------------------------------------------*/
+#define LOOPSTATS_SET(field, value)	__atomic_store_n(&(field), (value), __ATOMIC_RELAXED)
+#define LOOPSTATS_GET(field)		__atomic_load_n(&(field), __ATOMIC_RELAXED)
+
+/* Private variables ---------------------------------------------------------*/
+uint32_t loopstats_threshold_us = 10000;
+__thread loopstats * loopstats_current;
+
+static loopstats slots[LOOPSTATS_SLOTS];
+static pthread_mutex_t slots_lock = PTHREAD_MUTEX_INITIALIZER;
+static volatile sig_atomic_t dump_pending;
+
+/* Private function prototypes -----------------------------------------------*/
+static uint64_t loopstats_now_ns(void);
+static void loopstats_signal(int signo);
+/* Private functions ---------------------------------------------------------*/
+
+loopstats * loopstats_open(const char * name, int index)
+{
+  loopstats * stats = 0;
+  char full[LOOPSTATS_NAME];
+  uint32_t i;
+
+  if (index >= 0)
+	  snprintf(full, LOOPSTATS_NAME, "%s %d", name, index);
+  else
+	  snprintf(full, LOOPSTATS_NAME, "%s", name);
+  // An empty name is a free slot
+  if (full[0] == 0)
+	  strcpy(full, "?");
+
+  pthread_mutex_lock(&slots_lock);
+  for (i = 0; i < LOOPSTATS_SLOTS && stats == 0; i++)
+  {
+	  if (strcmp(slots[i].name, full) == 0)
+		  stats = &slots[i];
+  }
+  for (i = 0; i < LOOPSTATS_SLOTS && stats == 0; i++)
+  {
+	  if (slots[i].name[0] == 0)
+	  {
+		  stats = &slots[i];
+		  memset(stats, 0, sizeof(*stats));
+		  strcpy(stats->name, full);
+	  }
+  }
+  pthread_mutex_unlock(&slots_lock);
+  return stats;
+}
+
+void loopstats_close(loopstats * stats)
+{
+  pthread_mutex_lock(&slots_lock);
+  stats->name[0] = 0;
+  pthread_mutex_unlock(&slots_lock);
+}
+
+loopstats * loopstats_slot(uint32_t i)
+{
+  return &slots[i % LOOPSTATS_SLOTS];
+}
+
+void loopstats_begin(loopstats * stats)
+{
+  stats->frame = 0;
+  stats->start_ns = loopstats_now_ns();
+}
+
+void loopstats_end(loopstats * stats)
+{
+  uint64_t us = (loopstats_now_ns() - stats->start_ns) / 1000;
+  uint32_t threshold = LOOPSTATS_GET(loopstats_threshold_us);
+  uint32_t bucket = 0;
+
+  while (bucket < LOOPSTATS_BUCKETS - 1 && (us >> (bucket + 1)) != 0)
+	  bucket++;
+  if (us > 0xFFFFFFFFu)
+	  us = 0xFFFFFFFFu;
+
+  LOOPSTATS_SET(stats->iterations, stats->iterations + 1);
+  LOOPSTATS_SET(stats->buckets[bucket], stats->buckets[bucket] + 1);
+  if (us > stats->max_us)
+	  LOOPSTATS_SET(stats->max_us, (uint32_t)us);
+
+  if (threshold != 0 && us > threshold)
+  {
+	  LOOPSTATS_SET(stats->stalls, stats->stalls + 1);
+	  LOOPSTATS_SET(stats->last_frame, stats->frame);
+	  fprintf(stderr, "stall: %s %llu us, frame %08x\n", stats->name,
+		  (unsigned long long)us, (unsigned int)stats->frame);
+  }
+}
+
+void loopstats_dump(FILE * out, int reset)
+{
+  loopstats * stats;
+  uint32_t i, b;
+
+  pthread_mutex_lock(&slots_lock);
+  for (i = 0; i < LOOPSTATS_SLOTS; i++)
+  {
+	  stats = &slots[i];
+	  if (stats->name[0] == 0)
+		  continue;
+
+	  fprintf(out, "%-20s %10u iterations %6u stalls %8u us max, last stall frame %08x\n",
+		  stats->name, LOOPSTATS_GET(stats->iterations), LOOPSTATS_GET(stats->stalls),
+		  LOOPSTATS_GET(stats->max_us), LOOPSTATS_GET(stats->last_frame));
+	  fprintf(out, "  us:");
+	  for (b = 0; b < LOOPSTATS_BUCKETS; b++)
+	  {
+		  if (LOOPSTATS_GET(stats->buckets[b]) == 0)
+			  continue;
+		  if (b < LOOPSTATS_BUCKETS - 1)
+			  fprintf(out, " <%u:%u", 2u << b, LOOPSTATS_GET(stats->buckets[b]));
+		  else
+			  fprintf(out, " >=%u:%u", 1u << b, LOOPSTATS_GET(stats->buckets[b]));
+	  }
+	  fprintf(out, "\n");
+
+	  if (reset)
+	  {
+		  LOOPSTATS_SET(stats->iterations, 0);
+		  LOOPSTATS_SET(stats->stalls, 0);
+		  LOOPSTATS_SET(stats->max_us, 0);
+		  for (b = 0; b < LOOPSTATS_BUCKETS; b++)
+			  LOOPSTATS_SET(stats->buckets[b], 0);
+	  }
+  }
+  pthread_mutex_unlock(&slots_lock);
+  fflush(out);
+}
+
+int loopstats_dump_on_signal(int signo)
+{
+  struct sigaction action;
+
+  memset(&action, 0, sizeof(action));
+  action.sa_handler = loopstats_signal;
+  sigemptyset(&action.sa_mask);
+  action.sa_flags = SA_RESTART;
+  return sigaction(signo, &action, NULL);
+}
+
+void loopstats_poll_dump(FILE * out)
+{
+  if (dump_pending)
+  {
+	  dump_pending = 0;
+	  loopstats_dump(out, 0);
+  }
+}
+
+/************* Static function description *********************/
+
+static uint64_t loopstats_now_ns(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+// Only sets a flag: the dump is not async signal safe
+static void loopstats_signal(int signo)
+{
+  (void)signo;
+  dump_pending = 1;
+}
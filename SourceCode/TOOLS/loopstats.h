@@ -0,0 +1,72 @@
+#ifndef LOOPSTATS_H_
+#define LOOPSTATS_H_
+
+#include <stdint.h>
+#include <stdio.h>
+
+// Iteration time of the main loop of a thread. The thread marks the start
+// and the end of the work of each iteration, not its waits. Durations are
+// kept in a histogram of power of two buckets, and iterations longer than
+// the stall threshold are logged with the name of the thread and the last
+// frame it processed.
+//
+// Statistics are slots of a fixed table, so they can be read as registers.
+// Each slot is written by its own thread only.
+
+#define LOOPSTATS_SLOTS		16
+#define LOOPSTATS_NAME		20	// Name with its terminator
+#define LOOPSTATS_BUCKETS	16	// Bucket i: [2^i, 2^(i+1)) us. The last one has the rest
+
+typedef struct
+{
+  char name[LOOPSTATS_NAME];	// Empty if the slot is free
+  // Register image: the counters are contiguous 32 bit words
+  uint32_t iterations;
+  uint32_t stalls;		// Iterations over the threshold
+  uint32_t max_us;
+  uint32_t last_frame;		// Frame of the last stall. See loopstats_frame
+  uint32_t buckets[LOOPSTATS_BUCKETS];
+  // Private
+  uint64_t start_ns;
+  uint32_t frame;		// Frame of the running iteration
+}loopstats;
+
+// Size of the register image that starts at iterations
+#define LOOPSTATS_REGISTER_SIZE	((4 + LOOPSTATS_BUCKETS) * sizeof(uint32_t))
+
+// Stall threshold in us, shared by all the slots. 0 disables the log
+extern uint32_t loopstats_threshold_us;
+
+// Slot of the calling thread, NULL if it has none
+extern __thread loopstats * loopstats_current;
+
+// Takes the slot of a thread. The name is "name" or "name index" when
+// index >= 0. A thread started again gets its slot back, with its counters.
+// Returns NULL if all the slots are in use
+loopstats * loopstats_open(const char * name, int index);
+
+// Gives a slot back
+void loopstats_close(loopstats * stats);
+
+// Slot number i, used or not
+loopstats * loopstats_slot(uint32_t i);
+
+// Marks the start and the end of the work of an iteration
+void loopstats_begin(loopstats * stats);
+void loopstats_end(loopstats * stats);
+
+// Identifies what the running iteration processes. Logged if it stalls
+static inline void loopstats_frame(loopstats * stats, uint32_t frame)
+{
+  stats->frame = frame;
+}
+
+// Writes the used slots. Reset clears their counters
+void loopstats_dump(FILE * out, int reset);
+
+// Makes signo request a dump, done by the next loopstats_poll_dump call.
+// Returns 0 on success
+int loopstats_dump_on_signal(int signo);
+void loopstats_poll_dump(FILE * out);
+
+#endif /* LOOPSTATS_H_ */
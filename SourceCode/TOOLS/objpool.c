@@ -0,0 +1,59 @@
+
+/* Includes ------------------------------------------------------------------*/
+
+#include "objpool.h"
+#include "MemoryManagement.h"
+
+/* Private typedef -----------------------------------------------------------*/
+/* Private define ------------------------------------------------------------*/
+/* Private macro -------------------------------------------------------------*/
+/* Private variables ---------------------------------------------------------*/
+/* Private function prototypes -----------------------------------------------*/
+/* Private functions ---------------------------------------------------------*/
+
+void objpool_init(objpool * pool, size_t size, uint32_t max)
+{
+  pool->free = 0;
+  pool->size = (size < sizeof(void *)) ? sizeof(void *) : size;
+  pool->count = 0;
+  pool->max = max;
+  pool->allocs = 0;
+}
+
+void objpool_release(objpool * pool)
+{
+  void * obj;
+
+  while ((obj = pool->free) != 0)
+  {
+	  pool->free = *(void **)obj;
+	  MemFree(obj);
+  }
+  pool->count = 0;
+}
+
+void * objpool_get(objpool * pool)
+{
+  void * obj = pool->free;
+
+  if (obj != 0)
+  {
+	  pool->free = *(void **)obj;
+	  pool->count--;
+	  return obj;
+  }
+  pool->allocs++;
+  return MemAlloc(pool->size);
+}
+
+void objpool_put(objpool * pool, void * obj)
+{
+  if (pool->count >= pool->max)
+  {
+	  MemFree(obj);
+	  return;
+  }
+  *(void **)obj = pool->free;
+  pool->free = obj;
+  pool->count++;
+}
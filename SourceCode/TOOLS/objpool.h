@@ -0,0 +1,32 @@
+#ifndef OBJPOOL_H_
+#define OBJPOOL_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Cache of free objects of one size, owned by one thread. Objects are heap
+// blocks of their own: an object taken from a pool can be returned to the
+// pool of another thread or released with MemFree.
+
+typedef struct
+{
+  void * free;		// List of cached objects, linked through their first bytes
+  size_t size;
+  uint32_t count;	// Cached objects
+  uint32_t max;		// Objects kept at most; the rest are freed
+  uint64_t allocs;	// Objects taken from the heap
+}objpool;
+
+// Objects of size bytes, at least a pointer. Caches up to max objects
+void objpool_init(objpool * pool, size_t size, uint32_t max);
+
+// Frees the cached objects
+void objpool_release(objpool * pool);
+
+// Returns a cached object or a new one. NULL if the heap is exhausted
+void * objpool_get(objpool * pool);
+
+// Caches an object of the pool size, or frees it if the cache is full
+void objpool_put(objpool * pool, void * obj);
+
+#endif /* OBJPOOL_H_ */
@@ -4,6 +4,11 @@
 #include "pqueue.h"
 #include "MemoryManagement.h"
 #include <stddef.h>
+#include <time.h>
+#ifdef __linux__
+#include <sys/eventfd.h>
+#include <unistd.h>
+#endif
 
 
 /* Private typedef -----------------------------------------------------------*/
@@ -13,14 +18,38 @@
 
 /* Private variables ---------------------------------------------------------*/
 /* Private function prototypes -----------------------------------------------*/
+static struct pqueue_lane * pqueue_select_lane(pqueue * queue);
+static void * pqueue_take(pqueue * queue);
+static void pqueue_event_set(pqueue * queue);
+static void pqueue_event_clear(pqueue * queue);
 /* Private functions ---------------------------------------------------------*/
 
 void pqueue_init(pqueue * queue)
 {
+  int lane;
+
   queue->queue_end = 0;
-  queue->qhead = 0;
+  queue->count = 0;
+  queue->open = PQUEUE_LANES;
+  queue->ready = 0;
+  queue->event_fd = -1;
+  for (lane = 0; lane < PQUEUE_LANES; lane++)
+  {
+	  queue->lanes[lane].head = 0;
+	  queue->lanes[lane].tail = 0;
+	  queue->lanes[lane].count = 0;
+	  queue->lanes[lane].weight = 0;
+	  queue->lanes[lane].credit = 0;
+  }
   pthread_mutex_init(&queue->queue_lock, NULL);
-  pthread_cond_init(&queue->not_empty, NULL);
+
+  // Timed waits are measured on the monotonic clock so that wall clock
+  // adjustments do not stretch or shorten them
+  pthread_condattr_t attr;
+  pthread_condattr_init(&attr);
+  pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+  pthread_cond_init(&queue->not_empty, &attr);
+  pthread_condattr_destroy(&attr);
 }
 
 void pqueue_release(pqueue * queue)
@@ -31,23 +60,67 @@ void pqueue_release(pqueue * queue)
   queue->queue_end = 1;
   // Unblock all threads
   pthread_cond_broadcast(&queue->not_empty);
+  pqueue_event_set(queue);
 
   pthread_mutex_unlock(&queue->queue_lock);
 }
 
+void pqueue_destroy(pqueue * queue)
+{
+  struct pqueue_elem * h;
+  int lane;
+
+  for (lane = 0; lane < PQUEUE_LANES; lane++)
+  {
+	  while ((h = queue->lanes[lane].head) != 0)
+	  {
+		  queue->lanes[lane].head = h->next;
+		  MemFree(h);
+	  }
+	  queue->lanes[lane].tail = 0;
+	  queue->lanes[lane].count = 0;
+  }
+  queue->count = 0;
+  queue->ready = 0;
+
+#ifdef __linux__
+  if (queue->event_fd >= 0)
+  {
+	  close(queue->event_fd);
+	  queue->event_fd = -1;
+  }
+#endif
+  pthread_cond_destroy(&queue->not_empty);
+  pthread_mutex_destroy(&queue->queue_lock);
+}
+
 void pqueue_push(pqueue * queue, void * usr_data)
 {
-	pthread_mutex_lock(&queue->queue_lock);
-	struct pqueue_elem * h = queue->qhead;
-	while (h && h->next != 0)
-		h = h->next;
+	pqueue_push_prio(queue, usr_data, PQUEUE_LANE_BULK);
+}
 
-	struct pqueue_elem * ne = (struct pqueue_elem *)MemAlloc(sizeof(pqueue_elem));
+// Push element at the end of the selected lane
+void pqueue_push_prio(pqueue * queue, void * usr_data, int lane)
+{
+	struct pqueue_lane * l;
+	struct pqueue_elem * ne = (struct pqueue_elem *)MemAlloc(sizeof(struct pqueue_elem));
 	ne->data = usr_data;
 	ne->next = 0;
 
-	if (h) h->next = ne;
-	else   queue->qhead = ne;
+	if (lane < 0 || lane >= PQUEUE_LANES)
+		lane = PQUEUE_LANE_BULK;
+
+	pthread_mutex_lock(&queue->queue_lock);
+	l = &queue->lanes[lane];
+
+	// The tail pointer keeps the push O(1) regardless of the queue depth
+	if (l->tail) l->tail->next = ne;
+	else         l->head = ne;
+	l->tail = ne;
+	l->count++;
+	queue->count++;
+	if (lane < queue->open && queue->ready++ == 0)
+		pqueue_event_set(queue);
 
 	// Signal some other thread waiting in the queue
 	pthread_cond_signal(&queue->not_empty);
@@ -58,13 +131,20 @@ void pqueue_push(pqueue * queue, void * usr_data)
 // Push element in the front (typically used to give hi prio)
 void pqueue_push_front(pqueue * queue, void * usr_data)
 {
-  pthread_mutex_lock(&queue->queue_lock);
-
-  struct pqueue_elem * ne = (struct pqueue_elem *)MemAlloc(sizeof(pqueue_elem));
+  struct pqueue_lane * l;
+  struct pqueue_elem * ne = (struct pqueue_elem *)MemAlloc(sizeof(struct pqueue_elem));
   ne->data = usr_data;
-  ne->next = queue->qhead;
 
-  queue->qhead = ne;
+  pthread_mutex_lock(&queue->queue_lock);
+  l = &queue->lanes[PQUEUE_LANE_CONTROL];
+
+  ne->next = l->head;
+  l->head = ne;
+  if (l->tail == 0) l->tail = ne;
+  l->count++;
+  queue->count++;
+  if (queue->ready++ == 0)
+	  pqueue_event_set(queue);
 
   // Signal some other thread waiting in the queue
   pthread_cond_signal(&queue->not_empty);
@@ -72,6 +152,47 @@ void pqueue_push_front(pqueue * queue, void * usr_data)
   pthread_mutex_unlock(&queue->queue_lock);
 }
 
+// Sets the weight of each lane (0 = strict priority)
+void pqueue_set_weights(pqueue * queue, const int * weights)
+{
+  int lane;
+
+  pthread_mutex_lock(&queue->queue_lock);
+  for (lane = 0; lane < PQUEUE_LANES; lane++)
+  {
+	  queue->lanes[lane].weight = (weights[lane] > 0) ? weights[lane] : 0;
+	  queue->lanes[lane].credit = queue->lanes[lane].weight;
+  }
+  pthread_mutex_unlock(&queue->queue_lock);
+}
+
+// Holds the lanes from lane on (PQUEUE_LANES = none)
+void pqueue_hold(pqueue * queue, int lane)
+{
+  int ready = 0, l;
+
+  if (lane < PQUEUE_LANE_CONTROL + 1)
+	  lane = PQUEUE_LANE_CONTROL + 1;
+  if (lane > PQUEUE_LANES)
+	  lane = PQUEUE_LANES;
+
+  pthread_mutex_lock(&queue->queue_lock);
+  queue->open = lane;
+  for (l = 0; l < lane; l++)
+	  ready += queue->lanes[l].count;
+
+  if (ready != 0 && queue->ready == 0)
+  {
+	  pqueue_event_set(queue);
+	  pthread_cond_broadcast(&queue->not_empty);
+  }
+  else if (ready == 0 && queue->ready != 0 && !queue->queue_end)
+	  pqueue_event_clear(queue);
+  queue->ready = ready;
+
+  pthread_mutex_unlock(&queue->queue_lock);
+}
+
 // Returns the fron element. If there is no element it blocks until there is any.
 // If the writing end of the queue is closed it returns NULL
 void * pqueue_pop(pqueue * queue)
@@ -81,13 +202,7 @@ pthread_mutex_lock(&queue->queue_lock);
 void * udata = 0;
 while (1)
 {
-  if (queue->qhead != 0) {
-	  struct pqueue_elem * h = queue->qhead;
-	  udata = queue->qhead->data;
-
-	  queue->qhead = queue->qhead->next;
-	  free(h);
-  }
+  udata = pqueue_take(queue);
 
   if (udata == 0) {
 	  if (queue->queue_end == 0) // No work in the queue, wait here!
@@ -110,13 +225,45 @@ void * pqueue_pop_nonb(pqueue * queue)
 {
   pthread_mutex_lock(&queue->queue_lock);
 
+  void * udata = pqueue_take(queue);
+
+  pthread_mutex_unlock(&queue->queue_lock);
+
+  return udata;
+}
+
+// Returns the front element. If there is no element it blocks until there is
+// any or timeout_ms milliseconds have elapsed. Returns NULL on timeout or if
+// the writing end of the queue is closed
+void * pqueue_pop_timed(pqueue * queue, unsigned int timeout_ms)
+{
+  struct timespec deadline;
   void * udata = 0;
-  if (queue->qhead != 0) {
-      struct pqueue_elem * h = queue->qhead;
-      udata = queue->qhead->data;
 
-      queue->qhead = queue->qhead->next;
-      free(h);
+  clock_gettime(CLOCK_MONOTONIC, &deadline);
+  deadline.tv_sec  += timeout_ms / 1000;
+  deadline.tv_nsec += (long)(timeout_ms % 1000) * 1000000L;
+  if (deadline.tv_nsec >= 1000000000L)
+  {
+	  deadline.tv_sec++;
+	  deadline.tv_nsec -= 1000000000L;
+  }
+
+  pthread_mutex_lock(&queue->queue_lock);
+
+  while (1)
+  {
+	  udata = pqueue_take(queue);
+
+	  if (udata != 0 || queue->queue_end != 0)
+		  break;
+
+	  // No work in the queue, wait here until the deadline
+	  if (pthread_cond_timedwait(&queue->not_empty, &queue->queue_lock, &deadline) != 0)
+	  {
+		  udata = pqueue_take(queue);
+		  break;
+	  }
   }
 
   pthread_mutex_unlock(&queue->queue_lock);
@@ -128,13 +275,23 @@ void * pqueue_pop_nonb(pqueue * queue)
 int pqueue_size(pqueue * queue)
 {
   pthread_mutex_lock(&queue->queue_lock);
-  struct pqueue_elem * h = queue->qhead;
 
+  int size = queue->count;
+
+  pthread_mutex_unlock(&queue->queue_lock);
+
+  return size;
+}
+
+// Returns the number of elements in a lane
+int pqueue_lane_size(pqueue * queue, int lane)
+{
   int size = 0;
-  while (h != 0) {
-	  h = h->next;
-	  size++;
-  }
+
+  pthread_mutex_lock(&queue->queue_lock);
+
+  if (lane >= 0 && lane < PQUEUE_LANES)
+	  size = queue->lanes[lane].count;
 
   pthread_mutex_unlock(&queue->queue_lock);
 
@@ -158,7 +315,7 @@ void pqueue_wait(pqueue * queue)
 {
   pthread_mutex_lock(&queue->queue_lock);
 
-  while (queue->qhead == 0 && !queue->queue_end)
+  while (queue->ready == 0 && !queue->queue_end)
   {
 	  pthread_cond_wait(&queue->not_empty,&queue->queue_lock);
   }
@@ -166,5 +323,111 @@ void pqueue_wait(pqueue * queue)
   pthread_mutex_unlock(&queue->queue_lock);
 }
 
+// Returns a file descriptor readable while the queue is not empty
+int pqueue_eventfd(pqueue * queue)
+{
+  int fd;
+
+  pthread_mutex_lock(&queue->queue_lock);
+
+#ifdef __linux__
+  if (queue->event_fd < 0)
+  {
+	  queue->event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	  // Elements pushed before the descriptor existed must be visible
+	  if (queue->ready != 0 || queue->queue_end)
+		  pqueue_event_set(queue);
+  }
+#endif
+  fd = queue->event_fd;
+
+  pthread_mutex_unlock(&queue->queue_lock);
+
+  return fd;
+}
+
+/************* Static function description *********************/
 
+// Selects the lane to be served. Must be called with the queue locked.
+static struct pqueue_lane * pqueue_select_lane(pqueue * queue)
+{
+  int lane, lower;
+  struct pqueue_lane * l;
 
+  for (lane = 0; lane < queue->open; lane++)
+  {
+	  l = &queue->lanes[lane];
+	  if (l->count == 0)
+		  continue;
+
+	  if (l->weight == 0)
+		  return l;	// Strict priority
+
+	  if (l->credit > 0)
+	  {
+		  l->credit--;
+		  return l;
+	  }
+
+	  // Turn is over: refill it and let the next non empty lane in once
+	  l->credit = l->weight;
+	  for (lower = lane + 1; lower < queue->open; lower++)
+	  {
+		  if (queue->lanes[lower].count != 0)
+			  return &queue->lanes[lower];
+	  }
+	  l->credit--;
+	  return l;
+  }
+
+  return 0;
+}
+
+// Removes the next element to be served. Must be called with the queue locked.
+static void * pqueue_take(pqueue * queue)
+{
+  struct pqueue_lane * l;
+  struct pqueue_elem * h;
+  void * udata;
+
+  l = pqueue_select_lane(queue);
+  if (l == 0)
+	  return 0;
+
+  h = l->head;
+  udata = h->data;
+
+  l->head = h->next;
+  if (l->head == 0) l->tail = 0;
+  l->count--;
+  queue->count--;
+  if (--queue->ready == 0 && !queue->queue_end)
+	  pqueue_event_clear(queue);
+  MemFree(h);
+
+  return udata;
+}
+
+// Makes the eventfd readable. Must be called with the queue locked.
+static void pqueue_event_set(pqueue * queue)
+{
+#ifdef __linux__
+  if (queue->event_fd >= 0)
+	  eventfd_write(queue->event_fd, 1);
+#else
+  (void)queue;
+#endif
+}
+
+// Drains the eventfd. Must be called with the queue locked.
+static void pqueue_event_clear(pqueue * queue)
+{
+#ifdef __linux__
+  eventfd_t value;
+
+  if (queue->event_fd >= 0)
+	  eventfd_read(queue->event_fd, &value);
+#else
+  (void)queue;
+#endif
+}
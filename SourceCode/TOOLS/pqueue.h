@@ -1,41 +1,97 @@
+#ifndef PQUEUE_H_
+#define PQUEUE_H_
+
 #include <pthread.h>
 
+// Number of priority lanes of each queue. Lane 0 has the highest priority.
+#define PQUEUE_LANES		3
+
+// Lane identifiers
+#define PQUEUE_LANE_CONTROL	0	// Config / operation protocol traffic
+#define PQUEUE_LANE_REALTIME	1	// Traffic addressed to a local bus
+#define PQUEUE_LANE_BULK	2	// Forwarded traffic (captures, bridges)
+
 struct pqueue_elem
 {
   void * data;
   struct pqueue_elem * next;
-} pqueue_elem;
+};
+
+struct pqueue_lane
+{
+  struct pqueue_elem * head;
+  struct pqueue_elem * tail;
+  int count;
+  int weight;	// Frames served in a row before lower lanes get a turn. 0 = strict
+  int credit;	// Remaining frames of the current turn
+};
 
 typedef struct
 {
   pthread_mutex_t queue_lock;
   pthread_cond_t  not_empty;
   int queue_end;
-  struct pqueue_elem * qhead;
+  int count;
+  int open;	// Lanes served, from lane 0. See pqueue_hold
+  int ready;	// Elements of the lanes served
+  int event_fd;	// eventfd readable while the lanes served are not empty. -1 = not created
+  struct pqueue_lane lanes[PQUEUE_LANES];
 }pqueue;
 
 void pqueue_init(pqueue * queue);
 
 void pqueue_release(pqueue * queue);
 
+// Frees the queue and closes its eventfd. Pending elements are dropped but the
+// data they point to is not freed. No thread may use the queue any more
+void pqueue_destroy(pqueue * queue);
+
+// Push element in the bulk lane
 void pqueue_push(pqueue * queue, void * usr_data) ;
 
+// Push element at the end of the selected lane
+void pqueue_push_prio(pqueue * queue, void * usr_data, int lane);
+
 // Push element in the front (typically used to give hi prio)
 void pqueue_push_front(pqueue * queue, void * usr_data);
 
+// Sets the weight of each lane. With all weights set to 0 (default) the pop is
+// strict priority. Otherwise a lane with weight W yields to the next non empty
+// lower lane after serving W elements in a row.
+void pqueue_set_weights(pqueue * queue, const int * weights);
+
+// Holds the lanes from lane on: their elements stay in the queue, but pops,
+// waits and the eventfd go on as if the lanes were empty. PQUEUE_LANES serves
+// all the lanes again. The control lane is never held
+void pqueue_hold(pqueue * queue, int lane);
+
 // Returns the fron element. If there is no element it blocks until there is any.
 // If the writing end of the queue is closed it returns NULL
 void * pqueue_pop(pqueue * queue);
 // Returns the element in the front or NULL if no element is present
 // It never blocks!
 void * pqueue_pop_nonb(pqueue * queue);
+// Returns the front element. If there is no element it blocks until there is
+// any or timeout_ms milliseconds have elapsed. Returns NULL on timeout or if
+// the writing end of the queue is closed
+void * pqueue_pop_timed(pqueue * queue, unsigned int timeout_ms);
 
 // Returns queue size
 int pqueue_size(pqueue * queue);
 
+// Returns the number of elements in a lane
+int pqueue_lane_size(pqueue * queue, int lane);
+
 // Returns whether the queue has been marked as released (writer finished)
 int pqueue_released(pqueue * queue);
 
-// Sleeps until the queue has at least one element in it or the queue is released
+// Sleeps until the lanes served have at least one element or the queue is released
 void pqueue_wait(pqueue * queue);
 
+// Returns a file descriptor that is readable while the queue is not empty or
+// after it has been released, so the queue can be waited on with poll/epoll
+// together with other descriptors. The descriptor is created on the first call
+// and must not be read by the caller. Returns -1 if not supported (non Linux).
+int pqueue_eventfd(pqueue * queue);
+
+#endif /* PQUEUE_H_ */
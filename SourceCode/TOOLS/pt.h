@@ -0,0 +1,88 @@
+#ifndef PT_H_
+#define PT_H_
+
+// Protothreads: stackless tasks that yield at their wait points. A task is a
+// function run again and again by a scheduler; its position is kept in a
+// struct pt and restored by a switch on entry, so many tasks share one stack.
+//
+// Local variables are not kept across PT_WAIT_UNTIL and PT_YIELD: the state
+// of a task lives in its arguments or in static storage. PT_BEGIN opens a
+// switch, so a task cannot use switch statements around its wait points.
+//
+//   static PT_THREAD(task(struct pt * pt, ...))
+//   {
+//     PT_BEGIN(pt);
+//     while (1)
+//     {
+//       PT_WAIT_UNTIL(pt, data_available());
+//       ...
+//       PT_YIELD(pt);
+//     }
+//     PT_END(pt);
+//   }
+
+struct pt
+{
+  unsigned short lc;	// Line of the last wait point, 0 = start
+};
+
+// Values returned by a task
+#define PT_WAITING	0	// Blocked in PT_WAIT_UNTIL
+#define PT_YIELDED	1	// Has done some work and lets the others run
+#define PT_EXITED	2	// Left through PT_EXIT
+#define PT_ENDED	3	// Reached PT_END
+
+#define PT_THREAD(name_args)	char name_args
+
+// Makes the next run of the task start from PT_BEGIN
+#define PT_INIT(pt)	(pt)->lc = 0
+
+// The wait points fall through into their own case label on purpose
+#if defined(__has_attribute)
+#if __has_attribute(fallthrough)
+#define PT_FALLTHROUGH	__attribute__((fallthrough));
+#endif
+#endif
+#ifndef PT_FALLTHROUGH
+#define PT_FALLTHROUGH
+#endif
+
+#define PT_BEGIN(pt)	{ char pt_yield_flag = 1; (void)pt_yield_flag; switch ((pt)->lc) { case 0:
+
+#define PT_END(pt)	} pt_yield_flag = 0; PT_INIT(pt); return PT_ENDED; }
+
+// Returns to the scheduler until condition is true
+#define PT_WAIT_UNTIL(pt, condition)		\
+  do						\
+  {						\
+	  (pt)->lc = __LINE__; PT_FALLTHROUGH	\
+	  case __LINE__:			\
+	  if (!(condition))			\
+		  return PT_WAITING;		\
+  } while (0)
+
+#define PT_WAIT_WHILE(pt, condition)	PT_WAIT_UNTIL((pt), !(condition))
+
+// Returns to the scheduler once. The task goes on at the next run
+#define PT_YIELD(pt)				\
+  do						\
+  {						\
+	  pt_yield_flag = 0;			\
+	  (pt)->lc = __LINE__; PT_FALLTHROUGH	\
+	  case __LINE__:			\
+	  if (pt_yield_flag == 0)		\
+		  return PT_YIELDED;		\
+  } while (0)
+
+// Finishes the task. The next run starts from PT_BEGIN
+#define PT_EXIT(pt)				\
+  do						\
+  {						\
+	  PT_INIT(pt);				\
+	  return PT_EXITED;			\
+  } while (0)
+
+// Not 0 while the task has not finished
+#define PT_SCHEDULE(f)	((f) < PT_EXITED)
+
+#endif /* PT_H_ */
@@ -0,0 +1,195 @@
+
+/* Includes ------------------------------------------------------------------*/
+
+#include "spscring.h"
+#include "MemoryManagement.h"
+#include <string.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/eventfd.h>
+#endif
+
+/* Private typedef -----------------------------------------------------------*/
+
+struct spscring_spill
+{
+  void * data;
+  struct spscring_spill * next;
+};
+
+/* Private define ------------------------------------------------------------*/
+/* Private macro -------------------------------------------------------------*/
+/* Private variables ---------------------------------------------------------*/
+/* Private function prototypes -----------------------------------------------*/
+static void spscring_wake(spscring * ring);
+static void * spscring_take_spill(spscring * ring);
+/* Private functions ---------------------------------------------------------*/
+
+int spscring_init(spscring * ring, uint32_t size)
+{
+  uint32_t slots = 1;
+
+  memset(ring, 0, sizeof(*ring));
+  ring->event_fd = -1;
+  while (slots < size)
+	  slots <<= 1;
+
+  ring->slots = (void **)MemAlloc(slots * sizeof(void *));
+  if (ring->slots == 0)
+	  return -1;
+  ring->mask = slots - 1;
+  pthread_mutex_init(&ring->spill_lock, NULL);
+
+#ifdef __linux__
+  ring->event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+#endif
+  return 0;
+}
+
+void spscring_release(spscring * ring)
+{
+  struct spscring_spill * s;
+
+  while ((s = ring->spill_head) != 0)
+  {
+	  ring->spill_head = s->next;
+	  MemFree(s);
+  }
+  ring->spill_tail = 0;
+  ring->spill_count = 0;
+  pthread_mutex_destroy(&ring->spill_lock);
+
+  MemFree(ring->slots);
+  ring->slots = 0;
+  if (ring->event_fd >= 0)
+  {
+	  close(ring->event_fd);
+	  ring->event_fd = -1;
+  }
+}
+
+int spscring_push(spscring * ring, void * data)
+{
+  uint32_t head = ring->head;
+
+  // The consumer's tail is only read again when the ring looks full
+  if (head - ring->tail_cache > ring->mask)
+  {
+	  ring->tail_cache = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+	  if (head - ring->tail_cache > ring->mask)
+		  return -1;
+  }
+
+  ring->slots[head & ring->mask] = data;
+  __atomic_store_n(&ring->head, head + 1, __ATOMIC_SEQ_CST);
+
+  spscring_wake(ring);
+  return 0;
+}
+
+int spscring_push_spill(spscring * ring, void * data)
+{
+  struct spscring_spill * s;
+
+  // Only this thread fills the spill: seen empty, it is empty
+  if (__atomic_load_n(&ring->spill_count, __ATOMIC_ACQUIRE) == 0 &&
+      spscring_push(ring, data) == 0)
+	  return 0;
+
+  s = (struct spscring_spill *)MemAlloc(sizeof(struct spscring_spill));
+  if (s == 0)
+	  return -1;
+  s->data = data;
+  s->next = 0;
+
+  pthread_mutex_lock(&ring->spill_lock);
+  if (ring->spill_tail != 0)
+	  ring->spill_tail->next = s;
+  else
+	  ring->spill_head = s;
+  ring->spill_tail = s;
+  __atomic_store_n(&ring->spill_count, ring->spill_count + 1, __ATOMIC_SEQ_CST);
+  pthread_mutex_unlock(&ring->spill_lock);
+
+  // The consumer may have emptied the spill meanwhile and be waiting
+  spscring_wake(ring);
+  return 0;
+}
+
+void * spscring_pop(spscring * ring)
+{
+  uint32_t tail = ring->tail;
+  void * data;
+
+  if (__atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) == tail)
+  {
+	  // The ring goes first: the spill only holds newer elements
+	  if (__atomic_load_n(&ring->spill_count, __ATOMIC_ACQUIRE) != 0)
+		  return spscring_take_spill(ring);
+
+	  // Arm, then look again: a push may have come before the producer saw it
+	  __atomic_store_n(&ring->armed, 1, __ATOMIC_SEQ_CST);
+	  if (__atomic_load_n(&ring->head, __ATOMIC_SEQ_CST) == tail)
+	  {
+		  if (__atomic_load_n(&ring->spill_count, __ATOMIC_SEQ_CST) != 0)
+			  return spscring_take_spill(ring);
+		  return 0;
+	  }
+  }
+
+  data = ring->slots[tail & ring->mask];
+  __atomic_store_n(&ring->tail, tail + 1, __ATOMIC_RELEASE);
+  return data;
+}
+
+int spscring_eventfd(spscring * ring)
+{
+  return ring->event_fd;
+}
+
+void spscring_clear(spscring * ring)
+{
+#ifdef __linux__
+  eventfd_t value;
+
+  if (ring->event_fd >= 0)
+	  eventfd_read(ring->event_fd, &value);
+#else
+  (void)ring;
+#endif
+}
+
+/************* Static function description *********************/
+
+// Producer: writes the eventfd if the consumer waits. Paired with
+// spscring_pop: either the consumer sees the element or we see it armed
+static void spscring_wake(spscring * ring)
+{
+  if (__atomic_load_n(&ring->armed, __ATOMIC_SEQ_CST) &&
+      __atomic_exchange_n(&ring->armed, 0, __ATOMIC_SEQ_CST))
+  {
+#ifdef __linux__
+	  if (ring->event_fd >= 0)
+		  eventfd_write(ring->event_fd, 1);
+#endif
+  }
+}
+
+// Consumer: takes the oldest spilled element. The spill is not empty
+static void * spscring_take_spill(spscring * ring)
+{
+  struct spscring_spill * s;
+  void * data;
+
+  pthread_mutex_lock(&ring->spill_lock);
+  s = ring->spill_head;
+  ring->spill_head = s->next;
+  if (ring->spill_head == 0)
+	  ring->spill_tail = 0;
+  __atomic_store_n(&ring->spill_count, ring->spill_count - 1, __ATOMIC_RELEASE);
+  pthread_mutex_unlock(&ring->spill_lock);
+
+  data = s->data;
+  MemFree(s);
+  return data;
+}
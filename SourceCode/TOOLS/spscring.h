@@ -0,0 +1,60 @@
+#ifndef SPSCRING_H_
+#define SPSCRING_H_
+
+#include <stdint.h>
+#include <pthread.h>
+
+// Bounded ring of pointers between one producer thread and one consumer
+// thread, without locks. The consumer can wait for it with poll/epoll on an
+// eventfd, which is only written when the consumer has found the ring empty,
+// so a busy consumer costs the producer no system calls.
+//
+// A producer that cannot wait may spill into a locked list instead. Once an
+// element has been spilled the next ones follow it there until the consumer
+// has taken them all, so elements keep their order.
+
+// Size of the producer and consumer blocks: they do not share cache lines
+#define SPSCRING_CACHE_LINE	64
+
+typedef struct
+{
+  void ** slots;
+  uint32_t mask;		// Slots - 1. Slots is a power of two
+  int event_fd;			// -1 if not supported (non Linux)
+  // Producer
+  uint32_t head __attribute__((aligned(SPSCRING_CACHE_LINE)));	// Next slot to write
+  uint32_t tail_cache;		// Last tail seen by the producer
+  // Consumer
+  uint32_t tail __attribute__((aligned(SPSCRING_CACHE_LINE)));	// Next slot to read
+  int armed;			// The consumer waits: the next push writes the eventfd
+  // Spill, taken by the consumer once the ring is empty
+  pthread_mutex_t spill_lock __attribute__((aligned(SPSCRING_CACHE_LINE)));
+  struct spscring_spill * spill_head;
+  struct spscring_spill * spill_tail;
+  uint32_t spill_count;		// Written with the lock taken
+}spscring;
+
+// Creates a ring of at least size slots. Returns 0 on success, -1 on error
+int spscring_init(spscring * ring, uint32_t size);
+
+// Frees the ring. Pending elements are not freed
+void spscring_release(spscring * ring);
+
+// Producer: queues an element. Returns 0 on success, -1 if the ring is full
+int spscring_push(spscring * ring, void * data);
+
+// Producer: queues an element behind the ones already queued, spilling it if
+// the ring is full or has spilled. Do not mix with spscring_push. Returns 0
+// on success, -1 if there is no memory for the spill
+int spscring_push_spill(spscring * ring, void * data);
+
+// Consumer: returns the oldest element or NULL if the ring and the spill are
+// empty. Once it has returned NULL, the next push makes the eventfd readable
+void * spscring_pop(spscring * ring);
+
+// Consumer: descriptor readable after a push into a ring found empty. The
+// consumer reads it with spscring_clear before popping. -1 if not supported
+int spscring_eventfd(spscring * ring);
+void spscring_clear(spscring * ring);
+
+#endif /* SPSCRING_H_ */
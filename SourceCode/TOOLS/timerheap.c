@@ -0,0 +1,152 @@
+
+/* Includes ------------------------------------------------------------------*/
+
+#include "timerheap.h"
+#include "MemoryManagement.h"
+#include <stddef.h>
+
+/* Private typedef -----------------------------------------------------------*/
+/* Private define ------------------------------------------------------------*/
+#define TIMERHEAP_MIN_SIZE	16
+
+/* Private macro -------------------------------------------------------------*/
+/* Private variables ---------------------------------------------------------*/
+/* Private function prototypes -----------------------------------------------*/
+static void timerheap_place(timerheap * heap, struct timerheap_node * node, uint32_t index);
+static void timerheap_sift_up(timerheap * heap, uint32_t index);
+static void timerheap_sift_down(timerheap * heap, uint32_t index);
+/* Private functions ---------------------------------------------------------*/
+
+void timerheap_init(timerheap * heap)
+{
+  heap->nodes = 0;
+  heap->count = 0;
+  heap->size = 0;
+}
+
+void timerheap_release(timerheap * heap)
+{
+  uint32_t i;
+
+  for (i = 0; i < heap->count; i++)
+	  heap->nodes[i]->index = TIMERHEAP_NONE;
+  MemFree(heap->nodes);
+  timerheap_init(heap);
+}
+
+void timerheap_node_init(struct timerheap_node * node)
+{
+  node->deadline = 0;
+  node->index = TIMERHEAP_NONE;
+}
+
+int timerheap_push(timerheap * heap, struct timerheap_node * node, uint64_t deadline)
+{
+  struct timerheap_node ** nodes;
+  uint32_t size;
+
+  if (timerheap_queued(node))
+  {
+	  // Already queued: move it up or down from where it is
+	  uint64_t previous = node->deadline;
+
+	  node->deadline = deadline;
+	  if (deadline < previous)
+		  timerheap_sift_up(heap, node->index);
+	  else
+		  timerheap_sift_down(heap, node->index);
+	  return 0;
+  }
+
+  if (heap->count == heap->size)
+  {
+	  size = (heap->size != 0) ? heap->size * 2 : TIMERHEAP_MIN_SIZE;
+	  nodes = (struct timerheap_node **)MemRealloc(heap->nodes, size * sizeof(*nodes));
+	  if (nodes == 0)
+		  return -1;
+	  heap->nodes = nodes;
+	  heap->size = size;
+  }
+
+  node->deadline = deadline;
+  timerheap_place(heap, node, heap->count++);
+  timerheap_sift_up(heap, node->index);
+  return 0;
+}
+
+void timerheap_remove(timerheap * heap, struct timerheap_node * node)
+{
+  uint32_t index = node->index;
+  struct timerheap_node * last;
+
+  if (!timerheap_queued(node))
+	  return;
+
+  node->index = TIMERHEAP_NONE;
+  last = heap->nodes[--heap->count];
+  if (last == node)
+	  return;
+
+  // The last node fills the hole and goes wherever its deadline belongs
+  timerheap_place(heap, last, index);
+  if (index > 0 && last->deadline < heap->nodes[(index - 1) / 2]->deadline)
+	  timerheap_sift_up(heap, index);
+  else
+	  timerheap_sift_down(heap, index);
+}
+
+struct timerheap_node * timerheap_top(timerheap * heap)
+{
+  return (heap->count != 0) ? heap->nodes[0] : 0;
+}
+
+struct timerheap_node * timerheap_pop(timerheap * heap)
+{
+  struct timerheap_node * node = timerheap_top(heap);
+
+  if (node != 0)
+	  timerheap_remove(heap, node);
+  return node;
+}
+
+/************* Static function description *********************/
+
+static void timerheap_place(timerheap * heap, struct timerheap_node * node, uint32_t index)
+{
+  heap->nodes[index] = node;
+  node->index = index;
+}
+
+static void timerheap_sift_up(timerheap * heap, uint32_t index)
+{
+  struct timerheap_node * node = heap->nodes[index];
+  uint32_t parent;
+
+  while (index > 0)
+  {
+	  parent = (index - 1) / 2;
+	  if (heap->nodes[parent]->deadline <= node->deadline)
+		  break;
+	  timerheap_place(heap, heap->nodes[parent], index);
+	  index = parent;
+  }
+  timerheap_place(heap, node, index);
+}
+
+static void timerheap_sift_down(timerheap * heap, uint32_t index)
+{
+  struct timerheap_node * node = heap->nodes[index];
+  uint32_t child;
+
+  while ((child = 2 * index + 1) < heap->count)
+  {
+	  if (child + 1 < heap->count &&
+	      heap->nodes[child + 1]->deadline < heap->nodes[child]->deadline)
+		  child++;
+	  if (node->deadline <= heap->nodes[child]->deadline)
+		  break;
+	  timerheap_place(heap, heap->nodes[child], index);
+	  index = child;
+  }
+  timerheap_place(heap, node, index);
+}
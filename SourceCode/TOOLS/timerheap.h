@@ -0,0 +1,52 @@
+#ifndef TIMERHEAP_H_
+#define TIMERHEAP_H_
+
+#include <stdint.h>
+
+// Binary min-heap of deadlines. Nodes are embedded in the user structures and
+// remember their position, so a queued node is removed in O(log n) without
+// searching for it. The heap does no locking.
+
+// Index of a node that is not queued
+#define TIMERHEAP_NONE		0xFFFFFFFFu
+
+struct timerheap_node
+{
+  uint64_t deadline;
+  uint32_t index;	// Position in the heap or TIMERHEAP_NONE
+};
+
+typedef struct
+{
+  struct timerheap_node ** nodes;
+  uint32_t count;
+  uint32_t size;	// Allocated entries. Grows on demand
+}timerheap;
+
+void timerheap_init(timerheap * heap);
+
+// Frees the node array. Nodes belong to the caller
+void timerheap_release(timerheap * heap);
+
+// Must be called on each node before its first use
+void timerheap_node_init(struct timerheap_node * node);
+
+// Queues node with the given deadline. A queued node is moved to the new
+// deadline. Returns 0 on success, -1 if the array cannot grow
+int timerheap_push(timerheap * heap, struct timerheap_node * node, uint64_t deadline);
+
+// Unqueues node. Nothing is done if it is not queued
+void timerheap_remove(timerheap * heap, struct timerheap_node * node);
+
+// Node with the earliest deadline or NULL if the heap is empty
+struct timerheap_node * timerheap_top(timerheap * heap);
+
+// Unqueues and returns the node with the earliest deadline, NULL if empty
+struct timerheap_node * timerheap_pop(timerheap * heap);
+
+static inline int timerheap_queued(const struct timerheap_node * node)
+{
+  return node->index != TIMERHEAP_NONE;
+}
+
+#endif /* TIMERHEAP_H_ */
@@ -0,0 +1,167 @@
+
+/* Includes ------------------------------------------------------------------*/
+
+#include "timerwheel.h"
+#include <stddef.h>
+
+/* Private typedef -----------------------------------------------------------*/
+/* Private define ------------------------------------------------------------*/
+#define TIMERWHEEL_MASK		(TIMERWHEEL_SLOTS - 1)
+#define TIMERWHEEL_RANGE	(1ull << (TIMERWHEEL_BITS * TIMERWHEEL_LEVELS))
+
+/* Private macro -------------------------------------------------------------*/
+// Slot of a tick in a level
+#define TIMERWHEEL_INDEX(tick, level)	(((tick) >> ((level) * TIMERWHEEL_BITS)) & TIMERWHEEL_MASK)
+
+/* Private variables ---------------------------------------------------------*/
+/* Private function prototypes -----------------------------------------------*/
+static void timerwheel_link(struct timerwheel_entry ** head, struct timerwheel_entry * entry);
+static void timerwheel_unlink(struct timerwheel_entry * entry);
+static void timerwheel_place(timerwheel * wheel, struct timerwheel_entry * entry);
+static void timerwheel_cascade(timerwheel * wheel, int level);
+/* Private functions ---------------------------------------------------------*/
+
+void timerwheel_init(timerwheel * wheel, uint64_t now)
+{
+  int level, slot;
+
+  wheel->now = now;
+  wheel->pending = 0;
+  for (level = 0; level < TIMERWHEEL_LEVELS; level++)
+	  for (slot = 0; slot < TIMERWHEEL_SLOTS; slot++)
+		  wheel->slots[level][slot] = 0;
+}
+
+void timerwheel_entry_init(struct timerwheel_entry * entry, timerwheel_cb cb, void * arg)
+{
+  entry->next = 0;
+  entry->pprev = 0;
+  entry->expires = 0;
+  entry->cb = cb;
+  entry->arg = arg;
+}
+
+void timerwheel_add(timerwheel * wheel, struct timerwheel_entry * entry, uint64_t expires)
+{
+  if (timerwheel_armed(entry))
+	  timerwheel_unlink(entry);
+  else
+	  wheel->pending++;
+
+  entry->expires = expires;
+  timerwheel_place(wheel, entry);
+}
+
+void timerwheel_del(timerwheel * wheel, struct timerwheel_entry * entry)
+{
+  if (!timerwheel_armed(entry))
+	  return;
+
+  timerwheel_unlink(entry);
+  wheel->pending--;
+}
+
+uint32_t timerwheel_advance(timerwheel * wheel, uint64_t now)
+{
+  struct timerwheel_entry * expired, * entry;
+  uint32_t runs = 0;
+  int level;
+
+  while (wheel->now <= now)
+  {
+	  // Nothing armed: the slots have nothing to say about the skipped ticks
+	  if (wheel->pending == 0)
+	  {
+		  wheel->now = now + 1;
+		  break;
+	  }
+
+	  // At the start of each round the next slot of the upper level is
+	  // spread over the lower ones
+	  for (level = 1; level < TIMERWHEEL_LEVELS; level++)
+	  {
+		  if (TIMERWHEEL_INDEX(wheel->now, level - 1) != 0)
+			  break;
+		  timerwheel_cascade(wheel, level);
+	  }
+
+	  // Detach the slot, so callbacks can arm entries for this same tick
+	  expired = wheel->slots[0][TIMERWHEEL_INDEX(wheel->now, 0)];
+	  wheel->slots[0][TIMERWHEEL_INDEX(wheel->now, 0)] = 0;
+	  if (expired)
+		  expired->pprev = &expired;
+	  wheel->now++;
+
+	  while ((entry = expired) != 0)
+	  {
+		  timerwheel_unlink(entry);
+		  wheel->pending--;
+		  entry->cb(entry, entry->arg);
+		  runs++;
+	  }
+  }
+
+  return runs;
+}
+
+/************* Static function description *********************/
+
+static void timerwheel_link(struct timerwheel_entry ** head, struct timerwheel_entry * entry)
+{
+  entry->next = *head;
+  if (entry->next)
+	  entry->next->pprev = &entry->next;
+  entry->pprev = head;
+  *head = entry;
+}
+
+static void timerwheel_unlink(struct timerwheel_entry * entry)
+{
+  *entry->pprev = entry->next;
+  if (entry->next)
+	  entry->next->pprev = entry->pprev;
+  entry->next = 0;
+  entry->pprev = 0;
+}
+
+// Links an entry in the level matching its distance to the wheel time
+static void timerwheel_place(timerwheel * wheel, struct timerwheel_entry * entry)
+{
+  uint64_t expires = entry->expires;
+  uint64_t delta;
+  int level;
+
+  if (expires < wheel->now)
+	  expires = wheel->now;
+  delta = expires - wheel->now;
+  if (delta >= TIMERWHEEL_RANGE)
+  {
+	  // Too far: it is placed at the end of the range and placed again there
+	  delta = TIMERWHEEL_RANGE - 1;
+	  expires = wheel->now + delta;
+  }
+
+  for (level = 0; level < TIMERWHEEL_LEVELS - 1; level++)
+  {
+	  if (delta < (1ull << ((level + 1) * TIMERWHEEL_BITS)))
+		  break;
+  }
+  timerwheel_link(&wheel->slots[level][TIMERWHEEL_INDEX(expires, level)], entry);
+}
+
+// Places again the entries of the current slot of a level
+static void timerwheel_cascade(timerwheel * wheel, int level)
+{
+  int slot = (int)TIMERWHEEL_INDEX(wheel->now, level);
+  struct timerwheel_entry * list = wheel->slots[level][slot];
+  struct timerwheel_entry * entry;
+
+  wheel->slots[level][slot] = 0;
+  if (list)
+	  list->pprev = &list;
+  while ((entry = list) != 0)
+  {
+	  timerwheel_unlink(entry);
+	  timerwheel_place(wheel, entry);
+  }
+}
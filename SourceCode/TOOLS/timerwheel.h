@@ -0,0 +1,56 @@
+#ifndef TIMERWHEEL_H_
+#define TIMERWHEEL_H_
+
+#include <stdint.h>
+
+// Hierarchical timer wheel. Entries are embedded in the user structures and
+// kept in doubly linked slot lists, so arming, re-arming and cancelling are
+// O(1) whatever the number of timers. Time is counted in ticks chosen by the
+// user. The wheel does no locking.
+
+// Levels and slots per level. Expiries further than
+// TIMERWHEEL_SLOTS ^ TIMERWHEEL_LEVELS ticks are clamped to that range
+#define TIMERWHEEL_BITS		6
+#define TIMERWHEEL_SLOTS	(1 << TIMERWHEEL_BITS)
+#define TIMERWHEEL_LEVELS	4
+
+struct timerwheel_entry;
+typedef void (*timerwheel_cb)(struct timerwheel_entry * entry, void * arg);
+
+struct timerwheel_entry
+{
+  struct timerwheel_entry * next;
+  struct timerwheel_entry ** pprev;	// NULL while not armed
+  uint64_t expires;
+  timerwheel_cb cb;
+  void * arg;
+};
+
+typedef struct
+{
+  uint64_t now;		// Next tick to be processed
+  uint32_t pending;	// Armed entries
+  struct timerwheel_entry * slots[TIMERWHEEL_LEVELS][TIMERWHEEL_SLOTS];
+}timerwheel;
+
+void timerwheel_init(timerwheel * wheel, uint64_t now);
+
+void timerwheel_entry_init(struct timerwheel_entry * entry, timerwheel_cb cb, void * arg);
+
+// Arms entry to expire at the given tick. An armed entry is moved. Expiries
+// in the past run on the next advance
+void timerwheel_add(timerwheel * wheel, struct timerwheel_entry * entry, uint64_t expires);
+
+// Disarms entry. Nothing is done if it is not armed
+void timerwheel_del(timerwheel * wheel, struct timerwheel_entry * entry);
+
+// Runs the callbacks of the entries expired up to tick now (included).
+// Callbacks may arm and disarm any entry. Returns the number of callbacks run
+uint32_t timerwheel_advance(timerwheel * wheel, uint64_t now);
+
+static inline int timerwheel_armed(const struct timerwheel_entry * entry)
+{
+  return entry->pprev != 0;
+}
+
+#endif /* TIMERWHEEL_H_ */
@@ -0,0 +1,318 @@
+
+/* Includes ------------------------------------------------------------------*/
+
+#include "workpool.h"
+#include "MemoryManagement.h"
+#include <stddef.h>
+#include <string.h>
+
+/* Private typedef -----------------------------------------------------------*/
+/* Private define ------------------------------------------------------------*/
+#define WORKPOOL_MIN_ITEMS	8
+
+/* Private macro -------------------------------------------------------------*/
+#define WORKPOOL_COUNT(counter)	__atomic_fetch_add(&(counter), 1, __ATOMIC_RELAXED)
+
+/* Private variables ---------------------------------------------------------*/
+/* Private function prototypes -----------------------------------------------*/
+static void workpool_schedule(workpool * pool, struct workpool_actor * actor, uint32_t worker);
+static struct workpool_actor * workpool_take(workpool * pool, uint32_t worker);
+static struct workpool_actor * workpool_steal(workpool * pool, uint32_t worker);
+static int workpool_serve(workpool * pool, struct workpool_actor * actor);
+static void workpool_sleep(workpool * pool);
+/* Private functions ---------------------------------------------------------*/
+
+int workpool_init(workpool * pool, uint32_t workers, uint32_t actors, workpool_fn fn, void * arg)
+{
+  pthread_rwlockattr_t attr;
+  uint32_t i;
+
+  memset(pool, 0, sizeof(*pool));
+  if (workers == 0 || workers > WORKPOOL_MAX_WORKERS || actors == 0)
+	  return -1;
+
+  pool->fn = fn;
+  pool->arg = arg;
+  pool->workers = workers;
+  pool->actors = actors;
+  pool->actor = (struct workpool_actor *)MemAlloc(actors * sizeof(struct workpool_actor));
+  if (pool->actor == 0)
+	  return -1;
+  for (i = 0; i < actors; i++)
+  {
+	  memset(&pool->actor[i], 0, sizeof(struct workpool_actor));
+	  pthread_mutex_init(&pool->actor[i].lock, NULL);
+	  pool->actor[i].home = i % workers;
+  }
+
+  for (i = 0; i < workers; i++)
+  {
+	  pool->deque[i].ring = (struct workpool_actor **)MemAlloc(actors * sizeof(struct workpool_actor *));
+	  if (pool->deque[i].ring == 0)
+	  {
+		  workpool_free(pool);
+		  return -1;
+	  }
+	  pthread_mutex_init(&pool->deque[i].lock, NULL);
+  }
+
+  // Readers keep coming while frames flow: exclusive items must not starve
+  pthread_rwlockattr_init(&attr);
+#ifdef __GLIBC__
+  pthread_rwlockattr_setkind_np(&attr, PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
+#endif
+  pthread_rwlock_init(&pool->state_lock, &attr);
+  pthread_rwlockattr_destroy(&attr);
+
+  pthread_mutex_init(&pool->idle_lock, NULL);
+  pthread_cond_init(&pool->idle, NULL);
+  return 0;
+}
+
+void workpool_release(workpool * pool)
+{
+  pthread_mutex_lock(&pool->idle_lock);
+  __atomic_store_n(&pool->stop, 1, __ATOMIC_SEQ_CST);
+  pthread_cond_broadcast(&pool->idle);
+  pthread_mutex_unlock(&pool->idle_lock);
+}
+
+void workpool_free(workpool * pool)
+{
+  uint32_t i;
+
+  if (pool->actor != 0)
+  {
+	  for (i = 0; i < pool->actors; i++)
+	  {
+		  MemFree(pool->actor[i].items);
+		  pthread_mutex_destroy(&pool->actor[i].lock);
+	  }
+	  MemFree(pool->actor);
+	  pool->actor = 0;
+  }
+  for (i = 0; i < pool->workers; i++)
+  {
+	  if (pool->deque[i].ring != 0)
+	  {
+		  MemFree(pool->deque[i].ring);
+		  pool->deque[i].ring = 0;
+		  pthread_mutex_destroy(&pool->deque[i].lock);
+	  }
+  }
+}
+
+int workpool_submit(workpool * pool, uint32_t key, void * item, int flags)
+{
+  struct workpool_actor * actor = &pool->actor[key % pool->actors];
+  struct workpool_item * items;
+  uint32_t size, i;
+  int schedule = 0;
+
+  pthread_mutex_lock(&actor->lock);
+
+  if (actor->count == actor->size)
+  {
+	  // Unwrap the ring into a larger one
+	  size = (actor->size != 0) ? actor->size * 2 : WORKPOOL_MIN_ITEMS;
+	  items = (struct workpool_item *)MemAlloc(size * sizeof(struct workpool_item));
+	  if (items == 0)
+	  {
+		  pthread_mutex_unlock(&actor->lock);
+		  return -1;
+	  }
+	  for (i = 0; i < actor->count; i++)
+		  items[i] = actor->items[(actor->head + i) % actor->size];
+	  MemFree(actor->items);
+	  actor->items = items;
+	  actor->head = 0;
+	  actor->size = size;
+  }
+
+  i = (actor->head + actor->count) % actor->size;
+  actor->items[i].data = item;
+  actor->items[i].flags = flags;
+  actor->count++;
+
+  // An actor is queued once: its items are never handled by two workers
+  if (!actor->scheduled)
+  {
+	  actor->scheduled = 1;
+	  schedule = 1;
+  }
+
+  pthread_mutex_unlock(&actor->lock);
+
+  if (schedule)
+	  workpool_schedule(pool, actor, actor->home);
+  return 0;
+}
+
+void workpool_run(workpool * pool, uint32_t worker)
+{
+  struct workpool_actor * actor;
+
+  while (1)
+  {
+	  actor = workpool_take(pool, worker);
+	  if (actor == 0)
+		  actor = workpool_steal(pool, worker);
+
+	  if (actor != 0)
+	  {
+		  // Batch over: back to the end of the line behind the other actors
+		  if (workpool_serve(pool, actor))
+			  workpool_schedule(pool, actor, worker);
+		  continue;
+	  }
+
+	  if (__atomic_load_n(&pool->stop, __ATOMIC_SEQ_CST) &&
+	      __atomic_load_n(&pool->ready, __ATOMIC_SEQ_CST) == 0)
+		  break;
+	  workpool_sleep(pool);
+  }
+}
+
+void workpool_exclusive_begin(workpool * pool)
+{
+  pthread_rwlock_wrlock(&pool->state_lock);
+}
+
+void workpool_exclusive_end(workpool * pool)
+{
+  pthread_rwlock_unlock(&pool->state_lock);
+}
+
+void workpool_get_stats(workpool * pool, workpool_stats * stats, int reset)
+{
+  stats->items = __atomic_load_n(&pool->stats.items, __ATOMIC_RELAXED);
+  stats->steals = __atomic_load_n(&pool->stats.steals, __ATOMIC_RELAXED);
+  stats->sleeps = __atomic_load_n(&pool->stats.sleeps, __ATOMIC_RELAXED);
+  if (reset)
+  {
+	  __atomic_store_n(&pool->stats.items, 0, __ATOMIC_RELAXED);
+	  __atomic_store_n(&pool->stats.steals, 0, __ATOMIC_RELAXED);
+	  __atomic_store_n(&pool->stats.sleeps, 0, __ATOMIC_RELAXED);
+  }
+}
+
+/************* Static function description *********************/
+
+// Queues an actor at the end of the deque of a worker and wakes a sleeper
+static void workpool_schedule(workpool * pool, struct workpool_actor * actor, uint32_t worker)
+{
+  struct workpool_deque * deque = &pool->deque[worker];
+
+  pthread_mutex_lock(&deque->lock);
+  deque->ring[(deque->head + deque->count) % pool->actors] = actor;
+  __atomic_store_n(&deque->count, deque->count + 1, __ATOMIC_RELAXED);
+  pthread_mutex_unlock(&deque->lock);
+
+  // Paired with workpool_sleep: either the sleeper sees ready or we see it
+  __atomic_fetch_add(&pool->ready, 1, __ATOMIC_SEQ_CST);
+  if (__atomic_load_n(&pool->sleepers, __ATOMIC_SEQ_CST) != 0)
+  {
+	  pthread_mutex_lock(&pool->idle_lock);
+	  pthread_cond_signal(&pool->idle);
+	  pthread_mutex_unlock(&pool->idle_lock);
+  }
+}
+
+// The owner serves its deque in FIFO order
+static struct workpool_actor * workpool_take(workpool * pool, uint32_t worker)
+{
+  struct workpool_deque * deque = &pool->deque[worker];
+  struct workpool_actor * actor = 0;
+
+  pthread_mutex_lock(&deque->lock);
+  if (deque->count != 0)
+  {
+	  actor = deque->ring[deque->head];
+	  deque->head = (deque->head + 1) % pool->actors;
+	  __atomic_store_n(&deque->count, deque->count - 1, __ATOMIC_RELAXED);
+  }
+  pthread_mutex_unlock(&deque->lock);
+
+  if (actor != 0)
+	  __atomic_fetch_sub(&pool->ready, 1, __ATOMIC_SEQ_CST);
+  return actor;
+}
+
+// Thieves take the newest actor of the first non empty deque after their own
+static struct workpool_actor * workpool_steal(workpool * pool, uint32_t worker)
+{
+  struct workpool_deque * deque;
+  struct workpool_actor * actor = 0;
+  uint32_t i;
+
+  if (__atomic_load_n(&pool->ready, __ATOMIC_SEQ_CST) == 0)
+	  return 0;
+
+  for (i = 1; i < pool->workers && actor == 0; i++)
+  {
+	  deque = &pool->deque[(worker + i) % pool->workers];
+	  // Peek without the lock: empty deques are skipped cheaply
+	  if (__atomic_load_n(&deque->count, __ATOMIC_RELAXED) == 0)
+		  continue;
+
+	  pthread_mutex_lock(&deque->lock);
+	  if (deque->count != 0)
+	  {
+		  __atomic_store_n(&deque->count, deque->count - 1, __ATOMIC_RELAXED);
+		  actor = deque->ring[(deque->head + deque->count) % pool->actors];
+	  }
+	  pthread_mutex_unlock(&deque->lock);
+  }
+
+  if (actor != 0)
+  {
+	  __atomic_fetch_sub(&pool->ready, 1, __ATOMIC_SEQ_CST);
+	  WORKPOOL_COUNT(pool->stats.steals);
+  }
+  return actor;
+}
+
+// Handles up to WORKPOOL_BATCH items of an actor. Returns 1 if the actor is
+// still scheduled and must be queued again
+static int workpool_serve(workpool * pool, struct workpool_actor * actor)
+{
+  struct workpool_item item;
+  int n;
+
+  for (n = 0; n < WORKPOOL_BATCH; n++)
+  {
+	  pthread_mutex_lock(&actor->lock);
+	  if (actor->count == 0)
+	  {
+		  actor->scheduled = 0;
+		  pthread_mutex_unlock(&actor->lock);
+		  return 0;
+	  }
+	  item = actor->items[actor->head];
+	  actor->head = (actor->head + 1) % actor->size;
+	  actor->count--;
+	  pthread_mutex_unlock(&actor->lock);
+
+	  if (item.flags & WORKPOOL_EXCLUSIVE)
+		  pthread_rwlock_wrlock(&pool->state_lock);
+	  else
+		  pthread_rwlock_rdlock(&pool->state_lock);
+	  pool->fn(item.data, pool->arg);
+	  pthread_rwlock_unlock(&pool->state_lock);
+	  WORKPOOL_COUNT(pool->stats.items);
+  }
+
+  return 1;
+}
+
+// Waits until an actor is queued or the pool is released
+static void workpool_sleep(workpool * pool)
+{
+  pthread_mutex_lock(&pool->idle_lock);
+  __atomic_fetch_add(&pool->sleepers, 1, __ATOMIC_SEQ_CST);
+  while (__atomic_load_n(&pool->ready, __ATOMIC_SEQ_CST) == 0 && !pool->stop)
+	  pthread_cond_wait(&pool->idle, &pool->idle_lock);
+  __atomic_fetch_sub(&pool->sleepers, 1, __ATOMIC_SEQ_CST);
+  pthread_mutex_unlock(&pool->idle_lock);
+  WORKPOOL_COUNT(pool->stats.sleeps);
+}
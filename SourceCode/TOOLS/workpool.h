@@ -0,0 +1,101 @@
+#ifndef WORKPOOL_H_
+#define WORKPOOL_H_
+
+#include <stdint.h>
+#include <pthread.h>
+
+// Pool of worker threads with work stealing. Items are submitted to actors:
+// the items of an actor are handled one at a time and in submission order,
+// whatever worker runs them. An actor with pending items is queued in the
+// deque of its home worker; idle workers steal actors from the other deques.
+//
+// Handlers run holding a shared lock. Items submitted as WORKPOOL_EXCLUSIVE
+// hold it exclusively, so they never run together with any other item.
+// The threads belong to the caller, which runs workpool_run in each of them.
+
+// Maximum number of workers of a pool
+#define WORKPOOL_MAX_WORKERS	16
+
+// Items an actor handles in a row before it goes back to the end of a deque
+#define WORKPOOL_BATCH		16
+
+// Submission flags
+#define WORKPOOL_EXCLUSIVE	0x01	// Runs alone: it updates shared state
+
+typedef void (*workpool_fn)(void * item, void * arg);
+
+struct workpool_item
+{
+  void * data;
+  int flags;
+};
+
+struct workpool_actor
+{
+  pthread_mutex_t lock;
+  struct workpool_item * items;	// Ring of pending items. Grows on demand
+  uint32_t head;
+  uint32_t count;
+  uint32_t size;
+  int scheduled;	// Queued in a deque or being run by a worker
+  uint32_t home;	// Worker whose deque it is queued in
+};
+
+struct workpool_deque
+{
+  pthread_mutex_t lock;
+  struct workpool_actor ** ring;	// Sized for every actor: it never fills
+  uint32_t head;
+  uint32_t count;
+};
+
+typedef struct
+{
+  uint64_t items;	// Items handled
+  uint64_t steals;	// Actors taken from the deque of another worker
+  uint64_t sleeps;	// Times a worker has found no work anywhere
+}workpool_stats;
+
+typedef struct
+{
+  workpool_fn fn;
+  void * arg;
+  uint32_t workers;
+  uint32_t actors;
+  struct workpool_actor * actor;
+  struct workpool_deque deque[WORKPOOL_MAX_WORKERS];
+  pthread_rwlock_t state_lock;	// Shared by the handlers, exclusive for WORKPOOL_EXCLUSIVE
+  pthread_mutex_t idle_lock;
+  pthread_cond_t idle;
+  int ready;		// Actors queued in the deques
+  int sleepers;		// Workers waiting on idle
+  int stop;
+  workpool_stats stats;
+}workpool;
+
+// Allocates the actors and the deques. fn is called with every item and arg.
+// Returns 0 on success, -1 on error
+int workpool_init(workpool * pool, uint32_t workers, uint32_t actors, workpool_fn fn, void * arg);
+
+// Makes the workers return from workpool_run once every queued item has
+// been handled
+void workpool_release(workpool * pool);
+
+// Frees the pool. The workers must have returned
+void workpool_free(workpool * pool);
+
+// Queues an item in actor key % actors. Returns 0 on success, -1 if the actor
+// cannot grow
+int workpool_submit(workpool * pool, uint32_t key, void * item, int flags);
+
+// Worker loop of worker number worker. Returns after workpool_release
+void workpool_run(workpool * pool, uint32_t worker);
+
+// Excludes the handlers, so the caller can update the shared state
+void workpool_exclusive_begin(workpool * pool);
+void workpool_exclusive_end(workpool * pool);
+
+// Copies the statistics and resets them if reset is not 0
+void workpool_get_stats(workpool * pool, workpool_stats * stats, int reset);
+
+#endif /* WORKPOOL_H_ */
@@ -65,8 +65,18 @@ int main (void) {
     InitDeviceProcess();
 #endif
     
+#if OS_ACTIVE != 0
   /* Start thread execution */
     OS_START();
+#else
+    /* Super loop: each step runs to completion, frames are processed in the
+     * step that reads them */
+    while(1)
+    {
+      BUSProcessStep();
+      MBAProcessStep();
+    }
+#endif
 
     return 0;
 }
@@ -0,0 +1,129 @@
+/**
+  ******************************************************************************
+  * @file    TestAggregator.c
+  * @author  Javier Fernandez Cepeda
+  * @brief   Unit tests of the write aggregator (TOOLS/aggregator).
+  *
+  *******************************************************************************
+  * Copyright (c) 2015, Javier Fernandez. All rights reserved.
+  *******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include <string.h>
+#include "TestUtils.h"
+#include "TOOLS/aggregator.h"
+
+/* Private define ------------------------------------------------------------*/
+#define TEST_WRITE	64	/* Size of a write */
+#define TEST_HOLD	200	/* us */
+
+/* Private variables ---------------------------------------------------------*/
+static uint8_t Written[1024];
+static uint32_t WrittenSize;
+static uint32_t Writes;
+static uint32_t LastWrite;	/* Size of the last write */
+
+/* Private functions ---------------------------------------------------------*/
+
+static void Collect(void *arg, const uint8_t *data, uint32_t size)
+{
+  (void)arg;
+  memcpy(Written + WrittenSize, data, size);
+  WrittenSize += size;
+  LastWrite = size;
+  Writes++;
+}
+
+static void Reset(void)
+{
+  WrittenSize = 0;
+  Writes = 0;
+  LastWrite = 0;
+}
+
+/**
+  * @brief Frames are packed until the next one does not fit, and come out
+  *        in order.
+  */
+static void TestPacking(void)
+{
+  uint8_t Frame[20];
+  aggregator Aggregator;
+  uint32_t i;
+
+  Reset();
+  aggregator_init(&Aggregator);
+  for (i = 0; i < 4; i++)
+  {
+    memset(Frame, (int)i, sizeof(Frame));
+    aggregator_add(&Aggregator, Frame, sizeof(Frame), TEST_WRITE, 1000, TEST_HOLD, Collect, NULL);
+  }
+  /* Three frames fit in 64 bytes: the fourth one pushes them out */
+  TEST_CHECK(Writes == 1 && LastWrite == 60);
+  aggregator_flush(&Aggregator, Collect, NULL);
+  TEST_CHECK(Writes == 2 && LastWrite == 20);
+  TEST_CHECK(WrittenSize == 80 && Written[0] == 0 && Written[40] == 2 && Written[79] == 3);
+  TEST_CHECK(Aggregator.writes == 2 && Aggregator.packed == 4);
+
+  /* Nothing held: no write */
+  aggregator_flush(&Aggregator, Collect, NULL);
+  TEST_CHECK(Writes == 2);
+  aggregator_reset(&Aggregator);
+}
+
+/**
+  * @brief The oldest frame waits no longer than the hold time.
+  */
+static void TestHold(void)
+{
+  uint8_t Frame[8] = {0};
+  aggregator Aggregator;
+
+  Reset();
+  aggregator_init(&Aggregator);
+  aggregator_add(&Aggregator, Frame, sizeof(Frame), TEST_WRITE, 1000, TEST_HOLD, Collect, NULL);
+  TEST_CHECK(Writes == 0);
+  TEST_CHECK(aggregator_wait_us(&Aggregator, 1050, TEST_HOLD) == 150);
+  aggregator_add(&Aggregator, Frame, sizeof(Frame), TEST_WRITE, 1100, TEST_HOLD, Collect, NULL);
+  TEST_CHECK(Writes == 0);
+
+  /* The third frame comes once the first has waited enough */
+  aggregator_add(&Aggregator, Frame, sizeof(Frame), TEST_WRITE, 1200, TEST_HOLD, Collect, NULL);
+  TEST_CHECK(Writes == 1 && LastWrite == 24);
+  TEST_CHECK(aggregator_wait_us(&Aggregator, 1300, TEST_HOLD) == 0);
+  aggregator_reset(&Aggregator);
+}
+
+/**
+  * @brief Off, or with frames that fill a write, every frame goes alone.
+  */
+static void TestPassThrough(void)
+{
+  uint8_t Frame[TEST_WRITE + 1] = {0};
+  aggregator Aggregator;
+
+  Reset();
+  aggregator_init(&Aggregator);
+  aggregator_add(&Aggregator, Frame, 10, 0, 1000, TEST_HOLD, Collect, NULL);
+  TEST_CHECK(Writes == 1 && LastWrite == 10);
+
+  aggregator_add(&Aggregator, Frame, 10, TEST_WRITE, 1000, TEST_HOLD, Collect, NULL);
+  aggregator_add(&Aggregator, Frame, sizeof(Frame), TEST_WRITE, 1000, TEST_HOLD, Collect, NULL);
+  TEST_CHECK(Writes == 3 && LastWrite == sizeof(Frame));
+
+  /* Turned off with a frame held: it goes first */
+  aggregator_add(&Aggregator, Frame, 10, TEST_WRITE, 1000, TEST_HOLD, Collect, NULL);
+  aggregator_add(&Aggregator, Frame, 12, 0, 1000, TEST_HOLD, Collect, NULL);
+  TEST_CHECK(Writes == 5 && LastWrite == 12 && Aggregator.buf == NULL);
+  aggregator_reset(&Aggregator);
+}
+
+int main(void)
+{
+  TEST_RUN(TestPacking);
+  TEST_RUN(TestHold);
+  TEST_RUN(TestPassThrough);
+
+  return TEST_RESULT();
+}
@@ -0,0 +1,106 @@
+/**
+  ******************************************************************************
+  * @file    TestCrc16.c
+  * @author  Javier Fernandez Cepeda
+  * @brief   Unit tests of the CRC-16 of the MBA frames (TOOLS/crc16).
+  *
+  *******************************************************************************
+  * Copyright (c) 2015, Javier Fernandez. All rights reserved.
+  *******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include <string.h>
+#include "TestUtils.h"
+#include "TOOLS/crc16.h"
+
+/* Private define ------------------------------------------------------------*/
+#define TEST_BUFFER	300	/* Bytes, not a multiple of 8 */
+
+/* Private variables ---------------------------------------------------------*/
+static uint8_t Buffer[TEST_BUFFER + 8];
+
+/* Private functions ---------------------------------------------------------*/
+
+/**
+  * @brief All the variants give the check value of the algorithm.
+  */
+static void TestCheckValue(void)
+{
+  const uint8_t *Check = (const uint8_t *)"123456789";
+
+  TEST_CHECK(crc16_bitwise(CRC16_INIT, Check, 9) == CRC16_CHECK);
+  TEST_CHECK(crc16_table(CRC16_INIT, Check, 9) == CRC16_CHECK);
+  TEST_CHECK(crc16_slice8(CRC16_INIT, Check, 9) == CRC16_CHECK);
+  TEST_CHECK(crc16(Check, 9) == CRC16_CHECK);
+  TEST_CHECK(crc16(Check, 0) == CRC16_INIT);
+}
+
+/**
+  * @brief The table variants match the bitwise one for every length and
+  *        alignment of the data.
+  */
+static void TestVariantsMatch(void)
+{
+  uint32_t Seed = 1, i, Offset, Size;
+  uint16_t Crc;
+  int Mismatches = 0;
+
+  for (i = 0; i < sizeof(Buffer); i++)
+  {
+    Seed = Seed * 1103515245 + 12345;
+    Buffer[i] = (uint8_t)(Seed >> 16);
+  }
+
+  for (Offset = 0; Offset < 8; Offset++)
+    for (Size = 0; Size <= TEST_BUFFER; Size++)
+    {
+      Crc = crc16_bitwise(CRC16_INIT, Buffer + Offset, Size);
+      if (crc16_table(CRC16_INIT, Buffer + Offset, Size) != Crc ||
+          crc16_slice8(CRC16_INIT, Buffer + Offset, Size) != Crc ||
+          crc16(Buffer + Offset, Size) != Crc)
+        Mismatches++;
+    }
+  TEST_CHECK(Mismatches == 0);
+}
+
+/**
+  * @brief A CRC goes on from the CRC of the previous part.
+  */
+static void TestChained(void)
+{
+  uint16_t Crc;
+
+  Crc = crc16_slice8(CRC16_INIT, Buffer, 13);
+  Crc = crc16_table(Crc, Buffer + 13, 100);
+  Crc = crc16_slice8(Crc, Buffer + 113, TEST_BUFFER - 113);
+  TEST_CHECK(Crc == crc16(Buffer, TEST_BUFFER));
+}
+
+/**
+  * @brief Any single flipped bit changes the CRC.
+  */
+static void TestSingleBitErrors(void)
+{
+  uint16_t Crc = crc16(Buffer, 64);
+  int Bit, Missed = 0;
+
+  for (Bit = 0; Bit < 64 * 8; Bit++)
+  {
+    Buffer[Bit / 8] ^= (uint8_t)(1 << (Bit % 8));
+    if (crc16(Buffer, 64) == Crc)
+      Missed++;
+    Buffer[Bit / 8] ^= (uint8_t)(1 << (Bit % 8));
+  }
+  TEST_CHECK(Missed == 0);
+}
+
+int main(void)
+{
+  TEST_RUN(TestCheckValue);
+  TEST_RUN(TestVariantsMatch);
+  TEST_RUN(TestChained);
+  TEST_RUN(TestSingleBitErrors);
+
+  return TEST_RESULT();
+}
@@ -0,0 +1,169 @@
+/**
+  ******************************************************************************
+  * @file    TestDeframer.c
+  * @author  Javier Fernandez Cepeda
+  * @brief   Unit tests of the byte stream deframer (TOOLS/deframer).
+  *
+  *******************************************************************************
+  * Copyright (c) 2015, Javier Fernandez. All rights reserved.
+  *******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include <string.h>
+#include "TestUtils.h"
+#include "TOOLS/deframer.h"
+#include "TOOLS/MemoryManagement.h"
+
+/* Private define ------------------------------------------------------------*/
+#define TEST_HEADER	10	/* MBA header */
+#define TEST_SIZE_FIELD	2
+#define TEST_TRAILER	2	/* Checksum */
+#define TEST_MAX	256
+#define TEST_FRAMES	8
+
+/* Private variables ---------------------------------------------------------*/
+static uint8_t Stream[TEST_FRAMES * TEST_MAX];
+static uint32_t StreamSize;
+static uint32_t FrameSizes[TEST_FRAMES];
+static uint8_t Received[TEST_FRAMES * TEST_MAX];
+static uint32_t ReceivedSize;
+static uint32_t Frames;
+static int BadFrames;	/* Frames that do not match their header */
+
+/* Private functions ---------------------------------------------------------*/
+
+/**
+  * @brief Builds a stream of frames of increasing sizes, bytes numbered.
+  */
+static void BuildStream(void)
+{
+  uint32_t i, j, Data;
+
+  StreamSize = 0;
+  for (i = 0; i < TEST_FRAMES; i++)
+  {
+    Data = i * 23;
+    FrameSizes[i] = TEST_HEADER + Data + TEST_TRAILER;
+    for (j = 0; j < FrameSizes[i]; j++)
+      Stream[StreamSize + j] = (uint8_t)(StreamSize + j);
+    Stream[StreamSize + TEST_SIZE_FIELD] = (uint8_t)(Data & 0xFF);
+    Stream[StreamSize + TEST_SIZE_FIELD + 1] = (uint8_t)(Data >> 8);
+    StreamSize += FrameSizes[i];
+  }
+  ReceivedSize = 0;
+  Frames = 0;
+  BadFrames = 0;
+}
+
+static void Collect(void *arg, uint8_t *frame, uint32_t size)
+{
+  (void)arg;
+  if (Frames >= TEST_FRAMES || size != FrameSizes[Frames])
+    BadFrames++;
+  else
+  {
+    memcpy(Received + ReceivedSize, frame, size);
+    ReceivedSize += size;
+  }
+  Frames++;
+  MemFree(frame);
+}
+
+/**
+  * @brief  Feeds the stream in chunks of the given size.
+  */
+static void Feed(deframer *Deframer, uint32_t Chunk)
+{
+  uint32_t Pos, Size;
+  uint8_t *Data;
+
+  for (Pos = 0; Pos < StreamSize; Pos += Size)
+  {
+    Size = (StreamSize - Pos < Chunk) ? StreamSize - Pos : Chunk;
+    Data = (uint8_t *)MemAlloc(Size);
+    memcpy(Data, Stream + Pos, Size);
+    deframer_feed(Deframer, Data, Size, Collect, NULL);
+  }
+}
+
+/**
+  * @brief A chunk holding one frame is handed over as it is.
+  */
+static void TestWholeFrame(void)
+{
+  deframer Deframer;
+  uint8_t *Data;
+  uint32_t Size;
+
+  BuildStream();
+  deframer_init(&Deframer, TEST_HEADER, TEST_SIZE_FIELD, TEST_TRAILER, TEST_MAX);
+  Size = FrameSizes[0];
+  Data = (uint8_t *)MemAlloc(Size);
+  memcpy(Data, Stream, Size);
+
+  TEST_CHECK(deframer_feed(&Deframer, Data, Size, Collect, NULL) == 1);
+  TEST_CHECK(Frames == 1 && BadFrames == 0);
+  TEST_CHECK(Deframer.buf == NULL);
+}
+
+/**
+  * @brief Whatever the chunks, every frame comes out once and in order:
+  *        byte by byte, several frames per chunk and frames across chunks.
+  */
+static void TestChunks(void)
+{
+  const uint32_t Chunks[] = {1, 3, 7, 12, 64, 100, 1000, TEST_FRAMES * TEST_MAX};
+  deframer Deframer;
+  uint32_t i;
+
+  for (i = 0; i < sizeof(Chunks) / sizeof(Chunks[0]); i++)
+  {
+    BuildStream();
+    deframer_init(&Deframer, TEST_HEADER, TEST_SIZE_FIELD, TEST_TRAILER, TEST_MAX);
+    Feed(&Deframer, Chunks[i]);
+    TEST_CHECK(Frames == TEST_FRAMES && BadFrames == 0);
+    TEST_CHECK(ReceivedSize == StreamSize && memcmp(Received, Stream, StreamSize) == 0);
+    TEST_CHECK(Deframer.buf == NULL && Deframer.len == 0);
+  }
+}
+
+/**
+  * @brief A frame over the maximum size drops the stream buffered; the
+  *        partial frame is released on reset.
+  */
+static void TestOversize(void)
+{
+  deframer Deframer;
+  uint8_t *Data;
+
+  BuildStream();
+  deframer_init(&Deframer, TEST_HEADER, TEST_SIZE_FIELD, TEST_TRAILER, TEST_MAX);
+
+  /* Half a frame is kept */
+  Data = (uint8_t *)MemAlloc(5);
+  memcpy(Data, Stream, 5);
+  TEST_CHECK(deframer_feed(&Deframer, Data, 5, Collect, NULL) == 0);
+  TEST_CHECK(Deframer.buf != NULL && Deframer.len == 5);
+  deframer_reset(&Deframer);
+  TEST_CHECK(Deframer.buf == NULL && Deframer.len == 0);
+
+  Data = (uint8_t *)MemAlloc(TEST_HEADER);
+  memset(Data, 0, TEST_HEADER);
+  Data[TEST_SIZE_FIELD + 1] = 0x10;
+  TEST_CHECK(deframer_feed(&Deframer, Data, TEST_HEADER, Collect, NULL) < 0);
+  TEST_CHECK(Deframer.dropped == 1 && Deframer.buf == NULL);
+
+  /* The stream goes on from the next chunk */
+  Feed(&Deframer, 50);
+  TEST_CHECK(Frames == TEST_FRAMES && BadFrames == 0);
+}
+
+int main(void)
+{
+  TEST_RUN(TestWholeFrame);
+  TEST_RUN(TestChunks);
+  TEST_RUN(TestOversize);
+
+  return TEST_RESULT();
+}
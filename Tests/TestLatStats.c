@@ -0,0 +1,82 @@
+/**
+  ******************************************************************************
+  * @file    TestLatStats.c
+  * @author  Javier Fernandez Cepeda
+  * @brief   Unit tests of the frame latency statistics (TOOLS/latstats).
+  *
+  *******************************************************************************
+  * Copyright (c) 2015, Javier Fernandez. All rights reserved.
+  *******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "TestUtils.h"
+#include "TOOLS/latstats.h"
+
+/* Private functions ---------------------------------------------------------*/
+
+/**
+  * @brief A frame with every mark counts in the total and in each stage.
+  */
+static void TestStages(void)
+{
+  const uint64_t Marks[LATSTATS_MARKS] = {1000, 1010, 1110, 1400};
+  latstats Stats;
+
+  latstats_reset(&Stats);
+  latstats_add(&Stats, Marks);
+  TEST_CHECK(Stats.frames == 1 && Stats.staged == 1);
+  TEST_CHECK(Stats.sum_us == 400 && Stats.max_us == 400);
+  TEST_CHECK(Stats.stage_sum_us[0] == 10 && Stats.stage_max_us[0] == 10);
+  TEST_CHECK(Stats.stage_sum_us[1] == 100 && Stats.stage_max_us[1] == 100);
+  TEST_CHECK(Stats.stage_sum_us[2] == 290 && Stats.stage_max_us[2] == 290);
+  /* 400 us: [256, 512) */
+  TEST_CHECK(Stats.buckets[8] == 1);
+}
+
+/**
+  * @brief Frames that skip a mark count in the total only; frames without
+  *        capture time are not counted.
+  */
+static void TestSkippedMarks(void)
+{
+  const uint64_t Routed[LATSTATS_MARKS] = {1000, 0, 0, 1003};
+  const uint64_t Made[LATSTATS_MARKS] = {0, 0, 2000, 2100};
+  latstats Stats;
+
+  latstats_reset(&Stats);
+  latstats_add(&Stats, Routed);
+  latstats_add(&Stats, Made);
+  TEST_CHECK(Stats.frames == 1 && Stats.staged == 0);
+  TEST_CHECK(Stats.sum_us == 3 && Stats.stage_sum_us[2] == 0);
+  TEST_CHECK(Stats.buckets[1] == 1);
+}
+
+/**
+  * @brief Long latencies go to the last bucket and marks out of order give
+  *        no time.
+  */
+static void TestLimits(void)
+{
+  const uint64_t Long[LATSTATS_MARKS] = {1, 2, 3, 10000000};
+  const uint64_t Backwards[LATSTATS_MARKS] = {500, 400, 600, 700};
+  latstats Stats;
+
+  latstats_reset(&Stats);
+  latstats_add(&Stats, Long);
+  TEST_CHECK(Stats.buckets[LATSTATS_BUCKETS - 1] == 1);
+  TEST_CHECK(Stats.max_us == 9999999);
+
+  latstats_add(&Stats, Backwards);
+  TEST_CHECK(Stats.frames == 2 && Stats.staged == 2);
+  TEST_CHECK(Stats.stage_sum_us[0] == 1 && Stats.stage_sum_us[1] == 1 + 200);
+}
+
+int main(void)
+{
+  TEST_RUN(TestStages);
+  TEST_RUN(TestSkippedMarks);
+  TEST_RUN(TestLimits);
+
+  return TEST_RESULT();
+}
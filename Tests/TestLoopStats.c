@@ -0,0 +1,154 @@
+/**
+  ******************************************************************************
+  * @file    TestLoopStats.c
+  * @author  Javier Fernandez Cepeda
+  * @brief   Unit tests of the thread loop statistics (TOOLS/loopstats).
+  *
+  *******************************************************************************
+  * Copyright (c) 2015, Javier Fernandez. All rights reserved.
+  *******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include <signal.h>
+#include <string.h>
+#include <unistd.h>
+#include "TestUtils.h"
+#include "TOOLS/loopstats.h"
+
+/* Private functions ---------------------------------------------------------*/
+/* Bucket of a duration, as kept by loopstats_end */
+static uint32_t Bucket(uint32_t Us)
+{
+  uint32_t b = 0;
+
+  while (b < LOOPSTATS_BUCKETS - 1 && (Us >> (b + 1)) != 0)
+    b++;
+  return b;
+}
+
+/* Writes a dump into Text. Returns its length */
+static size_t Dump(char *Text, size_t Size, int Signal)
+{
+  FILE *Out = tmpfile();
+  size_t Len;
+
+  if (Out == NULL)
+    return 0;
+  if (Signal)
+    loopstats_poll_dump(Out);
+  else
+    loopstats_dump(Out, 0);
+  rewind(Out);
+  Len = fread(Text, 1, Size - 1, Out);
+  Text[Len] = 0;
+  fclose(Out);
+  return Len;
+}
+
+/**
+  * @brief A thread gets its slot back by name; index makes names unique.
+  */
+static void TestSlots(void)
+{
+  loopstats *A, *B, *C;
+
+  A = loopstats_open("BUSReadProcess", 0);
+  B = loopstats_open("BUSReadProcess", 1);
+  TEST_ASSERT(A != NULL && B != NULL && A != B);
+  TEST_CHECK(strcmp(A->name, "BUSReadProcess 0") == 0);
+
+  loopstats_begin(A);
+  loopstats_end(A);
+  C = loopstats_open("BUSReadProcess", 0);
+  TEST_CHECK(C == A);
+  TEST_CHECK(C->iterations == 1);
+
+  /* Freed slots are taken again, cleared */
+  loopstats_close(B);
+  C = loopstats_open("MBAProcess", -1);
+  TEST_CHECK(C == B);
+  TEST_CHECK(strcmp(C->name, "MBAProcess") == 0 && C->iterations == 0);
+  loopstats_close(A);
+  loopstats_close(C);
+}
+
+/**
+  * @brief Iterations fill the histogram; the long ones are stalls and keep
+  *        the frame they were processing.
+  */
+static void TestStalls(void)
+{
+  loopstats *S = loopstats_open("TestStalls", -1);
+  uint32_t i, Total = 0;
+
+  TEST_ASSERT(S != NULL);
+  loopstats_threshold_us = 2000;
+
+  for (i = 0; i < 10; i++)
+  {
+    loopstats_begin(S);
+    loopstats_frame(S, 0x11);
+    loopstats_end(S);
+  }
+  TEST_CHECK(S->iterations == 10 && S->stalls == 0);
+
+  loopstats_begin(S);
+  loopstats_frame(S, 0x0A010203);
+  usleep(5000);
+  loopstats_end(S);
+  TEST_CHECK(S->iterations == 11);
+  TEST_CHECK(S->stalls == 1);
+  TEST_CHECK(S->last_frame == 0x0A010203);
+  TEST_CHECK(S->max_us >= 5000);
+  TEST_CHECK(S->buckets[Bucket(S->max_us)] == 1);
+
+  for (i = 0; i < LOOPSTATS_BUCKETS; i++)
+    Total += S->buckets[i];
+  TEST_CHECK(Total == S->iterations);
+
+  /* 0 disables the log */
+  loopstats_threshold_us = 0;
+  loopstats_begin(S);
+  usleep(3000);
+  loopstats_end(S);
+  TEST_CHECK(S->stalls == 1);
+
+  loopstats_threshold_us = 10000;
+  loopstats_close(S);
+}
+
+/**
+  * @brief The dump lists the used slots, on request or on a signal.
+  */
+static void TestDump(void)
+{
+  loopstats *S = loopstats_open("TestDump", 3);
+  char Text[4096];
+
+  TEST_ASSERT(S != NULL);
+  loopstats_begin(S);
+  loopstats_end(S);
+
+  TEST_CHECK(Dump(Text, sizeof(Text), 0) > 0);
+  TEST_CHECK(strstr(Text, "TestDump 3") != NULL);
+  TEST_CHECK(strstr(Text, " 1 iterations") != NULL);
+
+  /* Nothing is written until the signal comes */
+  TEST_ASSERT(loopstats_dump_on_signal(SIGUSR1) == 0);
+  TEST_CHECK(Dump(Text, sizeof(Text), 1) == 0);
+  raise(SIGUSR1);
+  TEST_CHECK(Dump(Text, sizeof(Text), 1) > 0);
+  TEST_CHECK(strstr(Text, "TestDump 3") != NULL);
+  TEST_CHECK(Dump(Text, sizeof(Text), 1) == 0);
+  loopstats_close(S);
+}
+
+int main(void)
+{
+  TEST_RUN(TestSlots);
+  TEST_RUN(TestStalls);
+  TEST_RUN(TestDump);
+
+  return TEST_RESULT();
+}
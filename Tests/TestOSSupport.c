@@ -0,0 +1,267 @@
+/**
+  ******************************************************************************
+  * @file    TestOSSupport.c
+  * @author  Javier Fernandez Cepeda
+  * @brief   Unit tests of the pThread backend of OSSupport.
+  *
+  *******************************************************************************
+  * Copyright (c) 2015, Javier Fernandez. All rights reserved.
+  *******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include <unistd.h>
+#include "TestUtils.h"
+#include "OSSupport.h"
+
+/* Private define ------------------------------------------------------------*/
+#define TEST_TIMERS	200
+
+/* Private function prototypes -----------------------------------------------*/
+OS_THREAD_TYPE TestThread (OS_THREAD_ARG argument);
+DEFINE_THREAD(TestThread, osPriorityHigh, 1, 0);
+static void TestTimerCallback(void const *arg);
+static DEFINE_TIMER(TestTimer, TestTimerCallback);
+
+/* Private variables ---------------------------------------------------------*/
+static MUTEX_ID TestMutex;
+static OSRetValue WaiterRet;
+static uint32_t WaiterTimeout;
+static volatile int TimerRuns[TEST_TIMERS];
+
+/* Private functions ---------------------------------------------------------*/
+OS_THREAD_TYPE TestThread (OS_THREAD_ARG argument)
+{
+  *((int *)argument) += 1;
+  return NULL;
+}
+
+static void TestTimerCallback(void const *arg)
+{
+  TimerRuns[*(const int *)arg]++;
+}
+
+static void *Waiter(void *arg)
+{
+  (void)arg;
+  WaiterRet = MutexWaitTimeout(TestMutex, WaiterTimeout);
+  if (WaiterRet == OS_OK)
+    MutexRelease(TestMutex);
+  return NULL;
+}
+
+static OSRetValue WaitFromThread(uint32_t millisec)
+{
+  pthread_t Thread;
+
+  WaiterTimeout = millisec;
+  pthread_create(&Thread, NULL, Waiter, NULL);
+  pthread_join(Thread, NULL);
+  return WaiterRet;
+}
+
+/**
+  * @brief Threads are created from their definition whatever the privileges
+  *        of the process: real time attributes are dropped if refused.
+  */
+static void TestThreadCreate(void)
+{
+  THREAD_ID ThreadID;
+  int32_t FuncRet;
+  int Runs = 0;
+  int i;
+
+  for (i = 0; i < 2; i++)
+  {
+    CreateThread(FuncRet, ThreadID, THREAD_REF(TestThread), &Runs);
+    TEST_ASSERT(FuncRet);
+    pthread_join(ThreadID, NULL);
+  }
+  TEST_CHECK(Runs == 2);
+}
+
+/**
+  * @brief Uncontended waits are counted as acquisitions only.
+  */
+static void TestMutexUncontended(void)
+{
+  OSMutexStats Stats;
+  int32_t FuncRet;
+  int i;
+
+  CreateMutex(FuncRet, TestMutex, MUTEX_REF(TestMutex));
+  TEST_ASSERT(FuncRet);
+
+  for (i = 0; i < 3; i++)
+  {
+    TEST_CHECK(MutexWait(TestMutex) == OS_OK);
+    MutexRelease(TestMutex);
+  }
+
+  MutexGetStats(TestMutex, &Stats, 1);
+  TEST_CHECK(Stats.Acquisitions == 3);
+  TEST_CHECK(Stats.Contended == 0);
+  TEST_CHECK(Stats.Timeouts == 0);
+
+  MutexGetStats(TestMutex, &Stats, 0);
+  TEST_CHECK(Stats.Acquisitions == 0);
+}
+
+/**
+  * @brief A taken mutex makes timed waits expire instead of failing at once.
+  */
+static void TestMutexTimeout(void)
+{
+  OSMutexStats Stats;
+  uint32_t Start;
+
+  TEST_CHECK(MutexWait(TestMutex) == OS_OK);
+
+  TEST_CHECK(WaitFromThread(0) == OS_TIMEOUT);
+  Start = OSGetTick();
+  TEST_CHECK(WaitFromThread(30) == OS_TIMEOUT);
+  TEST_CHECK(OS_TICKS_TO_MS(OSGetTick() - Start) >= 25);
+
+  MutexRelease(TestMutex);
+  TEST_CHECK(WaitFromThread(30) == OS_OK);
+
+  MutexGetStats(TestMutex, &Stats, 1);
+  TEST_CHECK(Stats.Timeouts == 2);
+  TEST_CHECK(Stats.Acquisitions == 2);
+}
+
+/**
+  * @brief A wait that finds the mutex taken blocks until it is released and
+  *        its waiting time is accounted.
+  */
+static void TestMutexContended(void)
+{
+  OSMutexStats Stats;
+  pthread_t Thread;
+
+  TEST_CHECK(MutexWait(TestMutex) == OS_OK);
+  WaiterTimeout = OS_WAIT_FOREVER;
+  pthread_create(&Thread, NULL, Waiter, NULL);
+  usleep(20000);
+  MutexRelease(TestMutex);
+  pthread_join(Thread, NULL);
+  TEST_CHECK(WaiterRet == OS_OK);
+
+  MutexGetStats(TestMutex, &Stats, 1);
+  TEST_CHECK(Stats.Acquisitions == 2);
+  TEST_CHECK(Stats.Contended == 1);
+  TEST_CHECK(Stats.WaitTimeUs >= 10000);
+}
+
+/**
+  * @brief One shot timers run once, periodic ones until they are stopped.
+  */
+static void TestTimerModes(void)
+{
+  static int Index[2] = { 0, 1 };
+  TIMER_ID Once, Periodic;
+  OSRetValue Ret;
+  int Runs;
+
+  TimerRuns[0] = TimerRuns[1] = 0;
+  Once = CreateTimer(TIMER_REF(TestTimer), osTimerOnce, &Index[0]);
+  Periodic = CreateTimer(TIMER_REF(TestTimer), osTimerPeriodic, &Index[1]);
+  TEST_ASSERT(Once != NULL && Periodic != NULL);
+
+  TimerStart(Ret, Once, 10);
+  TEST_CHECK(Ret == OS_OK);
+  TimerStart(Ret, Periodic, 10);
+  TEST_CHECK(Ret == OS_OK);
+  usleep(105000);
+  TimerStop(Ret, Periodic);
+  TEST_CHECK(Ret == OS_OK);
+  TimerStop(Ret, Once);
+  TEST_CHECK(Ret == OS_ERROR);
+
+  Runs = TimerRuns[1];
+  TEST_CHECK(TimerRuns[0] == 1);
+  TEST_CHECK(Runs >= 6 && Runs <= 11);
+  usleep(30000);
+  TEST_CHECK(TimerRuns[1] == Runs);
+
+  TimerDelete(Once);
+  TimerDelete(Periodic);
+}
+
+/**
+  * @brief A restart moves the expiry instead of adding a second one.
+  */
+static void TestTimerRestart(void)
+{
+  static int Index = 0;
+  TIMER_ID Timer;
+  OSRetValue Ret;
+  int i;
+
+  TimerRuns[0] = 0;
+  Timer = CreateTimer(TIMER_REF(TestTimer), osTimerOnce, &Index);
+  TEST_ASSERT(Timer != NULL);
+  for (i = 0; i < 5; i++)
+  {
+    TimerStart(Ret, Timer, 30);
+    TEST_CHECK(Ret == OS_OK);
+    usleep(10000);
+  }
+  TEST_CHECK(TimerRuns[0] == 0);
+  usleep(40000);
+  TEST_CHECK(TimerRuns[0] == 1);
+  TimerDelete(Timer);
+}
+
+/**
+  * @brief Timers expiring together are served from a single wake up.
+  */
+static void TestTimerBatch(void)
+{
+  static int Index[TEST_TIMERS];
+  TIMER_ID Timers[TEST_TIMERS];
+  OSTimerStats Stats;
+  OSRetValue Ret;
+  int i, Total = 0;
+
+  TimerGetStats(&Stats, 1);
+  for (i = 0; i < TEST_TIMERS; i++)
+  {
+    Index[i] = i;
+    TimerRuns[i] = 0;
+    Timers[i] = CreateTimer(TIMER_REF(TestTimer), osTimerPeriodic, &Index[i]);
+    TEST_ASSERT(Timers[i] != NULL);
+  }
+  /* Same period, started back to back: their expiries are microseconds apart */
+  for (i = 0; i < TEST_TIMERS; i++)
+  {
+    TimerStart(Ret, Timers[i], 20);
+    TEST_CHECK(Ret == OS_OK);
+  }
+  usleep(110000);
+  for (i = 0; i < TEST_TIMERS; i++)
+  {
+    TimerStop(Ret, Timers[i]);
+    TEST_CHECK(Ret == OS_OK);
+    TimerDelete(Timers[i]);
+    Total += TimerRuns[i];
+  }
+
+  TimerGetStats(&Stats, 1);
+  TEST_CHECK(Stats.Expirations == (uint32_t)Total);
+  TEST_CHECK(Total >= 4 * TEST_TIMERS);
+  TEST_CHECK(Stats.Wakeups * 10 < Stats.Expirations);
+}
+
+int main(void)
+{
+  TEST_RUN(TestThreadCreate);
+  TEST_RUN(TestMutexUncontended);
+  TEST_RUN(TestMutexTimeout);
+  TEST_RUN(TestMutexContended);
+  TEST_RUN(TestTimerModes);
+  TEST_RUN(TestTimerRestart);
+  TEST_RUN(TestTimerBatch);
+
+  return TEST_RESULT();
+}
@@ -0,0 +1,190 @@
+/**
+  ******************************************************************************
+  * @file    TestPqueue.c
+  * @author  Javier Fernandez Cepeda
+  * @brief   Unit tests of the pThread mail queue (TOOLS/pqueue).
+  *
+  *******************************************************************************
+  * Copyright (c) 2015, Javier Fernandez. All rights reserved.
+  *******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+#include "TestUtils.h"
+#include "TOOLS/pqueue.h"
+
+/* Private variables ---------------------------------------------------------*/
+static int Items[8] = {0, 1, 2, 3, 4, 5, 6, 7};
+
+/* Private functions ---------------------------------------------------------*/
+
+/**
+  * @brief Elements of the same lane are served in FIFO order.
+  */
+static void TestFifo(void)
+{
+  pqueue q;
+  int i;
+
+  pqueue_init(&q);
+  for (i = 0; i < 4; i++)
+    pqueue_push(&q, &Items[i]);
+
+  TEST_CHECK(pqueue_size(&q) == 4);
+  for (i = 0; i < 4; i++)
+    TEST_CHECK(pqueue_pop_nonb(&q) == &Items[i]);
+  TEST_CHECK(pqueue_pop_nonb(&q) == NULL);
+  TEST_CHECK(pqueue_size(&q) == 0);
+}
+
+/**
+  * @brief Higher lanes overtake lower lanes.
+  */
+static void TestStrictPriority(void)
+{
+  pqueue q;
+
+  pqueue_init(&q);
+  pqueue_push_prio(&q, &Items[0], PQUEUE_LANE_BULK);
+  pqueue_push_prio(&q, &Items[1], PQUEUE_LANE_REALTIME);
+  pqueue_push_prio(&q, &Items[2], PQUEUE_LANE_CONTROL);
+  pqueue_push_front(&q, &Items[3]);
+
+  TEST_CHECK(pqueue_lane_size(&q, PQUEUE_LANE_CONTROL) == 2);
+  TEST_CHECK(pqueue_pop_nonb(&q) == &Items[3]);
+  TEST_CHECK(pqueue_pop_nonb(&q) == &Items[2]);
+  TEST_CHECK(pqueue_pop_nonb(&q) == &Items[1]);
+  TEST_CHECK(pqueue_pop_nonb(&q) == &Items[0]);
+}
+
+/**
+  * @brief A weighted lane lets the lower lanes in once per turn.
+  */
+static void TestWeights(void)
+{
+  pqueue q;
+  const int Weights[PQUEUE_LANES] = {2, 0, 0};
+
+  pqueue_init(&q);
+  pqueue_set_weights(&q, Weights);
+  pqueue_push_prio(&q, &Items[0], PQUEUE_LANE_CONTROL);
+  pqueue_push_prio(&q, &Items[1], PQUEUE_LANE_CONTROL);
+  pqueue_push_prio(&q, &Items[2], PQUEUE_LANE_CONTROL);
+  pqueue_push_prio(&q, &Items[3], PQUEUE_LANE_BULK);
+
+  TEST_CHECK(pqueue_pop_nonb(&q) == &Items[0]);
+  TEST_CHECK(pqueue_pop_nonb(&q) == &Items[1]);
+  TEST_CHECK(pqueue_pop_nonb(&q) == &Items[3]);
+  TEST_CHECK(pqueue_pop_nonb(&q) == &Items[2]);
+}
+
+/**
+  * @brief The timed pop returns NULL once the timeout expires.
+  */
+static void TestTimedPop(void)
+{
+  pqueue q;
+  struct timespec t0, t1;
+  long ElapsedMs;
+
+  pqueue_init(&q);
+  clock_gettime(CLOCK_MONOTONIC, &t0);
+  TEST_CHECK(pqueue_pop_timed(&q, 20) == NULL);
+  clock_gettime(CLOCK_MONOTONIC, &t1);
+  ElapsedMs = (t1.tv_sec - t0.tv_sec) * 1000 + (t1.tv_nsec - t0.tv_nsec) / 1000000;
+  TEST_CHECK(ElapsedMs >= 19);
+
+  pqueue_push(&q, &Items[5]);
+  TEST_CHECK(pqueue_pop_timed(&q, 1000) == &Items[5]);
+}
+
+/**
+  * @brief The eventfd is readable only while the queue holds elements.
+  */
+static void TestEventFd(void)
+{
+  pqueue q;
+  struct pollfd pfd;
+
+  pqueue_init(&q);
+  pqueue_push(&q, &Items[0]);
+  pfd.fd = pqueue_eventfd(&q);
+  pfd.events = POLLIN;
+#ifdef __linux__
+  TEST_ASSERT(pfd.fd >= 0);
+  TEST_CHECK(poll(&pfd, 1, 0) == 1);
+  pqueue_pop(&q);
+  TEST_CHECK(poll(&pfd, 1, 0) == 0);
+  pqueue_release(&q);
+  TEST_CHECK(poll(&pfd, 1, 0) == 1);
+  /* Pending elements are dropped with the queue */
+  pqueue_push(&q, &Items[1]);
+  pqueue_destroy(&q);
+  TEST_CHECK(fcntl(pfd.fd, F_GETFD) == -1);
+#else
+  TEST_CHECK(pfd.fd == -1);
+  pqueue_destroy(&q);
+#endif
+}
+
+/**
+  * @brief Held lanes keep their elements: only the control lane is served and
+  *        waited on until they are released, in order.
+  */
+static void TestHold(void)
+{
+  pqueue q;
+  struct pollfd pfd;
+  int i;
+
+  pqueue_init(&q);
+  pfd.fd = pqueue_eventfd(&q);
+  pfd.events = POLLIN;
+  for (i = 0; i < 3; i++)
+    pqueue_push_prio(&q, &Items[i], PQUEUE_LANE_REALTIME);
+  pqueue_hold(&q, PQUEUE_LANE_REALTIME);
+  pqueue_push_prio(&q, &Items[3], PQUEUE_LANE_BULK);
+
+  TEST_CHECK(pqueue_size(&q) == 4);
+  TEST_CHECK(pqueue_pop_nonb(&q) == NULL);
+  TEST_CHECK(pqueue_pop_timed(&q, 10) == NULL);
+#ifdef __linux__
+  TEST_CHECK(poll(&pfd, 1, 0) == 0);
+#endif
+
+  pqueue_push_prio(&q, &Items[4], PQUEUE_LANE_CONTROL);
+#ifdef __linux__
+  TEST_CHECK(poll(&pfd, 1, 0) == 1);
+#endif
+  TEST_CHECK(pqueue_pop_nonb(&q) == &Items[4]);
+#ifdef __linux__
+  TEST_CHECK(poll(&pfd, 1, 0) == 0);
+#endif
+
+  pqueue_hold(&q, PQUEUE_LANES);
+#ifdef __linux__
+  TEST_CHECK(poll(&pfd, 1, 0) == 1);
+#endif
+  for (i = 0; i < 4; i++)
+    TEST_CHECK(pqueue_pop_nonb(&q) == &Items[i]);
+  TEST_CHECK(pqueue_pop_nonb(&q) == NULL);
+#ifdef __linux__
+  TEST_CHECK(poll(&pfd, 1, 0) == 0);
+#endif
+  pqueue_destroy(&q);
+}
+
+int main(void)
+{
+  TEST_RUN(TestFifo);
+  TEST_RUN(TestStrictPriority);
+  TEST_RUN(TestWeights);
+  TEST_RUN(TestTimedPop);
+  TEST_RUN(TestEventFd);
+  TEST_RUN(TestHold);
+
+  return TEST_RESULT();
+}
@@ -0,0 +1,141 @@
+/**
+  ******************************************************************************
+  * @file    TestProtothreads.c
+  * @author  Javier Fernandez Cepeda
+  * @brief   Unit tests of the protothreads used by the bus tasks (TOOLS/pt).
+  *
+  *******************************************************************************
+  * Copyright (c) 2015, Javier Fernandez. All rights reserved.
+  *******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "TestUtils.h"
+#include "TOOLS/pt.h"
+
+/* Private typedef -----------------------------------------------------------*/
+typedef struct
+{
+  struct pt Pt;
+  int Input;		/* Items waiting for the task */
+  int Served;		/* Items taken by the task */
+  int Steps;		/* Code run after a wait point */
+}TestTask;
+
+/* Private functions ---------------------------------------------------------*/
+static PT_THREAD(Consumer(TestTask *Task))
+{
+  PT_BEGIN(&Task->Pt);
+
+  while (1)
+  {
+    PT_WAIT_UNTIL(&Task->Pt, Task->Input > 0);
+    Task->Input--;
+    Task->Served++;
+    PT_YIELD(&Task->Pt);
+    Task->Steps++;
+  }
+
+  PT_END(&Task->Pt);
+}
+
+static PT_THREAD(Counter(TestTask *Task))
+{
+  PT_BEGIN(&Task->Pt);
+
+  Task->Steps++;
+  PT_YIELD(&Task->Pt);
+  Task->Steps++;
+  if (Task->Input < 0)
+    PT_EXIT(&Task->Pt);
+  PT_YIELD(&Task->Pt);
+  Task->Steps++;
+
+  PT_END(&Task->Pt);
+}
+
+/**
+  * @brief A task waits without running until its condition holds, and goes
+  *        on from its wait point.
+  */
+static void TestWaitUntil(void)
+{
+  TestTask Task = {{0}, 0, 0, 0};
+
+  PT_INIT(&Task.Pt);
+  TEST_CHECK(Consumer(&Task) == PT_WAITING);
+  TEST_CHECK(Consumer(&Task) == PT_WAITING);
+  TEST_CHECK(Task.Served == 0);
+
+  Task.Input = 2;
+  TEST_CHECK(Consumer(&Task) == PT_YIELDED);
+  TEST_CHECK(Task.Served == 1 && Task.Steps == 0);
+  TEST_CHECK(Consumer(&Task) == PT_YIELDED);
+  TEST_CHECK(Task.Served == 2 && Task.Steps == 1);
+  TEST_CHECK(Consumer(&Task) == PT_WAITING);
+  TEST_CHECK(Task.Served == 2 && Task.Steps == 2);
+}
+
+/**
+  * @brief Each yield returns once; the task ends or exits and restarts.
+  */
+static void TestYieldAndEnd(void)
+{
+  TestTask Task = {{0}, 0, 0, 0};
+
+  PT_INIT(&Task.Pt);
+  TEST_CHECK(Counter(&Task) == PT_YIELDED);
+  TEST_CHECK(Counter(&Task) == PT_YIELDED);
+  TEST_CHECK(PT_SCHEDULE(Counter(&Task)) == 0);
+  TEST_CHECK(Task.Steps == 3);
+
+  /* Restarts from PT_BEGIN */
+  TEST_CHECK(Counter(&Task) == PT_YIELDED);
+  TEST_CHECK(Task.Steps == 4);
+
+  Task.Input = -1;
+  TEST_CHECK(Counter(&Task) == PT_EXITED);
+  TEST_CHECK(Task.Steps == 5);
+  TEST_CHECK(Counter(&Task) == PT_YIELDED);
+  TEST_CHECK(Task.Steps == 6);
+}
+
+/**
+  * @brief Tasks sharing the caller stack are served in turn by a scheduler.
+  */
+static void TestRoundRobin(void)
+{
+  TestTask Tasks[4];
+  int i, Round, Progress;
+
+  for (i = 0; i < 4; i++)
+  {
+    PT_INIT(&Tasks[i].Pt);
+    Tasks[i].Input = i * 10;
+    Tasks[i].Served = 0;
+    Tasks[i].Steps = 0;
+  }
+
+  for (Round = 0; Round < 100; Round++)
+  {
+    Progress = 0;
+    for (i = 0; i < 4; i++)
+      Progress |= (Consumer(&Tasks[i]) != PT_WAITING);
+    if (!Progress)
+      break;
+  }
+
+  /* Longest task: one item per round plus the idle round */
+  TEST_CHECK(Round == 30);
+  for (i = 0; i < 4; i++)
+    TEST_CHECK(Tasks[i].Served == i * 10 && Tasks[i].Input == 0);
+}
+
+int main(void)
+{
+  TEST_RUN(TestWaitUntil);
+  TEST_RUN(TestYieldAndEnd);
+  TEST_RUN(TestRoundRobin);
+
+  return TEST_RESULT();
+}
@@ -0,0 +1,809 @@
+/**
+  ******************************************************************************
+  * @file    TestSocketLoopback.c
+  * @author  Javier Fernandez Cepeda
+  * @brief   End to end test of the host daemon: a client connects to the
+  *	     socket interface and reads and writes dictionary registers.
+  *	     Built with OS_ACTIVE = 0 the daemon is the super loop, run by a
+  *	     background thread as it would run on its own MCU.
+  *
+  *******************************************************************************
+  * Copyright (c) 2015, Javier Fernandez. All rights reserved.
+  *******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include "TestUtils.h"
+#include "SysConfig.h"
+#include "APPLAYER/Communication/BUSApp.h"
+#include "APPLAYER/Communication/MBAApp.h"
+#include "MBALibrary/MBAProtocols/MBATransferProtocol.h"
+#include "MBALibrary/MBADictionary/MBADictionary.h"
+#include "PHDLLAYER/BUSAPI/BUSAPI.h"
+#include "TOOLS/crc16.h"
+#include "TOOLS/latstats.h"
+#include "TOOLS/MemoryManagement.h"
+
+/* Private define ------------------------------------------------------------*/
+#define SOCKET_PORT		10005	/*!< Port of the socket interface */
+#define SOCKET_INTERFACE	(AVAILABLE_INTERFACES - 1) /*!< The socket is the last interface */
+#define NODE_ID			2	/*!< Logical ID of the node under test */
+#define REMOTE_ID		5	/*!< Logical ID of the client */
+#define GROUP_ID		12	/*!< Logical ID of a group */
+#define FLOOD_FRAMES		40000	/*!< Echoes of the flood test */
+#define FLOOD_DATA		200	/*!< Data of each of them */
+#define FLOW_BACKLOG		100	/*!< Echoes queued without credit */
+
+/* Private variables ---------------------------------------------------------*/
+#if OS_ACTIVE == 0
+static volatile int SuperLoopRunning = 1;
+#endif
+static int DaemonFd = -1;	/*!< The socket interface serves a single client */
+#if (OS_ACTIVE != 0) && (BUS_TASK_MODEL == 0)
+static uint8_t FloodStream[FLOOD_FRAMES * (HEADER_SIZE + FLOOD_DATA + CRC_SIZE)];
+static uint8_t FloodRep[sizeof(FloodStream)];
+static ssize_t FloodWritten;
+#endif
+
+/* Private functions ---------------------------------------------------------*/
+#if OS_ACTIVE == 0
+/**
+  * @brief  Same start up sequence and loop than main.c.
+  */
+static void *SuperLoop(void *arg)
+{
+  (void)arg;
+  OS_INIT();
+  InitBUSProcess();
+  InitMBAProcess();
+  while (SuperLoopRunning)
+  {
+    BUSProcessStep();
+    MBAProcessStep();
+  }
+  return NULL;
+}
+#endif
+
+/**
+  * @brief  Writes the checksum of a MBA bridge frame.
+  * @param  Frame Frame, checksum included
+  * @param  Size  Frame size
+  */
+static void SetChecksum(uint8_t *Frame, size_t Size)
+{
+  uint16_t Crc = crc16(Frame, Size - CRC_SIZE);
+
+  Frame[Size - 2] = (uint8_t)(Crc & 0xFF);
+  Frame[Size - 1] = (uint8_t)(Crc >> 8);
+}
+
+/**
+  * @brief  Connects to the socket interface of the daemon.
+  * @retval Socket descriptor or -1
+  */
+static int ConnectToDaemon(void)
+{
+  struct sockaddr_in Addr;
+  struct timeval Timeout = {5, 0};
+  int Fd, Retries;
+
+  memset(&Addr, 0, sizeof(Addr));
+  Addr.sin_family = AF_INET;
+  Addr.sin_port = htons(SOCKET_PORT);
+  Addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+
+  /* The bus thread may not be listening yet */
+  for (Retries = 0; Retries < 200; Retries++)
+  {
+    Fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (connect(Fd, (struct sockaddr *)&Addr, sizeof(Addr)) == 0)
+    {
+      setsockopt(Fd, SOL_SOCKET, SO_RCVTIMEO, &Timeout, sizeof(Timeout));
+      return Fd;
+    }
+    close(Fd);
+    usleep(10000);
+  }
+  return -1;
+}
+
+/**
+  * @brief The device ID register is read through the socket interface.
+  */
+static void TestConfigReadThroughSocket(void)
+{
+  uint8_t Req[HEADER_SIZE + 3 + CRC_SIZE] =
+  {
+    SetLogicalId(NODE_ID) | SOCKET_INTERFACE, CONFIG_COMMAND, 3, 0,
+    SetLogicalId(REMOTE_ID), 0, 0, 0, 0, 0,
+    0x00, 0x0F, READ_DATA,
+    0, 0
+  };
+  uint8_t Rep[64];
+  ssize_t Size;
+  int Fd = DaemonFd;
+
+  SetChecksum(Req, sizeof(Req));
+  TEST_ASSERT(write(Fd, Req, sizeof(Req)) == (ssize_t)sizeof(Req));
+  Size = read(Fd, Rep, sizeof(Rep));
+
+  TEST_ASSERT(Size == HEADER_SIZE + 4 + CRC_SIZE);
+  TEST_CHECK(Rep[0] == SetLogicalId(REMOTE_ID));
+  TEST_CHECK(Rep[1] == CONFIG_COMMAND);
+  TEST_CHECK(Rep[4] == (SetLogicalId(NODE_ID) | SOCKET_INTERFACE));
+  TEST_CHECK(Rep[HEADER_SIZE + 3] == NODE_ID);
+  TEST_CHECK(GetBufChecksum(Rep, 4) == crc16(Rep, HEADER_SIZE + 4));
+}
+
+/**
+  * @brief A transfer frame for the socket interface of the node is bridged
+  *        back to the socket as it came.
+  */
+static void TestTransferEcho(void)
+{
+  uint8_t Req[HEADER_SIZE + 4 + CRC_SIZE] =
+  {
+    SetLogicalId(NODE_ID) | SOCKET_INTERFACE, TRANSFER_COMMAND, 4, 0,
+    SetLogicalId(REMOTE_ID), 0, 0, 0, 0, 0,
+    0xDE, 0xAD, 0xBE, 0xEF,
+    0, 0
+  };
+  uint8_t Rep[64];
+  ssize_t Size;
+  int Fd = DaemonFd;
+
+  SetChecksum(Req, sizeof(Req));
+  TEST_ASSERT(write(Fd, Req, sizeof(Req)) == (ssize_t)sizeof(Req));
+  Size = read(Fd, Rep, sizeof(Rep));
+
+  TEST_ASSERT(Size == (ssize_t)sizeof(Req));
+  TEST_CHECK(memcmp(Rep, Req, sizeof(Req)) == 0);
+}
+
+/**
+  * @brief  Reads from the daemon until Size bytes have come.
+  * @retval Bytes read
+  */
+static ssize_t ReadAll(int Fd, uint8_t *Buf, size_t Size)
+{
+  ssize_t Got = 0, Ret;
+
+  while ((size_t)Got < Size)
+  {
+    Ret = read(Fd, Buf + Got, Size - Got);
+    if (Ret <= 0)
+      break;
+    Got += Ret;
+  }
+  return Got;
+}
+
+/**
+  * @brief Frames are split out of the stream by their size: several frames
+  *        in one write and a frame across two writes are all answered.
+  */
+static void TestStreamedFrames(void)
+{
+  uint8_t Stream[4 * (HEADER_SIZE + 6 + CRC_SIZE)];
+  uint8_t Rep[sizeof(Stream)];
+  uint8_t *Frame;
+  size_t FrameSize = HEADER_SIZE + 6 + CRC_SIZE;
+  int Fd = DaemonFd;
+  int NoDelay = 1, i;
+
+  setsockopt(Fd, IPPROTO_TCP, TCP_NODELAY, &NoDelay, sizeof(NoDelay));
+  for (i = 0; i < 4; i++)
+  {
+    Frame = Stream + i * FrameSize;
+    memset(Frame, 0, FrameSize);
+    Frame[0] = SetLogicalId(NODE_ID) | SOCKET_INTERFACE;
+    Frame[1] = TRANSFER_COMMAND;
+    Frame[2] = 6;
+    Frame[4] = SetLogicalId(REMOTE_ID);
+    memset(Frame + HEADER_SIZE, 0x10 * (i + 1), 6);
+    SetChecksum(Frame, FrameSize);
+  }
+
+  /* Three frames and the header of the fourth, then the rest of it */
+  TEST_ASSERT(write(Fd, Stream, 3 * FrameSize + HEADER_SIZE) == (ssize_t)(3 * FrameSize + HEADER_SIZE));
+  usleep(5000);
+  TEST_ASSERT(write(Fd, Stream + 3 * FrameSize + HEADER_SIZE, FrameSize - HEADER_SIZE) ==
+              (ssize_t)(FrameSize - HEADER_SIZE));
+
+  TEST_ASSERT(ReadAll(Fd, Rep, sizeof(Rep)) == (ssize_t)sizeof(Rep));
+  TEST_CHECK(memcmp(Rep, Stream, sizeof(Stream)) == 0);
+}
+
+/**
+  * @brief A frame with a wrong checksum is dropped: only the next, good one
+  *        is answered.
+  */
+static void TestCorruptFrameDropped(void)
+{
+  uint8_t Bad[HEADER_SIZE + 3 + CRC_SIZE] =
+  {
+    SetLogicalId(NODE_ID) | SOCKET_INTERFACE, CONFIG_COMMAND, 3, 0,
+    SetLogicalId(REMOTE_ID), 0, 0, 0, 0, 0,
+    0x00, 0x0F, READ_DATA,
+    0, 0
+  };
+  uint8_t Req[HEADER_SIZE + 2 + CRC_SIZE] =
+  {
+    SetLogicalId(NODE_ID) | SOCKET_INTERFACE, TRANSFER_COMMAND, 2, 0,
+    SetLogicalId(REMOTE_ID), 0, 0, 0, 0, 0,
+    0xC0, 0xDE,
+    0, 0
+  };
+  uint8_t Rep[64];
+  ssize_t Size;
+  int Fd = DaemonFd;
+
+  SetChecksum(Bad, sizeof(Bad));
+  Bad[HEADER_SIZE + 1] ^= 0x01;
+  SetChecksum(Req, sizeof(Req));
+
+  TEST_ASSERT(write(Fd, Bad, sizeof(Bad)) == (ssize_t)sizeof(Bad));
+  usleep(20000);
+  TEST_ASSERT(write(Fd, Req, sizeof(Req)) == (ssize_t)sizeof(Req));
+  Size = read(Fd, Rep, sizeof(Rep));
+
+  TEST_ASSERT(Size == (ssize_t)sizeof(Req));
+  TEST_CHECK(memcmp(Rep, Req, sizeof(Req)) == 0);
+}
+
+/**
+  * @brief  Reads a register of the daemon.
+  * @retval Register size, or -1 if there is no valid reply
+  */
+static int ReadRegister(int Fd, uint16_t RegisterID, uint32_t *Value)
+{
+  uint8_t Req[HEADER_SIZE + 3 + CRC_SIZE] =
+  {
+    SetLogicalId(NODE_ID) | SOCKET_INTERFACE, CONFIG_COMMAND, 3, 0,
+    SetLogicalId(REMOTE_ID), 0, 0, 0, 0, 0,
+    (uint8_t)RegisterID, (uint8_t)(RegisterID >> 8), READ_DATA,
+    0, 0
+  };
+  uint8_t Rep[64];
+  ssize_t Size;
+  int i;
+
+  SetChecksum(Req, sizeof(Req));
+  if (write(Fd, Req, sizeof(Req)) != (ssize_t)sizeof(Req))
+    return -1;
+  Size = read(Fd, Rep, sizeof(Rep)) - (HEADER_SIZE + 3 + CRC_SIZE);
+  if (Size < 0 || Size > 4)
+    return -1;
+  *Value = 0;
+  for (i = 0; i < Size; i++)
+    *Value |= (uint32_t)Rep[HEADER_SIZE + 3 + i] << (8 * i);
+  return (int)Size;
+}
+
+/**
+  * @brief The node is ready once its required interfaces are up, and reports
+  *        the time each one took.
+  */
+static void TestBringUp(void)
+{
+  uint16_t Base = (uint16_t)((SOCKET_INTERFACE + 1) << 12);
+  uint32_t Ready, Required, InitTime;
+
+#if OS_ACTIVE != 0
+  TEST_CHECK(BUSWaitReady(1000) == 1);
+#endif
+  TEST_ASSERT(ReadRegister(DaemonFd, 0x0F21, &Required) == 2);
+  TEST_ASSERT(ReadRegister(DaemonFd, 0x0F20, &Ready) == 2);
+  TEST_CHECK(Required == BUS_REQUIRED_INTERFACES);
+  TEST_CHECK((Ready & Required) == Required);
+  TEST_CHECK(BUSReady() == 1);
+
+  /* Includes the wait for this client */
+  TEST_CHECK(ReadRegister(DaemonFd, Base | 0x0005, &InitTime) == 4);
+  TEST_CHECK(InitTime < 30000);
+}
+
+#if (OS_ACTIVE != 0) && defined(LOOP_STATS) && (LOOP_STATS > 0)
+/**
+  * @brief The stall threshold of the thread loops is published.
+  */
+static void TestLoopStatsRegisters(void)
+{
+  uint32_t Threshold;
+
+  TEST_ASSERT(ReadRegister(DaemonFd, LOOP_STALL_INDEX, &Threshold) == 4);
+  TEST_CHECK(Threshold == LOOP_STALL_US);
+}
+#endif
+
+/**
+  * @brief  Reads a register of the daemon of any size.
+  * @retval Register size, or -1 if there is no valid reply
+  */
+static int ReadRegisterData(int Fd, uint16_t RegisterID, void *Data, size_t Size)
+{
+  uint8_t Req[HEADER_SIZE + 3 + CRC_SIZE] =
+  {
+    SetLogicalId(NODE_ID) | SOCKET_INTERFACE, CONFIG_COMMAND, 3, 0,
+    SetLogicalId(REMOTE_ID), 0, 0, 0, 0, 0,
+    (uint8_t)RegisterID, (uint8_t)(RegisterID >> 8), READ_DATA,
+    0, 0
+  };
+  uint8_t Rep[256];
+  ssize_t Read;
+
+  SetChecksum(Req, sizeof(Req));
+  if (write(Fd, Req, sizeof(Req)) != (ssize_t)sizeof(Req))
+    return -1;
+  Read = ReadAll(Fd, Rep, HEADER_SIZE + 3 + Size + CRC_SIZE);
+  if (Read < HEADER_SIZE + 3 + CRC_SIZE || GetBufFrameDataSize(Rep) != 3 + Size)
+    return -1;
+  memcpy(Data, &Rep[HEADER_SIZE + 3], Size);
+  return (int)Size;
+}
+
+/**
+  * @brief The frames written into the socket are counted in its latency
+  *        register, from their read to their write. The replies of the
+  *        MBA have every stage.
+  */
+static void TestLatencyRegister(void)
+{
+  uint16_t Base = (uint16_t)((SOCKET_INTERFACE + 1) << 12);
+  latstats Latency;
+  uint32_t Frames = 0, i;
+
+  TEST_ASSERT(ReadRegisterData(DaemonFd, Base | 0x0007, &Latency, sizeof(Latency)) ==
+              (int)sizeof(Latency));
+  TEST_CHECK(Latency.frames >= 5);
+  TEST_CHECK(Latency.staged > 0 && Latency.staged <= Latency.frames);
+  for (i = 0; i < LATSTATS_BUCKETS; i++)
+    Frames += Latency.buckets[i];
+  TEST_CHECK(Frames == Latency.frames);
+  TEST_CHECK(Latency.max_us < 1000000);
+  for (i = 0; i < LATSTATS_STAGES; i++)
+    TEST_CHECK(Latency.stage_max_us[i] <= Latency.max_us);
+}
+
+/**
+  * @brief  Writes a 16 bit register of the daemon.
+  * @retval 1 if the write has been acknowledged
+  */
+static int WriteRegister(int Fd, uint16_t RegisterID, uint16_t Value)
+{
+  uint8_t Req[HEADER_SIZE + 5 + CRC_SIZE] =
+  {
+    SetLogicalId(NODE_ID) | SOCKET_INTERFACE, CONFIG_COMMAND, 5, 0,
+    SetLogicalId(REMOTE_ID), 0, 0, 0, 0, 0,
+    (uint8_t)RegisterID, (uint8_t)(RegisterID >> 8), WRITE_DATA,
+    (uint8_t)Value, (uint8_t)(Value >> 8),
+    0, 0
+  };
+  uint8_t Rep[64];
+
+  SetChecksum(Req, sizeof(Req));
+  if (write(Fd, Req, sizeof(Req)) != (ssize_t)sizeof(Req))
+    return 0;
+  return read(Fd, Rep, sizeof(Rep)) == HEADER_SIZE + 3 + CRC_SIZE;
+}
+
+/**
+  * @brief A frame split in two writes is gathered when the interface detects
+  *        the end of frame by timeout.
+  */
+static void TestFrameTimeoutDetection(void)
+{
+  uint16_t Base = (uint16_t)((SOCKET_INTERFACE + 1) << 12);
+  uint8_t Req[HEADER_SIZE + 3 + CRC_SIZE] =
+  {
+    SetLogicalId(NODE_ID) | SOCKET_INTERFACE, CONFIG_COMMAND, 3, 0,
+    SetLogicalId(REMOTE_ID), 0, 0, 0, 0, 0,
+    0x00, 0x0F, READ_DATA,
+    0, 0
+  };
+  uint8_t Rep[64];
+  ssize_t Size;
+  int Fd = DaemonFd;
+  int NoDelay = 1;
+
+  /* Both parts of the frame must leave as they are written */
+  setsockopt(Fd, IPPROTO_TCP, TCP_NODELAY, &NoDelay, sizeof(NoDelay));
+
+  TEST_ASSERT(WriteRegister(Fd, Base | 0x0711, 20));
+  TEST_ASSERT(WriteRegister(Fd, Base | 0x0700, FRAME_DETECTION_TIMEOUT));
+
+  SetChecksum(Req, sizeof(Req));
+  TEST_ASSERT(write(Fd, Req, HEADER_SIZE) == HEADER_SIZE);
+  usleep(5000);
+  TEST_ASSERT(write(Fd, Req + HEADER_SIZE, sizeof(Req) - HEADER_SIZE) ==
+              (ssize_t)(sizeof(Req) - HEADER_SIZE));
+  Size = read(Fd, Rep, sizeof(Rep));
+
+  TEST_CHECK(Size == HEADER_SIZE + 4 + CRC_SIZE);
+  TEST_CHECK(Rep[HEADER_SIZE + 3] == NODE_ID);
+
+  /* The write ends by timeout too */
+  TEST_CHECK(WriteRegister(Fd, Base | 0x0700, FRAME_DETECTION_SIZE));
+}
+
+/**
+  * @brief A frame for a group with the socket interface as a member is sent
+  *        to the socket like a frame for a node behind it.
+  */
+static void TestGroupEcho(void)
+{
+  uint16_t Base = (uint16_t)((SOCKET_INTERFACE + 1) << 12);
+  uint8_t Req[HEADER_SIZE + 4 + CRC_SIZE] =
+  {
+    SetLogicalId(GROUP_ID), TRANSFER_COMMAND, 4, 0,
+    SetLogicalId(REMOTE_ID), 0, 0, 0, 0, 0,
+    0x12, 0x34, 0x56, 0x78,
+    0, 0
+  };
+  uint8_t Rep[sizeof(Req)];
+  uint32_t Value = 0;
+  int Fd = DaemonFd;
+
+  TEST_ASSERT(WriteRegister(Fd, Base | 0x000B, 1u << GROUP_ID));
+  TEST_CHECK(ReadRegister(Fd, Base | 0x000B, &Value) == 4 && Value == (1u << GROUP_ID));
+
+  SetChecksum(Req, sizeof(Req));
+  TEST_ASSERT(write(Fd, Req, sizeof(Req)) == (ssize_t)sizeof(Req));
+  TEST_ASSERT(ReadAll(Fd, Rep, sizeof(Rep)) == (ssize_t)sizeof(Rep));
+  TEST_CHECK(memcmp(Rep, Req, sizeof(Req)) == 0);
+
+  TEST_CHECK(WriteRegister(Fd, Base | 0x000B, 0));
+}
+
+/**
+  * @brief A frame sent in fragments is echoed whole, and with a fragment size
+  *        the echo comes in fragments that give the frame back.
+  */
+static void TestFragmentedEcho(void)
+{
+  uint16_t Base = (uint16_t)((SOCKET_INTERFACE + 1) << 12);
+  uint8_t Req[HEADER_SIZE + 200 + CRC_SIZE];
+  uint8_t Stream[sizeof(Req) + 3 * (HEADER_SIZE + CRC_SIZE)];
+  uint8_t *Fragment;
+  uint32_t Size, StreamSize = 0, FragmentSize, i;
+  TPReassembly Reassembly;
+  int Fd = DaemonFd;
+
+  memset(Req, 0, sizeof(Req));
+  Req[0] = SetLogicalId(NODE_ID) | SOCKET_INTERFACE;
+  Req[1] = TRANSFER_COMMAND;
+  Req[2] = 200;
+  Req[4] = SetLogicalId(REMOTE_ID);
+  for (i = 0; i < 200; i++)
+    Req[HEADER_SIZE + i] = (uint8_t)(i ^ 0xA5);
+  SetChecksum(Req, sizeof(Req));
+
+  /* 4 fragments of up to 64 bytes in a single write */
+  for (i = 0; (Size = TransferProtocolFragment(Stream + StreamSize, Req, i, 64)) != 0; i++)
+    StreamSize += Size;
+  TEST_ASSERT(i == 4 && StreamSize == sizeof(Stream));
+  TEST_ASSERT(write(Fd, Stream, StreamSize) == (ssize_t)StreamSize);
+  TEST_ASSERT(ReadAll(Fd, Stream, sizeof(Req)) == (ssize_t)sizeof(Req));
+  TEST_CHECK(memcmp(Stream, Req, sizeof(Req)) == 0);
+
+  TEST_ASSERT(WriteRegister(Fd, Base | 0x000C, 64));
+  TEST_ASSERT(write(Fd, Req, sizeof(Req)) == (ssize_t)sizeof(Req));
+  TEST_ASSERT(ReadAll(Fd, Stream, sizeof(Stream)) == (ssize_t)sizeof(Stream));
+  TransferProtocolReassemblyInit(&Reassembly, 0xFFFF);
+  for (StreamSize = 0, i = 0; i < 4; i++)
+  {
+    Size = HEADER_SIZE + GetBufFrameDataSize(Stream + StreamSize) + CRC_SIZE;
+    TEST_ASSERT(Size <= 64);
+    Fragment = (uint8_t *)MemAlloc(Size);
+    memcpy(Fragment, Stream + StreamSize, Size);
+    StreamSize += Size;
+    FragmentSize = Size;
+    TEST_CHECK(TransferProtocolReassemble(&Reassembly, &Fragment, &FragmentSize) == (i == 3));
+  }
+  TEST_CHECK(FragmentSize == sizeof(Req) && memcmp(Fragment, Req, sizeof(Req)) == 0);
+  MemFree(Fragment);
+
+  TEST_CHECK(WriteRegister(Fd, Base | 0x000C, 0));
+}
+
+#if OS_ACTIVE != 0
+/**
+  * @brief  Builds an echo frame for the socket interface.
+  */
+static void EchoFrame(uint8_t *Frame, uint8_t FlowControl, uint8_t Data)
+{
+  memset(Frame, 0, HEADER_SIZE + 2 + CRC_SIZE);
+  Frame[0] = SetLogicalId(NODE_ID) | SOCKET_INTERFACE;
+  Frame[1] = TRANSFER_COMMAND;
+  Frame[2] = 2;
+  Frame[4] = SetLogicalId(REMOTE_ID);
+  Frame[5] = FlowControl;
+  Frame[HEADER_SIZE] = Data;
+  Frame[HEADER_SIZE + 1] = Data;
+  SetChecksum(Frame, HEADER_SIZE + 2 + CRC_SIZE);
+}
+
+/**
+  * @brief With a flow window the node sends the client no more frames than
+  *        the limit it has been granted: the rest wait, in order, until a
+  *        credit frame moves the limit on. Each frame carries the limit the
+  *        node grants back.
+  */
+static void TestFlowControl(void)
+{
+  uint16_t Base = (uint16_t)((SOCKET_INTERFACE + 1) << 12);
+  uint8_t Req[HEADER_SIZE + 2 + CRC_SIZE];
+  uint8_t Credit[HEADER_SIZE + CRC_SIZE];
+  uint8_t Rep[sizeof(Req)];
+  struct pollfd Poll;
+  int Fd = DaemonFd;
+  int i;
+
+  /* The reply takes the first credit of the window */
+  TEST_ASSERT(WriteRegister(Fd, Base | 0x0008, 4));
+
+  /* Limit 5: four more frames */
+  for (i = 0; i < 3; i++)
+  {
+    EchoFrame(Req, TP_FLOW_CREDITS | 5, (uint8_t)i);
+    TEST_ASSERT(write(Fd, Req, sizeof(Req)) == (ssize_t)sizeof(Req));
+    TEST_ASSERT(ReadAll(Fd, Rep, sizeof(Rep)) == (ssize_t)sizeof(Rep));
+    TEST_CHECK(Rep[HEADER_SIZE] == i);
+    /* The limit granted moves on as the echoes leave the node */
+    TEST_CHECK(Rep[5] == (TP_FLOW_CREDITS | (4 + i)));
+  }
+  for (i = 3; i < 6; i++)
+  {
+    EchoFrame(Req, TP_FLOW_CREDITS | 5, (uint8_t)i);
+    TEST_ASSERT(write(Fd, Req, sizeof(Req)) == (ssize_t)sizeof(Req));
+  }
+  TEST_ASSERT(ReadAll(Fd, Rep, sizeof(Rep)) == (ssize_t)sizeof(Rep));
+  TEST_CHECK(Rep[HEADER_SIZE] == 3);
+
+  /* Out of credit: the other two wait */
+  Poll.fd = Fd;
+  Poll.events = POLLIN;
+  TEST_CHECK(poll(&Poll, 1, 100) == 0);
+
+  memset(Credit, 0, sizeof(Credit));
+  Credit[0] = SetLogicalId(NODE_ID) | SOCKET_INTERFACE;
+  Credit[1] = FLOW_CONTROL_COMMAND;
+  Credit[4] = SetLogicalId(REMOTE_ID);
+  Credit[5] = TP_FLOW_CREDITS | 7;
+  SetChecksum(Credit, sizeof(Credit));
+  TEST_ASSERT(write(Fd, Credit, sizeof(Credit)) == (ssize_t)sizeof(Credit));
+  for (i = 4; i < 6; i++)
+  {
+    TEST_ASSERT(ReadAll(Fd, Rep, sizeof(Rep)) == (ssize_t)sizeof(Rep));
+    TEST_CHECK(Rep[1] == TRANSFER_COMMAND && Rep[HEADER_SIZE] == i);
+  }
+
+  TEST_CHECK(WriteRegister(Fd, Base | 0x0008, 0));
+}
+
+/**
+  * @brief Reads the next frame that is not a credit frame.
+  */
+static int ReadDataFrame(int Fd, uint8_t *Frame, size_t Size)
+{
+  size_t DataSize;
+
+  do
+  {
+    if (ReadAll(Fd, Frame, HEADER_SIZE) != HEADER_SIZE)
+      return 0;
+    DataSize = Frame[2] | ((size_t)Frame[3] << 8);
+    if (HEADER_SIZE + DataSize + CRC_SIZE > Size)
+      return 0;
+    if (ReadAll(Fd, Frame + HEADER_SIZE, DataSize + CRC_SIZE) != (ssize_t)(DataSize + CRC_SIZE))
+      return 0;
+  } while (Frame[1] == FLOW_CONTROL_COMMAND);
+  return 1;
+}
+
+/**
+  * @brief Frames keep waiting for credit however many pile up: far more than
+  *        a window of echoes queued behind a peer that grants no credit all
+  *        come out, in order, as credit is granted a few at a time.
+  */
+static void TestFlowControlBacklog(void)
+{
+  uint16_t Base = (uint16_t)((SOCKET_INTERFACE + 1) << 12);
+  uint8_t Stream[FLOW_BACKLOG * (HEADER_SIZE + 2 + CRC_SIZE)];
+  uint8_t Credit[HEADER_SIZE + CRC_SIZE];
+  uint8_t Rep[HEADER_SIZE + 2 + CRC_SIZE];
+  size_t FrameSize = HEADER_SIZE + 2 + CRC_SIZE;
+  struct pollfd Poll;
+  int Fd = DaemonFd;
+  int Sent, Limit, Read, i;
+
+  /* The reply takes the first credit of the window */
+  TEST_ASSERT(WriteRegister(Fd, Base | 0x0008, 4));
+  Sent = 1;
+
+  /* No credit granted with them */
+  for (i = 0; i < FLOW_BACKLOG; i++)
+    EchoFrame(Stream + i * FrameSize, 0, (uint8_t)i);
+  TEST_ASSERT(write(Fd, Stream, sizeof(Stream)) == (ssize_t)sizeof(Stream));
+
+  Poll.fd = Fd;
+  Poll.events = POLLIN;
+  memset(Credit, 0, sizeof(Credit));
+  Credit[0] = SetLogicalId(NODE_ID) | SOCKET_INTERFACE;
+  Credit[1] = FLOW_CONTROL_COMMAND;
+  Credit[4] = SetLogicalId(REMOTE_ID);
+  Limit = 4;
+  for (Read = 0; Read < FLOW_BACKLOG; )
+  {
+    /* The rest of the window, then nothing until more credit comes */
+    for (; (Sent < Limit) && (Read < FLOW_BACKLOG); Sent++, Read++)
+    {
+      if (!ReadDataFrame(Fd, Rep, sizeof(Rep)) || (Rep[HEADER_SIZE] != Read))
+        break;
+    }
+    if (Sent < Limit)
+      break;
+    TEST_CHECK(poll(&Poll, 1, 20) == 0);
+
+    Limit = Sent + 4;
+    Credit[5] = (uint8_t)(TP_FLOW_CREDITS | (Limit & TP_FLOW_LIMIT_MASK));
+    SetChecksum(Credit, sizeof(Credit));
+    TEST_ASSERT(write(Fd, Credit, sizeof(Credit)) == (ssize_t)sizeof(Credit));
+  }
+  TEST_CHECK(Read == FLOW_BACKLOG);
+
+  TEST_CHECK(WriteRegister(Fd, Base | 0x0008, 0));
+}
+
+/**
+  * @brief With aggregation the echoes are packed into fewer writes and split
+  *        again by the client: all of them come, in order, and a frame left
+  *        alone is not held beyond its hold time.
+  */
+static void TestAggregatedWrites(void)
+{
+  uint16_t Base = (uint16_t)((SOCKET_INTERFACE + 1) << 12);
+  uint8_t Stream[8 * (HEADER_SIZE + 2 + CRC_SIZE)];
+  uint8_t Rep[sizeof(Stream)];
+  size_t FrameSize = HEADER_SIZE + 2 + CRC_SIZE;
+  struct timeval Start, End;
+  uint32_t Value = 0;
+  int Fd = DaemonFd;
+  int i;
+
+  TEST_ASSERT(WriteRegister(Fd, Base | 0x000A, 5000));
+  TEST_ASSERT(WriteRegister(Fd, Base | 0x0009, 64));
+  TEST_CHECK(ReadRegister(Fd, Base | 0x0009, &Value) == 2 && Value == 64);
+
+  for (i = 0; i < 8; i++)
+    EchoFrame(Stream + i * FrameSize, 0, (uint8_t)(0x40 + i));
+  TEST_ASSERT(write(Fd, Stream, sizeof(Stream)) == (ssize_t)sizeof(Stream));
+  TEST_ASSERT(ReadAll(Fd, Rep, sizeof(Rep)) == (ssize_t)sizeof(Rep));
+  TEST_CHECK(memcmp(Rep, Stream, sizeof(Stream)) == 0);
+
+  gettimeofday(&Start, NULL);
+  TEST_ASSERT(write(Fd, Stream, FrameSize) == (ssize_t)FrameSize);
+  TEST_ASSERT(ReadAll(Fd, Rep, FrameSize) == (ssize_t)FrameSize);
+  gettimeofday(&End, NULL);
+  TEST_CHECK(memcmp(Rep, Stream, FrameSize) == 0);
+  TEST_CHECK((End.tv_sec - Start.tv_sec) * 1000000 + (End.tv_usec - Start.tv_usec) < 500000);
+
+  TEST_CHECK(WriteRegister(Fd, Base | 0x0009, 0));
+}
+#endif
+
+#if (OS_ACTIVE != 0) && (BUS_TASK_MODEL == 0)
+/**
+  * @brief  Writes the flood stream while the test reads the echoes.
+  */
+static void *FloodWriter(void *arg)
+{
+  ssize_t Ret;
+
+  (void)arg;
+  FloodWritten = 0;
+  while ((size_t)FloodWritten < sizeof(FloodStream))
+  {
+    Ret = write(DaemonFd, FloodStream + FloodWritten, sizeof(FloodStream) - FloodWritten);
+    if (Ret <= 0)
+      break;
+    FloodWritten += Ret;
+  }
+  return NULL;
+}
+
+/**
+  * @brief Echoes sent much faster than the client reads them fill the output
+  *        of the node: the frames that wait behind the pending data, in the
+  *        bus queue or in a shard ring, come back in order and none is lost.
+  *        The tasks and the super loop have no output queue to wait in.
+  */
+static void TestFloodOrder(void)
+{
+  size_t FrameSize = HEADER_SIZE + FLOOD_DATA + CRC_SIZE;
+  uint8_t *Frame;
+  pthread_t Thread;
+  int OutOfOrder = 0, i;
+
+  for (i = 0; i < FLOOD_FRAMES; i++)
+  {
+    Frame = FloodStream + i * FrameSize;
+    memset(Frame, 0, FrameSize);
+    Frame[0] = SetLogicalId(NODE_ID) | SOCKET_INTERFACE;
+    Frame[1] = TRANSFER_COMMAND;
+    Frame[2] = FLOOD_DATA;
+    Frame[4] = SetLogicalId(REMOTE_ID);
+    Frame[HEADER_SIZE] = (uint8_t)(i >> 8);
+    Frame[HEADER_SIZE + 1] = (uint8_t)i;
+    memset(Frame + HEADER_SIZE + 2, (uint8_t)i, FLOOD_DATA - 2);
+    SetChecksum(Frame, FrameSize);
+  }
+
+  TEST_ASSERT(pthread_create(&Thread, NULL, FloodWriter, NULL) == 0);
+  /* Not read yet: the echoes pile up in the node */
+  usleep(200000);
+  TEST_CHECK(ReadAll(DaemonFd, FloodRep, sizeof(FloodRep)) == (ssize_t)sizeof(FloodRep));
+  pthread_join(Thread, NULL);
+  TEST_CHECK(FloodWritten == (ssize_t)sizeof(FloodStream));
+
+  for (i = 0; i < FLOOD_FRAMES; i++)
+    OutOfOrder += (memcmp(FloodRep + i * FrameSize, FloodStream + i * FrameSize, FrameSize) != 0);
+  TEST_CHECK(OutOfOrder == 0);
+}
+#endif
+
+int main(void)
+{
+#if OS_ACTIVE != 0
+  /* Same start up sequence than main.c. Threads run in the background */
+  TEST_ASSERT(InitBUSProcess() == INSTANCE_OK);
+  TEST_ASSERT(InitMBAProcess() == INSTANCE_OK);
+#else
+  pthread_t Thread;
+
+  TEST_ASSERT(pthread_create(&Thread, NULL, SuperLoop, NULL) == 0);
+#endif
+
+  DaemonFd = ConnectToDaemon();
+  TEST_ASSERT(DaemonFd >= 0);
+
+  TEST_RUN(TestConfigReadThroughSocket);
+  TEST_RUN(TestBringUp);
+#if (OS_ACTIVE != 0) && defined(LOOP_STATS) && (LOOP_STATS > 0)
+  TEST_RUN(TestLoopStatsRegisters);
+#endif
+  TEST_RUN(TestFrameTimeoutDetection);
+  TEST_RUN(TestTransferEcho);
+  TEST_RUN(TestLatencyRegister);
+  TEST_RUN(TestGroupEcho);
+  TEST_RUN(TestFragmentedEcho);
+#if OS_ACTIVE != 0
+  TEST_RUN(TestFlowControl);
+  TEST_RUN(TestFlowControlBacklog);
+  TEST_RUN(TestAggregatedWrites);
+#endif
+  TEST_RUN(TestCorruptFrameDropped);
+  TEST_RUN(TestStreamedFrames);
+#if (OS_ACTIVE != 0) && (BUS_TASK_MODEL == 0)
+  TEST_RUN(TestFloodOrder);
+#endif
+
+  close(DaemonFd);
+
+#if OS_ACTIVE == 0
+  SuperLoopRunning = 0;
+  pthread_join(Thread, NULL);
+#endif
+
+  return TEST_RESULT();
+}
@@ -0,0 +1,239 @@
+/**
+  ******************************************************************************
+  * @file    TestSpscRing.c
+  * @author  Javier Fernandez Cepeda
+  * @brief   Unit tests of the rings and frame pools between bus shards
+  *	     (TOOLS/spscring, TOOLS/objpool).
+  *
+  *******************************************************************************
+  * Copyright (c) 2015, Javier Fernandez. All rights reserved.
+  *******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include <pthread.h>
+#include <poll.h>
+#include <sched.h>
+#include "TestUtils.h"
+#include "TOOLS/spscring.h"
+#include "TOOLS/objpool.h"
+
+/* Private define ------------------------------------------------------------*/
+#define TEST_RING_SIZE	16
+#define TEST_ITEMS	200000
+
+/* Private variables ---------------------------------------------------------*/
+static spscring Ring;
+
+/* Private functions ---------------------------------------------------------*/
+static void *Producer(void *arg)
+{
+  uintptr_t i;
+
+  (void)arg;
+  for (i = 1; i <= TEST_ITEMS; i++)
+  {
+    while (spscring_push(&Ring, (void *)i) != 0)
+      sched_yield();
+  }
+  return NULL;
+}
+
+/**
+  * @brief Elements cross from one thread to another in order, none lost,
+  *        through a ring much smaller than the stream.
+  */
+static void TestOrderAcrossThreads(void)
+{
+  pthread_t Thread;
+  uintptr_t Next = 1, Item;
+  int OutOfOrder = 0;
+
+  TEST_ASSERT(spscring_init(&Ring, TEST_RING_SIZE) == 0);
+  TEST_ASSERT(pthread_create(&Thread, NULL, Producer, NULL) == 0);
+
+  while (Next <= TEST_ITEMS)
+  {
+    Item = (uintptr_t)spscring_pop(&Ring);
+    if (Item == 0)
+    {
+      sched_yield();
+      continue;
+    }
+    OutOfOrder += (Item != Next);
+    Next++;
+  }
+  pthread_join(Thread, NULL);
+
+  TEST_CHECK(OutOfOrder == 0);
+  TEST_CHECK(spscring_pop(&Ring) == NULL);
+  spscring_release(&Ring);
+}
+
+/**
+  * @brief A full ring refuses the push until the consumer takes an element.
+  *        Sizes are rounded up to a power of two.
+  */
+static void TestFull(void)
+{
+  uintptr_t i;
+
+  TEST_ASSERT(spscring_init(&Ring, 5) == 0);
+  for (i = 1; i <= 8; i++)
+    TEST_CHECK(spscring_push(&Ring, (void *)i) == 0);
+  TEST_CHECK(spscring_push(&Ring, (void *)i) != 0);
+
+  TEST_CHECK(spscring_pop(&Ring) == (void *)1);
+  TEST_CHECK(spscring_push(&Ring, (void *)i) == 0);
+  spscring_release(&Ring);
+}
+
+/**
+  * @brief The eventfd wakes a consumer that has found the ring empty, and
+  *        only then.
+  */
+static void TestEventfdWake(void)
+{
+  struct pollfd Pfd;
+
+  TEST_ASSERT(spscring_init(&Ring, TEST_RING_SIZE) == 0);
+  TEST_ASSERT(spscring_eventfd(&Ring) >= 0);
+  Pfd.fd = spscring_eventfd(&Ring);
+  Pfd.events = POLLIN;
+
+  /* Not armed yet: a busy consumer costs no system calls */
+  TEST_CHECK(spscring_push(&Ring, (void *)1) == 0);
+  TEST_CHECK(poll(&Pfd, 1, 0) == 0);
+  TEST_CHECK(spscring_pop(&Ring) == (void *)1);
+
+  /* Found empty: the next push signals once */
+  TEST_CHECK(spscring_pop(&Ring) == NULL);
+  TEST_CHECK(spscring_push(&Ring, (void *)2) == 0);
+  TEST_CHECK(spscring_push(&Ring, (void *)3) == 0);
+  TEST_CHECK(poll(&Pfd, 1, 0) == 1);
+  spscring_clear(&Ring);
+  TEST_CHECK(poll(&Pfd, 1, 0) == 0);
+  TEST_CHECK(spscring_pop(&Ring) == (void *)2);
+  TEST_CHECK(spscring_pop(&Ring) == (void *)3);
+  spscring_release(&Ring);
+}
+
+/**
+  * @brief Once an element has spilled, the next ones follow it to the spill
+  *        even if the ring has room again: all come out in order.
+  */
+static void TestSpillOrder(void)
+{
+  uintptr_t i;
+
+  TEST_ASSERT(spscring_init(&Ring, 4) == 0);
+  for (i = 1; i <= 10; i++)
+    TEST_CHECK(spscring_push_spill(&Ring, (void *)i) == 0);
+  TEST_CHECK(Ring.spill_count == 6);
+
+  TEST_CHECK(spscring_pop(&Ring) == (void *)1);
+  TEST_CHECK(spscring_push_spill(&Ring, (void *)11) == 0);
+  TEST_CHECK(Ring.spill_count == 7);
+  for (i = 2; i <= 11; i++)
+    TEST_CHECK(spscring_pop(&Ring) == (void *)i);
+  TEST_CHECK(spscring_pop(&Ring) == NULL);
+
+  /* Emptied: the ring is used again */
+  TEST_CHECK(spscring_push_spill(&Ring, (void *)12) == 0);
+  TEST_CHECK(Ring.spill_count == 0);
+  TEST_CHECK(spscring_pop(&Ring) == (void *)12);
+  spscring_release(&Ring);
+}
+
+static void *SpillProducer(void *arg)
+{
+  uintptr_t i;
+
+  (void)arg;
+  for (i = 1; i <= TEST_ITEMS; i++)
+  {
+    if (spscring_push_spill(&Ring, (void *)i) != 0)
+      break;
+  }
+  return NULL;
+}
+
+/**
+  * @brief A producer that never waits floods a small ring: the consumer,
+  *        woken by the eventfd only, gets every element in order.
+  */
+static void TestSpillAcrossThreads(void)
+{
+  pthread_t Thread;
+  struct pollfd Pfd;
+  uintptr_t Next = 1, Item;
+  int OutOfOrder = 0, Stalls = 0;
+
+  TEST_ASSERT(spscring_init(&Ring, TEST_RING_SIZE) == 0);
+  Pfd.fd = spscring_eventfd(&Ring);
+  Pfd.events = POLLIN;
+  TEST_ASSERT(pthread_create(&Thread, NULL, SpillProducer, NULL) == 0);
+
+  while ((Next <= TEST_ITEMS) && (Stalls == 0))
+  {
+    Item = (uintptr_t)spscring_pop(&Ring);
+    if (Item == 0)
+    {
+      /* A lost wake up leaves the consumer waiting here */
+      Stalls += (poll(&Pfd, 1, 2000) == 0);
+      spscring_clear(&Ring);
+      continue;
+    }
+    OutOfOrder += (Item != Next);
+    Next++;
+  }
+  pthread_join(Thread, NULL);
+
+  TEST_CHECK(Stalls == 0);
+  TEST_CHECK(OutOfOrder == 0);
+  TEST_CHECK(Next == TEST_ITEMS + 1);
+  TEST_CHECK(spscring_pop(&Ring) == NULL);
+  spscring_release(&Ring);
+}
+
+/**
+  * @brief Returned objects are reused, and the pool keeps no more than its
+  *        maximum.
+  */
+static void TestPoolReuse(void)
+{
+  objpool Pool;
+  void *Obj[4];
+  int i;
+
+  objpool_init(&Pool, 48, 2);
+  for (i = 0; i < 4; i++)
+  {
+    Obj[i] = objpool_get(&Pool);
+    TEST_ASSERT(Obj[i] != NULL);
+  }
+  TEST_CHECK(Pool.allocs == 4);
+  for (i = 0; i < 4; i++)
+    objpool_put(&Pool, Obj[i]);
+  TEST_CHECK(Pool.count == 2);
+
+  TEST_CHECK(objpool_get(&Pool) == Obj[1]);
+  TEST_CHECK(objpool_get(&Pool) == Obj[0]);
+  TEST_CHECK(Pool.allocs == 4);
+  objpool_put(&Pool, Obj[0]);
+  objpool_put(&Pool, Obj[1]);
+  objpool_release(&Pool);
+  TEST_CHECK(Pool.count == 0);
+}
+
+int main(void)
+{
+  TEST_RUN(TestOrderAcrossThreads);
+  TEST_RUN(TestFull);
+  TEST_RUN(TestEventfdWake);
+  TEST_RUN(TestSpillOrder);
+  TEST_RUN(TestSpillAcrossThreads);
+  TEST_RUN(TestPoolReuse);
+
+  return TEST_RESULT();
+}
@@ -0,0 +1,99 @@
+/**
+  ******************************************************************************
+  * @file    TestTimerHeap.c
+  * @author  Javier Fernandez Cepeda
+  * @brief   Unit tests of the deadline heap of the timer service
+  *	     (TOOLS/timerheap).
+  *
+  *******************************************************************************
+  * Copyright (c) 2015, Javier Fernandez. All rights reserved.
+  *******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "TestUtils.h"
+#include "TOOLS/timerheap.h"
+
+/* Private define ------------------------------------------------------------*/
+#define TEST_NODES	1000
+
+/* Private variables ---------------------------------------------------------*/
+static struct timerheap_node Nodes[TEST_NODES];
+
+/* Private functions ---------------------------------------------------------*/
+
+/**
+  * @brief Pops every node and checks that deadlines never go backwards.
+  */
+static uint32_t PopAllSorted(timerheap *Heap)
+{
+  struct timerheap_node *Node;
+  uint64_t Last = 0;
+  uint32_t Count = 0;
+
+  while ((Node = timerheap_pop(Heap)) != NULL)
+  {
+    TEST_CHECK(Node->deadline >= Last);
+    TEST_CHECK(!timerheap_queued(Node));
+    Last = Node->deadline;
+    Count++;
+  }
+  return Count;
+}
+
+/**
+  * @brief Nodes come out by deadline whatever the insertion order.
+  */
+static void TestOrder(void)
+{
+  timerheap Heap;
+  uint32_t i;
+
+  timerheap_init(&Heap);
+  srand(1);
+  for (i = 0; i < TEST_NODES; i++)
+  {
+    timerheap_node_init(&Nodes[i]);
+    TEST_ASSERT(timerheap_push(&Heap, &Nodes[i], (uint64_t)(rand() % 5000)) == 0);
+  }
+  TEST_CHECK(Heap.count == TEST_NODES);
+  TEST_CHECK(PopAllSorted(&Heap) == TEST_NODES);
+  TEST_CHECK(timerheap_top(&Heap) == NULL);
+  timerheap_release(&Heap);
+}
+
+/**
+  * @brief Removed and moved nodes keep the heap consistent.
+  */
+static void TestRemoveAndMove(void)
+{
+  timerheap Heap;
+  uint32_t i;
+
+  timerheap_init(&Heap);
+  for (i = 0; i < TEST_NODES; i++)
+  {
+    timerheap_node_init(&Nodes[i]);
+    timerheap_push(&Heap, &Nodes[i], (uint64_t)(i * 7919u % TEST_NODES) + 1);
+  }
+
+  /* Remove a third, move another third to both ends */
+  for (i = 0; i < TEST_NODES; i += 3)
+    timerheap_remove(&Heap, &Nodes[i]);
+  timerheap_remove(&Heap, &Nodes[0]);
+  for (i = 1; i < TEST_NODES; i += 3)
+    timerheap_push(&Heap, &Nodes[i], (i & 1) ? 0 : 1000000);
+
+  TEST_CHECK(Heap.count == TEST_NODES - (TEST_NODES + 2) / 3);
+  TEST_CHECK(timerheap_top(&Heap)->deadline == 0);
+  TEST_CHECK(PopAllSorted(&Heap) == TEST_NODES - (TEST_NODES + 2) / 3);
+  timerheap_release(&Heap);
+}
+
+int main(void)
+{
+  TEST_RUN(TestOrder);
+  TEST_RUN(TestRemoveAndMove);
+
+  return TEST_RESULT();
+}
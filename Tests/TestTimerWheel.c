@@ -0,0 +1,134 @@
+/**
+  ******************************************************************************
+  * @file    TestTimerWheel.c
+  * @author  Javier Fernandez Cepeda
+  * @brief   Unit tests of the hierarchical timer wheel (TOOLS/timerwheel).
+  *
+  *******************************************************************************
+  * Copyright (c) 2015, Javier Fernandez. All rights reserved.
+  *******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "TestUtils.h"
+#include "TOOLS/timerwheel.h"
+
+/* Private define ------------------------------------------------------------*/
+#define TEST_ENTRIES	2000
+
+/* Private variables ---------------------------------------------------------*/
+static timerwheel Wheel;
+static struct timerwheel_entry Entries[TEST_ENTRIES];
+static uint32_t Runs[TEST_ENTRIES];
+static uint32_t Late;
+
+/* Private functions ---------------------------------------------------------*/
+static void Expired(struct timerwheel_entry *Entry, void *Arg)
+{
+  /* Callbacks run while the wheel processes the expiry tick */
+  if (Wheel.now != Entry->expires + 1)
+    Late++;
+  Runs[(int)(intptr_t)Arg]++;
+}
+
+static void ArmAll(uint64_t Base, uint64_t Range)
+{
+  uint32_t i;
+
+  for (i = 0; i < TEST_ENTRIES; i++)
+  {
+    Runs[i] = 0;
+    timerwheel_entry_init(&Entries[i], Expired, (void *)(intptr_t)i);
+    timerwheel_add(&Wheel, &Entries[i], Base + (uint64_t)rand() % Range);
+  }
+}
+
+/**
+  * @brief Every entry runs once, on its own tick, whatever the advance steps
+  *        and the level it was armed in.
+  */
+static void TestExpiryTicks(void)
+{
+  uint64_t Now = 12345;
+  uint32_t i, Total = 0;
+
+  srand(1);
+  timerwheel_init(&Wheel, Now);
+  Late = 0;
+  ArmAll(Now, 300000);
+  TEST_CHECK(Wheel.pending == TEST_ENTRIES);
+
+  while (Wheel.pending != 0)
+  {
+    Now += 1 + (uint64_t)rand() % 700;
+    Total += timerwheel_advance(&Wheel, Now);
+  }
+
+  TEST_CHECK(Total == TEST_ENTRIES);
+  TEST_CHECK(Late == 0);
+  for (i = 0; i < TEST_ENTRIES; i++)
+    TEST_CHECK(Runs[i] == 1);
+}
+
+/**
+  * @brief Cancelled entries never run and re-armed ones run at their last
+  *        expiry only.
+  */
+static void TestCancelAndRearm(void)
+{
+  uint32_t i;
+
+  srand(2);
+  timerwheel_init(&Wheel, 0);
+  Late = 0;
+  ArmAll(1, 5000);
+
+  for (i = 0; i < TEST_ENTRIES; i += 2)
+    timerwheel_del(&Wheel, &Entries[i]);
+  timerwheel_del(&Wheel, &Entries[0]);
+  for (i = 1; i < TEST_ENTRIES; i += 4)
+    timerwheel_add(&Wheel, &Entries[i], 10000 + i);
+  TEST_CHECK(Wheel.pending == TEST_ENTRIES / 2);
+
+  TEST_CHECK(timerwheel_advance(&Wheel, 9999) == TEST_ENTRIES / 4);
+  TEST_CHECK(timerwheel_advance(&Wheel, 20000) == TEST_ENTRIES / 4);
+  TEST_CHECK(Late == 0);
+  for (i = 0; i < TEST_ENTRIES; i++)
+    TEST_CHECK(Runs[i] == (i & 1));
+}
+
+/**
+  * @brief Expiries beyond the wheel range and in the past are not lost.
+  */
+static void TestRangeLimits(void)
+{
+  uint64_t Far = 3ull << (TIMERWHEEL_BITS * TIMERWHEEL_LEVELS);
+  uint64_t Now;
+
+  timerwheel_init(&Wheel, 1000);
+  Late = 0;
+  Runs[0] = Runs[1] = 0;
+  timerwheel_entry_init(&Entries[0], Expired, (void *)0);
+  timerwheel_entry_init(&Entries[1], Expired, (void *)1);
+  timerwheel_add(&Wheel, &Entries[0], Far);
+  timerwheel_add(&Wheel, &Entries[1], 10);
+
+  /* Already expired: it runs on the first tick processed */
+  TEST_CHECK(timerwheel_advance(&Wheel, 1000) == 1);
+  TEST_CHECK(Runs[1] == 1);
+  Late = 0;
+
+  for (Now = 1000; Wheel.pending != 0; Now += 1000000)
+    timerwheel_advance(&Wheel, Now);
+  TEST_CHECK(Runs[0] == 1);
+  TEST_CHECK(Late == 0);
+}
+
+int main(void)
+{
+  TEST_RUN(TestExpiryTicks);
+  TEST_RUN(TestCancelAndRearm);
+  TEST_RUN(TestRangeLimits);
+
+  return TEST_RESULT();
+}
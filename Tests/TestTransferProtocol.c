@@ -0,0 +1,635 @@
+/**
+  ******************************************************************************
+  * @file    TestTransferProtocol.c
+  * @author  Javier Fernandez Cepeda
+  * @brief   Unit tests of the MBA transfer protocol.
+  *
+  *******************************************************************************
+  * Copyright (c) 2015, Javier Fernandez. All rights reserved.
+  *******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include <string.h>
+#include <pthread.h>
+#include "TestUtils.h"
+#include "MBALibrary/MBALib.h"
+#include "MBALibrary/MBAProtocols/MBAConfigProtocol.h"
+#include "TOOLS/MemoryManagement.h"
+#include "TOOLS/crc16.h"
+
+/* Private define ------------------------------------------------------------*/
+#define NODE_ID		2	/*!< Logical ID of the node under test */
+#define REMOTE_ID	5	/*!< Logical ID of the node sending the requests */
+#define ROUTES_REG	0x1006	/*!< Routes of interface 0 */
+#define LINK_REG	0x1002	/*!< Device linked to interface 0 */
+#define GROUPS_REG	0x100B	/*!< Groups of interface 0 */
+#define GROUP_ID	9	/*!< Logical ID of a group */
+#define FRAGMENT_DATA	30	/*!< Data of a fragment in the fragment tests */
+#define FRAGMENT_SIZE	(HEADER_SIZE + FRAGMENT_DATA + CRC_SIZE)
+
+/* Private functions ---------------------------------------------------------*/
+
+/**
+  * @brief Writes the checksum of a MBA bridge buffer.
+  */
+static void SetChecksum(uint8_t *Buf, uint16_t Size)
+{
+  uint16_t Crc = crc16(Buf, HEADER_SIZE + Size);
+
+  Buf[HEADER_SIZE + Size] = (uint8_t)(Crc & 0xFF);
+  Buf[HEADER_SIZE + Size + 1] = (uint8_t)(Crc >> 8);
+}
+
+/**
+  * @brief Builds a MBA bridge buffer.
+  * @retval Size of the buffer
+  */
+static uint32_t BuildFrame(uint8_t *Buf, uint8_t Dest, uint8_t Command, uint8_t Source,
+                           const uint8_t *Data, uint16_t Size)
+{
+  Buf[0] = Dest;
+  Buf[1] = Command;
+  Buf[2] = (uint8_t)(Size & 0xFF);
+  Buf[3] = (uint8_t)(Size >> 8);
+  Buf[4] = Source;
+  Buf[5] = 0;
+  Buf[6] = 0x11;
+  Buf[7] = 0x22;
+  Buf[8] = 0x33;
+  Buf[9] = 0x44;
+  memcpy(&Buf[HEADER_SIZE], Data, Size);
+  SetChecksum(Buf, Size);
+
+  return HEADER_SIZE + Size + CRC_SIZE;
+}
+
+/**
+  * @brief A bridge buffer survives a cast into a frame and back.
+  */
+static void TestCastRoundTrip(void)
+{
+  uint8_t In[64], Out[64];
+  const uint8_t Payload[5] = {1, 2, 3, 4, 5};
+  uint32_t Size;
+  int32_t OutSize;
+  TransProtFrame Frame;
+
+  TransferProtocolFrameInit(&Frame);
+  Size = BuildFrame(In, SetLogicalId(NODE_ID) | 1, TRANSFER_COMMAND,
+                    SetLogicalId(REMOTE_ID), Payload, sizeof(Payload));
+
+  TEST_CHECK(TransferProtocolCast(&Frame, In, Size, 0, MBA_BRIDGE | FROM_BUFFER) >= 0);
+  TEST_CHECK(GetFrameDataSize(Frame) == sizeof(Payload));
+  TEST_CHECK((uint32_t)GetFrameSize(Frame) == Size);
+  TEST_CHECK(GetDestInterfaceId(Frame) == 1);
+  TEST_CHECK(Frame.Checksum == crc16(In, HEADER_SIZE + sizeof(Payload)));
+  TEST_ASSERT(Frame.Data != NULL);
+  TEST_CHECK(memcmp(Frame.Data, Payload, sizeof(Payload)) == 0);
+
+  OutSize = TransferProtocolCast(&Frame, Out, sizeof(Out), 0, MBA_BRIDGE | TO_BUFFER);
+  TEST_CHECK(OutSize >= 0);
+  TEST_CHECK(memcmp(In, Out, Size) == 0);
+  TEST_CHECK(Frame.Data == NULL);
+}
+
+/**
+  * @brief An in place cast is a view of the buffer: the frame is routed and
+  *        written back into it without copies.
+  */
+static void TestCastInPlace(void)
+{
+  const uint8_t Payload[5] = {1, 2, 3, 4, 5};
+  uint8_t Expected[32];
+  uint8_t *In;
+  uint32_t Size;
+  TransProtFrame Rx, Tx;
+
+  TransferProtocolFrameInit(&Rx);
+  TransferProtocolFrameInit(&Tx);
+  In = (uint8_t *)MemAlloc(32);
+  TEST_ASSERT(In != NULL);
+  Size = BuildFrame(In, SetLogicalId(NODE_ID) | 1, TRANSFER_COMMAND,
+                    SetLogicalId(REMOTE_ID), Payload, sizeof(Payload));
+  memcpy(Expected, In, Size);
+
+  TEST_CHECK(TransferProtocolCast(&Rx, In, Size, 0, MBA_BRIDGE | FROM_BUFFER | IN_PLACE) == (int32_t)Size);
+  TEST_CHECK(Rx.Buffer == In && Rx.Data == In + HEADER_SIZE);
+  TEST_CHECK(GetFrameDataSize(Rx) == sizeof(Payload));
+  TEST_CHECK(GetBufSrcNodeId(In) == Rx.Header.SourceID);
+  TEST_CHECK(Rx.Header.TimeStamp == 0x44332211);
+  TEST_CHECK(Rx.Checksum == GetBufChecksum(In, sizeof(Payload)));
+
+  /* The routed frame takes the buffer over */
+  TEST_CHECK(TransferProtocolProcess(&Tx, &Rx) == 1);
+  TEST_CHECK(Rx.Buffer == NULL && Rx.Data == NULL);
+  TEST_ASSERT(TransferProtocolFrameBuffer(&Tx, MBA_BRIDGE) == In);
+
+  /* Untouched, the buffer is left as read */
+  TEST_CHECK(TransferProtocolCast(&Tx, In, Size, 0, MBA_BRIDGE | TO_BUFFER) == (int32_t)Size);
+  TEST_CHECK(memcmp(In, Expected, Size) == 0);
+
+  /* Only the changed field and the checksum are written */
+  Tx.Header.FlowControl = 7;
+  Expected[5] = 7;
+  SetChecksum(Expected, sizeof(Payload));
+  TEST_CHECK(TransferProtocolCast(&Tx, In, Size, 0, MBA_BRIDGE | TO_BUFFER) == (int32_t)Size);
+  TEST_CHECK(memcmp(In, Expected, Size) == 0);
+  TEST_CHECK(Tx.Buffer == In);
+
+  /* The data of an end bus is the payload in the buffer */
+  TEST_CHECK(TransferProtocolFrameBuffer(&Tx, END_BUS) == In + HEADER_SIZE);
+  TransferProtocolFrameFree(&Tx);
+  TEST_CHECK(Tx.Buffer == NULL && Tx.Data == NULL);
+  TEST_CHECK(TransferProtocolFrameBuffer(&Tx, MBA_BRIDGE) == NULL);
+}
+
+/**
+  * @brief A buffer shorter than its header says is not a frame.
+  */
+static void TestCastBounds(void)
+{
+  const uint8_t Payload[5] = {1, 2, 3, 4, 5};
+  uint8_t *In;
+  uint32_t Size;
+  TransProtFrame Frame;
+
+  TransferProtocolFrameInit(&Frame);
+  In = (uint8_t *)MemAlloc(32);
+  TEST_ASSERT(In != NULL);
+  Size = BuildFrame(In, SetLogicalId(NODE_ID), TRANSFER_COMMAND,
+                    SetLogicalId(REMOTE_ID), Payload, sizeof(Payload));
+
+  TEST_CHECK(TransferProtocolCast(&Frame, In, HEADER_SIZE, 0, MBA_BRIDGE | FROM_BUFFER) < 0);
+  TEST_CHECK(Frame.Data == NULL);
+  TEST_CHECK(TransferProtocolCast(&Frame, In, Size - 1, 0, MBA_BRIDGE | FROM_BUFFER) < 0);
+
+  /* In place, the buffer is released */
+  TEST_CHECK(TransferProtocolCast(&Frame, In, Size - 1, 0, MBA_BRIDGE | FROM_BUFFER | IN_PLACE) < 0);
+  TEST_CHECK(Frame.Buffer == NULL && Frame.Data == NULL);
+}
+
+/**
+  * @brief A buffer whose checksum does not match its header and data is
+  *        dropped, with nothing allocated for it.
+  */
+static void TestCastChecksum(void)
+{
+  const uint8_t Payload[5] = {1, 2, 3, 4, 5};
+  uint8_t *In;
+  uint32_t Size;
+  TransProtFrame Frame;
+
+  TransferProtocolFrameInit(&Frame);
+  In = (uint8_t *)MemAlloc(32);
+  TEST_ASSERT(In != NULL);
+  Size = BuildFrame(In, SetLogicalId(NODE_ID), TRANSFER_COMMAND,
+                    SetLogicalId(REMOTE_ID), Payload, sizeof(Payload));
+
+  /* A flipped bit in the data, in the header and in the checksum */
+  In[HEADER_SIZE + 2] ^= 0x10;
+  TEST_CHECK(TransferProtocolCast(&Frame, In, Size, 0, MBA_BRIDGE | FROM_BUFFER) < 0);
+  TEST_CHECK(Frame.Data == NULL);
+  In[HEADER_SIZE + 2] ^= 0x10;
+  In[5] ^= 0x01;
+  TEST_CHECK(TransferProtocolCast(&Frame, In, Size, 0, MBA_BRIDGE | FROM_BUFFER) < 0);
+  In[5] ^= 0x01;
+  In[Size - 1] ^= 0x80;
+  TEST_CHECK(TransferProtocolCast(&Frame, In, Size, 0, MBA_BRIDGE | FROM_BUFFER) < 0);
+  In[Size - 1] ^= 0x80;
+
+  /* In place, the buffer is released */
+  In[HEADER_SIZE] ^= 0x01;
+  TEST_CHECK(TransferProtocolCast(&Frame, In, Size, 0, MBA_BRIDGE | FROM_BUFFER | IN_PLACE) < 0);
+  TEST_CHECK(Frame.Buffer == NULL && Frame.Data == NULL);
+}
+
+/**
+  * @brief Frames are classified by command and destination.
+  */
+static void TestPriority(void)
+{
+  TransProtFrame Frame;
+
+  TransferProtocolFrameInit(&Frame);
+  Frame.Header.Command = CONFIG_COMMAND;
+  TEST_CHECK(TransferProtocolGetPriority(&Frame) == TP_PRIORITY_CONTROL);
+  Frame.Header.Command = OPERATION_COMMAND;
+  TEST_CHECK(TransferProtocolGetPriority(&Frame) == TP_PRIORITY_CONTROL);
+  Frame.Header.Command = TRANSFER_COMMAND;
+  Frame.Header.DestinationID = SetLogicalId(NODE_ID);
+  TEST_CHECK(TransferProtocolGetPriority(&Frame) == TP_PRIORITY_REALTIME);
+  Frame.Header.DestinationID = SetLogicalId(REMOTE_ID);
+  TEST_CHECK(TransferProtocolGetPriority(&Frame) == TP_PRIORITY_BULK);
+}
+
+/**
+  * @brief A config read of the device ID is answered to the requester.
+  */
+static void TestConfigRead(void)
+{
+  uint8_t In[32];
+  const uint8_t Request[3] = {0x00, 0x0F, READ_DATA};
+  uint32_t Size;
+  int32_t Interface;
+  TransProtFrame Rx, Tx;
+
+  TransferProtocolFrameInit(&Rx);
+  TransferProtocolFrameInit(&Tx);
+  Size = BuildFrame(In, SetLogicalId(NODE_ID), CONFIG_COMMAND,
+                    SetLogicalId(REMOTE_ID) | 1, Request, sizeof(Request));
+  TransferProtocolCast(&Rx, In, Size, 0, MBA_BRIDGE | FROM_BUFFER);
+
+  Interface = TransferProtocolProcess(&Tx, &Rx);
+  TEST_CHECK(Interface == 0);
+  TEST_CHECK(Tx.Header.DestinationID == (SetLogicalId(REMOTE_ID) | 1));
+  TEST_CHECK(Tx.Header.Command == CONFIG_COMMAND);
+  TEST_ASSERT(Tx.Header.Size == 4);
+  TEST_CHECK(Tx.Data[0] == 0x00 && Tx.Data[1] == 0x0F);
+  TEST_CHECK(Tx.Data[3] == NODE_ID);
+  MemFree(Tx.Data);
+}
+
+/**
+  * @brief Writes a register of the dictionary.
+  */
+static void WriteRegister(uint16_t Register, const void *Value, uint32_t Size)
+{
+  uint8_t Access = WRITE_DATA;
+  uint8_t *Data = (uint8_t *)MemAlloc(Size);
+
+  memcpy(Data, Value, Size);
+  TEST_CHECK(ProcessObject(Register, &Access, &Size, &Data) == OBJECT_SUCCESS);
+}
+
+/**
+  * @brief Writes the routes register of interface 0.
+  */
+static void WriteRoutes(uint32_t Mask)
+{
+  WriteRegister(ROUTES_REG, &Mask, sizeof(Mask));
+}
+
+/**
+  * @brief Routes written into the routes register are taken at once, by
+  *        the MBA and by the route views.
+  */
+static void TestRoutesRegister(void)
+{
+  TPRouteView View;
+  TransProtFrame Frame, Rx, Tx;
+  uint8_t In[32];
+  const uint8_t Payload[2] = {0xAB, 0xCD};
+  uint8_t Access = READ_DATA;
+  uint32_t Size = 0, Default;
+  uint8_t *Data = NULL;
+
+  TEST_ASSERT(ProcessObject(ROUTES_REG, &Access, &Size, &Data) == OBJECT_SUCCESS);
+  TEST_ASSERT(Size == sizeof(Default));
+  memcpy(&Default, Data, sizeof(Default));
+  MemFree(Data);
+
+  memset(&View, 0, sizeof(View));
+  TEST_CHECK(TransferProtocolGetRouteView(&View) == 1);
+  TEST_CHECK(TransferProtocolGetRouteView(&View) == 0);
+  TransferProtocolFrameInit(&Frame);
+  Frame.Header.Command = TRANSFER_COMMAND;
+  Frame.Header.DestinationID = SetLogicalId(REMOTE_ID);
+  TEST_CHECK(TransferProtocolRoute(&View, &Frame) == -1);
+
+  WriteRoutes(Default | (1u << REMOTE_ID) | (1u << 31));
+  TEST_CHECK(TransferProtocolGetRouteView(&View) == 1);
+  TEST_CHECK(TransferProtocolRoute(&View, &Frame) == 0);
+  TransferProtocolFrameInit(&Rx);
+  TransferProtocolFrameInit(&Tx);
+  Size = BuildFrame(In, SetLogicalId(REMOTE_ID), TRANSFER_COMMAND, SetLogicalId(NODE_ID),
+                    Payload, sizeof(Payload));
+  TransferProtocolCast(&Rx, In, Size, 0, MBA_BRIDGE | FROM_BUFFER);
+  TEST_CHECK(TransferProtocolProcess(&Tx, &Rx) == 0);
+  MemFree(Tx.Data);
+  Frame.Header.DestinationID = SetLogicalId(31);
+  TEST_CHECK(TransferProtocolRoute(&View, &Frame) == 0);
+
+  WriteRoutes(Default);
+  TEST_CHECK(TransferProtocolGetRouteView(&View) == 1);
+  TEST_CHECK(TransferProtocolRoute(&View, &Frame) == -1);
+}
+
+#if OS_ACTIVE != 0
+#define REWRITES	100000	/*!< Rebuilds of the routing tables */
+
+static volatile int RewritesDone;
+
+/**
+  * @brief Rewrites the routes register with the same routes.
+  */
+static void *RoutesWriter(void *arg)
+{
+  uint32_t Mask = *(uint32_t *)arg;
+  int i;
+
+  for (i = 0; i < REWRITES; i++)
+    WriteRoutes(Mask);
+  RewritesDone = 1;
+  return NULL;
+}
+
+/**
+  * @brief A route view copied while the tables are rebuilt never sees a
+  *        route that is in the tables before and after the rebuild missing.
+  */
+static void TestRouteViewDuringRebuild(void)
+{
+  TPRouteView View;
+  pthread_t Thread;
+  uint8_t Access = READ_DATA;
+  uint32_t Size = 0, Default, Mask;
+  uint8_t *Data = NULL;
+  int Torn = 0;
+
+  TEST_ASSERT(ProcessObject(ROUTES_REG, &Access, &Size, &Data) == OBJECT_SUCCESS);
+  memcpy(&Default, Data, sizeof(Default));
+  MemFree(Data);
+  Mask = Default | (1u << REMOTE_ID);
+  WriteRoutes(Mask);
+
+  memset(&View, 0, sizeof(View));
+  RewritesDone = 0;
+  TEST_ASSERT(pthread_create(&Thread, NULL, RoutesWriter, &Mask) == 0);
+  while (!RewritesDone)
+  {
+    TransferProtocolGetRouteView(&View);
+    Torn += (View.Interface[REMOTE_ID] != 0);
+  }
+  pthread_join(Thread, NULL);
+  TEST_CHECK(Torn == 0);
+
+  WriteRoutes(Default);
+}
+#endif
+
+/**
+  * @brief Data read from an end bus goes to the device linked to the
+  *        interface, also after the link is written.
+  */
+static void TestEndBusLink(void)
+{
+  uint8_t In[4] = {1, 2, 3, 4};
+  uint8_t Link = REMOTE_ID, Default = 0;
+  uint8_t Access = READ_DATA, *Data = NULL;
+  uint32_t Size = 0;
+  TransProtFrame Frame;
+
+  TEST_ASSERT(ProcessObject(LINK_REG, &Access, &Size, &Data) == OBJECT_SUCCESS);
+  TEST_ASSERT(Size == sizeof(Default));
+  Default = Data[0];
+  MemFree(Data);
+
+  TransferProtocolFrameInit(&Frame);
+  TEST_ASSERT(TransferProtocolCast(&Frame, In, sizeof(In), 0, END_BUS | FROM_BUFFER) > 0);
+  TEST_CHECK(Frame.Header.DestinationID == SetLogicalId(Default));
+  TEST_CHECK(Frame.Header.Size == sizeof(In) && memcmp(Frame.Data, In, sizeof(In)) == 0);
+  MemFree(Frame.Data);
+
+  WriteRegister(LINK_REG, &Link, sizeof(Link));
+  TransferProtocolFrameInit(&Frame);
+  TEST_ASSERT(TransferProtocolCast(&Frame, In, sizeof(In), 0, END_BUS | FROM_BUFFER) > 0);
+  TEST_CHECK(Frame.Header.DestinationID == SetLogicalId(REMOTE_ID));
+  TEST_CHECK(Frame.Header.SourceID == (SetLogicalId(NODE_ID) | SetInterfaceId(0)));
+  MemFree(Frame.Data);
+
+  WriteRegister(LINK_REG, &Default, sizeof(Default));
+}
+
+/**
+  * @brief Frames for a logical ID with members in the groups registers go
+  *        to the group, for the MBA and for the route views.
+  */
+static void TestGroups(void)
+{
+  const uint8_t Payload[3] = {7, 8, 9};
+  uint8_t In[32];
+  uint32_t Mask = 1u << GROUP_ID, Size;
+  TPRouteView View;
+  TransProtFrame Rx, Tx;
+
+  TEST_CHECK(TransferProtocolGetGroup(GROUP_ID) == 0);
+  WriteRegister(GROUPS_REG, &Mask, sizeof(Mask));
+  TEST_CHECK(TransferProtocolGetGroup(GROUP_ID) == 0x01);
+#if AVAILABLE_INTERFACES > 1
+  WriteRegister(GROUPS_REG + 0x1000, &Mask, sizeof(Mask));
+  TEST_CHECK(TransferProtocolGetGroup(GROUP_ID) == 0x03);
+#endif
+
+  TransferProtocolFrameInit(&Rx);
+  TransferProtocolFrameInit(&Tx);
+  Size = BuildFrame(In, SetLogicalId(GROUP_ID), TRANSFER_COMMAND, SetLogicalId(REMOTE_ID),
+                    Payload, sizeof(Payload));
+  TransferProtocolCast(&Rx, In, Size, 0, MBA_BRIDGE | FROM_BUFFER);
+  TEST_CHECK(TransferProtocolProcess(&Tx, &Rx) == TP_MULTICAST);
+  TEST_CHECK(Tx.Data != NULL && memcmp(Tx.Data, Payload, sizeof(Payload)) == 0);
+  TransferProtocolFrameFree(&Tx);
+
+  memset(&View, 0, sizeof(View));
+  TransferProtocolGetRouteView(&View);
+  TEST_CHECK(TransferProtocolRoute(&View, &Rx) == TP_MULTICAST);
+
+  Mask = 0;
+  WriteRegister(GROUPS_REG, &Mask, sizeof(Mask));
+#if AVAILABLE_INTERFACES > 1
+  WriteRegister(GROUPS_REG + 0x1000, &Mask, sizeof(Mask));
+#endif
+  TEST_CHECK(TransferProtocolGetGroup(GROUP_ID) == 0);
+  TransferProtocolGetRouteView(&View);
+  TEST_CHECK(TransferProtocolRoute(&View, &Rx) == -1);
+}
+
+/**
+  * @brief Frames that share their data do not write into it in place and
+  *        release it with the last of them.
+  */
+static void TestSharedData(void)
+{
+  const uint8_t Payload[4] = {0xA1, 0xA2, 0xA3, 0xA4};
+  uint8_t Out[32];
+  uint8_t *In;
+  uint32_t Size;
+  TransProtFrame Frames[3];
+
+  In = (uint8_t *)MemAlloc(32);
+  TEST_ASSERT(In != NULL);
+  Size = BuildFrame(In, SetLogicalId(GROUP_ID), TRANSFER_COMMAND, SetLogicalId(REMOTE_ID),
+                    Payload, sizeof(Payload));
+  TransferProtocolFrameInit(&Frames[0]);
+  TEST_ASSERT(TransferProtocolCast(&Frames[0], In, Size, 0, MBA_BRIDGE | FROM_BUFFER | IN_PLACE) ==
+              (int32_t)Size);
+  Frames[0].CreditInterface = 0;
+  TEST_ASSERT(TransferProtocolShare(&Frames[1], &Frames[0]) == 0);
+  TEST_ASSERT(TransferProtocolShare(&Frames[2], &Frames[0]) == 0);
+  TEST_CHECK(Frames[0].Shared != NULL && Frames[0].Shared->Refs == 3);
+  TEST_CHECK(Frames[1].Data == Frames[0].Data && Frames[2].Buffer == In);
+  TEST_CHECK(Frames[1].CreditInterface == -1 && Frames[0].CreditInterface == 0);
+
+  /* Each bridge casts its own header; end buses write the data as it is */
+  TEST_CHECK(TransferProtocolFrameBuffer(&Frames[1], MBA_BRIDGE) == NULL);
+  TEST_CHECK(TransferProtocolFrameBuffer(&Frames[1], END_BUS) == In + HEADER_SIZE);
+  Frames[1].Header.FlowControl = 0x85;
+  TEST_CHECK(TransferProtocolCast(&Frames[1], Out, Size, 0, MBA_BRIDGE | TO_BUFFER) == (int32_t)Size);
+  TEST_CHECK(Out[5] == 0x85 && In[5] == 0);
+  TEST_CHECK(Frames[1].Data == NULL && Frames[0].Shared->Refs == 2);
+
+  TransferProtocolFrameFree(&Frames[0]);
+  TEST_CHECK(Frames[0].Data == NULL && Frames[2].Shared->Refs == 1);
+  TEST_CHECK(memcmp(Frames[2].Data, Payload, sizeof(Payload)) == 0);
+  TransferProtocolFrameFree(&Frames[2]);
+  TEST_CHECK(Frames[2].Shared == NULL && Frames[2].Buffer == NULL);
+}
+
+/**
+  * @brief  Hands a copy of a fragment over to a reassembly, as a bridge reads it.
+  * @retval TransferProtocolReassemble result. Whole frames are left in Frame
+  */
+static int32_t Reassemble(TPReassembly *Reassembly, const uint8_t *Fragment, uint32_t Size,
+                          uint8_t **Frame, uint32_t *FrameSize)
+{
+  *Frame = (uint8_t *)MemAlloc(Size);
+  memcpy(*Frame, Fragment, Size);
+  *FrameSize = Size;
+  return TransferProtocolReassemble(Reassembly, Frame, FrameSize);
+}
+
+/**
+  * @brief A frame split in fragments is gathered back as it was, whatever
+  *        the number of fragments, and a frame that fits goes through.
+  */
+static void TestFragments(void)
+{
+  uint8_t Payload[100], In[HEADER_SIZE + sizeof(Payload) + CRC_SIZE];
+  uint8_t Fragments[4][FRAGMENT_SIZE];
+  uint8_t Tiny[HEADER_SIZE + 1 + CRC_SIZE];
+  uint32_t Size, Sizes[4], FrameSize, Piece, i;
+  uint8_t *Frame;
+  TPReassembly Reassembly;
+  TransProtFrame Rx;
+
+  for (i = 0; i < sizeof(Payload); i++)
+    Payload[i] = (uint8_t)(i * 3);
+  Size = BuildFrame(In, SetLogicalId(NODE_ID) | 1, TRANSFER_COMMAND, SetLogicalId(REMOTE_ID),
+                    Payload, sizeof(Payload));
+
+  /* 30 + 30 + 30 + 10 bytes of data */
+  for (i = 0; i < 4; i++)
+    Sizes[i] = TransferProtocolFragment(Fragments[i], In, i, FRAGMENT_SIZE);
+  TEST_CHECK(TransferProtocolFragment(Fragments[0], In, 4, FRAGMENT_SIZE) == 0);
+  TEST_CHECK(Sizes[0] == FRAGMENT_SIZE && Sizes[3] == HEADER_SIZE + 10 + CRC_SIZE);
+  TEST_CHECK(Fragments[0][1] == (TRANSFER_COMMAND | TP_FRAGMENT_MORE | (1 << TP_FRAGMENT_INDEX_SHIFT)));
+  TEST_CHECK(Fragments[3][1] == (TRANSFER_COMMAND | (4 << TP_FRAGMENT_INDEX_SHIFT)));
+  TEST_CHECK(GetBufChecksum(Fragments[1], FRAGMENT_DATA) == crc16(Fragments[1], HEADER_SIZE + FRAGMENT_DATA));
+
+  TransferProtocolReassemblyInit(&Reassembly, 0xFFFF);
+  for (i = 0; i < 3; i++)
+    TEST_CHECK(Reassemble(&Reassembly, Fragments[i], Sizes[i], &Frame, &FrameSize) == 0);
+  TEST_ASSERT(Reassemble(&Reassembly, Fragments[3], Sizes[3], &Frame, &FrameSize) == 1);
+  TEST_CHECK(FrameSize == Size && memcmp(Frame, In, Size) == 0);
+  TEST_CHECK(Reassembly.Buffer == NULL && Reassembly.Dropped == 0);
+  TEST_CHECK(TransferProtocolCast(&Rx, Frame, FrameSize, 0, MBA_BRIDGE | FROM_BUFFER | IN_PLACE) ==
+             (int32_t)Size);
+  TransferProtocolFrameFree(&Rx);
+
+  /* A frame that fits is its only fragment, and passes through */
+  TEST_CHECK(TransferProtocolFragment(Fragments[0], In, 0, Size) == Size);
+  TEST_CHECK(TransferProtocolFragment(Fragments[0], In, 1, Size) == 0);
+  TEST_ASSERT(Reassemble(&Reassembly, In, Size, &Frame, &FrameSize) == 1);
+  TEST_CHECK(FrameSize == Size);
+  MemFree(Frame);
+
+  /* One byte per fragment: the fragment number goes around */
+  Size = BuildFrame(In, SetLogicalId(NODE_ID) | 1, CONFIG_COMMAND, SetLogicalId(REMOTE_ID),
+                    Payload, 20);
+  for (i = 0; (Piece = TransferProtocolFragment(Tiny, In, i, sizeof(Tiny))) != 0; i++)
+    TEST_CHECK(Reassemble(&Reassembly, Tiny, Piece, &Frame, &FrameSize) == (i == 19));
+  TEST_CHECK(i == 20 && FrameSize == Size && memcmp(Frame, In, Size) == 0);
+  MemFree(Frame);
+  TEST_CHECK(Reassembly.Dropped == 0);
+}
+
+/**
+  * @brief Frames with a fragment lost, corrupt or beyond the reassembly
+  *        size are dropped, the rest of their fragments with them, and the
+  *        next frame is gathered.
+  */
+static void TestFragmentsLost(void)
+{
+  uint8_t Payload[100], In[HEADER_SIZE + sizeof(Payload) + CRC_SIZE];
+  uint8_t Fragments[4][FRAGMENT_SIZE];
+  uint32_t Size, Sizes[4], FrameSize, i;
+  uint8_t *Frame;
+  TPReassembly Reassembly;
+
+  memset(Payload, 0x5A, sizeof(Payload));
+  Size = BuildFrame(In, SetLogicalId(NODE_ID) | 1, TRANSFER_COMMAND, SetLogicalId(REMOTE_ID),
+                    Payload, sizeof(Payload));
+  for (i = 0; i < 4; i++)
+    Sizes[i] = TransferProtocolFragment(Fragments[i], In, i, FRAGMENT_SIZE);
+
+  /* The second fragment is lost */
+  TransferProtocolReassemblyInit(&Reassembly, 0xFFFF);
+  TEST_CHECK(Reassemble(&Reassembly, Fragments[0], Sizes[0], &Frame, &FrameSize) == 0);
+  TEST_CHECK(Reassemble(&Reassembly, Fragments[2], Sizes[2], &Frame, &FrameSize) == 0);
+  TEST_CHECK(Reassemble(&Reassembly, Fragments[3], Sizes[3], &Frame, &FrameSize) == 0);
+  TEST_CHECK(Reassembly.Dropped == 1 && Reassembly.Buffer == NULL);
+
+  /* A corrupt fragment */
+  Fragments[1][HEADER_SIZE] ^= 0xFF;
+  for (i = 0; i < 4; i++)
+    TEST_CHECK(Reassemble(&Reassembly, Fragments[i], Sizes[i], &Frame, &FrameSize) == 0);
+  TEST_CHECK(Reassembly.Dropped == 2);
+  Fragments[1][HEADER_SIZE] ^= 0xFF;
+
+  /* A whole frame ends the frame being gathered */
+  TEST_CHECK(Reassemble(&Reassembly, Fragments[0], Sizes[0], &Frame, &FrameSize) == 0);
+  TEST_ASSERT(Reassemble(&Reassembly, In, Size, &Frame, &FrameSize) == 1);
+  MemFree(Frame);
+  TEST_CHECK(Reassembly.Dropped == 3);
+
+  /* The next frame comes whole */
+  for (i = 0; i < 4; i++)
+    TEST_CHECK(Reassemble(&Reassembly, Fragments[i], Sizes[i], &Frame, &FrameSize) == (i == 3));
+  TEST_CHECK(FrameSize == Size && memcmp(Frame, In, Size) == 0);
+  MemFree(Frame);
+
+  /* Too large for the reassembly */
+  TransferProtocolReassemblyInit(&Reassembly, 80);
+  for (i = 0; i < 4; i++)
+    TEST_CHECK(Reassemble(&Reassembly, Fragments[i], Sizes[i], &Frame, &FrameSize) == 0);
+  TEST_CHECK(Reassembly.Dropped == 1 && Reassembly.Buffer == NULL);
+
+  /* A link lost in the middle of a frame */
+  TEST_CHECK(Reassemble(&Reassembly, Fragments[0], Sizes[0], &Frame, &FrameSize) == 0);
+  TransferProtocolReassemblyReset(&Reassembly);
+  TEST_CHECK(Reassembly.Buffer == NULL && Reassembly.Dropped == 1);
+}
+
+int main(void)
+{
+  /* Dictionary and transfer protocol tables */
+  MBAInit();
+
+  TEST_RUN(TestCastRoundTrip);
+  TEST_RUN(TestCastInPlace);
+  TEST_RUN(TestCastBounds);
+  TEST_RUN(TestCastChecksum);
+  TEST_RUN(TestPriority);
+  TEST_RUN(TestConfigRead);
+  TEST_RUN(TestRoutesRegister);
+#if OS_ACTIVE != 0
+  TEST_RUN(TestRouteViewDuringRebuild);
+#endif
+  TEST_RUN(TestEndBusLink);
+  TEST_RUN(TestGroups);
+  TEST_RUN(TestSharedData);
+  TEST_RUN(TestFragments);
+  TEST_RUN(TestFragmentsLost);
+
+  return TEST_RESULT();
+}
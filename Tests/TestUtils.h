@@ -0,0 +1,63 @@
+/**
+  ******************************************************************************
+  * @file    TestUtils.h
+  * @author  Javier Fernandez Cepeda
+  * @brief   Minimal assertion helpers for the host unit tests.
+  *
+  *******************************************************************************
+  * Copyright (c) 2015, Javier Fernandez. All rights reserved.
+  *******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __TESTUTILS_H
+#define __TESTUTILS_H
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdio.h>
+#include <stdlib.h>
+
+/* Exported variables --------------------------------------------------------*/
+static int TestFailures = 0;	/*!< Number of failed checks of the test program */
+
+/* Exported macro ------------------------------------------------------------*/
+/**
+  * @brief Checks a condition. The test goes on but it will fail at the end.
+  */
+#define TEST_CHECK(cond)							\
+  do {										\
+    if (!(cond))								\
+    {										\
+      fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond);	\
+      TestFailures++;								\
+    }										\
+  } while (0)
+
+/**
+  * @brief Checks a condition and aborts the test if it is false.
+  */
+#define TEST_ASSERT(cond)							\
+  do {										\
+    if (!(cond))								\
+    {										\
+      fprintf(stderr, "%s:%d: assert failed: %s\n", __FILE__, __LINE__, #cond);	\
+      exit(EXIT_FAILURE);							\
+    }										\
+  } while (0)
+
+/**
+  * @brief Runs a test case function.
+  */
+#define TEST_RUN(func)								\
+  do {										\
+    int FailuresBefore = TestFailures;						\
+    func();									\
+    printf("%-40s %s\n", #func, (TestFailures == FailuresBefore) ? "OK" : "FAILED");	\
+  } while (0)
+
+/**
+  * @brief Exit value of the test program.
+  */
+#define TEST_RESULT()		((TestFailures == 0) ? EXIT_SUCCESS : EXIT_FAILURE)
+
+#endif /* __TESTUTILS_H */
@@ -0,0 +1,194 @@
+/**
+  ******************************************************************************
+  * @file    TestWorkPool.c
+  * @author  Javier Fernandez Cepeda
+  * @brief   Unit tests of the work stealing worker pool (TOOLS/workpool).
+  *
+  *******************************************************************************
+  * Copyright (c) 2015, Javier Fernandez. All rights reserved.
+  *******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include <pthread.h>
+#include <unistd.h>
+#include "TestUtils.h"
+#include "TOOLS/workpool.h"
+
+/* Private define ------------------------------------------------------------*/
+#define TEST_WORKERS	4
+#define TEST_ACTORS	16
+#define TEST_ITEMS	2000	/* Per actor */
+#define TEST_STEAL_ITEMS	100	/* Per actor, stealing test */
+
+/* Private typedef -----------------------------------------------------------*/
+typedef struct
+{
+  uint32_t Actor;
+  uint32_t Seq;
+}TestItem;
+
+typedef struct
+{
+  workpool *Pool;
+  uint32_t Worker;
+}TestWorker;
+
+/* Private variables ---------------------------------------------------------*/
+static TestItem Items[TEST_ACTORS][TEST_ITEMS];
+static uint32_t NextSeq[TEST_ACTORS];
+static volatile int OutOfOrder;
+static volatile int Running;	/* Handlers running now */
+static volatile int Overlaps;	/* Exclusive items that have not run alone */
+static volatile uint32_t Handled;
+static uint32_t HandlerSleepUs;	/* Makes the handlers block, as on a bus write */
+static pthread_t Threads[TEST_WORKERS];
+static TestWorker Workers[TEST_WORKERS];
+
+/* Private functions ---------------------------------------------------------*/
+static void Handler(void *item, void *arg)
+{
+  TestItem *Item = (TestItem *)item;
+  int Exclusive = (arg != NULL) && (Item->Seq % 100 == 0);
+
+  if (__atomic_add_fetch(&Running, 1, __ATOMIC_SEQ_CST) != 1 && Exclusive)
+    Overlaps++;
+  if (Item->Seq != NextSeq[Item->Actor])
+    OutOfOrder++;
+  NextSeq[Item->Actor] = Item->Seq + 1;
+  if (HandlerSleepUs != 0)
+    usleep(HandlerSleepUs);
+  __atomic_sub_fetch(&Running, 1, __ATOMIC_SEQ_CST);
+  __atomic_add_fetch(&Handled, 1, __ATOMIC_SEQ_CST);
+}
+
+static void *WorkerThread(void *arg)
+{
+  TestWorker *Worker = (TestWorker *)arg;
+
+  workpool_run(Worker->Pool, Worker->Worker);
+  return NULL;
+}
+
+static void StartWorkers(workpool *Pool)
+{
+  uint32_t i;
+
+  for (i = 0; i < TEST_WORKERS; i++)
+  {
+    Workers[i].Pool = Pool;
+    Workers[i].Worker = i;
+    pthread_create(&Threads[i], NULL, WorkerThread, &Workers[i]);
+  }
+}
+
+static void StopWorkers(workpool *Pool)
+{
+  uint32_t i;
+
+  workpool_release(Pool);
+  for (i = 0; i < TEST_WORKERS; i++)
+    pthread_join(Threads[i], NULL);
+}
+
+static void ResetItems(void)
+{
+  uint32_t a, i;
+
+  for (a = 0; a < TEST_ACTORS; a++)
+  {
+    NextSeq[a] = 0;
+    for (i = 0; i < TEST_ITEMS; i++)
+    {
+      Items[a][i].Actor = a;
+      Items[a][i].Seq = i;
+    }
+  }
+  OutOfOrder = 0;
+  Overlaps = 0;
+  Handled = 0;
+}
+
+/**
+  * @brief The items of an actor are handled in submission order, whatever
+  *        worker runs them.
+  */
+static void TestActorOrder(void)
+{
+  workpool Pool;
+  uint32_t a, i;
+
+  ResetItems();
+  TEST_ASSERT(workpool_init(&Pool, TEST_WORKERS, TEST_ACTORS, Handler, NULL) == 0);
+  StartWorkers(&Pool);
+
+  for (i = 0; i < TEST_ITEMS; i++)
+    for (a = 0; a < TEST_ACTORS; a++)
+      TEST_ASSERT(workpool_submit(&Pool, a, &Items[a][i], 0) == 0);
+
+  StopWorkers(&Pool);
+  TEST_CHECK(Handled == TEST_ACTORS * TEST_ITEMS);
+  TEST_CHECK(OutOfOrder == 0);
+  workpool_free(&Pool);
+}
+
+/**
+  * @brief Actors queued to a single worker are stolen by the idle ones.
+  */
+static void TestStealing(void)
+{
+  workpool Pool;
+  workpool_stats Stats;
+  uint32_t a, i;
+
+  ResetItems();
+  TEST_ASSERT(workpool_init(&Pool, TEST_WORKERS, TEST_ACTORS, Handler, NULL) == 0);
+
+  /* Keys multiple of the workers have worker 0 as home */
+  for (i = 0; i < TEST_STEAL_ITEMS; i++)
+    for (a = 0; a < TEST_ACTORS; a += TEST_WORKERS)
+      workpool_submit(&Pool, a, &Items[a][i], 0);
+  HandlerSleepUs = 100;
+  StartWorkers(&Pool);
+  StopWorkers(&Pool);
+  HandlerSleepUs = 0;
+
+  workpool_get_stats(&Pool, &Stats, 1);
+  TEST_CHECK(Handled == (TEST_ACTORS / TEST_WORKERS) * TEST_STEAL_ITEMS);
+  TEST_CHECK(Stats.items == Handled);
+  TEST_CHECK(Stats.steals > 0);
+  TEST_CHECK(OutOfOrder == 0);
+  workpool_free(&Pool);
+}
+
+/**
+  * @brief Exclusive items never run together with other items.
+  */
+static void TestExclusive(void)
+{
+  workpool Pool;
+  uint32_t a, i;
+
+  ResetItems();
+  TEST_ASSERT(workpool_init(&Pool, TEST_WORKERS, TEST_ACTORS, Handler, &Pool) == 0);
+  StartWorkers(&Pool);
+
+  for (i = 0; i < TEST_ITEMS; i++)
+    for (a = 0; a < TEST_ACTORS; a++)
+      workpool_submit(&Pool, a, &Items[a][i], (i % 100 == 0) ? WORKPOOL_EXCLUSIVE : 0);
+
+  StopWorkers(&Pool);
+  TEST_CHECK(Handled == TEST_ACTORS * TEST_ITEMS);
+  TEST_CHECK(Overlaps == 0);
+  TEST_CHECK(OutOfOrder == 0);
+  workpool_free(&Pool);
+}
+
+int main(void)
+{
+  TEST_RUN(TestActorOrder);
+  TEST_RUN(TestStealing);
+  TEST_RUN(TestExclusive);
+
+  return TEST_RESULT();
+}